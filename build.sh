@@ -12,6 +12,17 @@ build () {
 		cd ../..
 	fi
 
+	# build Lua library for scripting
+	if [ ! -d ./3rd_party/lua-5.1.5 ]; then
+		cd 3rd_party
+		tar zxvf lua-5.1.5.tar.gz
+		
+		cd lua-5.1.5/src
+		make a MYCFLAGS=-DLUA_USE_POSIX
+		
+		cd ../../..
+	fi
+
 	# build kedis-server
 	cd base
 	make ver=release -j 4
@@ -20,10 +31,12 @@ build () {
 
 	# build tools
 	cd ../../tools/kedis_port
-	make -j 4
+	make rocksdb_ver=$rocksdb_version -j 4
 	cd ../kedis_to_redis
-	make -j 4
+	make rocksdb_ver=$rocksdb_version -j 4
 	cd ../redis_to_kedis
+	make rocksdb_ver=$rocksdb_version -j 4
+	cd ../kedis_benchmark
 	make -j 4
 
 	# make package
@@ -53,6 +66,8 @@ clean() {
 	make clean
 	cd ../redis_to_kedis
 	make clean
+	cd ../kedis_benchmark
+	make clean
 	cd ../hiredis
 	make clean
 }
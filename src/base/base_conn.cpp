@@ -8,62 +8,239 @@
 #include "base_conn.h"
 #include "event_loop.h"
 #include "io_thread_resource.h"
+#include "bounded_queue.h"
+#include "buffer_pool.h"
 #include "simple_log.h"
 
-typedef list<pair<net_handle_t, SimpleBuffer*>> PendingDataList;
-typedef list<net_handle_t>  PendingCloseList;
 typedef unordered_map<net_handle_t, BaseConn*> ConnMap_t;
 
+const uint32_t kPendingEventQueueSize = 8192;
+const uint32_t kPendingBufPoolSize = 1024;
+const uint32_t kPendingBufMaxPooledSize = 16 * 1024;   // larger buffer will be freed, not pooled
+const uint64_t kMovedHandleKeepTime = 300000;   // events to the old handle of a moved connection are forwarded in this time
+
 atomic<long> BaseConn::m_total_net_input_bytes {0};
 atomic<long> BaseConn::m_total_net_output_bytes {0};
+atomic<long> BaseConn::m_total_out_buf_bytes {0};
+
+enum {
+    PENDING_EVENT_SEND = 0,
+    PENDING_EVENT_CLOSE,
+    PENDING_EVENT_ATTACH,       // a connection moved from another io thread
+    PENDING_EVENT_REBALANCE,    // move idle connections out of this io thread
+    PENDING_EVENT_RESUME,       // a job of the connection in another thread is done
+};
+
+struct PendingEvent {
+    uint8_t         type;
+    net_handle_t    handle;
+    SimpleBuffer*   buf;    // data to send
+    BaseConn*       conn;   // the moved connection
+};
+
+struct MovedHandle {
+    net_handle_t    new_handle;
+    uint64_t        move_tick;
+};
 
+// events from other threads are pushed to a lock-free queue, and processed by the io thread in loop_callback,
+// if the queue is full, events go to the overflow list, and all later events follow them to keep the order
 struct PendingEventMgr {
-    ConnMap_t           conn_map;
-    mutex               mtx;
-    PendingDataList     data_list;
-    PendingCloseList    close_list;
+    int                         thread_index;
+    ConnMap_t                   conn_map;
+    ConnMap_t                   loop_conn_map;  // connections registered the OnLoop() hook
+    unordered_map<net_handle_t, MovedHandle> moved_map; // connections moved to other io threads
+    BoundedQueue<PendingEvent>  event_queue;
+    BoundedQueue<SimpleBuffer*> buf_pool;
+    atomic<bool>                wakeup_pending; // the io thread has been waked up but not processed the queue yet
+    atomic<int>                 overflow_count;
+    mutex                       overflow_mtx;
+    list<PendingEvent>          overflow_list;
+    list<BaseConn*>             yield_list;     // connections waiting for OnResume() in the next loop iteration
+    
+    PendingEventMgr() : thread_index(0), event_queue(kPendingEventQueueSize), buf_pool(kPendingBufPoolSize),
+        wakeup_pending(false), overflow_count(0) {}
 };
 
 IoThreadResource<PendingEventMgr> g_pending_event_mgr;
 
-void loop_callback(void* callback_data, uint8_t msg, uint32_t handle, void* pParam)
+static SimpleBuffer* alloc_pending_buf(PendingEventMgr* event_mgr)
 {
-    PendingEventMgr* event_mgr = (PendingEventMgr*)callback_data;
-    if (!event_mgr)
+    SimpleBuffer* buf = NULL;
+    if (!event_mgr->buf_pool.Pop(buf)) {
+        buf = new SimpleBuffer();
+    }
+    return buf;
+}
+
+static void free_pending_buf(PendingEventMgr* event_mgr, SimpleBuffer* buf)
+{
+    if (buf->GetAllocSize() > kPendingBufMaxPooledSize) {
+        delete buf;
         return;
+    }
+    
+    buf->Read(NULL, buf->GetReadableLen());
+    buf->ResetOffset();
+    if (!event_mgr->buf_pool.Push(buf)) {
+        delete buf;
+    }
+}
 
-    PendingDataList tmp_data_list;
-    PendingCloseList tmp_close_list;
-    {
-        lock_guard<mutex> mg(event_mgr->mtx);
-        tmp_data_list.swap(event_mgr->data_list);
-        tmp_close_list.swap(event_mgr->close_list);
+static void push_pending_event(const PendingEvent& event)
+{
+    EventLoop* el = get_io_event_loop(event.handle);
+    PendingEventMgr* event_mgr = g_pending_event_mgr.GetIOResource(event.handle);
+    
+    if ((event_mgr->overflow_count > 0) || !event_mgr->event_queue.Push(event)) {
+        lock_guard<mutex> mg(event_mgr->overflow_mtx);
+        event_mgr->overflow_list.push_back(event);
+        event_mgr->overflow_count++;
     }
     
-    for (auto it = tmp_data_list.begin(); it != tmp_data_list.end(); ++it) {
-        net_handle_t handle = it->first;
-        SimpleBuffer* buf = it->second;
-        ConnMap_t::iterator it_conn = event_mgr->conn_map.find(handle);
+    // only the first event after the io thread start to process the queue need to wake it up
+    if (!event_mgr->wakeup_pending.exchange(true)) {
+        el->Wakeup();
+    }
+}
+
+static int get_least_conn_thread()
+{
+    int best_index = 0;
+    for (int i = 1; i < get_io_thread_num(); i++) {
+        if (get_io_event_loop(i)->GetConnNum() < get_io_event_loop(best_index)->GetConnNum()) {
+            best_index = i;
+        }
+    }
+    return best_index;
+}
+
+// move idle connections to the io threads with the least connections,
+// until the connection number of this io thread is not above the average
+static void rebalance_connections(PendingEventMgr* event_mgr)
+{
+    uint64_t curr_tick = get_tick_count();
+    for (auto it = event_mgr->moved_map.begin(); it != event_mgr->moved_map.end(); ) {
+        if (curr_tick >= it->second.move_tick + kMovedHandleKeepTime) {
+            it = event_mgr->moved_map.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    
+    int thread_num = get_io_thread_num();
+    EventLoop* el = get_io_event_loop(event_mgr->thread_index);
+    for (auto it = event_mgr->conn_map.begin(); it != event_mgr->conn_map.end(); ) {
+        BaseConn* conn = it->second;
+        ++it;   // the connection is removed from the map after moved
+        
+        int total_conn_num = 0;
+        for (int i = 0; i < thread_num; i++) {
+            total_conn_num += get_io_event_loop(i)->GetConnNum();
+        }
+        
+        int target_index = get_least_conn_thread();
+        int conn_num = el->GetConnNum();
+        if ((conn_num * thread_num <= total_conn_num) || (get_io_event_loop(target_index)->GetConnNum() + 1 >= conn_num)) {
+            break;
+        }
+        
+        if (event_mgr->loop_conn_map.count(conn->GetHandle()) || !conn->IsIdle(curr_tick)) {
+            continue;
+        }
+        
+        net_handle_t old_handle = conn->GetHandle();
+        conn->MoveToThread(target_index);
+        event_mgr->moved_map[old_handle] = {conn->GetHandle(), curr_tick};
+        
+        PendingEvent event = {PENDING_EVENT_ATTACH, conn->GetHandle(), NULL, conn};
+        push_pending_event(event);
+    }
+}
+
+static void process_pending_event(PendingEventMgr* event_mgr, PendingEvent& event)
+{
+    if (event.type == PENDING_EVENT_ATTACH) {
+        event.conn->AttachToThread();
+        event.conn->ReleaseRef();   // reference added in MoveToThread()
+        return;
+    } else if (event.type == PENDING_EVENT_REBALANCE) {
+        rebalance_connections(event_mgr);
+        return;
+    } else if (event.type == PENDING_EVENT_RESUME) {
+        event.conn->OnResume();
+        event.conn->ReleaseRef();   // reference added before the job was handed over
+        return;
+    }
+    
+    ConnMap_t::iterator it_conn = event_mgr->conn_map.find(event.handle);
+    if (it_conn == event_mgr->conn_map.end()) {
+        // follow the connection if it was moved to another io thread
+        auto it_moved = event_mgr->moved_map.find(event.handle);
+        if (it_moved != event_mgr->moved_map.end()) {
+            event.handle = it_moved->second.new_handle;
+            push_pending_event(event);
+            return;
+        }
+    }
+    
+    if (event.type == PENDING_EVENT_SEND) {
         if (it_conn != event_mgr->conn_map.end()) {
             BaseConn* conn = it_conn->second;
             if (conn->IsOpen()) {
-                conn->Send(buf->GetReadBuffer(), buf->GetReadableLen());
+                conn->Send(event.buf->GetReadBuffer(), event.buf->GetReadableLen());
             }
         }
         
-        delete buf;
-    }
-    
-    for (auto it = tmp_close_list.begin(); it != tmp_close_list.end(); ++it) {
-        net_handle_t handle = *it;
-        ConnMap_t::iterator it_conn = event_mgr->conn_map.find(handle);
+        free_pending_buf(event_mgr, event.buf);
+    } else {
         if (it_conn != event_mgr->conn_map.end()) {
             it_conn->second->Close();
         }
     }
+}
+
+void loop_callback(void* callback_data, uint8_t msg, uint32_t handle, void* pParam)
+{
+    PendingEventMgr* event_mgr = (PendingEventMgr*)callback_data;
+    if (!event_mgr)
+        return;
+
+    // reset before draining, so an event pushed after this point will wake up the loop again
+    event_mgr->wakeup_pending = false;
+    
+    PendingEvent event;
+    while (event_mgr->event_queue.Pop(event)) {
+        process_pending_event(event_mgr, event);
+    }
+    
+    if (event_mgr->overflow_count > 0) {
+        list<PendingEvent> tmp_overflow_list;
+        {
+            lock_guard<mutex> mg(event_mgr->overflow_mtx);
+            tmp_overflow_list.swap(event_mgr->overflow_list);
+            event_mgr->overflow_count = 0;
+        }
+        
+        for (auto it = tmp_overflow_list.begin(); it != tmp_overflow_list.end(); ++it) {
+            process_pending_event(event_mgr, *it);
+        }
+    }
+    
+    // connections yielded in OnResume() go to the next iteration, so the events ready by then are processed first
+    if (!event_mgr->yield_list.empty()) {
+        list<BaseConn*> tmp_yield_list;
+        tmp_yield_list.swap(event_mgr->yield_list);
+        for (BaseConn* conn : tmp_yield_list) {
+            conn->OnResume();
+            conn->ReleaseRef();   // reference added in Yield()
+        }
+    }
     
-    for (auto it = event_mgr->conn_map.begin(); it != event_mgr->conn_map.end(); it++) {
-        it->second->OnLoop();
+    for (auto it = event_mgr->loop_conn_map.begin(); it != event_mgr->loop_conn_map.end(); ) {
+        BaseConn* conn = it->second;
+        ++it;   // OnLoop may close the connection and remove it from the map
+        conn->OnLoop();
     }
 }
 
@@ -82,6 +259,7 @@ void conn_callback(void* callback_data, uint8_t msg, uint32_t handle, void* pPar
             break;
         case NETLIB_MSG_READ:
             pConn->OnRead();
+            pConn->ReleaseIdleBuffer();
             break;
         case NETLIB_MSG_WRITE:
             pConn->OnWrite();
@@ -108,9 +286,11 @@ void init_thread_base_conn(int io_thread_num)
         return;
     
     g_pending_event_mgr.Init(io_thread_num);
+    init_thread_buffer_pools(io_thread_num);
     
     if (io_thread_num > 0) {
         for (int i = 0; i < io_thread_num; ++i) {
+            g_pending_event_mgr.GetIOResource(i)->thread_index = i;
             EventLoop* el = get_io_event_loop(i);
             el->AddLoop(loop_callback, g_pending_event_mgr.GetIOResource(i));
         }
@@ -123,8 +303,17 @@ void destroy_thread_base_conn(int io_thread_num)
 {
     for (int i = 0; i < io_thread_num; i++) {
         PendingEventMgr* event_mgr = g_pending_event_mgr.GetIOResource(i);
-        for (auto it = event_mgr->data_list.begin(); it != event_mgr->data_list.end(); ++it) {
-            SimpleBuffer* buf = it->second;
+        PendingEvent event;
+        while (event_mgr->event_queue.Pop(event)) {
+            delete event.buf;
+        }
+        
+        for (auto it = event_mgr->overflow_list.begin(); it != event_mgr->overflow_list.end(); ++it) {
+            delete it->buf;
+        }
+        
+        SimpleBuffer* buf;
+        while (event_mgr->buf_pool.Pop(buf)) {
             delete buf;
         }
     }
@@ -140,6 +329,9 @@ BaseConn::BaseConn()
 	m_handle = NETLIB_INVALID_HANDLE;
     m_heartbeat_interval = kHeartBeartInterval;
     m_conn_timeout = kConnTimeout;
+    m_read_size = kReadBufSize;
+    m_small_read_count = 0;
+    m_out_buf_bytes = 0;
     
 	m_last_send_tick = m_last_recv_tick = get_tick_count();
 }
@@ -159,7 +351,7 @@ net_handle_t BaseConn::Connect(const string& server_ip, uint16_t server_port, in
         event_loop = get_io_event_loop(thread_index);
     }
     
-    m_base_socket = new BaseSocket();
+    m_base_socket = new BaseSocket(thread_index);
     assert(m_base_socket);
     m_handle = m_base_socket->Connect(server_ip.c_str(), server_port, conn_callback, this, event_loop);
     if (thread_index != -1) {
@@ -176,6 +368,7 @@ net_handle_t BaseConn::Connect(const string& server_ip, uint16_t server_port, in
             PendingEventMgr* event_mgr = g_pending_event_mgr.GetIOResource(m_thread_index);
             event_mgr->conn_map.insert(make_pair(m_handle, this));
         }
+        m_in_buf.SetPool(get_io_buffer_pool(m_thread_index));
     }
     
     return m_handle;
@@ -190,6 +383,7 @@ void BaseConn::Close()
     if (g_pending_event_mgr.IsInited()) {
         PendingEventMgr* event_mgr = g_pending_event_mgr.GetIOResource(m_thread_index);
         event_mgr->conn_map.erase(m_handle);
+        event_mgr->loop_conn_map.erase(m_handle);
     }
     
     m_base_socket->Close();
@@ -197,10 +391,19 @@ void BaseConn::Close()
     m_busy = false;
     m_in_buf.Clear();
     m_out_buf.Clear();
+    _UpdateOutputBufferBytes();
     m_handle = NETLIB_INVALID_HANDLE;
     ReleaseRef();
 }
 
+// idle connections do not hold any input buffer, so a burst of big requests will not pin memory for long
+void BaseConn::ReleaseIdleBuffer()
+{
+    if ((m_handle != NETLIB_INVALID_HANDLE) && (m_in_buf.GetReadableLen() == 0)) {
+        m_in_buf.Clear();
+    }
+}
+
 int BaseConn::Send(void* data, int len)
 {
 	m_last_send_tick = get_tick_count();
@@ -211,7 +414,8 @@ int BaseConn::Send(void* data, int len)
     }
     
 	if (m_busy) {
-        m_out_buf.Write(data, len);
+        m_out_buf.Append(data, len);
+        _UpdateOutputBufferBytes();
 		return len;
 	}
 
@@ -235,13 +439,111 @@ int BaseConn::Send(void* data, int len)
 	}
 
 	if (remain > 0) {
-		m_out_buf.Write((char*)data + offset, remain);
+		m_out_buf.Append((char*)data + offset, remain);
 		m_busy = true;
+        _UpdateOutputBufferBytes();
 	}
 
 	return len;
 }
 
+int BaseConn::Send(ChainBuffer& chain)
+{
+	m_last_send_tick = get_tick_count();
+
+    if (!m_open) {
+        printf("connection do not open yet\n");
+        chain.Clear();
+        return 0;
+    }
+
+    int len = (int)chain.GetReadableLen();
+    if (!m_busy) {
+        _WriteChain(chain);
+    }
+
+    if (!chain.IsEmpty()) {
+        m_out_buf.Append(chain);
+        m_busy = true;
+        _UpdateOutputBufferBytes();
+    }
+
+    return len;
+}
+
+void BaseConn::SetTimer(uint64_t delay)
+{
+    if (m_base_socket && m_base_socket->GetEventLoop()) {
+        m_base_socket->GetEventLoop()->AddSocketTimer(m_base_socket, delay);
+    }
+}
+
+void BaseConn::RegisterLoopHook()
+{
+    if (g_pending_event_mgr.IsInited() && (m_handle != NETLIB_INVALID_HANDLE)) {
+        PendingEventMgr* event_mgr = g_pending_event_mgr.GetIOResource(m_thread_index);
+        event_mgr->loop_conn_map[m_handle] = this;
+    }
+}
+
+void BaseConn::UnregisterLoopHook()
+{
+    if (g_pending_event_mgr.IsInited() && (m_handle != NETLIB_INVALID_HANDLE)) {
+        PendingEventMgr* event_mgr = g_pending_event_mgr.GetIOResource(m_thread_index);
+        event_mgr->loop_conn_map.erase(m_handle);
+    }
+}
+
+bool BaseConn::IsIdle(uint64_t curr_tick)
+{
+    // the input buffer of an idle connection was returned to the pool in ReleaseIdleBuffer(), io_uring sockets
+    // are not moved, cause data may be received in the ring of the old loop before the recv is canceled
+    return m_open && !m_busy && (m_in_buf.GetReadableLen() == 0) && (m_in_buf.GetAllocSize() == 0) &&
+        (curr_tick >= m_last_recv_tick + kMoveIdleTime) && !m_base_socket->GetEventLoop()->IsUring() && IsMovable();
+}
+
+void BaseConn::MoveToThread(int thread_index)
+{
+    if (g_pending_event_mgr.IsInited()) {
+        PendingEventMgr* event_mgr = g_pending_event_mgr.GetIOResource(m_thread_index);
+        event_mgr->conn_map.erase(m_handle);
+    }
+    
+    AddRef();   // released after attached to the new io thread
+    m_base_socket->Detach(thread_index);
+    m_handle = m_base_socket->GetHandle();
+    m_thread_index = m_handle;
+    m_in_buf.SetPool(get_io_buffer_pool(m_thread_index));
+}
+
+void BaseConn::AttachToThread()
+{
+    if (g_pending_event_mgr.IsInited()) {
+        PendingEventMgr* event_mgr = g_pending_event_mgr.GetIOResource(m_thread_index);
+        event_mgr->conn_map.insert(make_pair(m_handle, this));
+    }
+    
+    m_base_socket->Attach();
+}
+
+void BaseConn::PostResume()
+{
+    PendingEvent event = {PENDING_EVENT_RESUME, m_handle, NULL, this};
+    push_pending_event(event);
+}
+
+void BaseConn::Yield()
+{
+    AddRef();
+    PendingEventMgr* event_mgr = g_pending_event_mgr.GetIOResource(m_handle);
+    event_mgr->yield_list.push_back(this);
+    
+    // do not block in the next wait for events
+    if (!event_mgr->wakeup_pending.exchange(true)) {
+        get_io_event_loop(m_handle)->Wakeup();
+    }
+}
+
 void BaseConn::OnConnect(BaseSocket *base_socket)
 {
     m_open = true;
@@ -253,6 +555,7 @@ void BaseConn::OnConnect(BaseSocket *base_socket)
         PendingEventMgr* event_mgr = g_pending_event_mgr.GetIOResource(m_thread_index);
         event_mgr->conn_map.insert(make_pair(m_handle, this));
     }
+    m_in_buf.SetPool(get_io_buffer_pool(m_thread_index));
     
     base_socket->SetCallback(conn_callback);
     base_socket->SetCallbackData((void*)this);
@@ -276,24 +579,10 @@ void BaseConn::OnWrite()
 	if (!m_busy)
 		return;
 
-    while (m_out_buf.GetReadableLen() > 0) {
-        int send_size = m_out_buf.GetReadableLen();
-        if (send_size > kMaxSendSize) {
-            send_size = kMaxSendSize;
-        }
-        
-        int ret = m_base_socket->Send(m_out_buf.GetReadBuffer(), send_size);
-        if (ret <= 0) {
-            ret = 0;
-            break;
-        }
-        
-        m_out_buf.Read(NULL, ret);
-    }
+    _WriteChain(m_out_buf);
+    _UpdateOutputBufferBytes();
     
-    m_out_buf.ResetOffset();
-    
-    if (m_out_buf.GetReadableLen() == 0) {
+    if (m_out_buf.IsEmpty()) {
         m_busy = false;
     }
 }
@@ -306,28 +595,73 @@ void BaseConn::OnClose()
 void BaseConn::OnTimer(uint64_t curr_tick)
 {
     //printf("OnTimer, curr_tick=%llu\n",curr_tick);
-    if (curr_tick > m_last_recv_tick + m_conn_timeout) {
+    uint64_t expire_tick = m_last_recv_tick + m_conn_timeout;
+    if (curr_tick > expire_tick) {
         printf("connection timeout, handle=%d\n", m_handle);
         Close();
         return;
     }
+    
+    SetTimer(expire_tick - curr_tick + 1);
+}
+
+// write as much data as possible with writev(), stop when the socket buffer is full
+void BaseConn::_WriteChain(ChainBuffer& chain)
+{
+    struct iovec iov[kChainMaxIovec];
+    while (!chain.IsEmpty()) {
+        int iov_cnt = chain.GetIovec(iov, kChainMaxIovec);
+        int ret = m_base_socket->Writev(iov, iov_cnt);
+        if (ret <= 0) {
+            break;
+        }
+        
+        m_total_net_output_bytes += ret;
+        chain.Consume(ret);
+    }
 }
 
+void BaseConn::_UpdateOutputBufferBytes()
+{
+    long len = (long)m_out_buf.GetReadableLen();
+    m_total_out_buf_bytes += len - m_out_buf_bytes;
+    m_out_buf_bytes = len;
+}
+
+// the read size doubles if one read event received more than it, and halves after the read events
+// received less than a quarter of it for several times, so a busy pipeline needs less recv() calls,
+// and an idle connection does not ask for big buffers
 void BaseConn::_RecvData()
 {
+    uint32_t total_len = 0;
     for (;;) {
 		uint32_t free_buf_len = m_in_buf.GetWritableLen();
-		if (free_buf_len < (kReadBufSize + 1))  // reserve 1 byte for text protocol to add '\0'
-			m_in_buf.Extend(kReadBufSize + 1);
+		if (free_buf_len < kReadBufSize)
+			m_in_buf.Extend(m_read_size);
         
-		int ret = m_base_socket->Recv(m_in_buf.GetWriteBuffer(), kReadBufSize);
+        // use all the free space, the buffer from pool may be larger than requested,
+        // reserve 1 byte for text protocol to add '\0'
+		int ret = m_base_socket->Recv(m_in_buf.GetWriteBuffer(), m_in_buf.GetWritableLen() - 1);
 		if (ret <= 0)
 			break;
         
+        total_len += ret;
         m_total_net_input_bytes += ret;
 		m_in_buf.IncWriteOffset(ret);
 		m_last_recv_tick = get_tick_count();
 	}
+    
+    if (total_len > m_read_size) {
+        m_read_size = min(m_read_size * 2, (uint32_t)kMaxReadBufSize);
+        m_small_read_count = 0;
+    } else if (total_len < m_read_size / 4) {
+        if (++m_small_read_count >= 4) {
+            m_read_size = max(m_read_size / 2, (uint32_t)kReadBufSize);
+            m_small_read_count = 0;
+        }
+    } else {
+        m_small_read_count = 0;
+    }
 }
 
 // static methods
@@ -339,18 +673,12 @@ int BaseConn::Send(net_handle_t handle, void* data, int len)
         return 0;
     }
     
-    EventLoop* el = get_io_event_loop(handle);
-    PendingEventMgr* event_mgr = g_pending_event_mgr.GetIOResource(handle);
-
-    // even handle is in the same IO thread, the data still need push to the end of the list,
+    // even handle is in the same IO thread, the data still need push to the end of the queue,
     // so the sequence will same between master and slave
-    SimpleBuffer* buf = new SimpleBuffer();
+    SimpleBuffer* buf = alloc_pending_buf(g_pending_event_mgr.GetIOResource(handle));
     buf->Write(data, len);
-    event_mgr->mtx.lock();
-    event_mgr->data_list.push_back(make_pair(handle, buf));
-    event_mgr->mtx.unlock();
-    
-    el->Wakeup();
+    PendingEvent event = {PENDING_EVENT_SEND, handle, buf, NULL};
+    push_pending_event(event);
     
     return 0;
 }
@@ -370,12 +698,29 @@ int BaseConn::CloseHandle(net_handle_t handle)
             it_conn->second->Close();
         }
     } else {
-        event_mgr->mtx.lock();
-        event_mgr->close_list.push_back(handle);
-        event_mgr->mtx.unlock();
-        
-        el->Wakeup();
+        PendingEvent event = {PENDING_EVENT_CLOSE, handle, NULL, NULL};
+        push_pending_event(event);
     }
     
     return 0;
 }
+
+void rebalance_io_threads()
+{
+    int thread_num = get_io_thread_num();
+    if (thread_num <= 1) {
+        return;
+    }
+    
+    int total_conn_num = 0;
+    for (int i = 0; i < thread_num; i++) {
+        total_conn_num += get_io_event_loop(i)->GetConnNum();
+    }
+    
+    for (int i = 0; i < thread_num; i++) {
+        if (get_io_event_loop(i)->GetConnNum() * thread_num > total_conn_num) {
+            PendingEvent event = {PENDING_EVENT_REBALANCE, i, NULL, NULL};
+            push_pending_event(event);
+        }
+    }
+}
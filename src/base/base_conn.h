@@ -10,13 +10,16 @@
 
 #include "util.h"
 #include "simple_buffer.h"
+#include "chain_buffer.h"
 #include "base_socket.h"
 
 const int kHeartBeartInterval =	3000;
 const int kConnTimeout = 16000;
 
 const int kMaxSendSize = 128 * 1024;
-const int kReadBufSize = 2048;
+const int kReadBufSize = 2048;          // initial and minimum size of one read
+const int kMaxReadBufSize = 64 * 1024;  // read size grows up to this when the connection is busy
+const uint64_t kMoveIdleTime = 1000;    // a connection can be moved to another io thread after idle for this time
 
 
 class BaseConn : public RefCount
@@ -32,10 +35,29 @@ public:
     net_handle_t GetHandle() { return m_handle; }
     char* GetPeerIP() { return (char*)m_peer_ip.c_str(); }
     uint16_t GetPeerPort() { return m_peer_port; }
+    uint64_t GetOutputBufferLen() { return m_out_buf.GetReadableLen(); }
     
     virtual net_handle_t Connect(const string& server_ip, uint16_t server_port, int thread_index = -1);
     int Send(void* data, int len);
+    int Send(ChainBuffer& chain); // segments of chain are moved to the output buffer if can not be sent at once
     virtual void Close();
+    void ReleaseIdleBuffer();   // return the input buffer to the pool if all data are consumed
+    
+    // the following methods must be called in the io thread of the connection
+    void SetTimer(uint64_t delay);  // OnTimer() will be called after delay ms, if not set, it will be called every second
+    void RegisterLoopHook();        // OnLoop() will be called in every loop iteration after registered
+    void UnregisterLoopHook();
+    bool IsIdle(uint64_t curr_tick);        // no pending data and no request in kMoveIdleTime, and IsMovable()
+    void MoveToThread(int thread_index);    // AttachToThread() must be called in the new io thread later
+    void AttachToThread();
+    
+    // a job of the connection can run in another thread: the io thread calls AddRef() before handing it over,
+    // the other thread calls PostResume() when the job is done, then OnResume() is called in the io thread
+    // and the reference is released. the connection must not be moved before that
+    void PostResume();
+    // called in the io thread to give it to other connections, OnResume() is called in a later loop iteration
+    // after the events ready by then are processed, connections yielded at the same time are resumed in order
+    void Yield();
     
 	virtual void OnConnect(BaseSocket* base_socket);
 	virtual void OnConfirm();
@@ -43,15 +65,20 @@ public:
 	virtual void OnWrite();
 	virtual void OnClose();
 	virtual void OnTimer(uint64_t curr_tick);
-    virtual void OnLoop() {} // be called everytime before waiting for event
+    virtual void OnLoop() {} // be called everytime before waiting for event, only if RegisterLoopHook() was called
+    virtual bool IsMovable() { return false; } // the upper layer allows to move the connection to another io thread
+    virtual void OnResume() {}
   
     static int Send(net_handle_t handle, void* data, int len);
     static int CloseHandle(net_handle_t handle);  // used for other thread to close the connection
     
     static long GetTotalNetInputBytes() { return m_total_net_input_bytes; }
     static long GetTotalNetOutputBytes() { return m_total_net_output_bytes; }
+    static long GetTotalOutputBufferBytes() { return m_total_out_buf_bytes; }
 protected:
     void _RecvData();
+    void _WriteChain(ChainBuffer& chain);
+    void _UpdateOutputBufferBytes();
 protected:
     int             m_thread_index;
     BaseSocket*     m_base_socket;
@@ -64,16 +91,23 @@ protected:
 	string			m_peer_ip;
 	uint16_t		m_peer_port;
 	SimpleBuffer	m_in_buf;
-	SimpleBuffer	m_out_buf;
+	ChainBuffer		m_out_buf;
+    long            m_out_buf_bytes;    // the size of m_out_buf added to m_total_out_buf_bytes
+    uint32_t        m_read_size;        // adapted to the bytes received in recent read events
+    int             m_small_read_count; // number of continuous read events that received much less than m_read_size
 
 	uint64_t		m_last_send_tick;
 	uint64_t		m_last_recv_tick;
     
     static atomic<long> m_total_net_input_bytes;
     static atomic<long> m_total_net_output_bytes;
+    static atomic<long> m_total_out_buf_bytes;  // data waiting in the output buffer of all connections
 };
 
 void init_thread_base_conn(int io_thread_num);
 void destroy_thread_base_conn(int io_thread_num);
 
+// io threads with more connections than the average move their idle connections to the least loaded io threads
+void rebalance_io_threads();
+
 #endif /* __BASE_CONN_H_ */
@@ -35,4 +35,25 @@ int start_listen(const string& server_ip, uint16_t port)
     }
 }
 
+// every io thread listens on the same port with SO_REUSEPORT, the kernel distributes new connections
+// among them, so accept() is no longer serialized in the main thread
+template <class T>
+int start_reuseport_listen(const string& server_ip, uint16_t port, int io_thread_num)
+{
+    if (io_thread_num <= 0) {
+        return start_listen<T>(server_ip, port);
+    }
+    
+    for (int i = 0; i < io_thread_num; ++i) {
+        BaseSocket* base_socket = new BaseSocket(i);
+        assert(base_socket);
+        net_handle_t handle = base_socket->Listen(server_ip.c_str(), port, connect_callback<T>, NULL, i);
+        if (handle == NETLIB_INVALID_HANDLE) {
+            return 1;
+        }
+    }
+    
+    return 0;
+}
+
 #endif
@@ -8,37 +8,70 @@
 #include <assert.h>
 #include "base_socket.h"
 #include "event_loop.h"
+#include "uring.h"
 #include "util.h"
 
 // replace socket with handle to notify upper layer, cause socket will be reused, 
 // while handle will be increasing whenever a new BaseSocket is created to avoid confusion
 static atomic<net_handle_t> g_handle_allocator {1};
 
-BaseSocket::BaseSocket()
+// handle = seq * io_thread_num + thread_index, so handle % io_thread_num is always the io thread that owns
+// the socket, this keeps get_io_event_loop(handle) right for sockets accepted in a SO_REUSEPORT io thread
+BaseSocket::BaseSocket(int thread_index)
 {
 	//printf("BaseSocket::BaseSocket\n");
 	m_socket = INVALID_SOCKET;
 	m_state = SOCKET_STATE_IDLE;
-	
+    m_thread_index = -1;
+    m_timer_node.data = this;
+    m_uring = NULL;
+    m_counted = false;
+    
+    _AllocHandle(thread_index);
+}
+
+BaseSocket::~BaseSocket()
+{
+	//printf("BaseSocket::~BaseSocket, socket=%d\n", m_socket);
+    if (m_counted) {
+        get_io_event_loop(m_handle)->DecConnNum();
+    }
+    
+    if (m_uring) {
+        delete m_uring;
+    }
+}
+
+void BaseSocket::_AllocHandle(int thread_index)
+{
+    int thread_num = get_io_thread_num();
+    if (thread_num < 1) {
+        thread_num = 1;
+    }
+    
     do {
-        m_handle = g_handle_allocator++;
-        if (m_handle < 0) {
-            m_handle = 1;
+        int64_t seq = g_handle_allocator++;
+        int64_t index = (thread_index >= 0) ? (thread_index % thread_num) : pick_io_thread(seq);
+        int64_t handle = seq * thread_num + index;
+        if ((seq <= 0) || (handle > INT32_MAX)) {
+            g_handle_allocator = 1;
+            continue;
         }
         
+        m_handle = (net_handle_t)handle;
+        
         // skip handle that is already used in listen socket, assume connection socket can not last too long
         if (get_main_event_loop()->FindBaseSocket(m_handle) == NULL) {
             break;
         }
     } while (true);
+    
+    get_io_event_loop(m_handle)->IncConnNum();
+    m_counted = true;
 }
 
-BaseSocket::~BaseSocket()
-{
-	//printf("BaseSocket::~BaseSocket, socket=%d\n", m_socket);
-}
-
-net_handle_t BaseSocket::Listen(const char* server_ip, uint16_t port, callback_t callback, void* callback_data)
+net_handle_t BaseSocket::Listen(const char* server_ip, uint16_t port, callback_t callback, void* callback_data,
+                                int thread_index)
 {
 	m_local_ip = server_ip;
 	m_local_port = port;
@@ -52,6 +85,9 @@ net_handle_t BaseSocket::Listen(const char* server_ip, uint16_t port, callback_t
 	}
 
 	SetReuseAddr(m_socket);
+    if (thread_index >= 0) {
+        SetReusePort(m_socket);
+    }
 	SetNonblock(m_socket, true);
 
 	sockaddr_in serv_addr;
@@ -73,10 +109,19 @@ net_handle_t BaseSocket::Listen(const char* server_ip, uint16_t port, callback_t
     GetBindAddr(m_socket, m_local_ip, m_local_port);
 
 	m_state = SOCKET_STATE_LISTENING;
+    
+    // listen socket is not a connection of the io thread
+    get_io_event_loop(m_handle)->DecConnNum();
+    m_counted = false;
 
 	printf("BaseSocket::Listen on %s:%d\n", server_ip, port);
 
-    m_event_loop = get_main_event_loop();
+    if (thread_index >= 0) {
+        m_thread_index = thread_index;
+        m_event_loop = get_io_event_loop(thread_index);
+    } else {
+        m_event_loop = get_main_event_loop();
+    }
 	m_event_loop->AddEvent(m_socket, SOCKET_READ | SOCKET_EXCEP | SOCKET_ADD_CONN, this);
     return m_handle;
 }
@@ -125,6 +170,11 @@ net_handle_t BaseSocket::Connect(const char* server_ip, uint16_t port, callback_
 
 int BaseSocket::Send(void* buf, int len)
 {
+    if (m_uring) {
+        struct iovec iov = {buf, (size_t)len};
+        return m_event_loop->UringSend(this, &iov, 1);
+    }
+    
     int ret = (int)send(m_socket, (char*)buf, len, 0);
 	if (ret == SOCKET_ERROR) {
 		if (_IsBlock(errno)) {
@@ -140,9 +190,30 @@ int BaseSocket::Send(void* buf, int len)
 	return ret;
 }
 
+int BaseSocket::Writev(const struct iovec* iov, int iov_cnt)
+{
+    if (m_uring) {
+        return m_event_loop->UringSend(this, iov, iov_cnt);
+    }
+    
+    int ret = (int)writev(m_socket, iov, iov_cnt);
+	if (ret == SOCKET_ERROR) {
+		if (_IsBlock(errno)) {
+#ifdef __APPLE__
+			m_event_loop->AddEvent(m_socket, SOCKET_WRITE, this);
+#endif
+			ret = 0;
+		} else {
+			printf("!!!writev failed, error code: %d\n", errno);
+		}
+	}
+
+	return ret;
+}
+
 int BaseSocket::Recv(void* buf, int len)
 {
-    int n = (int)recv(m_socket, (char*)buf, len, 0);
+    int n = m_uring ? m_event_loop->UringRecv(this, buf, len) : (int)recv(m_socket, (char*)buf, len, 0);
     if (n == 0) {
         m_state = SOCKET_STATE_PEER_CLOSING;
     }
@@ -154,7 +225,9 @@ int BaseSocket::Close()
 {
     m_state = SOCKET_STATE_CLOSING;
 	m_event_loop->RemoveEvent(m_socket, SOCKET_ALL|SOCKET_DEL_CONN, this);
-	close(m_socket);
+    if (!m_uring || !m_event_loop->UringDeferClose(this)) {
+        close(m_socket);
+    }
     ReleaseRef();
     
 	return 0;
@@ -169,6 +242,12 @@ void BaseSocket::OnRead()
 {
 	if (m_state == SOCKET_STATE_LISTENING) {
 		_AcceptNewSocket();
+	} else if (m_uring) {
+		// data was already received by io_uring, FIONREAD can not be used here
+		m_callback(m_callback_data, NETLIB_MSG_READ, m_handle, NULL);
+		if (m_state == SOCKET_STATE_PEER_CLOSING) {
+			m_callback(m_callback_data, NETLIB_MSG_CLOSE, m_handle, NULL);
+		}
 	} else {
 		u_long avail = 0;
 		if ( (ioctl(m_socket, FIONREAD, &avail) == SOCKET_ERROR) || (avail == 0) ) {
@@ -235,6 +314,11 @@ void BaseSocket::OnTimer(uint64_t curr_tick)
 {
     if (m_state != SOCKET_STATE_LISTENING) {
         m_callback(m_callback_data, NETLIB_MSG_TIMER, m_handle, &curr_tick);
+        
+        // keep the periodic timer if the upper layer did not set the next one
+        if ((m_state != SOCKET_STATE_CLOSING) && !m_timer_node.IsLinked()) {
+            m_event_loop->AddSocketTimer(this, kSocketTimerInterval);
+        }
     }
 }
 
@@ -270,6 +354,15 @@ void BaseSocket::SetReuseAddr(int fd)
 	}
 }
 
+void BaseSocket::SetReusePort(int fd)
+{
+	int reuse = 1;
+	int ret = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (char*)&reuse, sizeof(reuse));
+	if (ret == SOCKET_ERROR) {
+		printf("SetReusePort failed, err_code=%d\n", errno);
+	}
+}
+
 void BaseSocket::SetNoDelay(int fd)
 {
 	int nodelay = 1;
@@ -308,6 +401,22 @@ void BaseSocket::GetBindAddr(int fd, string& bind_ip, uint16_t& bind_port)
     bind_port = ntohs(local_addr.sin_port);
 }
 
+void BaseSocket::Detach(int thread_index)
+{
+    m_event_loop->RemoveEvent(m_socket, SOCKET_ALL|SOCKET_DEL_CONN, this);
+    if (m_counted) {
+        get_io_event_loop(m_handle)->DecConnNum();
+    }
+    
+    _AllocHandle(thread_index);
+    m_event_loop = get_io_event_loop(m_handle);
+}
+
+void BaseSocket::Attach()
+{
+    m_event_loop->AddEvent(m_socket, SOCKET_READ|SOCKET_EXCEP|SOCKET_ADD_CONN, this);
+}
+
 bool BaseSocket::_IsBlock(int error_code)
 {
 	return ( (error_code == EINPROGRESS) || (error_code == EWOULDBLOCK) );
@@ -330,7 +439,8 @@ void BaseSocket::_AcceptNewSocket()
             break;
         }
         
-		BaseSocket* pSocket = new BaseSocket();
+		// connection accepted by a SO_REUSEPORT listen socket stays in the same io thread
+		BaseSocket* pSocket = new BaseSocket(m_thread_index);
 
 		uint32_t ip = ntohl(peer_addr.sin_addr.s_addr);
 		uint16_t port = ntohs(peer_addr.sin_port);
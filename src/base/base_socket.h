@@ -10,6 +10,8 @@
 
 #include "ostype.h"
 #include "util.h"
+#include "timer_wheel.h"
+#include <sys/uio.h>
 
 enum
 {
@@ -21,12 +23,16 @@ enum
 	SOCKET_STATE_CLOSING
 };
 
+const uint64_t kSocketTimerInterval = 1000;  // default interval of OnTimer() if the upper layer do not set the timer
+
 class EventLoop;
+struct UringSocket;
 
 class BaseSocket : public RefCount
 {
 public:
-	BaseSocket();
+	BaseSocket(int thread_index = -1); // the handle will be mapped to io thread thread_index if presented,
+                                       // otherwise the io thread is picked by the placement policy
 	virtual ~BaseSocket();
 
 	net_handle_t GetHandle() { return m_handle; }
@@ -40,6 +46,10 @@ public:
 	void SetRemotePort(uint16_t port) { m_remote_port = port; }
 
     EventLoop*  GetEventLoop() { return m_event_loop; }
+    TimerNode*  GetTimerNode() { return &m_timer_node; }
+    uint8_t     GetState() { return m_state; }
+    UringSocket* GetUring() { return m_uring; }
+    void SetUring(UringSocket* us) { m_uring = us; }
 	const char*	GetRemoteIP() { return m_remote_ip.c_str(); }
 	uint16_t	GetRemotePort() { return m_remote_port; }
 	const char*	GetLocalIP() { return m_local_ip.c_str(); }
@@ -49,7 +59,8 @@ public:
 		const char*		server_ip, 
 		uint16_t		port,
 		callback_t		callback,
-		void*			callback_data);
+		void*			callback_data,
+        int             thread_index = -1); // listen with SO_REUSEPORT in io thread thread_index if presented
 
 	net_handle_t Connect(
 		const char*		server_ip, 
@@ -60,9 +71,16 @@ public:
 
 	int Send(void* buf, int len);
 
+	int Writev(const struct iovec* iov, int iov_cnt);
+
 	int Recv(void* buf, int len);
 
 	int Close();
+    
+    // move a connected socket to another io thread, it gets a new handle of that thread,
+    // Detach() must be called in the current io thread, and Attach() in the new one
+    void Detach(int thread_index);
+    void Attach();
 
 public:
     void OnConnect();
@@ -74,6 +92,7 @@ public:
     void SetFastAck();
 	static void SetNonblock(int fd, bool nonblock);
 	static void SetReuseAddr(int fd);
+	static void SetReusePort(int fd);
 	static void SetNoDelay(int fd);
 	static void SetAddr(const char* ip, const uint16_t port, sockaddr_in* pAddr);
     static void GetBindAddr(int fd, string& bind_ip, uint16_t& bind_port);
@@ -81,6 +100,7 @@ public:
 private:
 	bool _IsBlock(int error_code);
 	void _AcceptNewSocket();
+    void _AllocHandle(int thread_index);
 
 private:
     EventLoop*      m_event_loop;
@@ -94,7 +114,11 @@ private:
 
 	uint8_t			m_state;
 	int             m_socket;
+    int             m_thread_index; // io thread index of a SO_REUSEPORT listen socket, -1 for others
+    TimerNode       m_timer_node;
+    UringSocket*    m_uring;        // state of the io_uring backend, NULL for epoll
 	net_handle_t	m_handle;
+    bool            m_counted;      // counted in the connection number of the io thread of m_handle
 };
 
 #endif
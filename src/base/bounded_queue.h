@@ -0,0 +1,113 @@
+/*
+ * bounded_queue.h
+ */
+
+#ifndef __BASE_BOUNDED_QUEUE_H__
+#define __BASE_BOUNDED_QUEUE_H__
+
+#include "util.h"
+
+const int kCacheLineSize = 64;
+
+// bounded lock-free queue for multiple producers and consumers, based on Dmitry Vyukov's algorithm,
+// every cell has a sequence number, so producers and consumers only contend on their own position counter
+template <typename T>
+class BoundedQueue
+{
+public:
+    BoundedQueue(uint32_t capacity);   // capacity will be rounded up to the power of 2
+    ~BoundedQueue();
+
+    bool Push(const T& item);   // return false if the queue is full
+    bool Pop(T& item);          // return false if the queue is empty
+    uint32_t GetCapacity() { return (uint32_t)(m_mask + 1); }
+private:
+    struct Cell {
+        atomic<uint64_t>    sequence;
+        T                   data;
+    };
+
+    Cell*               m_cells;
+    uint64_t            m_mask;
+    char                m_pad0[kCacheLineSize];
+    atomic<uint64_t>    m_enqueue_pos;
+    char                m_pad1[kCacheLineSize];
+    atomic<uint64_t>    m_dequeue_pos;
+    char                m_pad2[kCacheLineSize];
+};
+
+template <typename T>
+BoundedQueue<T>::BoundedQueue(uint32_t capacity)
+{
+    uint64_t size = 2;
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    m_mask = size - 1;
+    m_cells = new Cell[size];
+    for (uint64_t i = 0; i < size; ++i) {
+        m_cells[i].sequence.store(i, memory_order_relaxed);
+    }
+
+    m_enqueue_pos.store(0, memory_order_relaxed);
+    m_dequeue_pos.store(0, memory_order_relaxed);
+}
+
+template <typename T>
+BoundedQueue<T>::~BoundedQueue()
+{
+    delete [] m_cells;
+}
+
+template <typename T>
+bool BoundedQueue<T>::Push(const T& item)
+{
+    Cell* cell;
+    uint64_t pos = m_enqueue_pos.load(memory_order_relaxed);
+    for (;;) {
+        cell = &m_cells[pos & m_mask];
+        uint64_t seq = cell->sequence.load(memory_order_acquire);
+        int64_t diff = (int64_t)seq - (int64_t)pos;
+        if (diff == 0) {
+            if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = m_enqueue_pos.load(memory_order_relaxed);
+        }
+    }
+
+    cell->data = item;
+    cell->sequence.store(pos + 1, memory_order_release);
+    return true;
+}
+
+template <typename T>
+bool BoundedQueue<T>::Pop(T& item)
+{
+    Cell* cell;
+    uint64_t pos = m_dequeue_pos.load(memory_order_relaxed);
+    for (;;) {
+        cell = &m_cells[pos & m_mask];
+        uint64_t seq = cell->sequence.load(memory_order_acquire);
+        int64_t diff = (int64_t)seq - (int64_t)(pos + 1);
+        if (diff == 0) {
+            if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = m_dequeue_pos.load(memory_order_relaxed);
+        }
+    }
+
+    item = cell->data;
+    cell->sequence.store(pos + m_mask + 1, memory_order_release);
+    return true;
+}
+
+#endif
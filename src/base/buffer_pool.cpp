@@ -0,0 +1,96 @@
+/*
+ * buffer_pool.cpp
+ */
+
+#include "buffer_pool.h"
+#include "io_thread_resource.h"
+
+atomic<uint64_t> BufferPool::m_total_pooled_bytes {0};
+atomic<uint64_t> BufferPool::m_total_in_use_bytes {0};
+
+IoThreadResource<BufferPool> g_buffer_pools;
+
+BufferPool::BufferPool()
+{
+    m_pooled_bytes = 0;
+}
+
+BufferPool::~BufferPool()
+{
+    for (int i = 0; i < kBufferPoolClassNum; ++i) {
+        for (uchar_t* buf : m_free_lists[i]) {
+            free(buf);
+        }
+    }
+    m_total_pooled_bytes -= m_pooled_bytes;
+}
+
+uchar_t* BufferPool::Alloc(uint32_t size, uint32_t& alloc_size)
+{
+    int cls = _GetClass(size);
+    if (cls == -1) {
+        alloc_size = size;
+        m_total_in_use_bytes += alloc_size;
+        return (uchar_t*)malloc(size);
+    }
+
+    alloc_size = kBufferPoolMinBlock << cls;
+    m_total_in_use_bytes += alloc_size;
+
+    vector<uchar_t*>& free_list = m_free_lists[cls];
+    if (free_list.empty()) {
+        return (uchar_t*)malloc(alloc_size);
+    }
+
+    uchar_t* buf = free_list.back();
+    free_list.pop_back();
+    m_pooled_bytes -= alloc_size;
+    m_total_pooled_bytes -= alloc_size;
+    return buf;
+}
+
+void BufferPool::Free(uchar_t* buf, uint32_t alloc_size)
+{
+    m_total_in_use_bytes -= alloc_size;
+
+    int cls = _GetClass(alloc_size);
+    if ((cls == -1) || ((kBufferPoolMinBlock << cls) != alloc_size) ||
+        (m_pooled_bytes + alloc_size > kBufferPoolMaxPooledBytes)) {
+        free(buf);
+        return;
+    }
+
+    m_free_lists[cls].push_back(buf);
+    m_pooled_bytes += alloc_size;
+    m_total_pooled_bytes += alloc_size;
+}
+
+// return the smallest class that can hold size, -1 if it's too large
+int BufferPool::_GetClass(uint32_t size)
+{
+    if (size > kBufferPoolMaxBlock) {
+        return -1;
+    }
+
+    int cls = 0;
+    while ((kBufferPoolMinBlock << cls) < size) {
+        cls++;
+    }
+    return cls;
+}
+
+void init_thread_buffer_pools(int io_thread_num)
+{
+    if (g_buffer_pools.IsInited())
+        return;
+
+    g_buffer_pools.Init(io_thread_num);
+}
+
+BufferPool* get_io_buffer_pool(int handle)
+{
+    if (!g_buffer_pools.IsInited())
+        return NULL;
+
+    return g_buffer_pools.GetIOResource(handle);
+}
@@ -0,0 +1,45 @@
+/*
+ * buffer_pool.h
+ */
+
+#ifndef __BASE_BUFFER_POOL_H__
+#define __BASE_BUFFER_POOL_H__
+
+#include "util.h"
+
+const uint32_t kBufferPoolMinBlock = 4 * 1024;      // block size of the smallest class
+const int kBufferPoolClassNum = 9;                  // 4KB, 8KB, ... 1MB
+const uint32_t kBufferPoolMaxBlock = kBufferPoolMinBlock << (kBufferPoolClassNum - 1);
+const uint64_t kBufferPoolMaxPooledBytes = 8 * 1024 * 1024; // idle blocks kept by one io thread
+
+// free lists of size-classed blocks for connection buffers, every io thread has its own pool,
+// so it is not thread safe, only the io thread of the connection can alloc/free blocks from its pool.
+// blocks larger than kBufferPoolMaxBlock are allocated by malloc and never pooled
+class BufferPool
+{
+public:
+    BufferPool();
+    ~BufferPool();
+
+    // alloc_size returns the real size of the block, it's at least size
+    uchar_t* Alloc(uint32_t size, uint32_t& alloc_size);
+    void Free(uchar_t* buf, uint32_t alloc_size);
+
+    static uint64_t GetPooledBytes() { return m_total_pooled_bytes; }
+    static uint64_t GetInUseBytes() { return m_total_in_use_bytes; }
+private:
+    int _GetClass(uint32_t size);
+private:
+    vector<uchar_t*>    m_free_lists[kBufferPoolClassNum];
+    uint64_t            m_pooled_bytes;
+
+    static atomic<uint64_t> m_total_pooled_bytes;
+    static atomic<uint64_t> m_total_in_use_bytes;
+};
+
+void init_thread_buffer_pools(int io_thread_num);
+
+// the pool of the io thread that handle belongs to, NULL if the pools are not initialized
+BufferPool* get_io_buffer_pool(int handle);
+
+#endif
@@ -0,0 +1,114 @@
+/*
+ * chain_buffer.cpp
+ */
+
+#include "chain_buffer.h"
+
+ChainBuffer::ChainBuffer()
+{
+    m_readable_len = 0;
+}
+
+ChainBuffer::~ChainBuffer()
+{
+
+}
+
+void ChainBuffer::Append(const void* buf, uint32_t len)
+{
+    if (len == 0) {
+        return;
+    }
+
+    if (!m_segments.empty()) {
+        Segment& tail = m_segments.back();
+        if (tail.is_inline && (tail.data.capacity() - tail.data.size() >= len)) {
+            tail.data.append((const char*)buf, len);
+            m_readable_len += len;
+            return;
+        }
+    }
+
+    Segment seg;
+    seg.read_offset = 0;
+    if (len >= kChainRefMinSize) {
+        seg.data.assign((const char*)buf, len);
+        seg.is_inline = false;
+    } else {
+        seg.data.reserve(kChainBlockSize);
+        seg.data.append((const char*)buf, len);
+        seg.is_inline = true;
+    }
+
+    m_segments.push_back(std::move(seg));
+    m_readable_len += len;
+}
+
+void ChainBuffer::Append(string&& data)
+{
+    uint32_t len = (uint32_t)data.size();
+    if (len < kChainRefMinSize) {
+        Append(data.data(), len);
+        return;
+    }
+
+    Segment seg;
+    seg.data = std::move(data);
+    seg.read_offset = 0;
+    seg.is_inline = false;
+    m_segments.push_back(std::move(seg));
+    m_readable_len += len;
+}
+
+void ChainBuffer::Append(ChainBuffer& chain)
+{
+    if (m_segments.empty()) {
+        m_segments.swap(chain.m_segments);
+    } else {
+        for (auto it = chain.m_segments.begin(); it != chain.m_segments.end(); ++it) {
+            m_segments.push_back(std::move(*it));
+        }
+        chain.m_segments.clear();
+    }
+
+    m_readable_len += chain.m_readable_len;
+    chain.m_readable_len = 0;
+}
+
+int ChainBuffer::GetIovec(struct iovec* iov, int iov_cnt) const
+{
+    int cnt = 0;
+    for (auto it = m_segments.begin(); (it != m_segments.end()) && (cnt < iov_cnt); ++it) {
+        iov[cnt].iov_base = (void*)(it->data.data() + it->read_offset);
+        iov[cnt].iov_len = it->data.size() - it->read_offset;
+        cnt++;
+    }
+
+    return cnt;
+}
+
+void ChainBuffer::Consume(uint64_t len)
+{
+    if (len > m_readable_len) {
+        len = m_readable_len;
+    }
+    m_readable_len -= len;
+
+    while (len > 0) {
+        Segment& head = m_segments.front();
+        uint64_t seg_len = head.data.size() - head.read_offset;
+        if (len < seg_len) {
+            head.read_offset += (uint32_t)len;
+            break;
+        }
+
+        len -= seg_len;
+        m_segments.pop_front();
+    }
+}
+
+void ChainBuffer::Clear()
+{
+    m_segments.clear();
+    m_readable_len = 0;
+}
@@ -0,0 +1,47 @@
+/*
+ * chain_buffer.h
+ */
+
+#ifndef __BASE_CHAIN_BUFFER_H__
+#define __BASE_CHAIN_BUFFER_H__
+
+#include "ostype.h"
+#include "util.h"
+#include <deque>
+#include <sys/uio.h>
+
+const uint32_t kChainBlockSize = 16 * 1024;     // capacity of the inline block for small data
+const uint32_t kChainRefMinSize = 4 * 1024;     // moved-in data at least this size is linked, not copied
+const int kChainMaxIovec = 64;
+
+// output buffer made of a list of segments, it is flushed with writev(),
+// so big values are linked into the chain and will never be copied again
+class ChainBuffer
+{
+public:
+    ChainBuffer();
+    ~ChainBuffer();
+
+    uint64_t GetReadableLen() const { return m_readable_len; }
+    bool IsEmpty() const { return m_readable_len == 0; }
+
+    void Append(const void* buf, uint32_t len);     // copy to the inline block at the tail
+    void Append(string&& data);                     // take the ownership of data
+    void Append(ChainBuffer& chain);                // move all segments of chain to the tail, chain will be empty
+
+    // fill at most iov_cnt iovec from the head of the chain, return the number of iovec filled
+    int GetIovec(struct iovec* iov, int iov_cnt) const;
+    void Consume(uint64_t len);
+    void Clear();
+private:
+    struct Segment {
+        string      data;
+        uint32_t    read_offset;
+        bool        is_inline;  // only inline block can be appended with more data
+    };
+
+    deque<Segment>  m_segments;
+    uint64_t        m_readable_len;
+};
+
+#endif
@@ -14,15 +14,15 @@
 #include "event_loop.h"
 #include "base_socket.h"
 #include "io_thread_resource.h"
+#include "uring.h"
 
 IoThreadResource<EventLoop> g_event_loops;
+static int g_io_backend = IO_BACKEND_EPOLL;
+static atomic<int> g_io_placement_policy {IO_PLACEMENT_ROUND_ROBIN};
 
-void timer_callback(void* callback_data, uint8_t msg, uint32_t handle, void* pParam)
+static void sample_cpu_time_callback(void* callback_data, uint8_t msg, uint32_t handle, void* pParam)
 {
-    if (callback_data) {
-        EventLoop* el = (EventLoop*)callback_data;
-        el->OnTimer();
-    }
+    ((EventLoop*)callback_data)->SampleCpuTime();
 }
 
 static void* event_loop_thread(void* arg)
@@ -32,13 +32,13 @@ static void* event_loop_thread(void* arg)
     
     EventLoop* el = g_event_loops.GetIOResource(event_loop_idx);
     el->SetThreadId(pthread_self());
-    el->AddTimer(timer_callback, el, 1000);
+    el->AddTimer(sample_cpu_time_callback, el, 1000);
     el->Start();
     
     return NULL;
 }
 
-void init_thread_event_loops(int io_thread_num)
+void init_thread_event_loops(int io_thread_num, int io_backend)
 {
     if (g_event_loops.IsInited())
         return;
@@ -46,10 +46,10 @@ void init_thread_event_loops(int io_thread_num)
     signal(SIGPIPE, SIG_IGN);
     srand((unsigned)time(NULL));
     
+    g_io_backend = io_backend;
     g_event_loops.Init(io_thread_num);
     
     g_event_loops.GetMainResource()->SetThreadId(pthread_self());
-    g_event_loops.GetMainResource()->AddTimer(timer_callback, g_event_loops.GetMainResource(), 1000);
     
     for (long i = 0; i < io_thread_num; ++i) {
         pthread_t thread_id;
@@ -78,6 +78,56 @@ EventLoop* get_io_event_loop(net_handle_t handle)
     return g_event_loops.GetIOResource(handle);
 }
 
+int get_io_thread_num()
+{
+    return g_event_loops.GetThreadNum();
+}
+
+void set_io_placement_policy(int policy)
+{
+    g_io_placement_policy = policy;
+}
+
+int get_io_placement_policy()
+{
+    return g_io_placement_policy;
+}
+
+// the load of io threads is read without lock, a slightly stale value only makes the placement less even
+int pick_io_thread(int64_t seq)
+{
+    int thread_num = g_event_loops.GetThreadNum();
+    if (thread_num <= 1) {
+        return 0;
+    }
+    
+    int policy = g_io_placement_policy;
+    if (policy == IO_PLACEMENT_ROUND_ROBIN) {
+        return (int)(seq % thread_num);
+    }
+    
+    int best_index = (int)(seq % thread_num);   // start from a rotating index, so ties are spread out
+    for (int i = 1; i < thread_num; i++) {
+        int index = (int)((seq + i) % thread_num);
+        EventLoop* el = g_event_loops.GetIOResource(index);
+        EventLoop* best_el = g_event_loops.GetIOResource(best_index);
+        if (policy == IO_PLACEMENT_LEAST_CONN) {
+            if (el->GetConnNum() < best_el->GetConnNum()) {
+                best_index = index;
+            }
+        } else {
+            uint64_t cpu_time = el->GetRecentCpuTime();
+            uint64_t best_cpu_time = best_el->GetRecentCpuTime();
+            if ((cpu_time < best_cpu_time) ||
+                ((cpu_time == best_cpu_time) && (el->GetConnNum() < best_el->GetConnNum()))) {
+                best_index = index;
+            }
+        }
+    }
+    
+    return best_index;
+}
+
 ///////////////////////
 EventLoop::EventLoop()
 {
@@ -94,6 +144,14 @@ EventLoop::EventLoop()
     BaseSocket::SetNonblock(wakeup_fds_[0], true);
     BaseSocket::SetNonblock(wakeup_fds_[1], true);
     stop_ = false;
+    conn_num_ = 0;
+    recent_cpu_time_ = 0;
+    last_cpu_time_ = 0;
+    
+    uring_ = NULL;
+    if (g_io_backend == IO_BACKEND_IO_URING) {
+        _UringInit();
+    }
 }
 
 EventLoop::~EventLoop()
@@ -106,6 +164,10 @@ EventLoop::~EventLoop()
         close(wakeup_fds_[0]);
         close(wakeup_fds_[1]);
     }
+    
+    if (uring_) {
+        delete uring_;
+    }
 }
 
 void EventLoop::AddTimer(callback_t callback, void* user_data, uint64_t interval)
@@ -201,17 +263,45 @@ void EventLoop::Wakeup()
     send(wakeup_fds_[1], &buf, 1, 0);
 }
 
-void EventLoop::OnTimer()
+void EventLoop::AddSocketTimer(BaseSocket* pSocket, uint64_t delay)
+{
+    timer_wheel_.Add(pSocket->GetTimerNode(), get_tick_count() + delay);
+}
+
+void EventLoop::RemoveSocketTimer(BaseSocket* pSocket)
+{
+    timer_wheel_.Remove(pSocket->GetTimerNode());
+}
+
+void EventLoop::_CheckSocketTimer()
 {
     uint64_t curr_tick = get_tick_count();
-    SocketMap::iterator it_old;
-    for (auto it = socket_map_.begin(); it != socket_map_.end(); ) {
-        it_old = it;
-        ++it;   // iterate to the next before OnTimer, cause OnTimer may close the connection and make iterator useless
-        it_old->second->OnTimer(curr_tick);
+    TimerList expired_list;
+    timer_wheel_.Advance(curr_tick, expired_list);
+    
+    // pop one by one, cause OnTimer may close other connections and remove their timers from the list
+    while (TimerNode* node = expired_list.PopFront()) {
+        BaseSocket* pSocket = (BaseSocket*)node->data;
+        pSocket->AddRef();
+        pSocket->OnTimer(curr_tick);
+        pSocket->ReleaseRef();
     }
 }
 
+void EventLoop::SampleCpuTime()
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+        return;
+    }
+    
+    uint64_t cpu_time = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    if (last_cpu_time_) {
+        recent_cpu_time_ = cpu_time - last_cpu_time_;
+    }
+    last_cpu_time_ = cpu_time;
+}
+
 BaseSocket* EventLoop::FindBaseSocket(net_handle_t handle)
 {
     SocketMap::iterator it = socket_map_.find(handle);
@@ -243,18 +333,25 @@ void EventLoop::AddEvent(int fd, uint8_t socket_event, BaseSocket* pSocket)
         }
         
 #else
-        struct epoll_event ev;
-        memset(&ev, 0, sizeof(ev));
-        ev.events = EPOLLIN | EPOLLOUT | EPOLLET | EPOLLPRI | EPOLLERR | EPOLLHUP;
-        ev.data.ptr = pSocket;
-        if (epoll_ctl(event_fd_, EPOLL_CTL_ADD, fd, &ev) != 0) {
-            printf("epoll_ctl() failed, errno=%d\n", errno);
+        if (uring_) {
+            _UringAddEvent(fd, socket_event, pSocket);
+        } else {
+            struct epoll_event ev;
+            memset(&ev, 0, sizeof(ev));
+            ev.events = EPOLLIN | EPOLLOUT | EPOLLET | EPOLLPRI | EPOLLERR | EPOLLHUP;
+            ev.data.ptr = pSocket;
+            if (epoll_ctl(event_fd_, EPOLL_CTL_ADD, fd, &ev) != 0) {
+                printf("epoll_ctl() failed, errno=%d\n", errno);
+            }
         }
 #endif
         
         if ( ((socket_event & SOCKET_ADD_CONN) != 0) && pSocket) {
             //printf("add conn: %d\n", pSocket->GetHandle());
             socket_map_.insert(make_pair(pSocket->GetHandle(), pSocket));
+            if (pSocket->GetState() != SOCKET_STATE_LISTENING) {
+                AddSocketTimer(pSocket, kSocketTimerInterval);
+            }
         }
         
         if ( ((socket_event & SOCKET_CONNECT_CB) != 0) && pSocket) {
@@ -289,7 +386,11 @@ void EventLoop::RemoveEvent(int fd, uint8_t socket_event, BaseSocket* pSocket)
 		kevent(event_fd_, &ke, 1, NULL, 0, NULL);
 	}
 #else
-    if (epoll_ctl(event_fd_, EPOLL_CTL_DEL, fd, NULL) != 0) {
+    if (uring_) {
+        if (((socket_event & SOCKET_DEL_CONN) != 0) && pSocket) {
+            _UringRemoveEvent(pSocket);
+        }
+    } else if (epoll_ctl(event_fd_, EPOLL_CTL_DEL, fd, NULL) != 0) {
 		printf("epoll_ctl failed, errno=%d\n", errno);
 	}
 #endif
@@ -297,6 +398,7 @@ void EventLoop::RemoveEvent(int fd, uint8_t socket_event, BaseSocket* pSocket)
     if ( ((socket_event & SOCKET_DEL_CONN) != 0) && pSocket) {
         //printf("delete conn: %d\n", pSocket->GetHandle());
         socket_map_.erase(pSocket->GetHandle());
+        RemoveSocketTimer(pSocket);
     }
 }
 
@@ -314,6 +416,7 @@ void EventLoop::Start(uint32_t wait_timeout)
     
 	while (!stop_) {
 		nfds = kevent(event_fd_, NULL, 0, events, 1024, &timeout);
+        update_tick_count();
 
 		for (int i = 0; i < nfds; i++) {
             if (!events[i].udata) {
@@ -342,6 +445,7 @@ void EventLoop::Start(uint32_t wait_timeout)
 		}
 
 		_CheckTimer();
+        _CheckSocketTimer();
 		_CheckLoop();
         
         _RegisterEventList();
@@ -352,6 +456,11 @@ void EventLoop::Start(uint32_t wait_timeout)
 
 void EventLoop::Start(uint32_t wait_timeout)
 {
+    if (uring_) {
+        _StartUring(wait_timeout);
+        return;
+    }
+    
 	struct epoll_event events[1024];
 	int nfds = 0;
     
@@ -359,6 +468,7 @@ void EventLoop::Start(uint32_t wait_timeout)
     
 	while (!stop_) {
 		nfds = epoll_wait(event_fd_, events, 1024, wait_timeout);
+        update_tick_count();    // one clock read per iteration, all handlers of this iteration use the cached tick
 		for (int i = 0; i < nfds; i++) {
 			BaseSocket* pSocket = (BaseSocket*)events[i].data.ptr;
             if (!pSocket) {
@@ -382,6 +492,7 @@ void EventLoop::Start(uint32_t wait_timeout)
 		}
 
 		_CheckTimer();
+        _CheckSocketTimer();
 		_CheckLoop();
 
         _RegisterEventList();
@@ -10,6 +10,7 @@
 
 #include "ostype.h"
 #include "util.h"
+#include "timer_wheel.h"
 
 enum {
 	SOCKET_READ		= 0x1,
@@ -21,7 +22,21 @@ enum {
     SOCKET_DEL_CONN     = 0x20,
 };
 
+enum {
+    IO_BACKEND_EPOLL = 0,   // kqueue on Mac OS
+    IO_BACKEND_IO_URING,    // Linux only, fall back to epoll if io_uring is not supported
+};
+
+// how to pick the io thread for a new connection
+enum {
+    IO_PLACEMENT_ROUND_ROBIN = 0,
+    IO_PLACEMENT_LEAST_CONN,    // the io thread with the least connections
+    IO_PLACEMENT_LEAST_CPU,     // the io thread that used the least cpu time in the last second
+};
+
 class BaseSocket;
+class Uring;
+struct iovec;
 typedef unordered_map<int, BaseSocket*> SocketMap;
 
 class EventLoop
@@ -47,15 +62,42 @@ public:
     bool IsInLoopThread() { return pthread_self() == thread_id_; }
     pthread_t GetThreadId() { return thread_id_; }
     
-    void OnTimer(); 
+    // timer of a socket, must be called in the loop thread, BaseSocket::OnTimer() will be called when it expires
+    void AddSocketTimer(BaseSocket* pSocket, uint64_t delay);
+    void RemoveSocketTimer(BaseSocket* pSocket);
     
     BaseSocket* FindBaseSocket(net_handle_t handle);
+    
+    // load of the loop, the connection number is counted when a handle of this loop is allocated
+    void IncConnNum() { conn_num_++; }
+    void DecConnNum() { conn_num_--; }
+    int GetConnNum() { return conn_num_; }
+    uint64_t GetRecentCpuTime() { return recent_cpu_time_; }   // microseconds in the last second
+    void SampleCpuTime();   // called by the loop thread every second
+    
+    // io_uring backend, used by BaseSocket in the loop thread
+    bool IsUring() { return uring_ != NULL; }
+    int UringRecv(BaseSocket* pSocket, void* buf, int len);
+    int UringSend(BaseSocket* pSocket, const struct iovec* iov, int iov_cnt);
+    bool UringDeferClose(BaseSocket* pSocket); // return true if the fd will be closed after all data are sent
 private:
 	void _CheckTimer();
 	void _CheckLoop();
+    void _CheckSocketTimer();
     void _ReadWakeupData();
     void _RegisterEventList();
     
+    bool _UringInit();
+    void _StartUring(uint32_t wait_timeout);
+    void _UringAddEvent(int fd, uint8_t socket_event, BaseSocket* pSocket);
+    void _UringRemoveEvent(BaseSocket* pSocket);
+    void _UringArmRecv(BaseSocket* pSocket);
+    void _UringSubmitSend(BaseSocket* pSocket);
+    void _UringFlushSend();
+    void _UringOnSend(BaseSocket* pSocket, int res);
+    void _UringOnRecv(net_handle_t handle, int res, uint32_t flags);
+    void _UringOnPoll(net_handle_t handle, int res, uint32_t flags);
+    
 	typedef struct {
 		callback_t	callback;
 		void*		user_data;
@@ -76,15 +118,29 @@ private:
 	list<TimerItem*>	timer_list_;
 	list<TimerItem*>	loop_list_;
     SocketMap           socket_map_;
+    TimerWheel          timer_wheel_;   // socket timers, only sockets with an expired timer will be visited
     
     mutex               mutex_;
     list<RegisterEvent> register_event_list_;
+    
+    Uring*              uring_;
+    vector<BaseSocket*> uring_send_list_;   // sockets that have data to send in this loop iteration
+    vector<net_handle_t> uring_read_list_;  // sockets that received data in this batch of completions
+    
+    atomic<int>         conn_num_;
+    atomic<uint64_t>    recent_cpu_time_;
+    uint64_t            last_cpu_time_;
 };
 
-void init_thread_event_loops(int io_thread_num);
+void init_thread_event_loops(int io_thread_num, int io_backend = IO_BACKEND_EPOLL);
 void destroy_thread_event_loops(int io_thread_num);
 
 EventLoop* get_main_event_loop();
 EventLoop* get_io_event_loop(net_handle_t handle);
+int get_io_thread_num();
+
+void set_io_placement_policy(int policy);
+int get_io_placement_policy();
+int pick_io_thread(int64_t seq);    // the io thread index for a new connection, seq is used by round-robin
 
 #endif
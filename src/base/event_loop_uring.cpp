@@ -0,0 +1,369 @@
+/*
+ * event_loop_uring.cpp
+ *
+ *  io_uring backend of EventLoop, listen/connect/wakeup sockets use multishot poll and go through the same
+ *  callbacks as epoll, connected sockets use multishot recv with provided buffers and sendmsg,
+ *  all submissions of a loop iteration are sent to the kernel with one io_uring_enter() call
+ */
+
+#include "event_loop.h"
+#include "base_socket.h"
+#include "uring.h"
+#include <poll.h>
+
+#ifdef HAVE_IO_URING
+
+enum {
+    URING_OP_WAKEUP = 1,
+    URING_OP_POLL,
+    URING_OP_RECV,
+    URING_OP_SEND,
+    URING_OP_CANCEL,
+};
+
+// the highest byte of user_data is the operation, the rest is the handle, or BaseSocket pointer for send
+// (send holds a reference of the socket, so it's safe even after the socket is closed)
+static inline uint64_t make_user_data(uint64_t op, uint64_t value)
+{
+    return (op << 56) | value;
+}
+
+bool EventLoop::_UringInit()
+{
+    uring_ = new Uring();
+    if (!uring_->Init(kUringEntries)) {
+        printf("init io_uring failed, use epoll instead\n");
+        delete uring_;
+        uring_ = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+void EventLoop::_UringAddEvent(int fd, uint8_t socket_event, BaseSocket* pSocket)
+{
+    if (!pSocket) {
+        struct io_uring_sqe* sqe = uring_->GetSqe();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+        sqe->poll32_events = POLLIN;
+        sqe->len = IORING_POLL_ADD_MULTI;
+        sqe->user_data = make_user_data(URING_OP_WAKEUP, 0);
+        return;
+    }
+
+    // only the first registration matters, io_uring do not need to add write event when the socket is busy
+    if ((socket_event & SOCKET_ADD_CONN) == 0) {
+        return;
+    }
+
+    uint8_t state = pSocket->GetState();
+    if ((state == SOCKET_STATE_LISTENING) || (state == SOCKET_STATE_CONNECTING)) {
+        struct io_uring_sqe* sqe = uring_->GetSqe();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+        if (state == SOCKET_STATE_LISTENING) {
+            sqe->poll32_events = POLLIN;
+            sqe->len = IORING_POLL_ADD_MULTI;
+        } else {
+            sqe->poll32_events = POLLOUT;
+        }
+        sqe->user_data = make_user_data(URING_OP_POLL, pSocket->GetHandle());
+    } else {
+        _UringArmRecv(pSocket);
+    }
+}
+
+void EventLoop::_UringRemoveEvent(BaseSocket* pSocket)
+{
+    UringSocket* us = pSocket->GetUring();
+    uint64_t user_data;
+    if (us && us->recv_armed) {
+        user_data = make_user_data(URING_OP_RECV, pSocket->GetHandle());
+        us->recv_armed = false;
+    } else if (!us) {
+        user_data = make_user_data(URING_OP_POLL, pSocket->GetHandle());
+    } else {
+        return;
+    }
+
+    struct io_uring_sqe* sqe = uring_->GetSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = user_data;
+    sqe->user_data = make_user_data(URING_OP_CANCEL, 0);
+}
+
+void EventLoop::_UringArmRecv(BaseSocket* pSocket)
+{
+    UringSocket* us = pSocket->GetUring();
+    if (!us) {
+        us = new UringSocket();
+        pSocket->SetUring(us);
+    }
+
+    if (us->recv_armed || us->eof) {
+        return;
+    }
+
+    struct io_uring_sqe* sqe = uring_->GetSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = pSocket->GetSocket();
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = uring_->GetBufGroup();
+    sqe->user_data = make_user_data(URING_OP_RECV, pSocket->GetHandle());
+    us->recv_armed = true;
+}
+
+int EventLoop::UringRecv(BaseSocket* pSocket, void* buf, int len)
+{
+    UringSocket* us = pSocket->GetUring();
+    int n = (int)us->in_buf.Read(buf, len);
+    if (us->in_buf.GetReadableLen() == 0) {
+        us->in_buf.ResetOffset();
+    }
+
+    if (n > 0) {
+        return n;
+    }
+
+    if (us->eof) {
+        return 0;
+    }
+
+    errno = EAGAIN;
+    return -1;
+}
+
+int EventLoop::UringSend(BaseSocket* pSocket, const struct iovec* iov, int iov_cnt)
+{
+    UringSocket* us = pSocket->GetUring();
+    if (!us) {
+        us = new UringSocket();
+        pSocket->SetUring(us);
+    }
+
+    if (us->out_buf.GetReadableLen() >= kUringMaxPendingSend) {
+        us->write_blocked = true;
+        return 0;
+    }
+
+    int len = 0;
+    for (int i = 0; i < iov_cnt; ++i) {
+        us->out_buf.Append(iov[i].iov_base, (uint32_t)iov[i].iov_len);
+        len += (int)iov[i].iov_len;
+    }
+
+    if (!us->send_queued && !us->sending) {
+        us->send_queued = true;
+        pSocket->AddRef();
+        uring_send_list_.push_back(pSocket);
+    }
+
+    return len;
+}
+
+bool EventLoop::UringDeferClose(BaseSocket* pSocket)
+{
+    UringSocket* us = pSocket->GetUring();
+    if (!us || (!us->sending && !us->send_queued)) {
+        return false;
+    }
+
+    us->close_pending = true;
+    return true;
+}
+
+void EventLoop::_UringSubmitSend(BaseSocket* pSocket)
+{
+    UringSocket* us = pSocket->GetUring();
+    int iov_cnt = us->out_buf.GetIovec(us->iov, kChainMaxIovec);
+
+    memset(&us->msg, 0, sizeof(us->msg));
+    us->msg.msg_iov = us->iov;
+    us->msg.msg_iovlen = iov_cnt;
+
+    struct io_uring_sqe* sqe = uring_->GetSqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = pSocket->GetSocket();
+    sqe->addr = (uint64_t)&us->msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = make_user_data(URING_OP_SEND, (uint64_t)pSocket);
+    us->sending = true;
+}
+
+// data sent in one loop iteration are merged into one sendmsg per socket
+void EventLoop::_UringFlushSend()
+{
+    for (BaseSocket* pSocket : uring_send_list_) {
+        UringSocket* us = pSocket->GetUring();
+        us->send_queued = false;
+        if (!us->sending && !us->out_buf.IsEmpty()) {
+            _UringSubmitSend(pSocket);  // the reference is kept until the send completes
+        } else {
+            pSocket->ReleaseRef();
+        }
+    }
+
+    uring_send_list_.clear();
+}
+
+void EventLoop::_UringOnSend(BaseSocket* pSocket, int res)
+{
+    UringSocket* us = pSocket->GetUring();
+    us->sending = false;
+
+    if (res >= 0) {
+        us->out_buf.Consume(res);
+    } else if ((res != -EAGAIN) && (res != -EINTR)) {
+        us->out_buf.Clear();
+        if (pSocket->GetState() != SOCKET_STATE_CLOSING) {
+            us->eof = true;
+            pSocket->AddRef();
+            pSocket->OnClose();
+            pSocket->ReleaseRef();
+        }
+    }
+
+    if (!us->out_buf.IsEmpty()) {
+        _UringSubmitSend(pSocket);
+        return;
+    }
+
+    if (us->close_pending) {
+        close(pSocket->GetSocket());
+    } else if (us->write_blocked && (pSocket->GetState() == SOCKET_STATE_CONNECTED)) {
+        us->write_blocked = false;
+        pSocket->OnWrite();
+    }
+
+    pSocket->ReleaseRef();
+}
+
+void EventLoop::_UringOnRecv(net_handle_t handle, int res, uint32_t flags)
+{
+    bool has_buf = (flags & IORING_CQE_F_BUFFER) != 0;
+    uint16_t bid = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+
+    BaseSocket* pSocket = FindBaseSocket(handle);
+    UringSocket* us = pSocket ? pSocket->GetUring() : NULL;
+    if (us) {
+        if (res > 0) {
+            us->in_buf.Write(uring_->GetBuffer(bid), res);
+        } else if ((res == 0) || ((res != -ENOBUFS) && (res != -ECANCELED))) {
+            us->eof = true;
+        }
+
+        if (((res > 0) || us->eof) && !us->read_pending) {
+            us->read_pending = true;
+            uring_read_list_.push_back(handle);
+        }
+
+        // multishot recv stops if no buffer left or error occurs, rearm it
+        if (!(flags & IORING_CQE_F_MORE) && us->recv_armed) {
+            us->recv_armed = false;
+            _UringArmRecv(pSocket);
+        }
+    }
+
+    if (has_buf) {
+        uring_->RecycleBuffer(bid);
+    }
+}
+
+void EventLoop::_UringOnPoll(net_handle_t handle, int res, uint32_t flags)
+{
+    BaseSocket* pSocket = FindBaseSocket(handle);
+    if (!pSocket) {
+        return;
+    }
+
+    pSocket->AddRef();
+    if (pSocket->GetState() == SOCKET_STATE_LISTENING) {
+        pSocket->OnRead();
+        if (!(flags & IORING_CQE_F_MORE)) {
+            _UringAddEvent(pSocket->GetSocket(), SOCKET_ADD_CONN, pSocket);
+        }
+    } else if (pSocket->GetState() == SOCKET_STATE_CONNECTING) {
+        pSocket->OnWrite();
+        if (pSocket->GetState() == SOCKET_STATE_CONNECTED) {
+            _UringArmRecv(pSocket);
+        }
+    }
+    pSocket->ReleaseRef();
+}
+
+void EventLoop::_StartUring(uint32_t wait_timeout)
+{
+    AddEvent(wakeup_fds_[0], SOCKET_READ, NULL);
+
+    while (!stop_) {
+        _UringFlushSend();
+        uring_->SubmitAndWait(wait_timeout);
+        update_tick_count();
+
+        struct io_uring_cqe cqe;
+        while (uring_->PopCqe(cqe)) {
+            uint64_t op = cqe.user_data >> 56;
+            uint64_t value = cqe.user_data & (((uint64_t)1 << 56) - 1);
+            switch (op) {
+                case URING_OP_WAKEUP:
+                    _ReadWakeupData();
+                    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                        AddEvent(wakeup_fds_[0], SOCKET_READ, NULL);
+                    }
+                    break;
+                case URING_OP_POLL:
+                    _UringOnPoll((net_handle_t)value, cqe.res, cqe.flags);
+                    break;
+                case URING_OP_RECV:
+                    _UringOnRecv((net_handle_t)value, cqe.res, cqe.flags);
+                    break;
+                case URING_OP_SEND:
+                    _UringOnSend((BaseSocket*)value, cqe.res);
+                    break;
+                default:
+                    break;
+            }
+        }
+        uring_->CommitBuffers();
+
+        // all data received in this batch are processed with one OnRead() per socket
+        for (net_handle_t handle : uring_read_list_) {
+            BaseSocket* pSocket = FindBaseSocket(handle);
+            if (pSocket && pSocket->GetUring()) {
+                pSocket->GetUring()->read_pending = false;
+                pSocket->AddRef();
+                pSocket->OnRead();
+                pSocket->ReleaseRef();
+            }
+        }
+        uring_read_list_.clear();
+
+        _CheckTimer();
+        _CheckSocketTimer();
+        _CheckLoop();
+
+        _RegisterEventList();
+    }
+}
+
+#else
+
+bool EventLoop::_UringInit()
+{
+    printf("io_uring is not supported, use epoll instead\n");
+    return false;
+}
+
+void EventLoop::_UringAddEvent(int fd, uint8_t socket_event, BaseSocket* pSocket) {}
+void EventLoop::_UringRemoveEvent(BaseSocket* pSocket) {}
+int EventLoop::UringRecv(BaseSocket* pSocket, void* buf, int len) { return -1; }
+int EventLoop::UringSend(BaseSocket* pSocket, const struct iovec* iov, int iov_cnt) { return -1; }
+bool EventLoop::UringDeferClose(BaseSocket* pSocket) { return false; }
+void EventLoop::_StartUring(uint32_t wait_timeout) {}
+
+#endif
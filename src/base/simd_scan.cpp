@@ -0,0 +1,189 @@
+/*
+ * simd_scan.cpp
+ */
+
+#include "simd_scan.h"
+#include <limits.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SCAN_USE_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define SCAN_USE_SWAR 1
+#endif
+
+typedef const char* (*scan_crlf_func_t)(const char* buf, int len);
+
+const char* scan_crlf_scalar(const char* buf, int len)
+{
+    const char* end = buf + len - 1; // the last position a "\r\n" can start
+    const char* pos = buf;
+    while (pos < end) {
+        pos = (const char*)memchr(pos, '\r', end - pos);
+        if (!pos) {
+            return NULL;
+        }
+
+        if (pos[1] == '\n') {
+            return pos;
+        }
+        pos++;
+    }
+
+    return NULL;
+}
+
+#ifdef SCAN_USE_X86
+
+// compare every position with '\r' and the next position with '\n' in one pass,
+// so a lonely '\r' in the data do not stop the vector loop
+static const char* scan_crlf_sse2(const char* buf, int len)
+{
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    int i = 0;
+    for (; i + 17 <= len; i += 16) {
+        __m128i cur = _mm_loadu_si128((const __m128i*)(buf + i));
+        __m128i next = _mm_loadu_si128((const __m128i*)(buf + i + 1));
+        int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(cur, cr), _mm_cmpeq_epi8(next, lf)));
+        if (mask) {
+            return buf + i + __builtin_ctz(mask);
+        }
+    }
+
+    return scan_crlf_scalar(buf + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static const char* scan_crlf_avx2(const char* buf, int len)
+{
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    int i = 0;
+    for (; i + 33 <= len; i += 32) {
+        __m256i cur = _mm256_loadu_si256((const __m256i*)(buf + i));
+        __m256i next = _mm256_loadu_si256((const __m256i*)(buf + i + 1));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(cur, cr),
+                                                                         _mm256_cmpeq_epi8(next, lf)));
+        if (mask) {
+            return buf + i + __builtin_ctz(mask);
+        }
+    }
+
+    return scan_crlf_sse2(buf + i, len - i);
+}
+
+static scan_crlf_func_t pick_scan_crlf(const char*& name)
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        name = "avx2";
+        return scan_crlf_avx2;
+    }
+
+    name = "sse2";  // SSE2 is part of x86-64
+    return scan_crlf_sse2;
+}
+
+#else
+
+static scan_crlf_func_t pick_scan_crlf(const char*& name)
+{
+    name = "scalar";
+    return scan_crlf_scalar;
+}
+
+#endif
+
+static const char* g_scan_kernel_name = NULL;
+static scan_crlf_func_t g_scan_crlf = pick_scan_crlf(g_scan_kernel_name);
+
+const char* scan_crlf(const char* buf, int len)
+{
+    return g_scan_crlf(buf, len);
+}
+
+const char* get_scan_kernel_name()
+{
+    return g_scan_kernel_name;
+}
+
+#ifdef SCAN_USE_SWAR
+
+// convert 8 digits with one load and three multiplies, the first digit is in the lowest byte,
+// return false if any of the 8 bytes is not a digit
+static inline bool parse_eight_digits(const char* buf, uint64_t& value)
+{
+    uint64_t chunk;
+    memcpy(&chunk, buf, 8);
+
+    // every byte must be in 0x30-0x3F, and still be in 0x30-0x3F after adding 6
+    if (((chunk & 0xF0F0F0F0F0F0F0F0ULL) | (((chunk + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4))
+        != 0x3333333333333333ULL) {
+        return false;
+    }
+
+    chunk = ((chunk & 0x0F0F0F0F0F0F0F0FULL) * 2561) >> 8;
+    chunk = ((chunk & 0x00FF00FF00FF00FFULL) * 6553601) >> 16;
+    value = ((chunk & 0x0000FFFF0000FFFFULL) * 42949672960001ULL) >> 32;
+    return true;
+}
+
+#endif
+
+int scan_long(const char* buf, int len, long& value)
+{
+    bool negative = false;
+    if ((len > 0) && (buf[0] == '-')) {
+        negative = true;
+        buf++;
+        len--;
+    }
+
+    // 19 digits always fit in uint64_t, the overflow of long is checked at the end
+    if ((len <= 0) || (len > 19)) {
+        return CODE_ERROR;
+    }
+
+    uint64_t result = 0;
+    int i = 0;
+#ifdef SCAN_USE_SWAR
+    // most lengths in the protocol are short, the leading digits go the scalar way, then 8 digits at a time
+    int scalar_len = len % 8;
+#else
+    int scalar_len = len;
+#endif
+    for (; i < scalar_len; ++i) {
+        uint32_t digit = (uint32_t)(uint8_t)buf[i] - '0';
+        if (digit > 9) {
+            return CODE_ERROR;
+        }
+        result = result * 10 + digit;
+    }
+
+#ifdef SCAN_USE_SWAR
+    for (; i < len; i += 8) {
+        uint64_t chunk;
+        if (!parse_eight_digits(buf + i, chunk)) {
+            return CODE_ERROR;
+        }
+        result = result * 100000000ULL + chunk;
+    }
+#endif
+
+    if (negative) {
+        if (result > (uint64_t)LONG_MAX + 1) {
+            return CODE_ERROR;
+        }
+        value = (long)(0 - result);
+    } else {
+        if (result > (uint64_t)LONG_MAX) {
+            return CODE_ERROR;
+        }
+        value = (long)result;
+    }
+
+    return CODE_OK;
+}
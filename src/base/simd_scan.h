@@ -0,0 +1,27 @@
+/*
+ * simd_scan.h
+ *
+ *  delimiter search and integer parsing kernels for the redis protocol parsers,
+ *  x86-64 uses SSE2 or AVX2 (chosen at startup by cpuid), other platforms use the scalar version.
+ *  all kernels are bounded by the length, the buffer do not need a terminating NUL
+ */
+
+#ifndef __BASE_SIMD_SCAN_H__
+#define __BASE_SIMD_SCAN_H__
+
+#include "util.h"
+
+// return the position of the first "\r\n" in [buf, buf + len), or NULL if not found
+const char* scan_crlf(const char* buf, int len);
+
+// the scalar version of scan_crlf(), used on platforms without SIMD and by the benchmark
+const char* scan_crlf_scalar(const char* buf, int len);
+
+// parse a decimal integer which is exactly [buf, buf + len), an optional '-' is allowed,
+// return CODE_OK or CODE_ERROR if there is non digit character or it overflows
+int scan_long(const char* buf, int len, long& value);
+
+// name of the kernel scan_crlf() uses: avx2, sse2 or scalar
+const char* get_scan_kernel_name();
+
+#endif /* __BASE_SIMD_SCAN_H__ */
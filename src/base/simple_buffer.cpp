@@ -6,6 +6,7 @@
  */
 
 #include "simple_buffer.h"
+#include "buffer_pool.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -16,26 +17,35 @@ SimpleBuffer::SimpleBuffer()
 	m_alloc_size = 0;
 	m_write_offset = 0;
     m_read_offset = 0;
+    m_pool = NULL;
 }
 
 SimpleBuffer::~SimpleBuffer()
 {
-    if (m_buffer) {
-		free(m_buffer);
-		m_buffer = NULL;
-	}
-    
-	m_alloc_size = 0;
-	m_write_offset = 0;
-    m_read_offset = 0;
+    Clear();
 }
 
 void SimpleBuffer::Extend(uint32_t len)
 {
-	m_alloc_size = m_write_offset + len;
-	m_alloc_size += m_alloc_size >> 2;	// increase by 1/4 allocate size
-	uchar_t* new_buf = (uchar_t*)realloc(m_buffer, m_alloc_size);
-	m_buffer = new_buf;
+	uint32_t alloc_size = m_write_offset + len;
+    if (!m_pool) {
+        alloc_size += alloc_size >> 2;	// increase by 1/4 allocate size
+        m_alloc_size = alloc_size;
+        m_buffer = (uchar_t*)realloc(m_buffer, m_alloc_size);
+        return;
+    }
+    
+    // size classes already grow by power of 2, only blocks larger than the biggest class need the extra 1/4
+    if (alloc_size > kBufferPoolMaxBlock) {
+        alloc_size += alloc_size >> 2;
+    }
+    uchar_t* new_buf = m_pool->Alloc(alloc_size, alloc_size);
+    if (m_buffer) {
+        memcpy(new_buf, m_buffer, m_write_offset);
+        m_pool->Free(m_buffer, m_alloc_size);
+    }
+    m_buffer = new_buf;
+    m_alloc_size = alloc_size;
 }
 
 uint32_t SimpleBuffer::Write(void* buf, uint32_t len)
@@ -80,10 +90,15 @@ void SimpleBuffer::ResetOffset()
 
 void SimpleBuffer::Clear()
 {
-    m_write_offset = m_read_offset = 0;
-    m_alloc_size = 0;
     if (m_buffer) {
-        free(m_buffer);
+        if (m_pool) {
+            m_pool->Free(m_buffer, m_alloc_size);
+        } else {
+            free(m_buffer);
+        }
         m_buffer = NULL;
     }
+    
+    m_write_offset = m_read_offset = 0;
+    m_alloc_size = 0;
 }
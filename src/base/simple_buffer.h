@@ -10,6 +10,8 @@
 
 #include "ostype.h"
 
+class BufferPool;
+
 class SimpleBuffer
 {
 public:
@@ -25,16 +27,20 @@ public:
     uint32_t GetReadableLen() const { return m_write_offset - m_read_offset; }
 	void IncWriteOffset(uint32_t len) { m_write_offset += len; }
     
+    // memory is borrowed from pool instead of malloc/realloc, must be set when the buffer is empty
+    void SetPool(BufferPool* pool) { m_pool = pool; }
+    
 	void Extend(uint32_t len);
 	uint32_t Write(void* buf, uint32_t len);
 	uint32_t Read(void* buf, uint32_t len);
     void ResetOffset();
-    void Clear();
+    void Clear();   // also return the memory to the pool
 private:
 	uchar_t*	m_buffer;
 	uint32_t	m_alloc_size;
 	uint32_t	m_write_offset;
     uint32_t    m_read_offset;
+    BufferPool* m_pool;
 };
 
 #endif
@@ -61,6 +61,7 @@ public:
 	void Unlock() { pthread_mutex_unlock(&m_mutex); }
 	void Wait() { pthread_cond_wait(&m_cond, &m_mutex); }
 	void Signal() { pthread_cond_signal(&m_cond); }
+	void Broadcast() { pthread_cond_broadcast(&m_cond); }
 private:
 	pthread_mutex_t 	m_mutex;
 	pthread_cond_t 		m_cond;
@@ -0,0 +1,135 @@
+/*
+ * timer_wheel.cpp
+ */
+
+#include "timer_wheel.h"
+#include "util.h"
+
+const uint64_t kRootSize = 1 << kTimerWheelRootBits;
+const uint64_t kRootMask = kRootSize - 1;
+const uint64_t kLevelSize = 1 << kTimerWheelLevelBits;
+const uint64_t kLevelMask = kLevelSize - 1;
+const uint64_t kMaxTimeout = ((uint64_t)1 << (kTimerWheelRootBits + kTimerWheelLevelNum * kTimerWheelLevelBits)) - 1;
+
+void TimerList::PushBack(TimerNode* node)
+{
+    node->prev = m_head.prev;
+    node->next = &m_head;
+    m_head.prev->next = node;
+    m_head.prev = node;
+}
+
+TimerNode* TimerList::PopFront()
+{
+    if (IsEmpty()) {
+        return NULL;
+    }
+
+    TimerNode* node = m_head.next;
+    Unlink(node);
+    return node;
+}
+
+void TimerList::Splice(TimerList& list)
+{
+    if (list.IsEmpty()) {
+        return;
+    }
+
+    TimerNode* first = list.m_head.next;
+    TimerNode* last = list.m_head.prev;
+    first->prev = m_head.prev;
+    m_head.prev->next = first;
+    last->next = &m_head;
+    m_head.prev = last;
+    list.m_head.prev = list.m_head.next = &list.m_head;
+}
+
+void TimerList::Unlink(TimerNode* node)
+{
+    if (!node->IsLinked()) {
+        return;
+    }
+
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node->next = NULL;
+}
+
+///////////////
+TimerWheel::TimerWheel()
+{
+    m_curr_jiffy = get_tick_count() / kTimerWheelJiffy;
+}
+
+void TimerWheel::Add(TimerNode* node, uint64_t expire_tick)
+{
+    TimerList::Unlink(node);
+    // round up, so the timer will never fire earlier than expected
+    node->expire = (expire_tick + kTimerWheelJiffy - 1) / kTimerWheelJiffy;
+    _AddNode(node);
+}
+
+void TimerWheel::Remove(TimerNode* node)
+{
+    TimerList::Unlink(node);
+}
+
+void TimerWheel::Advance(uint64_t curr_tick, TimerList& expired_list)
+{
+    uint64_t target_jiffy = curr_tick / kTimerWheelJiffy;
+    while (m_curr_jiffy <= target_jiffy) {
+        uint64_t index = m_curr_jiffy & kRootMask;
+        if (index == 0) {
+            for (int level = 0; level < kTimerWheelLevelNum; ++level) {
+                if (!_Cascade(level)) {
+                    break;
+                }
+            }
+        }
+
+        expired_list.Splice(m_root[index]);
+        m_curr_jiffy++;
+    }
+}
+
+void TimerWheel::_AddNode(TimerNode* node)
+{
+    if (node->expire < m_curr_jiffy) {
+        node->expire = m_curr_jiffy;
+    } else if (node->expire - m_curr_jiffy > kMaxTimeout) {
+        node->expire = m_curr_jiffy + kMaxTimeout;
+    }
+
+    uint64_t expire = node->expire;
+    uint64_t delta = expire - m_curr_jiffy;
+    if (delta < kRootSize) {
+        m_root[expire & kRootMask].PushBack(node);
+        return;
+    }
+
+    for (int level = 0; level < kTimerWheelLevelNum; ++level) {
+        int shift = kTimerWheelRootBits + (level + 1) * kTimerWheelLevelBits;
+        if ((delta < ((uint64_t)1 << shift)) || (level == kTimerWheelLevelNum - 1)) {
+            int index = (expire >> (shift - kTimerWheelLevelBits)) & kLevelMask;
+            m_levels[level][index].PushBack(node);
+            return;
+        }
+    }
+}
+
+// move all nodes in the current slot of the level to lower levels, return true if the level wraps around,
+// then the upper level need to be cascaded too
+bool TimerWheel::_Cascade(int level)
+{
+    int shift = kTimerWheelRootBits + level * kTimerWheelLevelBits;
+    int index = (m_curr_jiffy >> shift) & kLevelMask;
+
+    TimerList list;
+    list.Splice(m_levels[level][index]);
+    while (TimerNode* node = list.PopFront()) {
+        _AddNode(node);
+    }
+
+    return index == 0;
+}
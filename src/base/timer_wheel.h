@@ -0,0 +1,64 @@
+/*
+ * timer_wheel.h
+ */
+
+#ifndef __BASE_TIMER_WHEEL_H__
+#define __BASE_TIMER_WHEEL_H__
+
+#include "ostype.h"
+
+const uint64_t kTimerWheelJiffy = 10;   // milliseconds of one slot in the lowest level
+const int kTimerWheelRootBits = 8;
+const int kTimerWheelLevelBits = 6;
+const int kTimerWheelLevelNum = 3;      // number of levels above the root level
+
+// intrusive list node, embed it in the object that need a timer
+struct TimerNode {
+    TimerNode*  prev;
+    TimerNode*  next;
+    uint64_t    expire;     // in jiffies
+    void*       data;
+
+    TimerNode() : prev(NULL), next(NULL), expire(0), data(NULL) {}
+    bool IsLinked() { return next != NULL; }
+};
+
+// circular list with a sentinel head
+class TimerList
+{
+public:
+    TimerList() { m_head.prev = m_head.next = &m_head; }
+
+    bool IsEmpty() { return m_head.next == &m_head; }
+    void PushBack(TimerNode* node);
+    TimerNode* PopFront();
+    void Splice(TimerList& list); // move all nodes of list to the tail, list will be empty
+    static void Unlink(TimerNode* node);
+private:
+    TimerNode   m_head;
+};
+
+// hierarchical timing wheel (as the Linux kernel timer), add/remove is O(1), and advance only touches expired slots,
+// nodes in higher levels are cascaded down when the lower level wraps around.
+// the range is about 7.7 days, longer timeout will be clamped to it. not thread safe, used in one event loop
+class TimerWheel
+{
+public:
+    TimerWheel();
+    ~TimerWheel() {}
+
+    void Add(TimerNode* node, uint64_t expire_tick);  // expire_tick in milliseconds, re-add a linked node is fine
+    void Remove(TimerNode* node);
+
+    // move the wheel to curr_tick, all expired nodes are moved to expired_list
+    void Advance(uint64_t curr_tick, TimerList& expired_list);
+private:
+    void _AddNode(TimerNode* node);
+    bool _Cascade(int level);
+private:
+    uint64_t    m_curr_jiffy;   // next jiffy to be processed
+    TimerList   m_root[1 << kTimerWheelRootBits];
+    TimerList   m_levels[kTimerWheelLevelNum][1 << kTimerWheelLevelBits];
+};
+
+#endif
@@ -0,0 +1,257 @@
+/*
+ * uring.cpp
+ */
+
+#include "uring.h"
+#include "util.h"
+
+#ifdef HAVE_IO_URING
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+static int io_uring_setup(uint32_t entries, struct io_uring_params* params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_register(int fd, uint32_t opcode, void* arg, uint32_t nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+Uring::Uring()
+{
+    m_ring_fd = -1;
+    m_sq_ptr = m_cq_ptr = NULL;
+    m_sq_size = m_cq_size = 0;
+    m_sqes = NULL;
+    m_sqes_size = 0;
+    m_sqe_tail = m_sqe_submitted = 0;
+    m_buf_ring = NULL;
+    m_buf_ring_size = 0;
+    m_buf_tail = 0;
+    m_bufs = NULL;
+}
+
+Uring::~Uring()
+{
+    if (m_bufs) {
+        free(m_bufs);
+    }
+
+    if (m_buf_ring) {
+        munmap(m_buf_ring, m_buf_ring_size);
+    }
+
+    if (m_sqes) {
+        munmap(m_sqes, m_sqes_size);
+    }
+
+    if (m_cq_ptr && (m_cq_ptr != m_sq_ptr)) {
+        munmap(m_cq_ptr, m_cq_size);
+    }
+
+    if (m_sq_ptr) {
+        munmap(m_sq_ptr, m_sq_size);
+    }
+
+    if (m_ring_fd != -1) {
+        close(m_ring_fd);
+    }
+}
+
+bool Uring::Init(uint32_t entries)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4;
+
+    m_ring_fd = io_uring_setup(entries, &params);
+    if (m_ring_fd < 0) {
+        printf("io_uring_setup failed, errno=%d\n", errno);
+        m_ring_fd = -1;
+        return false;
+    }
+
+    uint32_t required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if ((params.features & required) != required) {
+        printf("io_uring features not supported: 0x%x\n", params.features);
+        return false;
+    }
+
+    m_sq_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (m_cq_size > m_sq_size) {
+        m_sq_size = m_cq_size;
+    }
+    m_cq_size = m_sq_size;
+
+    m_sq_ptr = mmap(NULL, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQ_RING);
+    if (m_sq_ptr == MAP_FAILED) {
+        m_sq_ptr = NULL;
+        return false;
+    }
+    m_cq_ptr = m_sq_ptr;
+
+    m_sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    m_sqes = (struct io_uring_sqe*)mmap(NULL, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                       m_ring_fd, IORING_OFF_SQES);
+    if (m_sqes == MAP_FAILED) {
+        m_sqes = NULL;
+        return false;
+    }
+
+    char* sq = (char*)m_sq_ptr;
+    m_sq_khead = (uint32_t*)(sq + params.sq_off.head);
+    m_sq_ktail = (uint32_t*)(sq + params.sq_off.tail);
+    m_sq_mask = *(uint32_t*)(sq + params.sq_off.ring_mask);
+    m_sq_entries = *(uint32_t*)(sq + params.sq_off.ring_entries);
+    m_sq_array = (uint32_t*)(sq + params.sq_off.array);
+    m_sqe_tail = m_sqe_submitted = *m_sq_ktail;
+
+    char* cq = (char*)m_cq_ptr;
+    m_cq_khead = (uint32_t*)(cq + params.cq_off.head);
+    m_cq_ktail = (uint32_t*)(cq + params.cq_off.tail);
+    m_cq_mask = *(uint32_t*)(cq + params.cq_off.ring_mask);
+    m_cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    // provided buffer ring for multishot recv
+    m_buf_ring_size = kUringBufCount * sizeof(struct io_uring_buf);
+    m_buf_ring = (struct io_uring_buf_ring*)mmap(NULL, m_buf_ring_size, PROT_READ | PROT_WRITE,
+                                                 MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (m_buf_ring == MAP_FAILED) {
+        m_buf_ring = NULL;
+        return false;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)m_buf_ring;
+    reg.ring_entries = kUringBufCount;
+    reg.bgid = GetBufGroup();
+    if (io_uring_register(m_ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        printf("register provided buffer ring failed, errno=%d\n", errno);
+        return false;
+    }
+
+    m_bufs = (char*)malloc((size_t)kUringBufCount * kUringBufSize);
+    if (!m_bufs) {
+        return false;
+    }
+
+    for (uint16_t bid = 0; bid < kUringBufCount; ++bid) {
+        RecycleBuffer(bid);
+    }
+    CommitBuffers();
+
+    return true;
+}
+
+struct io_uring_sqe* Uring::GetSqe()
+{
+    uint32_t head = __atomic_load_n(m_sq_khead, __ATOMIC_ACQUIRE);
+    if (m_sqe_tail - head >= m_sq_entries) {
+        Submit();
+        head = __atomic_load_n(m_sq_khead, __ATOMIC_ACQUIRE);
+        if (m_sqe_tail - head >= m_sq_entries) {
+            return NULL;
+        }
+    }
+
+    uint32_t index = m_sqe_tail & m_sq_mask;
+    struct io_uring_sqe* sqe = &m_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    m_sq_array[index] = index;
+    m_sqe_tail++;
+    return sqe;
+}
+
+int Uring::Submit()
+{
+    _FlushSq();
+    uint32_t to_submit = m_sqe_tail - m_sqe_submitted;
+    if (to_submit == 0) {
+        return 0;
+    }
+
+    int ret = _Enter(to_submit, 0, 0, NULL, 0);
+    if (ret > 0) {
+        m_sqe_submitted += ret;
+    }
+    return ret;
+}
+
+int Uring::SubmitAndWait(uint32_t timeout_ms)
+{
+    _FlushSq();
+    uint32_t to_submit = m_sqe_tail - m_sqe_submitted;
+    uint32_t min_complete = HasCqe() ? 0 : 1;
+    if ((to_submit == 0) && (min_complete == 0)) {
+        return 0;
+    }
+
+    struct __kernel_timespec ts;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = (uint64_t)&ts;
+
+    int ret = _Enter(to_submit, min_complete, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    if (ret > 0) {
+        m_sqe_submitted += ret;
+    }
+    return ret;
+}
+
+bool Uring::HasCqe()
+{
+    return *m_cq_khead != __atomic_load_n(m_cq_ktail, __ATOMIC_ACQUIRE);
+}
+
+bool Uring::PopCqe(struct io_uring_cqe& cqe)
+{
+    uint32_t head = *m_cq_khead;
+    if (head == __atomic_load_n(m_cq_ktail, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+
+    cqe = m_cqes[head & m_cq_mask];
+    __atomic_store_n(m_cq_khead, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+void Uring::RecycleBuffer(uint16_t bid)
+{
+    // do not use m_buf_ring->bufs, __DECLARE_FLEX_ARRAY adds an empty struct in C++ and moves the array by 8 bytes
+    struct io_uring_buf* buf = (struct io_uring_buf*)m_buf_ring + (m_buf_tail & (kUringBufCount - 1));
+    buf->addr = (uint64_t)GetBuffer(bid);
+    buf->len = kUringBufSize;
+    buf->bid = bid;
+    m_buf_tail++;
+}
+
+void Uring::CommitBuffers()
+{
+    // the tail overlays the resv field of the first buffer
+    __atomic_store_n(&((struct io_uring_buf*)m_buf_ring)->resv, m_buf_tail, __ATOMIC_RELEASE);
+}
+
+int Uring::_Enter(uint32_t to_submit, uint32_t min_complete, uint32_t flags, void* arg, size_t arg_size)
+{
+    int ret = (int)syscall(__NR_io_uring_enter, m_ring_fd, to_submit, min_complete, flags, arg, arg_size);
+    if ((ret < 0) && (errno != EINTR) && (errno != ETIME) && (errno != EBUSY)) {
+        printf("io_uring_enter failed, errno=%d\n", errno);
+    }
+    return ret;
+}
+
+void Uring::_FlushSq()
+{
+    __atomic_store_n(m_sq_ktail, m_sqe_tail, __ATOMIC_RELEASE);
+}
+
+#endif
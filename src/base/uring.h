@@ -0,0 +1,109 @@
+/*
+ * uring.h
+ */
+
+#ifndef __BASE_URING_H__
+#define __BASE_URING_H__
+
+#include "ostype.h"
+#include "simple_buffer.h"
+#include "chain_buffer.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#ifdef IORING_RECV_MULTISHOT
+#define HAVE_IO_URING 1
+#endif
+#endif
+#endif
+
+const uint32_t kUringEntries = 1024;
+const uint32_t kUringBufCount = 256;    // number of provided buffers for multishot recv
+const uint32_t kUringBufSize = 4096;
+const uint32_t kUringMaxPendingSend = 256 * 1024; // send will be blocked if more data are waiting in the queue
+
+// per socket state for the io_uring backend, data received by multishot recv is staged in in_buf
+// until the upper layer calls Recv(), data to send are queued in out_buf and sent by sendmsg
+struct UringSocket {
+    SimpleBuffer    in_buf;
+    bool            eof;            // peer closed or recv failed
+    bool            read_pending;   // OnRead() will be called after this batch of completions
+    bool            recv_armed;
+    ChainBuffer     out_buf;
+    bool            send_queued;    // in the send list of the event loop
+    bool            sending;        // a sendmsg is in flight
+    bool            write_blocked;  // Send() returned 0, OnWrite() will be called when out_buf drains
+    bool            close_pending;  // close the fd after out_buf is sent
+    struct iovec    iov[kChainMaxIovec];
+    struct msghdr   msg;
+
+    UringSocket() : eof(false), read_pending(false), recv_armed(false), send_queued(false), sending(false),
+        write_blocked(false), close_pending(false) {}
+};
+
+#ifdef HAVE_IO_URING
+
+// minimal io_uring wrapper with raw syscalls, the submission and completion queue are only
+// accessed by the thread of the event loop
+class Uring
+{
+public:
+    Uring();
+    ~Uring();
+
+    bool Init(uint32_t entries);
+
+    struct io_uring_sqe* GetSqe();  // submit queued entries first if the submission queue is full
+    int Submit();
+    int SubmitAndWait(uint32_t timeout_ms);
+    bool HasCqe();
+    bool PopCqe(struct io_uring_cqe& cqe);
+
+    uint16_t GetBufGroup() { return 0; }
+    char* GetBuffer(uint16_t bid) { return m_bufs + (uint64_t)bid * kUringBufSize; }
+    void RecycleBuffer(uint16_t bid);
+    void CommitBuffers();   // make the recycled buffers visible to the kernel
+private:
+    int _Enter(uint32_t to_submit, uint32_t min_complete, uint32_t flags, void* arg, size_t arg_size);
+    void _FlushSq();
+private:
+    int         m_ring_fd;
+    void*       m_sq_ptr;
+    size_t      m_sq_size;
+    void*       m_cq_ptr;
+    size_t      m_cq_size;
+    struct io_uring_sqe* m_sqes;
+    size_t      m_sqes_size;
+
+    uint32_t*   m_sq_khead;
+    uint32_t*   m_sq_ktail;
+    uint32_t    m_sq_mask;
+    uint32_t    m_sq_entries;
+    uint32_t*   m_sq_array;
+    uint32_t    m_sqe_tail;     // local tail, published to m_sq_ktail in _FlushSq()
+    uint32_t    m_sqe_submitted;
+
+    uint32_t*   m_cq_khead;
+    uint32_t*   m_cq_ktail;
+    uint32_t    m_cq_mask;
+    struct io_uring_cqe* m_cqes;
+
+    struct io_uring_buf_ring* m_buf_ring;
+    size_t      m_buf_ring_size;
+    uint16_t    m_buf_tail;
+    char*       m_bufs;
+};
+
+#else
+
+// placeholder when io_uring is not available, Init() always fails and the event loop falls back to epoll
+class Uring
+{
+public:
+    bool Init(uint32_t entries) { return false; }
+};
+
+#endif
+
+#endif
@@ -9,7 +9,32 @@
 #include <assert.h>
 #include <math.h>
 
+static thread_local uint64_t t_cached_tick = 0;
+static thread_local bool t_tick_cached = false;
+
 uint64_t get_tick_count()
+{
+    if (t_tick_cached) {
+        return t_cached_tick;
+    }
+    
+    return get_monotonic_us() / 1000;
+}
+
+void update_tick_count()
+{
+    t_cached_tick = get_monotonic_us() / 1000;
+    t_tick_cached = true;
+}
+
+uint64_t get_monotonic_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint64_t get_wall_time_ms()
 {
 	struct timeval tval;
 	gettimeofday(&tval, NULL);
@@ -65,7 +65,14 @@ private:
 	mutex*	mutex_;
 };
 
+// get_tick_count() is a coarse monotonic clock in milliseconds for timers and timeouts, it is cached in the
+// threads that run an event loop and refreshed once every loop iteration, so it is cheap to call for every I/O.
+// get_monotonic_us() is the precise clock for latency measurement,
+// get_wall_time_ms() is the wall clock for TTLs, which are saved in the database and sent to slaves
 uint64_t get_tick_count();
+void update_tick_count();
+uint64_t get_monotonic_us();
+uint64_t get_wall_time_ms();
 
 bool is_valid_ip(const char *ip);
 
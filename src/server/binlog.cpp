@@ -9,6 +9,7 @@
 #include "binlog.h"
 #include "server.h"
 #include "byte_stream.h"
+#include "transaction.h"
 
 uint64_t kMaxPurgeSize = 1000;
 
@@ -127,6 +128,13 @@ void Binlog::Drop()
 
 int Binlog::Store(int db_idx, const string& command)
 {
+    // the binlog of a transaction is stored as one record when it commits
+    Transaction* transaction = get_running_transaction();
+    if (transaction) {
+        transaction->AddBinlog(command);
+        return CODE_OK;
+    }
+    
     bool update_db_idx = false;
     uint64_t update_db_seq = 0;
     
@@ -145,8 +153,8 @@ int Binlog::Store(int db_idx, const string& command)
     uint64_t cmd_seq = ++max_seq_;
     mtx_.unlock();
     
+    rocksdb::WriteBatch batch;
     if (update_db_idx) {
-        rocksdb::WriteBatch batch;
         batch.Put("CUR_DB_IDX", to_string(db_idx));
         
         string select_key = EncodeKey(update_db_seq);
@@ -155,16 +163,14 @@ int Binlog::Store(int db_idx, const string& command)
         build_request(select_cmd_vec, select_command);
         
         batch.Put(select_key, select_command);
-        
-        string key = EncodeKey(cmd_seq);
-        batch.Put(key, command);
-        
-        db_->Write(g_server.write_option, &batch);
-    } else {
-        string key = EncodeKey(cmd_seq);
-        db_->Put(g_server.write_option, key, command);
     }
     
+    string key = EncodeKey(cmd_seq);
+    batch.Put(key, command);
+    
+    // the binlog of concurrent commands is written in groups too
+    commit_.Write(db_, &batch);
+    
     return CODE_OK;
 }
 
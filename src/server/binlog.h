@@ -11,6 +11,7 @@
 
 #include "util.h"
 #include "thread_pool.h"
+#include "group_commit.h"
 #include "rocksdb/db.h"
 
 class Binlog {
@@ -29,6 +30,7 @@ public:
     int GetCurDbIdx() { return cur_db_idx_; }
     uint64_t GetMinSeq() { return min_seq_; }
     uint64_t GetMaxSeq() { return max_seq_; }
+    GroupCommit& GetGroupCommit() { return commit_; }
 private:
     void GenerateBinlogId();
     string EncodeKey(uint64_t seq);
@@ -41,6 +43,7 @@ private:
     uint64_t        min_seq_;
     uint64_t        max_seq_;
     bool            empty_;
+    GroupCommit     commit_;
 };
 
 class PurgeBinlogThread : public Thread {
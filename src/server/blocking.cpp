@@ -0,0 +1,328 @@
+//
+//  blocking.cpp
+//  kedis
+//
+
+#include "blocking.h"
+#include "client_conn.h"
+#include "simple_log.h"
+#include <algorithm>
+
+// the clients blocked on a key of a db in the order they blocked, all guarded by one mutex,
+// since only the commands adding elements to a key with blocked clients take it
+static mutex g_block_mutex;
+static map<pair<int, string>, list<ClientConn*>> g_wait_queues;
+static atomic<int> g_blocked_client_count(0);
+
+// the clients woken up by a command and the clients woken up by them, the connection of the command replies
+// after all of them run their requests again. the fields are guarded by the mutex of the wait queues
+struct WakeGroup {
+    ClientConn* conn;       // the connection of the command, NULL after it closes
+    int         pending;    // woken clients that have not run their requests again
+    bool        parked;     // the connection waits in its io thread, the group holds a reference of it
+
+    WakeGroup(ClientConn* c) : conn(c), pending(0), parked(false) {}
+};
+
+// the connection running a command in this thread, the clients it wakes up join its group
+static thread_local ClientConn* t_waking_conn = NULL;
+
+static void join_wake_group(ClientConn* conn)
+{
+    if (!t_waking_conn) {
+        return;
+    }
+
+    // a woken client running its request again adds the clients it wakes up to the group it is in
+    BlockState* waking_state = t_waking_conn->GetBlockState();
+    WakeGroup* group = waking_state->woken_by;
+    if (!group) {
+        if (!waking_state->waking) {
+            waking_state->waking = new WakeGroup(t_waking_conn);
+        }
+        group = waking_state->waking;
+    }
+
+    // a client woken up again while it is in a group is not waited for twice
+    BlockState* block_state = conn->GetBlockState();
+    if (!block_state->woken_by) {
+        block_state->woken_by = group;
+        group->pending++;
+    }
+}
+
+static void leave_wake_group(BlockState* block_state)
+{
+    WakeGroup* group = block_state->woken_by;
+    block_state->woken_by = NULL;
+    if (--group->pending > 0) {
+        return;
+    }
+
+    // a group not parked yet is deleted when its connection parks
+    if (group->parked) {
+        // the reference added when the connection parked goes with the resume event
+        group->conn->GetBlockState()->waking = NULL;
+        group->conn->PostResume();
+        delete group;
+    } else if (!group->conn) {
+        delete group;
+    }
+}
+
+// wake up the first client of the key that is not woken up yet, which pops the element or finds it taken,
+// a served client wakes up the next one, so the clients are not woken up all at once for one element
+static void signal_key_locked(int db_idx, const string& key)
+{
+    auto it = g_wait_queues.find(make_pair(db_idx, key));
+    if (it == g_wait_queues.end()) {
+        return;
+    }
+
+    for (ClientConn* conn : it->second) {
+        BlockState* block_state = conn->GetBlockState();
+        if (block_state->state == BLOCK_RUNNING) {
+            block_state->state = BLOCK_READY;
+            join_wake_group(conn);
+            return;
+        } else if (block_state->state == BLOCK_PARKED) {
+            // the reference added when the connection parked goes with the resume event
+            block_state->state = BLOCK_WAKING;
+            join_wake_group(conn);
+            conn->PostResume();
+            return;
+        }
+    }
+}
+
+bool get_block_timeout(ClientConn* conn, const string& timeout_str, uint64_t& timeout_ms)
+{
+    long timeout;
+    if (get_long_from_string(timeout_str, timeout) == CODE_ERROR) {
+        conn->SendError("timeout is not an integer or out of range");
+        return false;
+    }
+
+    if (timeout < 0) {
+        conn->SendError("timeout is negative");
+        return false;
+    }
+
+    // a timeout of more than a hundred years blocks forever
+    timeout_ms = (timeout < 100L * 365 * 24 * 3600) ? (uint64_t)timeout * 1000 : 0;
+    return true;
+}
+
+// remove the client from the wait queues, return true if the reference of a parked connection should be released
+static bool unblock_client_locked(ClientConn* conn, BlockState* block_state)
+{
+    for (const string& key : block_state->keys) {
+        auto it = g_wait_queues.find(make_pair(block_state->db_idx, key));
+        if (it != g_wait_queues.end()) {
+            it->second.remove(conn);
+            if (it->second.empty()) {
+                g_wait_queues.erase(it);
+            }
+        }
+    }
+
+    // the element of a ready key may be left for the next client, since this one is served by another key,
+    // or gets an error, or times out, or closes
+    for (const string& key : block_state->keys) {
+        signal_key_locked(block_state->db_idx, key);
+    }
+
+    // the reference of a waking connection is released after OnResume()
+    bool parked = (block_state->state == BLOCK_PARKED);
+    block_state->state = BLOCK_NONE;
+    g_blocked_client_count--;
+    return parked;
+}
+
+bool block_client(ClientConn* conn, const vector<string>& keys, uint64_t timeout_ms)
+{
+    if (!conn->CanBlock()) {
+        return false;
+    }
+
+    BlockState* block_state = conn->GetBlockState();
+    lock_guard<mutex> lock(g_block_mutex);
+    if (block_state->state == BLOCK_NONE) {
+        block_state->db_idx = conn->GetDBIndex();
+        block_state->deadline = timeout_ms ? get_tick_count() + timeout_ms : 0;
+        block_state->keys.clear();
+        for (const string& key : keys) {
+            if (find(block_state->keys.begin(), block_state->keys.end(), key) == block_state->keys.end()) {
+                block_state->keys.push_back(key);
+                g_wait_queues[make_pair(block_state->db_idx, key)].push_back(conn);
+            }
+        }
+        g_blocked_client_count++;
+    } else if (block_state->deadline && (get_tick_count() >= block_state->deadline)) {
+        unblock_client_locked(conn, block_state);   // not parked while the request runs
+        return false;
+    }
+
+    // a key signaled before the request locked the keys has nothing left for it
+    block_state->state = BLOCK_RUNNING;
+    conn->SetBlocked();
+    return true;
+}
+
+bool is_client_blocked(ClientConn* conn)
+{
+    BlockState* block_state = conn->GetBlockState(false);
+    if (!block_state) {
+        return false;
+    }
+
+    lock_guard<mutex> lock(g_block_mutex);
+    return block_state->state != BLOCK_NONE;
+}
+
+void unblock_client(ClientConn* conn)
+{
+    BlockState* block_state = conn->GetBlockState(false);
+    if (!block_state) {
+        return;
+    }
+
+    bool parked = false;
+    {
+        lock_guard<mutex> lock(g_block_mutex);
+        if (block_state->state == BLOCK_NONE) {
+            return;
+        }
+        parked = unblock_client_locked(conn, block_state);
+    }
+
+    if (parked) {
+        conn->ReleaseRef();
+    }
+}
+
+void signal_key_ready(int db_idx, const string& key)
+{
+    // the client registers with the key locked, so it is seen here if it blocks before the change
+    if (g_blocked_client_count == 0) {
+        return;
+    }
+
+    lock_guard<mutex> lock(g_block_mutex);
+    signal_key_locked(db_idx, key);
+}
+
+bool park_blocked_client(ClientConn* conn)
+{
+    BlockState* block_state = conn->GetBlockState();
+    lock_guard<mutex> lock(g_block_mutex);
+    if (block_state->state == BLOCK_READY) {
+        block_state->state = BLOCK_RUNNING;
+        return false;
+    }
+
+    if (block_state->state == BLOCK_RUNNING) {
+        conn->AddRef();
+        block_state->state = BLOCK_PARKED;
+    }
+    return true;
+}
+
+bool resume_blocked_client(ClientConn* conn, bool timeout)
+{
+    BlockState* block_state = conn->GetBlockState();
+    {
+        lock_guard<mutex> lock(g_block_mutex);
+        if (block_state->state != (timeout ? BLOCK_PARKED : BLOCK_WAKING)) {
+            return false;
+        }
+        block_state->state = BLOCK_RUNNING;
+    }
+
+    if (timeout) {
+        conn->ReleaseRef();
+    }
+    return true;
+}
+
+bool begin_wake_command(ClientConn* conn)
+{
+    if (t_waking_conn) {
+        return false;
+    }
+
+    t_waking_conn = conn;
+    return true;
+}
+
+bool end_wake_command(ClientConn* conn)
+{
+    t_waking_conn = NULL;
+    BlockState* block_state = conn->GetBlockState(false);
+    if (!block_state) {
+        return false;
+    }
+
+    lock_guard<mutex> lock(g_block_mutex);
+    // a ready client runs the request again after this one returns
+    if (block_state->woken_by && (block_state->state != BLOCK_READY)) {
+        leave_wake_group(block_state);
+    }
+
+    WakeGroup* group = block_state->waking;
+    if (group && (group->pending == 0)) {
+        block_state->waking = NULL;
+        delete group;
+        return false;
+    }
+    return group != NULL;
+}
+
+bool park_waking_client(ClientConn* conn)
+{
+    BlockState* block_state = conn->GetBlockState();
+    lock_guard<mutex> lock(g_block_mutex);
+    WakeGroup* group = block_state->waking;
+    if (!group) {
+        return false;
+    }
+
+    if (group->pending == 0) {
+        block_state->waking = NULL;
+        delete group;
+        return false;
+    }
+
+    conn->AddRef();
+    group->parked = true;
+    return true;
+}
+
+void close_wake_groups(ClientConn* conn)
+{
+    BlockState* block_state = conn->GetBlockState(false);
+    if (!block_state) {
+        return;
+    }
+
+    lock_guard<mutex> lock(g_block_mutex);
+    if (block_state->woken_by) {
+        leave_wake_group(block_state);
+    }
+
+    // a parked connection is resumed and released when the group is done
+    WakeGroup* group = block_state->waking;
+    if (group && !group->parked) {
+        block_state->waking = NULL;
+        if (group->pending == 0) {
+            delete group;
+        } else {
+            group->conn = NULL;
+        }
+    }
+}
+
+int get_blocked_client_count()
+{
+    return g_blocked_client_count;
+}
@@ -0,0 +1,86 @@
+//
+//  blocking.h
+//  kedis
+//
+
+#ifndef __BLOCKING_H__
+#define __BLOCKING_H__
+
+#include "util.h"
+
+class ClientConn;
+struct WakeGroup;
+
+/*
+ * BLPOP/BRPOP/BRPOPLPUSH/BLMOVE/BZPOPMIN/BZPOPMAX block the client when none of the keys has an element.
+ * the handler registers the client in the wait queues of the keys with the keys locked, the request is left in
+ * the input buffer of the connection, which processes no more requests until it is woken up.
+ * a command adding elements to a key wakes up the first client waiting for the key that is not woken up yet,
+ * the io thread of the client runs the request again, so the clients are served in the order they blocked,
+ * and a served client wakes up the next one. the timeout is checked by the timer of the connection.
+ * like redis, the woken clients are served before the command adding the elements replies: the connection
+ * of the command holds its replies and processes no more requests until the clients it woke up, and the clients
+ * woken up by them, have run their requests again, so the reply of the command sees the moves they did.
+ * a blocking command in a transaction, in a script or from the master replies the null reply at once,
+ * the binlog has the non-blocking version of the command, so a slave never blocks
+ */
+
+enum {
+    BLOCK_NONE = 0,
+    BLOCK_RUNNING,  // registered, the request is running
+    BLOCK_READY,    // a key is ready while the request is running, it runs again after it returns
+    BLOCK_PARKED,   // the connection waits in its io thread, the wait queue holds a reference of it
+    BLOCK_WAKING,   // OnResume() of the connection is posted to its io thread
+};
+
+// the fields except keys are guarded by the mutex of the wait queues
+struct BlockState {
+    int             state;  // BLOCK_XXX
+    int             db_idx;
+    vector<string>  keys;   // unique
+    uint64_t        deadline;   // tick count of the timeout, 0 blocks forever
+    WakeGroup*      woken_by;   // the group of the command that woke up the client, left after the request runs again
+    WakeGroup*      waking;     // the group of the clients woken up by the last command of the connection
+
+    BlockState() : state(BLOCK_NONE), db_idx(0), deadline(0), woken_by(NULL), waking(NULL) {}
+};
+
+// the timeout in seconds of a blocking command, the error is replied if it is invalid
+bool get_block_timeout(ClientConn* conn, const string& timeout_str, uint64_t& timeout_ms);
+
+// called by the handler with the keys locked if none of the keys has an element, return false if the client can not
+// block or the timeout is reached, then the handler replies the null reply
+bool block_client(ClientConn* conn, const vector<string>& keys, uint64_t timeout_ms);
+
+// return true if the client is in the wait queues, so the request runs again after it is woken up or times out
+bool is_client_blocked(ClientConn* conn);
+
+// called by the handler with the keys locked when the request is served or fails, and when the connection closes
+void unblock_client(ClientConn* conn);
+
+// called after elements are added to the key, with the key locked, so a client blocking after that finds them
+void signal_key_ready(int db_idx, const string& key);
+
+// called in the io thread after the request blocked, return false if a key is ready meanwhile,
+// then the request should run again
+bool park_blocked_client(ClientConn* conn);
+
+// called in the io thread, by OnResume() after the client is woken up by a key, or by the timer after the timeout,
+// return false if the client is not parked for it, the request runs again if true is returned
+bool resume_blocked_client(ClientConn* conn, bool timeout);
+
+// called around a command of a normal client, return true from end_wake_command() if the clients woken up by the command
+// are not served yet, then the connection holds its replies. the commands called by EXEC or a script are not counted
+bool begin_wake_command(ClientConn* conn);
+bool end_wake_command(ClientConn* conn);
+
+// called in the io thread after end_wake_command() returns true, return false if the woken clients are served meanwhile,
+// otherwise OnResume() is posted when they are served
+bool park_waking_client(ClientConn* conn);
+
+// called when the connection closes, the commands waiting for it stop counting it
+void close_wake_groups(ClientConn* conn);
+
+int get_blocked_client_count();
+
+#endif /* __BLOCKING_H__ */
@@ -12,18 +12,63 @@
 #include "cmd_db.h"
 #include "replication.h"
 #include "slowlog.h"
-#include <algorithm>
-#include <ctype.h>
+#include "migrate.h"
+#include "storage_pool.h"
+#include "sliced_command.h"
+#include "read_coalesce.h"
+#include "transaction.h"
+#include "blocking.h"
 using namespace std;
 
+class StorageTask : public Task {
+public:
+    StorageTask(ClientConn* conn) : conn_(conn) {}
+    virtual ~StorageTask() {}
+    
+    virtual void run() { conn_->RunStorageRequests(); }
+private:
+    ClientConn* conn_;
+};
+
+// the serialized value of a big RESTORE is decoded while it is received
+static RedisBulkSink* create_bulk_sink(const vector<string>& args, long argc, void* data)
+{
+    if ((argc == 4) && (args.size() == 3) && !strcasecmp(args[0].c_str(), "RESTORE")) {
+        ClientConn* conn = (ClientConn*)data;
+        return new RestoreDecoder(conn->GetDBIndex());
+    }
+    return nullptr;
+}
+
 ClientConn::ClientConn()
 {
     ++g_server.client_num;
     db_index_ = 0;
     authenticated_ = false;
+    state_ = CONN_STATE_IDLE;
+    flag_ = CLIENT_NORMAL;
     slave_port_ = 0;
     sync_seq_ = 0;
     repl_snapshot_ = nullptr;
+    obuf_soft_limit_reached_tick_ = 0;
+    throttled_ = false;
+    deferring_array_ = false;
+    cur_req_buf_ = NULL;
+    cur_req_len_ = 0;
+    big_request_.SetSinkCreator(create_bulk_sink, this);
+    executing_ = false;
+    exec_big_request_ = false;
+    exec_len_ = 0;
+    read_pending_ = false;
+    close_pending_ = false;
+    sliced_cmd_ = NULL;
+    yielding_ = false;
+    coalescing_ = false;
+    transaction_ = NULL;
+    call_args_ = NULL;
+    blocked_ = false;
+    block_state_ = NULL;
+    waking_ = false;
 }
 
 ClientConn::~ClientConn()
@@ -32,13 +77,27 @@ ClientConn::~ClientConn()
     if (repl_snapshot_) {
         delete repl_snapshot_;
     }
+    if (sliced_cmd_) {
+        delete sliced_cmd_;
+    }
+    if (transaction_) {
+        delete transaction_;
+    }
+    if (block_state_) {
+        delete block_state_;
+    }
 }
 
 void ClientConn::Close()
 {
-    if (!pipeline_response_.empty()) {
-        Send((char*)pipeline_response_.data(), (int)pipeline_response_.size());
-        pipeline_response_.clear();
+    // the storage thread owns the response and the input buffer now, close after it returns
+    if (executing_) {
+        close_pending_ = true;
+        return;
+    }
+    
+    if (!pipeline_response_.IsEmpty()) {
+        Send(pipeline_response_);
     }
     
     if (flag_ == CLIENT_MASTER) {
@@ -52,6 +111,8 @@ void ClientConn::Close()
         g_server.slave_mutex.unlock();
     }
     
+    unblock_client(this);
+    close_wake_groups(this);
     BaseConn::Close();
 }
 
@@ -96,10 +157,14 @@ void ClientConn::OnConfirm()
 
 void ClientConn::OnRead()
 {
-    _RecvData();
+    // the arguments of the running requests point into m_in_buf, so it can not grow now
+    // a yielding connection reads after it resumes, so a client sending faster than it is served waits in the socket
+    if (executing_ || yielding_ || coalescing_) {
+        read_pending_ = true;
+        return;
+    }
     
-    // when parse redis protocol, this makes sure searching string pattern will not pass the boundary
-    m_in_buf.GetWriteBuffer()[0] = 0;
+    _RecvData();
 
     if (state_ <= CONN_STATE_RECV_PSYNC) {
         RedisReply reply;
@@ -150,22 +215,148 @@ void ClientConn::OnRead()
         }
     }
     
+    _ProcessRequests();
+}
+
+void ClientConn::OnWrite()
+{
+    BaseConn::OnWrite();
+    if (executing_ || _CheckOutputBufferLimit()) {
+        return;
+    }
+    
+    if (throttled_) {
+        ClientBufferLimit* limit = _GetOutputBufferLimit();
+        if (!limit->soft_limit_bytes || (GetOutputBufferLen() < limit->soft_limit_bytes)) {
+            _ProcessRequests();
+        }
+    }
+}
+
+void ClientConn::_ProcessRequests()
+{
+    // a running command keeps the order, the following requests wait in m_in_buf
+    if (executing_ || yielding_ || coalescing_ || blocked_ || waking_) {
+        return;
+    }
+    
+    uint64_t start_us = g_server.command_time_slice ? get_monotonic_us() : 0;
+    int handled = 0;    // at least one request is handled each time, or a slice shorter than parsing never ends
+    int quota = (flag_ == CLIENT_NORMAL) ? g_server.client_command_quota : 0;
+    throttled_ = false;
+    ClientBufferLimit* limit = _GetOutputBufferLimit();
     while (true) {
-        vector<string> cmd_vec;
+        // a pipeline generating responses faster than the client reads them pauses at the soft limit,
+        // the remaining requests are processed in OnWrite() after the output buffer drains
+        if ((flag_ == CLIENT_NORMAL) && limit->soft_limit_bytes &&
+            (GetOutputBufferLen() + pipeline_response_.GetReadableLen() >= limit->soft_limit_bytes)) {
+            Send(pipeline_response_);
+            if (_CheckOutputBufferLimit()) {
+                return;
+            }
+            
+            if (GetOutputBufferLen() >= limit->soft_limit_bytes) {
+                throttled_ = true;
+                break;
+            }
+        }
+        
+        // the arguments point into m_in_buf, the request is consumed after the command completes
+        vector<rocksdb::Slice> arg_vec;
+        vector<string> inline_args;
         string err_msg;
-        int ret = parse_redis_request((const char*)m_in_buf.GetReadBuffer(), m_in_buf.GetReadableLen(), cmd_vec, err_msg);
+        int ret = 0;
+        if (!big_request_.IsStarted()) {
+            ret = parse_redis_request((const char*)m_in_buf.GetReadBuffer(), m_in_buf.GetReadableLen(), arg_vec,
+                                      inline_args, err_msg);
+        }
+        
+        if ((ret == 0) && !coalescing_) {
+            // a request with big bulk arguments is consumed from m_in_buf as it arrives,
+            // instead of waiting in m_in_buf until the whole request is received
+            ret = big_request_.Feed((const char*)m_in_buf.GetReadBuffer(), m_in_buf.GetReadableLen(), err_msg);
+            if (ret > 0) {
+                m_in_buf.Read(NULL, ret);
+                if (!big_request_.IsComplete()) {
+                    m_in_buf.ResetOffset();
+                    break;
+                }
+                
+                cur_req_buf_ = NULL;
+                if (_StartStorageTask(big_request_.GetArgs(), true)) {
+                    return;
+                }
+                
+                _HandleRedisCommand(big_request_.GetArgs());
+                handled++;
+                big_request_.Reset();
+                if (waking_) {
+                    break;
+                }
+                _FlushStreamReply();
+                continue;
+            }
+        }
+        
         if (ret > 0) {
-            if (!cmd_vec.empty()) {
+            if (!arg_vec.empty()) {
                 // save the request here, so it will not need to rebuild the command when storing binlog
                 cur_req_buf_ = (char*)m_in_buf.GetReadBuffer();
                 cur_req_len_ = ret;
                 
-                string& cmd = cmd_vec[0];
-                transform(cmd.begin(), cmd.end(), cmd.begin(), ::toupper);
+                // a slow command after the time slice is used up waits for the next loop iteration,
+                // so does any command after the client used up its quota
+                bool over_quota = quota && (handled >= quota);
+                KedisCommand* read_cmd = over_quota ? NULL : _LookupCoalescedRead(arg_vec);
+                if (coalescing_ && !read_cmd) {
+                    // the request waits until the reads before it are answered
+                    m_in_buf.ResetOffset();
+                    break;
+                }
+                
+                if (over_quota || (handled && _IsSliceUsedUp(arg_vec, start_us))) {
+                    if (over_quota) {
+                        g_stat.deferred_pipelines++;
+                    }
+                    m_in_buf.ResetOffset();
+                    _YieldToLoop();
+                    break;
+                }
+                
+                // the following point reads of the connection join the same batch
+                if (read_cmd) {
+                    add_coalesced_read(this, read_cmd, arg_vec);
+                    coalescing_ = true;
+                    handled++;
+                    m_in_buf.Read(NULL, ret);
+                    continue;
+                }
+                
+                // the responses of the requests before are left in pipeline_response_, to be sent together
+                if (_StartStorageTask(arg_vec, false)) {
+                    return;
+                }
                 
-                _HandleRedisCommand(cmd_vec);
+                _HandleRedisCommand(arg_vec);
+                handled++;
+                if (blocked_) {
+                    m_in_buf.ResetOffset();
+                    break;
+                }
             }
             m_in_buf.Read(NULL, ret);
+            
+            if (waking_) {
+                break;
+            }
+            
+            if (sliced_cmd_) {
+                _YieldToLoop();
+                break;
+            }
+            
+            // responses of a long pipeline are sent in batches instead of all at the end
+            _FlushStreamReply();
         } else if (ret < 0) {
             SendError(err_msg);
             Close();
@@ -177,19 +368,62 @@ void ClientConn::OnRead()
         }
     }
     
-    if (!pipeline_response_.empty()) {
-        Send((char*)pipeline_response_.data(), (int)pipeline_response_.size());
-        pipeline_response_.clear();
+    // the replies wait until the clients woken up by the last request are served
+    if (waking_) {
+        _ParkWakingClient();
+        return;
+    }
+    
+    if (!pipeline_response_.IsEmpty()) {
+        Send(pipeline_response_);
+    }
+    if (!_CheckOutputBufferLimit() && blocked_) {
+        _ParkBlockedClient();
     }
 }
 
 void ClientConn::OnTimer(uint64_t curr_tick)
 {
+    if (executing_ || yielding_ || coalescing_ || waking_) {
+        SetTimer(1000);
+        return;
+    }
+    
+    if (_CheckOutputBufferLimit()) {
+        return;
+    }
+    
     if (flag_ == CLIENT_NORMAL) {
-        if (g_server.client_timeout && (curr_tick > m_last_recv_tick + g_server.client_timeout * 1000)) {
-            log_message(kLogLevelDebug, "client timeout %s:%d\n", m_peer_ip.c_str(), m_peer_port);
-            Close();
+        // idle client only wakes up when it may timeout, the check interval is limited,
+        // so the change of timeout by CONFIG SET will take effect in time
+        uint64_t delay = kClientTimerMaxInterval;
+        if (blocked_) {
+            // a blocked client is not idle, the request replies the null reply when it runs after the timeout
+            uint64_t deadline = block_state_->deadline;
+            if (deadline && (curr_tick >= deadline)) {
+                if (resume_blocked_client(this, true)) {
+                    blocked_ = false;
+                    _YieldToLoop();
+                }
+            } else if (deadline) {
+                delay = min(delay, deadline - curr_tick);
+            }
+        } else if (g_server.client_timeout) {
+            uint64_t expire_tick = m_last_recv_tick + g_server.client_timeout * 1000;
+            if (curr_tick > expire_tick) {
+                log_message(kLogLevelDebug, "client timeout %s:%d\n", m_peer_ip.c_str(), m_peer_port);
+                Close();
+                return;
+            }
+            
+            delay = min(delay, expire_tick - curr_tick + 1);
+        }
+        
+        if (obuf_soft_limit_reached_tick_) {
+            delay = min(delay, (uint64_t)1000); // check the soft limit of output buffer every second
         }
+        
+        SetTimer(delay);
     } else {
         // master/slave connection must send heartbeat packet
         if (!IsOpen()) {
@@ -249,6 +483,429 @@ void ClientConn::OnLoop()
         
         Send((char*)command.data(), (int)command.size());
     }
+    
+    _CheckOutputBufferLimit();
+}
+
+// only normal clients without pending responses can be moved to another io thread,
+// slaves and masters have replication state bound to the current thread
+bool ClientConn::IsMovable()
+{
+    return (flag_ == CLIENT_NORMAL) && (state_ == CONN_STATE_CONNECTED) && pipeline_response_.IsEmpty() && !throttled_ &&
+        !executing_ && !yielding_ && !coalescing_ && !blocked_ && !waking_;
+}
+
+void ClientConn::OnResume()
+{
+    if (coalescing_) {
+        // the reads in the batch are answered
+        coalescing_ = false;
+    } else if (yielding_) {
+        yielding_ = false;
+    } else if (blocked_ && !executing_) {
+        // a key of the blocked request is ready, the request runs again
+        if (resume_blocked_client(this, false)) {
+            blocked_ = false;
+        }
+    } else if (waking_ && !executing_) {
+        // the clients woken up by the last request are served, the replies are sent with the following requests
+        waking_ = false;
+    } else {
+        // back from a storage thread
+        executing_ = false;
+        if (exec_big_request_) {
+            exec_big_request_ = false;
+            big_request_.Reset();
+        } else {
+            m_in_buf.Read(NULL, exec_len_);
+        }
+        exec_len_ = 0;
+        
+        if (close_pending_) {
+            close_pending_ = false;
+            Close();
+        }
+    }
+    
+    if (!IsOpen()) {
+        delete sliced_cmd_;
+        sliced_cmd_ = NULL;
+        return;
+    }
+    
+    if (sliced_cmd_) {
+        if (g_storage_pool.IsEnabled() && (flag_ == CLIENT_NORMAL)) {
+            // the next slice goes to the end of the storage queue, behind the tasks of other connections
+            _DispatchStorageTask(false);
+            if (!pipeline_response_.IsEmpty()) {
+                Send(pipeline_response_);
+            }
+            return;
+        }
+        
+        _RunSlicedCommand();
+        if (sliced_cmd_) {
+            _YieldToLoop();
+            _CheckOutputBufferLimit();
+            return;
+        }
+    }
+    
+    if (blocked_) {
+        _ParkBlockedClient();
+    } else if (waking_) {
+        _ParkWakingClient();
+    }
+    
+    // continue with the requests left, and the data received while executing
+    if (read_pending_) {
+        read_pending_ = false;
+        OnRead();
+    } else {
+        _ProcessRequests();
+    }
+    ReleaseIdleBuffer();
+}
+
+bool ClientConn::_StartStorageTask(const vector<rocksdb::Slice>& arg_vec, bool big_request)
+{
+    // the replication stream from master is applied in the io thread, so its order with the heartbeat is kept
+    if (!g_storage_pool.IsEnabled() || (flag_ != CLIENT_NORMAL)) {
+        return false;
+    }
+    
+    KedisCommand* kedis_cmd = lookup_command(arg_vec[0]);
+    if (!kedis_cmd || (kedis_cmd->exec != CMD_EXEC_STORAGE)) {
+        return false;
+    }
+    
+    // the requests after MULTI are queued in the io thread
+    if (_IsQueuing() && (kedis_cmd->proc != exec_command)) {
+        return false;
+    }
+    
+    _DispatchStorageTask(big_request);
+    return true;
+}
+
+void ClientConn::_DispatchStorageTask(bool big_request)
+{
+    executing_ = true;
+    exec_big_request_ = big_request;
+    exec_len_ = 0;
+    AddRef();   // released after OnResume()
+    g_storage_pool.AddTask(new StorageTask(this));
+}
+
+void ClientConn::RunSlicedCommand(SlicedCommand* cmd)
+{
+    sliced_cmd_ = cmd;
+    _RunSlicedCommand();
+}
+
+void ClientConn::_RunSlicedCommand()
+{
+    // replication streams are applied as a whole, so are the commands of a transaction or a script,
+    // which hold the key locks
+    bool in_transaction = (get_running_transaction() != NULL);
+    uint64_t deadline_us = UINT64_MAX;
+    if (g_server.command_time_slice && (flag_ == CLIENT_NORMAL) && !in_transaction) {
+        deadline_us = get_monotonic_us() + g_server.command_time_slice;
+    }
+    
+    while (!sliced_cmd_->RunSlice(this, deadline_us)) {
+        if (!in_transaction) {
+            return;
+        }
+    }
+    
+    delete sliced_cmd_;
+    sliced_cmd_ = NULL;
+}
+
+void ClientConn::_YieldToLoop()
+{
+    // the command closed the connection
+    if (!IsOpen()) {
+        delete sliced_cmd_;
+        sliced_cmd_ = NULL;
+        return;
+    }
+    
+    if (!pipeline_response_.IsEmpty()) {
+        Send(pipeline_response_);
+    }
+    
+    yielding_ = true;
+    Yield();
+}
+
+bool ClientConn::_IsSliceUsedUp(const vector<rocksdb::Slice>& arg_vec, uint64_t start_us)
+{
+    // fast commands always run, the time slice only limits a pipeline of slow commands
+    if (!start_us || (flag_ != CLIENT_NORMAL)) {
+        return false;
+    }
+    
+    KedisCommand* kedis_cmd = lookup_command(arg_vec[0]);
+    if (!kedis_cmd || (kedis_cmd->cost != CMD_COST_SLOW)) {
+        return false;
+    }
+    
+    return get_monotonic_us() >= start_us + g_server.command_time_slice;
+}
+
+KedisCommand* ClientConn::_LookupCoalescedRead(const vector<rocksdb::Slice>& arg_vec)
+{
+    // a request before AUTH runs by itself to get the error, a request after MULTI is queued
+    if (!g_server.read_coalesce || (flag_ != CLIENT_NORMAL) || (!g_server.require_pass.empty() && !authenticated_) ||
+        _IsQueuing()) {
+        return NULL;
+    }
+    
+    KedisCommand* kedis_cmd = lookup_command(arg_vec[0]);
+    if (!kedis_cmd || !can_coalesce_read(kedis_cmd, arg_vec)) {
+        return NULL;
+    }
+    return kedis_cmd;
+}
+
+bool ClientConn::_IsQueuing()
+{
+    return transaction_ && transaction_->IsStarted();
+}
+
+void ClientConn::_RejectCommand(const string& error_msg)
+{
+    if (_IsQueuing()) {
+        transaction_->Abort();
+    }
+    SendError(error_msg);
+}
+
+bool ClientConn::CanBlock()
+{
+    // a transaction or a script holds the key locks, the master stream and a big request can not be run again
+    return (flag_ == CLIENT_NORMAL) && !get_running_transaction() && !call_args_ && !big_request_.IsStarted();
+}
+
+BlockState* ClientConn::GetBlockState(bool create)
+{
+    if (!block_state_ && create) {
+        block_state_ = new BlockState();
+    }
+    return block_state_;
+}
+
+void ClientConn::_ParkWakingClient()
+{
+    if (!park_waking_client(this)) {
+        // the woken clients are served before the connection parks
+        waking_ = false;
+        _YieldToLoop();
+    }
+}
+
+void ClientConn::_ParkBlockedClient()
+{
+    if (!park_blocked_client(this)) {
+        // a key is ready before the connection parks
+        blocked_ = false;
+        _YieldToLoop();
+        return;
+    }
+    
+    if (block_state_->deadline) {
+        uint64_t curr_tick = get_tick_count();
+        SetTimer((block_state_->deadline > curr_tick) ? block_state_->deadline - curr_tick : 1);
+    }
+}
+
+Transaction* ClientConn::GetTransaction()
+{
+    if (!transaction_) {
+        transaction_ = new Transaction();
+    }
+    return transaction_;
+}
+
+void ClientConn::ExecTransaction()
+{
+    if (!_IsQueuing()) {
+        SendError("EXEC without MULTI");
+        return;
+    }
+    
+    if (transaction_->IsAborted()) {
+        transaction_->Reset();
+        SendRawResponse("-EXECABORT Transaction discarded because of previous errors.\r\n");
+        return;
+    }
+    
+    set<string> keys;
+    transaction_->GetKeys(keys);
+    {
+        TransactionLockGuard lock_guard(db_index_, keys);
+        
+        // a watched key changed before the keys of the commands are locked, a change after that is ordered
+        // after the transaction, as the commands do not access the watched keys they have not locked
+        if (transaction_->IsWatchTouched()) {
+            transaction_->Reset();
+            SendRawResponse(kNullMultiBulk);
+            return;
+        }
+        
+        char* req_buf = cur_req_buf_;
+        int req_len = cur_req_len_;
+        vector<QueuedCommand>& commands = transaction_->GetCommands();
+        
+        // the replies are kept until the batch is written, they are replaced by an error if it fails
+        ChainBuffer pending_response;
+        pending_response.Append(pipeline_response_);
+        SendMultiBuldLen((long)commands.size());
+        transaction_->Run(db_index_);
+        for (QueuedCommand& cmd : commands) {
+            vector<rocksdb::Slice> arg_vec(cmd.args.begin(), cmd.args.end());
+            cur_req_buf_ = (char*)cmd.request.data();
+            cur_req_len_ = (int)cmd.request.size();
+            _HandleRedisCommand(arg_vec);
+        }
+        bool committed = transaction_->Commit();
+        cur_req_buf_ = req_buf;
+        cur_req_len_ = req_len;
+        
+        if (!committed) {
+            pipeline_response_.Consume(pipeline_response_.GetReadableLen());
+        }
+        pending_response.Append(pipeline_response_);
+        pipeline_response_.Append(pending_response);
+        if (!committed) {
+            SendError("db error");
+        }
+    }
+    
+    transaction_->Reset();
+}
+
+void ClientConn::CallCommand(const vector<rocksdb::Slice>& arg_vec, string& reply)
+{
+    // the response keeps the replies of the requests before the script, which are put back after the call
+    ChainBuffer pending_response;
+    pending_response.Append(pipeline_response_);
+    call_args_ = &arg_vec;
+    _HandleRedisCommand(arg_vec);
+    call_args_ = NULL;
+    
+    while (!pipeline_response_.IsEmpty()) {
+        struct iovec iov[kChainMaxIovec];
+        int iov_cnt = pipeline_response_.GetIovec(iov, kChainMaxIovec);
+        uint64_t len = 0;
+        for (int i = 0; i < iov_cnt; i++) {
+            reply.append((const char*)iov[i].iov_base, iov[i].iov_len);
+            len += iov[i].iov_len;
+        }
+        pipeline_response_.Consume(len);
+    }
+    pipeline_response_.Append(pending_response);
+}
+
+void ClientConn::RunStorageRequests()
+{
+    if (sliced_cmd_) {
+        _RunSlicedCommand();
+        PostResume();
+        return;
+    }
+    
+    if (exec_big_request_) {
+        _HandleRedisCommand(big_request_.GetArgs());
+        PostResume();
+        return;
+    }
+    
+    // the first request is a storage command, the following requests run here only if they are complete
+    // storage commands too, anything else is left to the io thread
+    uint64_t start_us = g_server.command_time_slice ? get_monotonic_us() : 0;
+    const char* buf = (const char*)m_in_buf.GetReadBuffer();
+    int len = (int)m_in_buf.GetReadableLen();
+    int batch_size = kStorageBatchSize;
+    if (g_server.client_command_quota && (g_server.client_command_quota < batch_size)) {
+        batch_size = g_server.client_command_quota;
+    }
+    for (int i = 0; i < batch_size; i++) {
+        vector<rocksdb::Slice> arg_vec;
+        vector<string> inline_args;
+        string err_msg;
+        int ret = parse_redis_request(buf + exec_len_, len - exec_len_, arg_vec, inline_args, err_msg);
+        if (ret <= 0) {
+            break;
+        }
+        
+        if (!arg_vec.empty()) {
+            KedisCommand* kedis_cmd = lookup_command(arg_vec[0]);
+            if ((i > 0) && (!kedis_cmd || (kedis_cmd->exec != CMD_EXEC_STORAGE) || _IsSliceUsedUp(arg_vec, start_us))) {
+                break;
+            }
+            
+            cur_req_buf_ = (char*)buf + exec_len_;
+            cur_req_len_ = ret;
+            _HandleRedisCommand(arg_vec);
+            if (blocked_) {
+                break;  // the request is left in m_in_buf
+            }
+        }
+        exec_len_ += ret;
+        
+        // the responses are sent by the io thread
+        if (sliced_cmd_ || close_pending_ || waking_ || (pipeline_response_.GetReadableLen() >= kStreamFlushSize)) {
+            break;
+        }
+    }
+    
+    PostResume();
+}
+
+ClientBufferLimit* ClientConn::_GetOutputBufferLimit()
+{
+    if (flag_ == CLIENT_SLAVE) {
+        return &g_server.client_obuf_limits[CLIENT_CLASS_SLAVE];
+    } else {
+        return &g_server.client_obuf_limits[CLIENT_CLASS_NORMAL];
+    }
+}
+
+// the master connection does not send responses, so it has no limit
+bool ClientConn::_CheckOutputBufferLimit()
+{
+    if ((flag_ == CLIENT_MASTER) || (m_handle == NETLIB_INVALID_HANDLE)) {
+        return false;
+    }
+    
+    ClientBufferLimit* limit = _GetOutputBufferLimit();
+    uint64_t obuf_len = GetOutputBufferLen();
+    bool hard = limit->hard_limit_bytes && (obuf_len >= limit->hard_limit_bytes);
+    bool soft = false;
+    if (limit->soft_limit_bytes && (obuf_len >= limit->soft_limit_bytes)) {
+        uint64_t curr_tick = get_tick_count();
+        if (obuf_soft_limit_reached_tick_ == 0) {
+            obuf_soft_limit_reached_tick_ = curr_tick;
+        } else if (curr_tick - obuf_soft_limit_reached_tick_ > (uint64_t)limit->soft_limit_seconds * 1000) {
+            soft = true;
+        }
+    } else {
+        obuf_soft_limit_reached_tick_ = 0;
+    }
+    
+    if (!hard && !soft) {
+        return false;
+    }
+    
+    log_message(kLogLevelWarning, "close client %s:%d for reaching the %s output buffer limit, output_buffer_len=%llu\n",
+                m_peer_ip.c_str(), m_peer_port, hard ? "hard" : "soft", obuf_len);
+    g_stat.client_obuf_limit_disconnections++;
+    pipeline_response_.Clear();
+    Close();
+    return true;
 }
 
 void ClientConn::SendRawResponse(const string& resp)
@@ -256,120 +913,273 @@ void ClientConn::SendRawResponse(const string& resp)
     // for client connection, just accumulate the response, will be sent after all requests have be processed
     // for master/slave connection, just discard the response
     if (flag_ == CLIENT_NORMAL) {
-        pipeline_response_.append(resp);
+        pipeline_response_.Append(resp.data(), (uint32_t)resp.size());
     }
 }
 
 void ClientConn::SendError(const string& error_msg)
 {
-    string resp = "-ERR ";
-    resp += error_msg;
-    resp += "\r\n";
-    SendRawResponse(resp);
+    if (flag_ != CLIENT_NORMAL) {
+        return;
+    }
+    
+    pipeline_response_.Append("-ERR ", 5);
+    pipeline_response_.Append(error_msg.data(), (uint32_t)error_msg.size());
+    pipeline_response_.Append("\r\n", 2);
 }
 
 void ClientConn::SendInteger(long i)
 {
-    string resp = ":";
-    resp += to_string(i);
-    resp += "\r\n";
-    SendRawResponse(resp);
+    if (flag_ != CLIENT_NORMAL) {
+        return;
+    }
+    
+    char tmp[32];
+    int len = snprintf(tmp, sizeof(tmp), ":%ld\r\n", i);
+    pipeline_response_.Append(tmp, len);
 }
 
 void ClientConn::SendSimpleString(const string& str)
 {
-    string resp = "+";
-    resp += str;
-    resp += "\r\n";
-    SendRawResponse(resp);
+    if (flag_ != CLIENT_NORMAL) {
+        return;
+    }
+    
+    pipeline_response_.Append("+", 1);
+    pipeline_response_.Append(str.data(), (uint32_t)str.size());
+    pipeline_response_.Append("\r\n", 2);
 }
 
 void ClientConn::SendBulkString(const string& str)
 {
-    string resp;
+    if (flag_ != CLIENT_NORMAL) {
+        return;
+    }
+    
+    if (str.empty()) {
+        pipeline_response_.Append(kNullBulkString.data(), (uint32_t)kNullBulkString.size());
+    } else {
+        _AppendBulkPrefix('$', (int)str.size());
+        pipeline_response_.Append(str.data(), (uint32_t)str.size());
+        pipeline_response_.Append("\r\n", 2);
+    }
+}
+
+void ClientConn::SendBulkString(string&& str)
+{
+    if (flag_ != CLIENT_NORMAL) {
+        return;
+    }
+    
     if (str.empty()) {
-        resp = "$-1\r\n";
+        pipeline_response_.Append(kNullBulkString.data(), (uint32_t)kNullBulkString.size());
     } else {
-        resp = "$";
-        resp += to_string(str.size());
-        resp += "\r\n";
-        resp += str;
-        resp += "\r\n";
+        _AppendBulkPrefix('$', (int)str.size());
+        pipeline_response_.Append(std::move(str));
+        pipeline_response_.Append("\r\n", 2);
     }
-    SendRawResponse(resp);
 }
 
 void ClientConn::SendArray(const vector<string> &str_vec)
 {
-    string resp;
-    char tmp[32];
-    int size = (int)str_vec.size();
-    int pos = build_prefix(tmp, 32, '*', size);
-    resp.append(tmp + pos, strlen(tmp + pos));
+    if (flag_ != CLIENT_NORMAL) {
+        return;
+    }
+    
+    _AppendBulkPrefix('*', (int)str_vec.size());
     for (auto it = str_vec.begin(); it != str_vec.end(); ++it) {
-        if (it->empty()) {  // empty string means the value is not exist
-            resp.append("$-1\r\n");
-        } else {
-            size = (int)it->size();
-            pos = build_prefix(tmp, 32, '$', size);
-            resp.append(tmp + pos, strlen(tmp + pos));
-            resp.append(it->data(), size);
-            resp.append("\r\n");
-        }
+        SendBulkString(*it);
+    }
+}
+
+void ClientConn::SendArray(vector<string>&& str_vec)
+{
+    if (flag_ != CLIENT_NORMAL) {
+        return;
     }
     
-    SendRawResponse(resp);
+    _AppendBulkPrefix('*', (int)str_vec.size());
+    for (auto it = str_vec.begin(); it != str_vec.end(); ++it) {
+        SendBulkString(std::move(*it));
+    }
 }
 
 void ClientConn::SendMultiBuldLen(long len)
 {
-    string resp;
-    char tmp[32];
-    int pos = build_prefix(tmp, 32, '*', (int)len);
-    resp.append(tmp + pos, strlen(tmp + pos));
+    if (flag_ != CLIENT_NORMAL) {
+        return;
+    }
     
-    SendRawResponse(resp);
+    _AppendBulkPrefix('*', (int)len);
 }
 
-void ClientConn::_HandleRedisCommand(vector<string>& cmd_vec)
+void ClientConn::SendBulkSlice(const rocksdb::Slice& str)
 {
-    string& cmd = cmd_vec[0];
-    if (cmd == "QUIT") {
-        SendRawResponse("+OK\r\n");
-        Close();
+    if ((flag_ != CLIENT_NORMAL) || !IsOpen()) {
         return;
     }
     
-    auto cmd_iter = g_server.kedis_commands.find(cmd);
-    if (cmd_iter == g_server.kedis_commands.end()) {
-        SendError("command not support");
-        log_message(kLogLevelError, "command not support: %s\n", cmd.c_str());
+    ChainBuffer& response = deferring_array_ ? deferred_response_ : pipeline_response_;
+    if (str.empty()) {
+        response.Append(kNullBulkString.data(), (uint32_t)kNullBulkString.size());
+    } else {
+        char tmp[32];
+        int pos = build_prefix(tmp, 32, '$', (int)str.size());
+        response.Append(tmp + pos, 32 - 1 - pos);
+        response.Append(str.data(), (uint32_t)str.size());
+        response.Append("\r\n", 2);
+    }
+    
+    _FlushStreamReply();
+}
+
+void ClientConn::BeginDeferredArray()
+{
+    deferring_array_ = true;
+}
+
+void ClientConn::EndDeferredArray(long len)
+{
+    deferring_array_ = false;
+    if (flag_ != CLIENT_NORMAL) {
+        deferred_response_.Clear();
         return;
     }
     
-    KedisCommand kedis_cmd = cmd_iter->second;
-    int cmd_vec_size = (int)cmd_vec.size();
-    if (((kedis_cmd.arity > 0) && (kedis_cmd.arity != cmd_vec_size)) || (cmd_vec_size < -kedis_cmd.arity)) {
-        string error_msg = "wrong number of arguments for '" + cmd + "' command";
+    _AppendBulkPrefix('*', (int)len);
+    pipeline_response_.Append(deferred_response_);
+    _FlushStreamReply();
+}
+
+void ClientConn::AbortStreamReply(const string& error_msg)
+{
+    if (deferring_array_) {
+        deferring_array_ = false;
+        deferred_response_.Clear();
         SendError(error_msg);
         return;
     }
     
-    if (!g_server.require_pass.empty() && !authenticated_ && (kedis_cmd.proc != auth_command)) {
-        SendError("NOAUTH Authentication required");
+    if (!IsOpen()) {
         return;
     }
     
-    if (g_server.slave_read_only && !g_server.master_host.empty() && (flag_ == CLIENT_NORMAL) && kedis_cmd.is_write) {
-        SendError("READONLY You can't write against a read only slave");
+    log_message(kLogLevelError, "close client %s:%d, error in the middle of a reply: %s\n",
+                m_peer_ip.c_str(), m_peer_port, error_msg.c_str());
+    Close();
+}
+
+string ClientConn::GetCurReqCommand()
+{
+    string request;
+    if (call_args_) {
+        build_request(*call_args_, request);
+        return request;
+    }
+    
+    if (cur_req_buf_) {
+        return string(cur_req_buf_, cur_req_len_);
+    }
+    
+    // the arguments of a big request are not contiguous in m_in_buf, rebuild the request
+    build_request(big_request_.GetArgs(), request);
+    return request;
+}
+
+void ClientConn::_HandleRedisCommand(const vector<rocksdb::Slice>& arg_vec)
+{
+    KedisCommand* kedis_cmd = lookup_command(arg_vec[0]);
+    if (!kedis_cmd) {
+        if (arg_equal_nocase(arg_vec[0], "QUIT")) {
+            SendRawResponse("+OK\r\n");
+            Close();
+            return;
+        }
+        
+        _RejectCommand("command not support");
+        log_message(kLogLevelError, "command not support: %s\n", arg_vec[0].ToString().c_str());
         return;
     }
     
-    uint64_t proc_start_tick = get_tick_count();
-    kedis_cmd.proc(this, cmd_vec);
-    uint64_t proc_time = get_tick_count() - proc_start_tick;
-    if ((g_server.slowlog_log_slower_than >= 0) && ((int)proc_time >= g_server.slowlog_log_slower_than)) {
-        add_slowlog(cmd_vec, proc_time);
+    int cmd_vec_size = (int)arg_vec.size();
+    if (((kedis_cmd->arity > 0) && (kedis_cmd->arity != cmd_vec_size)) || (cmd_vec_size < -kedis_cmd->arity)) {
+        string error_msg = "wrong number of arguments for '" + string(kedis_cmd->name) + "' command";
+        _RejectCommand(error_msg);
+        return;
+    }
+    
+    if (!g_server.require_pass.empty() && !authenticated_ && (kedis_cmd->proc != auth_command)) {
+        _RejectCommand("NOAUTH Authentication required");
+        return;
     }
+    
+    if (g_server.slave_read_only && !g_server.master_host.empty() && (flag_ == CLIENT_NORMAL) && kedis_cmd->is_write) {
+        _RejectCommand("READONLY You can't write against a read only slave");
+        return;
+    }
+    
+    // the commands after MULTI are queued until EXEC or DISCARD
+    if (_IsQueuing() && (kedis_cmd->proc != exec_command) && (kedis_cmd->proc != discard_command) &&
+        (kedis_cmd->proc != multi_command) && (kedis_cmd->proc != watch_command)) {
+        if (!can_queue_command(kedis_cmd)) {
+            _RejectCommand("command not allowed in a transaction");
+            return;
+        }
+        
+        transaction_->Queue(kedis_cmd, arg_vec, GetCurReqCommand());
+        SendRawResponse(kQueuedString);
+        return;
+    }
+    
+    // the cached tick does not move while a command runs, so use the precise clock for slowlog
+    uint64_t proc_start_us = get_monotonic_us();
+    bool wake_command = (flag_ == CLIENT_NORMAL) && begin_wake_command(this);
+    if (kedis_cmd->slice_proc) {
+        kedis_cmd->slice_proc(this, arg_vec);
+    } else {
+        // handlers of the string version get the command name in upper case. only the commands whose values go
+        // to rocksdb as they are take the slices, the arguments of the others are small and copied once here
+        vector<string> cmd_vec;
+        cmd_vec.reserve(arg_vec.size());
+        cmd_vec.emplace_back(kedis_cmd->name, kedis_cmd->name_len);
+        for (int i = 1; i < cmd_vec_size; i++) {
+            cmd_vec.emplace_back(arg_vec[i].data(), arg_vec[i].size());
+        }
+        kedis_cmd->proc(this, cmd_vec);
+    }
+    
+    // the clients woken up by the command are served before it replies, see blocking.h
+    if (wake_command) {
+        waking_ = end_wake_command(this);
+    }
+    
+    // a blocked request is counted when it runs again and replies
+    if (blocked_) {
+        return;
+    }
+    uint64_t proc_time_us = get_monotonic_us() - proc_start_us;
+    if ((g_server.slowlog_log_slower_than >= 0) &&
+        (proc_time_us >= (uint64_t)g_server.slowlog_log_slower_than * 1000)) {
+        add_slowlog(kedis_cmd->name, arg_vec, proc_time_us / 1000);
+    }
+    add_command_stat(kedis_cmd, proc_time_us);
     g_stat.total_commands_processed++;
 }
+
+void ClientConn::_AppendBulkPrefix(char start_char, int size)
+{
+    char tmp[32];
+    int pos = build_prefix(tmp, 32, start_char, size);
+    pipeline_response_.Append(tmp + pos, 32 - 1 - pos);
+}
+
+void ClientConn::_FlushStreamReply()
+{
+    // only the io thread can send, the storage thread leaves the response to it,
+    // and the reply of a command called by a script or in a transaction is not sent
+    if (!executing_ && !deferring_array_ && !call_args_ && !get_running_transaction() && IsOpen() &&
+        (pipeline_response_.GetReadableLen() >= kStreamFlushSize)) {
+        Send(pipeline_response_);
+        _CheckOutputBufferLimit();
+    }
+}
@@ -27,7 +27,16 @@ enum {
     CLIENT_MASTER, // the client is a master
 };
 
+const uint64_t kClientTimerMaxInterval = 10000;
+const uint64_t kStreamFlushSize = 64 * 1024; // send the response once it grows over this, even in the middle of a command
+const int kStorageBatchSize = 64; // max requests of a connection run in one storage task, so a long pipeline can not hold a storage thread
+
 class ReplicationSnapshot;
+class SlicedCommand;
+class Transaction;
+struct BlockState;
+struct ClientBufferLimit;
+struct KedisCommand;
 
 class ClientConn : public BaseConn {
 public:
@@ -38,20 +47,58 @@ public:
     virtual void OnConnect(BaseSocket* base_socket);
     virtual void OnConfirm();
     virtual void OnRead();
+    virtual void OnWrite();
     virtual void OnTimer(uint64_t curr_tick);
     virtual void OnLoop();
+    virtual bool IsMovable();
+    virtual void OnResume();
+    
+    // called in a storage thread, runs the request at the beginning of m_in_buf and the following storage requests,
+    // the connection is frozen in the io thread until OnResume()
+    void RunStorageRequests();
+    
+    // a slow command runs the first slice at once, the rest runs in later loop iterations or storage tasks,
+    // the following requests of the connection wait until it is done, the command is deleted after it is done
+    void RunSlicedCommand(SlicedCommand* cmd);
+    
+    // EXEC runs the commands queued after MULTI in the thread of EXEC, the replies are sent as an array
+    void ExecTransaction();
+    Transaction* GetTransaction();  // created at the first MULTI or WATCH
+    
+    // a command called by a script runs in the thread of the script, the reply is returned instead of sent
+    void CallCommand(const vector<rocksdb::Slice>& arg_vec, string& reply);
+    
+    // a blocking command leaves its request in m_in_buf until a key is ready or it times out, see blocking.h
+    bool CanBlock();
+    BlockState* GetBlockState(bool create = true);
+    void SetBlocked() { blocked_ = true; }
     
     void SendRawResponse(const string& resp);
     void SendError(const string& error_msg);
     void SendInteger(long i);
     void SendSimpleString(const string& str);
     void SendBulkString(const string& str);
+    void SendBulkString(string&& str); // big value will be linked to the response chain without copy
     void SendArray(const vector<string>& str_vec);
+    void SendArray(vector<string>&& str_vec);
     void SendMultiBuldLen(long len);
     
+    // streaming reply for big arrays, the header is sent with SendMultiBuldLen() from the count in MetaData,
+    // then every element is serialized into the response as it is read from rocksdb, without collecting
+    // the whole result first
+    void SendBulkSlice(const rocksdb::Slice& str);
+    // for arrays whose length is only known after the iteration (KEYS), the elements are kept aside
+    // and sent after the header in EndDeferredArray()
+    void BeginDeferredArray();
+    void EndDeferredArray(long len);
+    // an error in the middle of a streaming reply can not be sent to the client after the array header,
+    // so the connection is closed, a deferred array is dropped and the error is sent instead
+    void AbortStreamReply(const string& error_msg);
+    
     int GetDBIndex() { return db_index_; }
     void SetAuth(bool auth) { authenticated_ = auth; }
-    string GetCurReqCommand() { return string(cur_req_buf_, cur_req_len_); }
+    string GetCurReqCommand();
+    RedisBulkSink* GetBulkSink() { return big_request_.GetSink(); } // the sink of a big argument of the current request
     void SetState(int state) { state_ = state; }
     int GetState() { return state_; }
     void SetFlag(int flag) { flag_ = flag; }
@@ -64,18 +111,51 @@ public:
     int GetSlavePort() { return slave_port_; }
     string GetSlaveName() { return m_peer_ip + ":" + to_string(slave_port_); }
 private:
-    void _HandleRedisCommand(vector<string>& cmd_vec);
+    void _ProcessRequests();
+    void _HandleRedisCommand(const vector<rocksdb::Slice>& arg_vec);
+    ClientBufferLimit* _GetOutputBufferLimit();
+    bool _CheckOutputBufferLimit(); // return true if the connection is closed for reaching the limit
+    void _AppendBulkPrefix(char start_char, int size);
+    void _FlushStreamReply();
+    bool _StartStorageTask(const vector<rocksdb::Slice>& arg_vec, bool big_request);
+    void _DispatchStorageTask(bool big_request);
+    void _RunSlicedCommand();
+    void _YieldToLoop();   // continue the sliced command or the requests left in the next loop iteration
+    bool _IsSliceUsedUp(const vector<rocksdb::Slice>& arg_vec, uint64_t start_us);
+    KedisCommand* _LookupCoalescedRead(const vector<rocksdb::Slice>& arg_vec); // NULL if the request runs by itself
+    bool _IsQueuing();  // the requests after MULTI are queued until EXEC
+    void _RejectCommand(const string& error_msg);   // the error fails the transaction if it is queuing
+    void _ParkBlockedClient();
+    void _ParkWakingClient();
 private:
     int     db_index_;
-    string  pipeline_response_;
+    ChainBuffer pipeline_response_;
+    ChainBuffer deferred_response_; // elements of a deferred array
+    bool    deferring_array_;
     bool    authenticated_;
-    char*   cur_req_buf_; // the buffer of the current processing request
+    RedisBigRequest big_request_; // a request with big bulk arguments, which is received across reads
+    char*   cur_req_buf_; // the buffer of the current processing request, NULL for a big request
     int     cur_req_len_; // the length of current processing request
     int     state_;
     int     flag_;  // client type
     int     slave_port_;
     uint64_t sync_seq_;  // used for slave conn, the binlog sequence that need to send to slave
     ReplicationSnapshot* repl_snapshot_;
+    uint64_t obuf_soft_limit_reached_tick_; // 0 if the output buffer is below the soft limit
+    bool    throttled_; // stop processing requests until the output buffer drains below the soft limit
+    bool    executing_; // requests are running in a storage thread, set and cleared only in the io thread
+    bool    exec_big_request_;  // the running request is big_request_
+    int     exec_len_;  // length of the requests in m_in_buf that are done in the storage thread
+    bool    read_pending_;  // OnRead() was skipped while executing or yielding
+    atomic<bool> close_pending_; // Close() was called while executing
+    SlicedCommand* sliced_cmd_; // a slow command that has not finished
+    bool    yielding_;  // waiting for OnResume() after Yield(), requests are not processed until then
+    bool    coalescing_;    // point reads of the connection wait in the read batch of the io thread
+    Transaction* transaction_;
+    const vector<rocksdb::Slice>* call_args_;   // the arguments of the command called by a script, NULL if none
+    bool    blocked_;   // the request at the beginning of m_in_buf waits for its keys, no request is processed until then
+    BlockState* block_state_;   // created when the connection blocks or wakes up a client for the first time
+    bool    waking_;    // the clients woken up by the last request are not served yet, the replies wait for them
 };
 
 #endif
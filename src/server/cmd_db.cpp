@@ -10,8 +10,17 @@
 #include "db_util.h"
 #include "encoding.h"
 #include "migrate.h"
+#include "buffer_pool.h"
+#include "config.h"
+#include "event_loop.h"
+#include "storage_pool.h"
+#include "transaction.h"
+#include "blocking.h"
 #include <sys/utsname.h>
 
+const int kMaxHotKeys = 5;  // hot keys shown in INFO
+const size_t kMaxHotKeyInfoLen = 64;
+
 /* Return zero if strings are the same, non-zero if they are not.
  * The comparison is performed in a way that prevents an attacker to obtain
  * information about the nature of the strings just monitoring the execution
@@ -144,6 +153,40 @@ static uint64_t get_disk_usage()
     return total_bytes;
 }
 
+// the hot keys are in one line of INFO, so the separators and the control characters are replaced
+static string get_hot_keys_info(const vector<pair<string, uint64_t>>& hot_keys)
+{
+    string info;
+    for (const pair<string, uint64_t>& hot_key : hot_keys) {
+        if (!info.empty()) {
+            info.append(",");
+        }
+        
+        string key = hot_key.first.substr(0, kMaxHotKeyInfoLen);
+        for (char& c : key) {
+            if (!isprint((unsigned char)c) || (c == ',') || (c == '=')) {
+                c = '?';
+            }
+        }
+        info.append(key + "=" + to_string(hot_key.second));
+    }
+    return info;
+}
+
+static void append_group_commit_info(string& info, const string& prefix, GroupCommit& commit)
+{
+    uint64_t commit_count = commit.GetCommitCount();
+    uint64_t batch_count = commit.GetBatchCount();
+    char buf[64];
+    
+    info.append(prefix + "_commits:" + to_string(commit_count) + "\r\n");
+    info.append(prefix + "_batches:" + to_string(batch_count) + "\r\n");
+    snprintf(buf, sizeof(buf), "%.2f", commit_count ? (double)batch_count / commit_count : 0);
+    info.append(prefix + "_avg_batch_size:" + string(buf) + "\r\n");
+    snprintf(buf, sizeof(buf), "%.2f", batch_count ? (double)commit.GetTotalLatency() / batch_count : 0);
+    info.append(prefix + "_avg_latency_us:" + string(buf) + "\r\n");
+}
+
 void info_command(ClientConn* conn, const vector<string>& cmd_vec)
 {
     int cmd_size = (int)cmd_vec.size();
@@ -177,7 +220,70 @@ void info_command(ClientConn* conn, const vector<string>& cmd_vec)
         uint32_t client_num = g_server.client_num - (uint32_t)g_server.slaves.size();
         g_server.slave_mutex.unlock();
         info.append("connected_clients:" + to_string(client_num) + "\r\n");
-        info.append("blocked_clients:0\r\n");
+        info.append("blocked_clients:" + to_string(get_blocked_client_count()) + "\r\n");
+        info.append("client_output_buffer_bytes:" + to_string(BaseConn::GetTotalOutputBufferBytes()) + "\r\n");
+        info.append("\r\n");
+    }
+    
+    if (all_section || !strcasecmp(section.c_str(), "iothreads")) {
+        info.append("# IoThreads\r\n");
+        info.append("io_thread_placement:" + string(get_io_thread_placement_name()) + "\r\n");
+        for (int i = 0; i < get_io_thread_num(); i++) {
+            EventLoop* el = get_io_event_loop(i);
+            info.append("io_thread_" + to_string(i) + ":connections=" + to_string(el->GetConnNum()) +
+                        ",cpu_usec_per_sec=" + to_string(el->GetRecentCpuTime()) + "\r\n");
+        }
+        info.append("\r\n");
+    }
+    
+    if (all_section || !strcasecmp(section.c_str(), "storagethreads")) {
+        info.append("# StorageThreads\r\n");
+        info.append("storage_thread_num:" + to_string(g_storage_pool.GetThreadNum()) + "\r\n");
+        info.append("storage_queue_length:" + to_string(g_storage_pool.GetQueueLen()) + "\r\n");
+        info.append("storage_tasks_processed:" + to_string(g_storage_pool.GetProcessedTasks()) + "\r\n");
+        info.append("\r\n");
+    }
+    
+    if (all_section || !strcasecmp(section.c_str(), "groupcommit")) {
+        info.append("# GroupCommit\r\n");
+        append_group_commit_info(info, "db_group", g_group_commit);
+        append_group_commit_info(info, "binlog_group", g_server.binlog.GetGroupCommit());
+        info.append("\r\n");
+    }
+    
+    if (all_section || !strcasecmp(section.c_str(), "readcoalesce")) {
+        long reads = g_stat.coalesced_reads;
+        long batches = g_stat.coalesced_read_batches;
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.2f", batches ? (double)reads / batches : 0);
+        
+        info.append("# ReadCoalesce\r\n");
+        info.append("read_coalesce:" + string(g_server.read_coalesce ? "yes" : "no") + "\r\n");
+        info.append("coalesced_reads:" + to_string(reads) + "\r\n");
+        info.append("coalesced_read_batches:" + to_string(batches) + "\r\n");
+        info.append("coalesced_read_avg_batch_size:" + string(buf) + "\r\n");
+        info.append("\r\n");
+    }
+    
+    if (all_section || !strcasecmp(section.c_str(), "keylocks")) {
+        KeyLockStats stats;
+        get_key_lock_stats(stats, kMaxHotKeys);
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.2f", stats.contended_count ? (double)stats.wait_us / stats.contended_count : 0);
+        
+        info.append("# KeyLocks\r\n");
+        info.append("key_lock_acquires:" + to_string(stats.acquire_count) + "\r\n");
+        info.append("key_lock_contended:" + to_string(stats.contended_count) + "\r\n");
+        info.append("key_lock_wait_us:" + to_string(stats.wait_us) + "\r\n");
+        info.append("key_lock_avg_wait_us:" + string(buf) + "\r\n");
+        info.append("key_lock_hot_keys:" + get_hot_keys_info(stats.hot_keys) + "\r\n");
+        info.append("\r\n");
+    }
+    
+    if (all_section || !strcasecmp(section.c_str(), "memory")) {
+        info.append("# Memory\r\n");
+        info.append("buffer_pool_in_use_bytes:" + to_string(BufferPool::GetInUseBytes()) + "\r\n");
+        info.append("buffer_pool_pooled_bytes:" + to_string(BufferPool::GetPooledBytes()) + "\r\n");
         info.append("\r\n");
     }
     
@@ -194,6 +300,8 @@ void info_command(ClientConn* conn, const vector<string>& cmd_vec)
         info.append("expired_keys:" + to_string(g_stat.expired_keys) + "\r\n");
         info.append("keyspace_hits:" + to_string(g_stat.keyspace_hits) + "\r\n");
         info.append("keyspace_misses:" + to_string(g_stat.keyspace_missed) + "\r\n");
+        info.append("client_output_buffer_limit_disconnections:" + to_string(g_stat.client_obuf_limit_disconnections) + "\r\n");
+        info.append("deferred_pipelines:" + to_string(g_stat.deferred_pipelines) + "\r\n");
         info.append("migrate_cached_sockets:" + to_string(get_migrate_conn_number()) + "\r\n");
         info.append("\r\n");
     }
@@ -232,6 +340,26 @@ void info_command(ClientConn* conn, const vector<string>& cmd_vec)
         info.append("\r\n");
     }
     
+    // like redis, commandstats is only shown when asked, or with INFO all
+    if (!strcasecmp(section.c_str(), "commandstats") || !strcasecmp(section.c_str(), "all")) {
+        info.append("# Commandstats\r\n");
+        for (int i = 0; i < get_command_count(); i++) {
+            KedisCommand* cmd = get_command(i);
+            uint64_t calls = __atomic_load_n(&cmd->calls, __ATOMIC_RELAXED);
+            uint64_t usec = __atomic_load_n(&cmd->usec, __ATOMIC_RELAXED);
+            if (calls == 0) {
+                continue;
+            }
+            
+            char buf[256];
+            snprintf(buf, sizeof(buf), "cmdstat_%s:calls=%llu,usec=%llu,usec_per_call=%.2f\r\n",
+                     get_command_lower_name(cmd).c_str(), (unsigned long long)calls, (unsigned long long)usec,
+                     (double)usec / calls);
+            info.append(buf);
+        }
+        info.append("\r\n");
+    }
+    
     if (all_section || !strcasecmp(section.c_str(), "keyspace")) {
         info.append("# Keyspace\r\n");
         
@@ -248,13 +376,14 @@ void info_command(ClientConn* conn, const vector<string>& cmd_vec)
         info.append("\r\n");
     }
     
-    conn->SendBulkString(info);
+    conn->SendBulkString(std::move(info));
 }
 
 void generic_flushdb(int db_idx)
 {
-    rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
+    touch_watched_db(db_idx);
     
+    rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
     g_server.db->DropColumnFamily(cf_handle);
     delete cf_handle;
     
@@ -265,6 +394,7 @@ void generic_flushdb(int db_idx)
     string cf_name = to_string(db_idx);
     g_server.db->CreateColumnFamily(cf_options, cf_name, &cf_handle);
     g_server.cf_handles_map[db_idx] = cf_handle;
+    g_server.flush_count_vec[db_idx]++;
 }
 
 void flushdb_command(ClientConn* conn, const vector<string>& cmd_vec)
@@ -320,13 +450,88 @@ void debug_command(ClientConn* conn, const vector<string>& cmd_vec)
         tv.tv_nsec = (utime % 1000000) * 1000;
         nanosleep(&tv, NULL);
         conn->SendRawResponse(kOKString);
+    } else if (!strcasecmp(cmd_vec[1].c_str(), "rebalance") && (cmd_size == 2)) {
+        // move idle connections from the busiest io threads, the rebalance runs asynchronously in io threads
+        rebalance_io_threads();
+        conn->SendRawResponse(kOKString);
     } else {
-        conn->SendError("debug only support: debug sleep seconds");
+        conn->SendError("debug only support: debug sleep seconds, debug rebalance");
     }
 }
 
+// reply the same format as redis: name, arity, flags, first key, last key, key step
 void command_command(ClientConn* conn, const vector<string>& cmd_vec)
 {
-    // redis-cli will send COMMAND when start, this is just to prevent an error message of unknown command
+    int cmd_count = get_command_count();
+    conn->SendMultiBuldLen(cmd_count);
+    for (int i = 0; i < cmd_count; i++) {
+        KedisCommand* cmd = get_command(i);
+        conn->SendMultiBuldLen(6);
+        conn->SendBulkString(get_command_lower_name(cmd));
+        conn->SendInteger(cmd->arity);
+        
+        vector<string> flags;
+        flags.push_back(cmd->is_write ? "write" : "readonly");
+        if (cmd->cost == CMD_COST_FAST) {
+            flags.push_back("fast");
+        }
+        conn->SendMultiBuldLen((long)flags.size());
+        for (const string& flag : flags) {
+            conn->SendSimpleString(flag);
+        }
+        
+        conn->SendInteger(cmd->first_key);
+        conn->SendInteger(cmd->last_key);
+        conn->SendInteger(cmd->key_step);
+    }
+}
+
+void multi_command(ClientConn* conn, const vector<string>& cmd_vec)
+{
+    Transaction* transaction = conn->GetTransaction();
+    if (transaction->IsStarted()) {
+        conn->SendError("MULTI calls can not be nested");
+        return;
+    }
+    
+    transaction->Begin();
+    conn->SendRawResponse(kOKString);
+}
+
+void exec_command(ClientConn* conn, const vector<string>& cmd_vec)
+{
+    conn->ExecTransaction();
+}
+
+void discard_command(ClientConn* conn, const vector<string>& cmd_vec)
+{
+    Transaction* transaction = conn->GetTransaction();
+    if (!transaction->IsStarted()) {
+        conn->SendError("DISCARD without MULTI");
+        return;
+    }
+    
+    transaction->Reset();
+    conn->SendRawResponse(kOKString);
+}
+
+void watch_command(ClientConn* conn, const vector<string>& cmd_vec)
+{
+    Transaction* transaction = conn->GetTransaction();
+    if (transaction->IsStarted()) {
+        conn->SendError("WATCH inside MULTI is not allowed");
+        return;
+    }
+    
+    for (size_t i = 1; i < cmd_vec.size(); i++) {
+        transaction->Watch(conn->GetDBIndex(), cmd_vec[i]);
+    }
+    conn->SendRawResponse(kOKString);
+}
+
+void unwatch_command(ClientConn* conn, const vector<string>& cmd_vec)
+{
+    Transaction* transaction = conn->GetTransaction();
+    transaction->Unwatch();
     conn->SendRawResponse(kOKString);
 }
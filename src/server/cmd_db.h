@@ -24,4 +24,10 @@ void flushall_command(ClientConn* conn, const vector<string>& cmd_vec);
 void debug_command(ClientConn* conn, const vector<string>& cmd_vec);
 void command_command(ClientConn* conn, const vector<string>& cmd_vec);
 
+void multi_command(ClientConn* conn, const vector<string>& cmd_vec);
+void exec_command(ClientConn* conn, const vector<string>& cmd_vec);
+void discard_command(ClientConn* conn, const vector<string>& cmd_vec);
+void watch_command(ClientConn* conn, const vector<string>& cmd_vec);
+void unwatch_command(ClientConn* conn, const vector<string>& cmd_vec);
+
 #endif /* __CMD_DB_H__ */
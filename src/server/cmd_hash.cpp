@@ -9,18 +9,22 @@
 #include "cmd_hash.h"
 #include "db_util.h"
 #include "encoding.h"
+#include "sliced_command.h"
 
-static rocksdb::Status put_hash_field(int db_idx, const string& key, const string& field, const string& value,
+static rocksdb::Status put_hash_field(int db_idx, const string& key, const string& field, const rocksdb::Slice& value,
                                       rocksdb::WriteBatch* batch = NULL)
 {
     rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
     EncodeKey field_key(KEY_TYPE_HASH_FIELD, key, field);
-    EncodeValue field_value(KEY_TYPE_HASH_FIELD, value);
+    EncodeValueParts field_value(KEY_TYPE_HASH_FIELD, value);
+    rocksdb::Slice encode_key = field_key.GetEncodeKey();
     rocksdb::Status s;
     if (batch) {
-        s = batch->Put(cf_handle, field_key.GetEncodeKey(), field_value.GetEncodeValue());
+        s = batch->Put(cf_handle, rocksdb::SliceParts(&encode_key, 1), field_value.GetEncodeValue());
     } else {
-        s = g_server.db->Put(g_server.write_option, cf_handle, field_key.GetEncodeKey(), field_value.GetEncodeValue());
+        rocksdb::WriteBatch single_batch;
+        single_batch.Put(cf_handle, rocksdb::SliceParts(&encode_key, 1), field_value.GetEncodeValue());
+        s = g_group_commit.Write(g_server.db, &single_batch);
     }
     
     if (!s.ok()) {
@@ -29,13 +33,8 @@ static rocksdb::Status put_hash_field(int db_idx, const string& key, const strin
     return s;
 }
 
-int get_hash_field(int db_idx, const string& key, const string& field, string& value)
+int decode_hash_field(const rocksdb::Status& status, const string& encode_value, string& value)
 {
-    EncodeKey hash_field_key(KEY_TYPE_HASH_FIELD, key, field);
-    rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
-    string encode_value;
-    
-    rocksdb::Status status = g_server.db->Get(g_server.read_option, cf_handle, hash_field_key.GetEncodeKey(), &encode_value);
     if (status.ok()) {
         if (DecodeValue::Decode(encode_value, KEY_TYPE_HASH_FIELD, value) == kDecodeOK) {
             return FIELD_EXIST;
@@ -49,6 +48,39 @@ int get_hash_field(int db_idx, const string& key, const string& field, string& v
     }
 }
 
+int get_hash_field(int db_idx, const string& key, const string& field, string& value,
+                   const rocksdb::ReadOptions& read_option = g_server.read_option)
+{
+    EncodeKey hash_field_key(KEY_TYPE_HASH_FIELD, key, field);
+    rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
+    string encode_value;
+    
+    rocksdb::Status status = db_get(read_option, cf_handle, hash_field_key.GetEncodeKey(), &encode_value);
+    return decode_hash_field(status, encode_value, value);
+}
+
+// get_hash_field() of many fields with one MultiGet, results[i] and values[i] are of fields[i]
+static void get_hash_fields(int db_idx, const string& key, const vector<string>& fields, vector<int>& results,
+                            vector<string>& values, const rocksdb::ReadOptions& read_option = g_server.read_option)
+{
+    vector<string> encode_keys;
+    encode_keys.reserve(fields.size());
+    for (const string& field : fields) {
+        EncodeKey hash_field_key(KEY_TYPE_HASH_FIELD, key, field);
+        encode_keys.push_back(hash_field_key.GetEncodeKey().ToString());
+    }
+    
+    vector<rocksdb::Status> statuses;
+    vector<string> encode_values;
+    multi_get(db_idx, encode_keys, statuses, encode_values, read_option);
+    
+    results.resize(fields.size());
+    values.assign(fields.size(), string());
+    for (size_t i = 0; i < fields.size(); i++) {
+        results[i] = decode_hash_field(statuses[i], encode_values[i], values[i]);
+    }
+}
+
 void hdel_command(ClientConn* conn, const vector<string>& cmd_vec)
 {
     int db_idx = conn->GetDBIndex();
@@ -67,27 +99,30 @@ void hdel_command(ClientConn* conn, const vector<string>& cmd_vec)
         
         rocksdb::WriteBatch batch;
         int del_cnt = 0;
-        int cmd_size = (int)cmd_vec.size();
         rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
-        for (int i = 2; i < cmd_size; i++) {
-            EncodeKey hash_field_key(KEY_TYPE_HASH_FIELD, cmd_vec[1], cmd_vec[i]);
-            string value;
-            
-            rocksdb::Status status = g_server.db->Get(g_server.read_option, cf_handle, hash_field_key.GetEncodeKey(), &value);
-            if (status.ok()) {
+        vector<string> fields(cmd_vec.begin() + 2, cmd_vec.end());
+        vector<int> results;
+        vector<string> values;
+        get_hash_fields(db_idx, cmd_vec[1], fields, results, values);
+        for (size_t i = 0; i < fields.size(); i++) {
+            if (results[i] == FIELD_EXIST) {
+                EncodeKey hash_field_key(KEY_TYPE_HASH_FIELD, cmd_vec[1], fields[i]);
                 batch.Delete(cf_handle, hash_field_key.GetEncodeKey());
                 del_cnt++;
+            } else if (results[i] == DB_ERROR) {
+                conn->SendError("db error");
+                return;
             }
         }
         
         if (del_cnt > 0) {
             mdata.count -= del_cnt;
             if (mdata.count == 0) {
-                delete_key(db_idx, cmd_vec[1], mdata.ttl, KEY_TYPE_HASH);
+                delete_key(db_idx, cmd_vec[1], mdata.ttl, KEY_TYPE_HASH, &batch);
             } else {
                 put_meta_data(db_idx, KEY_TYPE_HASH, cmd_vec[1], mdata.ttl, mdata.count, &batch);
-                DB_BATCH_UPDATE(batch)
             }
+            DB_BATCH_UPDATE(batch)
             
             g_server.binlog.Store(db_idx, conn->GetCurReqCommand());
         }
@@ -100,8 +135,9 @@ void hexists_command(ClientConn* conn, const vector<string>& cmd_vec)
 {
     int db_idx = conn->GetDBIndex();
     MetaData mdata;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    ReadSnapshotGuard snapshot_guard(db_idx, false);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    int ret = get_meta_data(db_idx, cmd_vec[1], mdata, read_option);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
     } else if (ret == kExpireKeyNotExist) {
@@ -113,7 +149,7 @@ void hexists_command(ClientConn* conn, const vector<string>& cmd_vec)
         }
         
         string value;
-        int result = get_hash_field(db_idx, cmd_vec[1], cmd_vec[2], value);
+        int result = get_hash_field(db_idx, cmd_vec[1], cmd_vec[2], value, read_option);
         if (result == FIELD_EXIST) {
             conn->SendInteger(1);
         } else if (result == FIELD_NOT_EXIST) {
@@ -128,8 +164,9 @@ void hget_command(ClientConn* conn, const vector<string>& cmd_vec)
 {
     int db_idx = conn->GetDBIndex();
     MetaData mdata;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    ReadSnapshotGuard snapshot_guard(db_idx, false);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    int ret = get_meta_data(db_idx, cmd_vec[1], mdata, read_option);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
     } else if (ret == kExpireKeyNotExist) {
@@ -141,9 +178,9 @@ void hget_command(ClientConn* conn, const vector<string>& cmd_vec)
         }
         
         string value;
-        int result = get_hash_field(db_idx, cmd_vec[1], cmd_vec[2], value);
+        int result = get_hash_field(db_idx, cmd_vec[1], cmd_vec[2], value, read_option);
         if (result == FIELD_EXIST) {
-            conn->SendBulkString(value);
+            conn->SendBulkString(std::move(value));
         } else if (result == FIELD_NOT_EXIST) {
             conn->SendRawResponse(kNullBulkString);
         } else {
@@ -154,57 +191,113 @@ void hget_command(ClientConn* conn, const vector<string>& cmd_vec)
 
 const int kObjHashKey = 0x1;
 const int kObjHashValue = 0x2;
-static void generic_hgetall_command(ClientConn* conn, const vector<string>& cmd_vec, int obj_flag)
+// the fields are streamed from the snapshot taken when the command starts, so the count in the array header
+// still matches after the hash is changed between the slices
+class HGetAllCommand : public SlicedCommand {
+public:
+    HGetAllCommand(int db_idx, const string& key, int obj_flag)
+        : SlicedCommand(db_idx), key_(key), obj_flag_(obj_flag), started_(false), count_(0), seek_cnt_(0) {}
+    virtual ~HGetAllCommand() {}
+    
+    virtual bool RunSlice(ClientConn* conn, uint64_t deadline_us);
+private:
+    bool _Start(ClientConn* conn);
+private:
+    string      key_;
+    int         obj_flag_;
+    bool        started_;
+    uint64_t    count_;
+    uint64_t    seek_cnt_;
+    string      next_key_;  // the encoded key the next slice starts from
+};
+
+// return false if the reply is done without the fields
+bool HGetAllCommand::_Start(ClientConn* conn)
 {
-    vector<string> hash_vec;
-    int db_idx = conn->GetDBIndex();
     MetaData mdata;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    ScanKeyGuard scan_key_guard(db_idx_);
+    TakeSnapshot();
+    int ret = get_meta_data(db_idx_, key_, mdata, read_option_);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
+        return false;
     } else if (ret == kExpireKeyNotExist) {
-        conn->SendArray(hash_vec);
-    } else {
-        if (mdata.type != KEY_TYPE_HASH) {
-            conn->SendRawResponse(kWrongTypeError);
-            return;
+        conn->SendMultiBuldLen(0);
+        return false;
+    } else if (mdata.type != KEY_TYPE_HASH) {
+        conn->SendRawResponse(kWrongTypeError);
+        return false;
+    }
+    
+    count_ = mdata.count;
+    EncodeKey prefix_key(KEY_TYPE_HASH_FIELD, key_);
+    next_key_ = prefix_key.GetEncodeKey().ToString();
+    
+    // stream the fields from the iterator, a big hash is never held in memory as a whole
+    int obj_per_field = (obj_flag_ == (kObjHashKey | kObjHashValue)) ? 2 : 1;
+    conn->SendMultiBuldLen((long)count_ * obj_per_field);
+    return true;
+}
+
+bool HGetAllCommand::RunSlice(ClientConn* conn, uint64_t deadline_us)
+{
+    if (!started_) {
+        started_ = true;
+        if (!_Start(conn)) {
+            return true;
+        }
+    }
+    
+    ScanKeyGuard scan_key_guard(db_idx_);
+    if (IsFlushed()) {
+        conn->AbortStreamReply("db was flushed in the middle of the reply");
+        return true;
+    }
+    
+    rocksdb::Iterator* it = NewIterator();
+    int check_count = 0;
+    for (it->Seek(next_key_); it->Valid() && seek_cnt_ < count_ && conn->IsOpen(); it->Next(), seek_cnt_++) {
+        if (IsTimeout(deadline_us, check_count)) {
+            next_key_ = it->key().ToString();
+            delete it;
+            return false;
         }
         
-        EncodeKey prefix_key(KEY_TYPE_HASH_FIELD, cmd_vec[1]);
-        rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
-        rocksdb::Iterator* it = g_server.db->NewIterator(g_server.read_option, cf_handle);
-
-        uint64_t seek_cnt = 0;
-        for (it->Seek(prefix_key.GetEncodeKey()); it->Valid() && seek_cnt < mdata.count; it->Next(), seek_cnt++) {
-            string encode_key = it->key().ToString();
-            string encode_value = it->value().ToString();
-            string key, field, value;
-            
-            if (DecodeKey::Decode(encode_key, KEY_TYPE_HASH_FIELD, key, field) != kDecodeOK) {
-                conn->SendError("invalid hash key field");
-                delete it;
-                return;
-            }
-            
-            if (DecodeValue::Decode(encode_value, KEY_TYPE_HASH_FIELD, value) != kDecodeOK) {
-                conn->SendError("invalid hash key value");
-                delete it;
-                return;
-            }
-            
-            if (obj_flag & kObjHashKey) {
-                hash_vec.push_back(field);
-            }
-            
-            if (obj_flag & kObjHashValue) {
-                hash_vec.push_back(value);
-            }
+        string encode_key = it->key().ToString();
+        string encode_value = it->value().ToString();
+        string key, field, value;
+        
+        if (DecodeKey::Decode(encode_key, KEY_TYPE_HASH_FIELD, key, field) != kDecodeOK) {
+            conn->AbortStreamReply("invalid hash key field");
+            delete it;
+            return true;
         }
         
-        delete it;
-        conn->SendArray(hash_vec);
+        if (DecodeValue::Decode(encode_value, KEY_TYPE_HASH_FIELD, value) != kDecodeOK) {
+            conn->AbortStreamReply("invalid hash key value");
+            delete it;
+            return true;
+        }
+        
+        if (obj_flag_ & kObjHashKey) {
+            conn->SendBulkSlice(field);
+        }
+        
+        if (obj_flag_ & kObjHashValue) {
+            conn->SendBulkSlice(value);
+        }
     }
+    
+    delete it;
+    if (seek_cnt_ < count_) {
+        conn->AbortStreamReply("hash has less fields than the count in meta data");
+    }
+    return true;
+}
+
+static void generic_hgetall_command(ClientConn* conn, const vector<string>& cmd_vec, int obj_flag)
+{
+    conn->RunSlicedCommand(new HGetAllCommand(conn->GetDBIndex(), cmd_vec[1], obj_flag));
 }
 
 void hgetall_command(ClientConn* conn, const vector<string>& cmd_vec)
@@ -340,8 +433,9 @@ void hlen_command(ClientConn* conn, const vector<string>& cmd_vec)
 {
     int db_idx = conn->GetDBIndex();
     MetaData mdata;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    ReadSnapshotGuard snapshot_guard(db_idx, false);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    int ret = get_meta_data(db_idx, cmd_vec[1], mdata, read_option);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
     } else if (ret == kExpireKeyNotExist) {
@@ -361,8 +455,9 @@ void hmget_command(ClientConn* conn, const vector<string>& cmd_vec)
     int db_idx = conn->GetDBIndex();
     int cmd_size = (int)cmd_vec.size();
     MetaData mdata;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    ReadSnapshotGuard snapshot_guard(db_idx);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    int ret = get_meta_data(db_idx, cmd_vec[1], mdata, read_option);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
     } else if (ret == kExpireKeyNotExist) {
@@ -376,24 +471,21 @@ void hmget_command(ClientConn* conn, const vector<string>& cmd_vec)
             return;
         }
         
-        for (int i = 2; i < cmd_size; i++) {
-            string value;
-            int result = get_hash_field(db_idx, cmd_vec[1], cmd_vec[i], value);
-            if (result == FIELD_EXIST) {
-                hash_vec.push_back(value);
-            } else if (result == FIELD_NOT_EXIST) {
-                hash_vec.push_back("");
-            } else {
+        vector<string> fields(cmd_vec.begin() + 2, cmd_vec.end());
+        vector<int> results;
+        get_hash_fields(db_idx, cmd_vec[1], fields, results, hash_vec, read_option);
+        for (int result : results) {
+            if (result == DB_ERROR) {
                 conn->SendError("db error");
                 return;
             }
         }
         
-        conn->SendArray(hash_vec);
+        conn->SendArray(std::move(hash_vec));
     }
 }
 
-void hmset_command(ClientConn* conn, const vector<string>& cmd_vec)
+void hmset_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec)
 {
     int cmd_size = (int)cmd_vec.size();
     if (cmd_size % 2 != 0) {
@@ -402,20 +494,21 @@ void hmset_command(ClientConn* conn, const vector<string>& cmd_vec)
     }
     
     int db_idx = conn->GetDBIndex();
+    string key = cmd_vec[1].ToString();
     MetaData mdata;
     rocksdb::WriteBatch batch;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    KeyLockGuard lock_guard(db_idx, key);
+    int ret = expire_key_if_needed(db_idx, key, mdata);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
     } else if (ret == kExpireKeyNotExist) {
         g_server.key_count_vec[db_idx]++;
         for (int i = 2; i < cmd_size; i += 2) {
-            put_hash_field(db_idx, cmd_vec[1], cmd_vec[i], cmd_vec[i + 1], &batch);
+            put_hash_field(db_idx, key, cmd_vec[i].ToString(), cmd_vec[i + 1], &batch);
         }
         
         uint64_t count = (cmd_size - 2) / 2;
-        put_meta_data(db_idx, KEY_TYPE_HASH, cmd_vec[1], 0, count, &batch);
+        put_meta_data(db_idx, KEY_TYPE_HASH, key, 0, count, &batch);
         DB_BATCH_UPDATE(batch)
         g_server.binlog.Store(db_idx, conn->GetCurReqCommand());
         conn->SendSimpleString("OK");
@@ -426,15 +519,22 @@ void hmset_command(ClientConn* conn, const vector<string>& cmd_vec)
         }
         
         int add_cnt = 0;
+        vector<string> fields;
         for (int i = 2; i < cmd_size; i += 2) {
-            string value;
-            int result = get_hash_field(db_idx, cmd_vec[1], cmd_vec[i], value);
-            if (result == FIELD_EXIST) {
-                if (value != cmd_vec[i + 1]) {
-                    put_hash_field(db_idx, cmd_vec[1], cmd_vec[i], cmd_vec[i + 1], &batch);
+            fields.push_back(cmd_vec[i].ToString());
+        }
+        
+        vector<int> results;
+        vector<string> values;
+        get_hash_fields(db_idx, key, fields, results, values);
+        for (size_t i = 0; i < fields.size(); i++) {
+            const rocksdb::Slice& value = cmd_vec[2 * i + 3];
+            if (results[i] == FIELD_EXIST) {
+                if (rocksdb::Slice(values[i]) != value) {
+                    put_hash_field(db_idx, key, fields[i], value, &batch);
                 }
-            } else if (result == FIELD_NOT_EXIST) {
-                put_hash_field(db_idx, cmd_vec[1], cmd_vec[i], cmd_vec[i + 1], &batch);
+            } else if (results[i] == FIELD_NOT_EXIST) {
+                put_hash_field(db_idx, key, fields[i], value, &batch);
                 add_cnt++;
             } else {
                 conn->SendError("db error");
@@ -443,7 +543,7 @@ void hmset_command(ClientConn* conn, const vector<string>& cmd_vec)
         }
         
         if (add_cnt > 0) {
-            put_meta_data(db_idx, KEY_TYPE_HASH, cmd_vec[1], mdata.ttl, mdata.count + add_cnt, &batch);
+            put_meta_data(db_idx, KEY_TYPE_HASH, key, mdata.ttl, mdata.count + add_cnt, &batch);
         }
         
         DB_BATCH_UPDATE(batch)
@@ -466,7 +566,7 @@ void hscan_command(ClientConn* conn, const vector<string>& cmd_vec)
     
     ScanKeyGuard scan_key_guard(db_idx);
     rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
-    rocksdb::Iterator* it = g_server.db->NewIterator(g_server.read_option, cf_handle);
+    rocksdb::Iterator* it = db_new_iterator(g_server.read_option, cf_handle);
     
     string cursor;
     vector<string> fields;
@@ -512,22 +612,24 @@ void hscan_command(ClientConn* conn, const vector<string>& cmd_vec)
     string start_resp = "*2\r\n";
     conn->SendRawResponse(start_resp);
     conn->SendBulkString(cursor);
-    conn->SendArray(fields);
+    conn->SendArray(std::move(fields));
 }
 
-static void generic_hset_command(ClientConn* conn, const vector<string>& cmd_vec, bool nx)
+static void generic_hset_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec, bool nx)
 {
     int db_idx = conn->GetDBIndex();
+    string key = cmd_vec[1].ToString();
+    string field = cmd_vec[2].ToString();
     MetaData mdata;
     rocksdb::WriteBatch batch;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    KeyLockGuard lock_guard(db_idx, key);
+    int ret = expire_key_if_needed(db_idx, key, mdata);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
     } else if (ret == kExpireKeyNotExist) {
         g_server.key_count_vec[db_idx]++;
-        put_hash_field(db_idx, cmd_vec[1], cmd_vec[2], cmd_vec[3], &batch);
-        put_meta_data(db_idx, KEY_TYPE_HASH, cmd_vec[1], 0, 1, &batch);
+        put_hash_field(db_idx, key, field, cmd_vec[3], &batch);
+        put_meta_data(db_idx, KEY_TYPE_HASH, key, 0, 1, &batch);
         DB_BATCH_UPDATE(batch)
         g_server.binlog.Store(db_idx, conn->GetCurReqCommand());
         conn->SendInteger(1);
@@ -539,15 +641,15 @@ static void generic_hset_command(ClientConn* conn, const vector<string>& cmd_vec
         
         int new_field = 1;
         string value;
-        int result = get_hash_field(db_idx, cmd_vec[1], cmd_vec[2], value);
+        int result = get_hash_field(db_idx, key, field, value);
         if (result == FIELD_EXIST) {
             new_field = 0;
             if (!nx) {
-                put_hash_field(db_idx, cmd_vec[1], cmd_vec[2], cmd_vec[3]);
+                put_hash_field(db_idx, key, field, cmd_vec[3]);
             }
         } else if (result == FIELD_NOT_EXIST) {
-            put_hash_field(db_idx, cmd_vec[1], cmd_vec[2], cmd_vec[3], &batch);
-            put_meta_data(db_idx, KEY_TYPE_HASH, cmd_vec[1], mdata.ttl, mdata.count + 1, &batch);
+            put_hash_field(db_idx, key, field, cmd_vec[3], &batch);
+            put_meta_data(db_idx, KEY_TYPE_HASH, key, mdata.ttl, mdata.count + 1, &batch);
             DB_BATCH_UPDATE(batch)
         } else {
             conn->SendError("db error");
@@ -559,12 +661,12 @@ static void generic_hset_command(ClientConn* conn, const vector<string>& cmd_vec
     }
 }
 
-void hset_command(ClientConn* conn, const vector<string>& cmd_vec)
+void hset_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec)
 {
     generic_hset_command(conn, cmd_vec, false);
 }
 
-void hsetnx_command(ClientConn* conn, const vector<string>& cmd_vec)
+void hsetnx_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec)
 {
     generic_hset_command(conn, cmd_vec, true);
 }
@@ -573,8 +675,9 @@ void hstrlen_command(ClientConn* conn, const vector<string>& cmd_vec)
 {
     int db_idx = conn->GetDBIndex();
     MetaData mdata;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    ReadSnapshotGuard snapshot_guard(db_idx, false);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    int ret = get_meta_data(db_idx, cmd_vec[1], mdata, read_option);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
     } else if (ret == kExpireKeyNotExist) {
@@ -586,7 +689,7 @@ void hstrlen_command(ClientConn* conn, const vector<string>& cmd_vec)
         }
         
         string value;
-        int result = get_hash_field(db_idx, cmd_vec[1], cmd_vec[2], value);
+        int result = get_hash_field(db_idx, cmd_vec[1], cmd_vec[2], value, read_option);
         if (result == FIELD_EXIST) {
             conn->SendInteger(value.size());
         } else if (result == FIELD_NOT_EXIST) {
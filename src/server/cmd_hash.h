@@ -23,10 +23,13 @@ void hincrbyfloat_command(ClientConn* conn, const vector<string>& cmd_vec);
 
 void hlen_command(ClientConn* conn, const vector<string>& cmd_vec);
 void hmget_command(ClientConn* conn, const vector<string>& cmd_vec);
-void hmset_command(ClientConn* conn, const vector<string>& cmd_vec);
+void hmset_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec);
 void hscan_command(ClientConn* conn, const vector<string>& cmd_vec);
-void hset_command(ClientConn* conn, const vector<string>& cmd_vec);
-void hsetnx_command(ClientConn* conn, const vector<string>& cmd_vec);
+void hset_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec);
+void hsetnx_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec);
 void hstrlen_command(ClientConn* conn, const vector<string>& cmd_vec);
 
+// decode the result of reading a hash field, return FIELD_EXIST, FIELD_NOT_EXIST or DB_ERROR
+int decode_hash_field(const rocksdb::Status& status, const string& encode_value, string& value);
+
 #endif /* __CMD_HASH_H__ */
@@ -9,6 +9,7 @@
 #include "cmd_keys.h"
 #include "db_util.h"
 #include "encoding.h"
+#include "sliced_command.h"
 
 void del_command(ClientConn* conn, const vector<string>& cmd_vec)
 {
@@ -20,22 +21,24 @@ void del_command(ClientConn* conn, const vector<string>& cmd_vec)
         keys.insert(cmd_vec[i]);
     }
     
-    lock_keys(db_idx, keys);
+    KeysLockGuard keys_lock_guard(db_idx, keys);
     
-    for (int i = 1; i < (int)cmd_vec.size(); i++) {
+    // the keys are deleted with one batch, so a snapshot sees all of them or none
+    rocksdb::WriteBatch batch;
+    for (const string& key : keys) {
         MetaData mdata;
-        int ret = expire_key_if_needed(db_idx, cmd_vec[i], mdata);
+        int ret = expire_key_if_needed(db_idx, key, mdata);
         if (ret == kExpireKeyExist) {
-            delete_key(db_idx, cmd_vec[i], mdata.ttl, mdata.type);
+            delete_key(db_idx, key, mdata.ttl, mdata.type, &batch);
             del_cnt++;
         }
     }
     
     if (del_cnt > 0) {
+        DB_BATCH_UPDATE(batch)
         g_server.binlog.Store(db_idx, conn->GetCurReqCommand());
     }
     
-    unlock_keys(db_idx, keys);
     
     conn->SendInteger(del_cnt);
 }
@@ -44,8 +47,9 @@ void exists_command(ClientConn* conn, const vector<string>& cmd_vec)
 {
     int db_idx = conn->GetDBIndex();
     MetaData mdata;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    ReadSnapshotGuard snapshot_guard(db_idx, false);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    int ret = get_meta_data(db_idx, cmd_vec[1], mdata, read_option);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
     } else if (ret == kExpireKeyNotExist) {
@@ -59,9 +63,10 @@ static void generic_ttl_command(ClientConn* conn, const vector<string>& cmd_vec,
 {
     int db_idx = conn->GetDBIndex();
     MetaData mdata;
-    uint64_t now = get_tick_count();
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    uint64_t now = get_wall_time_ms();
+    ReadSnapshotGuard snapshot_guard(db_idx, false);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    int ret = get_meta_data(db_idx, cmd_vec[1], mdata, read_option);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
     } else if (ret == kExpireKeyNotExist) {
@@ -94,8 +99,9 @@ void type_command(ClientConn* conn, const vector<string>& cmd_vec)
 {
     int db_idx = conn->GetDBIndex();
     MetaData mdata;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    ReadSnapshotGuard snapshot_guard(db_idx, false);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    int ret = get_meta_data(db_idx, cmd_vec[1], mdata, read_option);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
     } else if (ret == kExpireKeyNotExist) {
@@ -129,7 +135,7 @@ static void generic_expire_command(ClientConn* conn, const vector<string>& cmd_v
         }
         
         ttl += base_time;
-        if (ttl <= get_tick_count()) {
+        if (ttl <= get_wall_time_ms()) {
             delete_key(db_idx, key, mdata.ttl, mdata.type);
             conn->SendInteger(1);
             return;
@@ -161,7 +167,7 @@ static void generic_expire_command(ClientConn* conn, const vector<string>& cmd_v
 
 void expire_command(ClientConn* conn, const vector<string>& cmd_vec)
 {
-    generic_expire_command(conn, cmd_vec, get_tick_count(), true);
+    generic_expire_command(conn, cmd_vec, get_wall_time_ms(), true);
 }
 
 void expireat_command(ClientConn* conn, const vector<string>& cmd_vec)
@@ -171,7 +177,7 @@ void expireat_command(ClientConn* conn, const vector<string>& cmd_vec)
 
 void pexpire_command(ClientConn* conn, const vector<string>& cmd_vec)
 {
-    generic_expire_command(conn, cmd_vec, get_tick_count(), false);
+    generic_expire_command(conn, cmd_vec, get_wall_time_ms(), false);
 }
 
 void pexpireat_command(ClientConn* conn, const vector<string>& cmd_vec)
@@ -219,7 +225,7 @@ void randomkey_command(ClientConn* conn, const vector<string>& cmd_vec)
     rocksdb::Slice encode_prefix = key_prefix.GetEncodeKey();
     int db_idx = conn->GetDBIndex();
     rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
-    rocksdb::Iterator* it = g_server.db->NewIterator(g_server.read_option, cf_handle);
+    rocksdb::Iterator* it = db_new_iterator(g_server.read_option, cf_handle);
     
     vector<string> keys;
     int seek_cnt = 0;
@@ -241,7 +247,7 @@ void randomkey_command(ClientConn* conn, const vector<string>& cmd_vec)
             uint64_t ttl;
             stream >> type;
             stream >> ttl;
-            if (!ttl || ttl > get_tick_count()) {
+            if (!ttl || ttl > get_wall_time_ms()) {
                 keys.push_back(key);
             }
         } catch (ParseException& ex) {
@@ -261,9 +267,24 @@ void randomkey_command(ClientConn* conn, const vector<string>& cmd_vec)
     }
 }
 
-void keys_command(ClientConn* conn, const vector<string>& cmd_vec)
+// KEYS goes through the keyspace in the snapshot taken when it starts, the matched keys are kept
+// in the deferred array of the connection between the slices
+class KeysCommand : public SlicedCommand {
+public:
+    KeysCommand(int db_idx, const string& pattern);
+    virtual ~KeysCommand() {}
+    
+    virtual bool RunSlice(ClientConn* conn, uint64_t deadline_us);
+private:
+    string  pattern_;
+    string  encode_prefix_;
+    string  next_key_;  // the encoded key the next slice starts from
+    bool    started_;
+    long    key_count_;
+};
+
+KeysCommand::KeysCommand(int db_idx, const string& pattern) : SlicedCommand(db_idx), pattern_(pattern)
 {
-    const string& pattern = cmd_vec[1];
     int pattern_size = (int)pattern.size();
     int idx = 0;
     for (; idx < pattern_size; idx++) {
@@ -274,21 +295,42 @@ void keys_command(ClientConn* conn, const vector<string>& cmd_vec)
     }
     
     // extract normal pattern to reduce key scan range
-    string prefix = pattern.substr(0, idx);
-    
-    EncodeKey key_prefix(KEY_TYPE_META, prefix);
-    rocksdb::Slice encode_prefix = key_prefix.GetEncodeKey();
-    int db_idx = conn->GetDBIndex();
-    
-    ScanKeyGuard scan_key_guard(db_idx);
-    rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
-    rocksdb::Iterator* it = g_server.db->NewIterator(g_server.read_option, cf_handle);
+    EncodeKey key_prefix(KEY_TYPE_META, pattern.substr(0, idx));
+    encode_prefix_ = key_prefix.GetEncodeKey().ToString();
+    next_key_ = encode_prefix_;
+    started_ = false;
+    key_count_ = 0;
+}
+
+bool KeysCommand::RunSlice(ClientConn* conn, uint64_t deadline_us)
+{
+    ScanKeyGuard scan_key_guard(db_idx_);
+    if (!started_) {
+        started_ = true;
+        TakeSnapshot();
+        
+        // the number of matched keys is unknown until the end, the keys are serialized aside
+        // instead of being collected in a vector, and sent after the array header
+        conn->BeginDeferredArray();
+    } else if (IsFlushed()) {
+        // the keys left were removed by flushdb after the command started
+        conn->EndDeferredArray(key_count_);
+        return true;
+    }
     
-    vector<string> keys;
-    for (it->Seek(encode_prefix); it->Valid(); it->Next()) {
-        if (!it->key().starts_with(encode_prefix)) {
+    rocksdb::Iterator* it = NewIterator();
+    int check_count = 0;
+    for (it->Seek(next_key_); it->Valid(); it->Next()) {
+        if (!it->key().starts_with(encode_prefix_)) {
             break;
         }
+        
+        if (IsTimeout(deadline_us, check_count)) {
+            next_key_ = it->key().ToString();
+            delete it;
+            return false;
+        }
+        
         string encode_key = it->key().ToString();
         string key;
         
@@ -297,7 +339,7 @@ void keys_command(ClientConn* conn, const vector<string>& cmd_vec)
             break;
         }
         
-        if (!stringmatchlen(pattern.c_str(), (int)pattern.size(), key.c_str(), (int)key.size(), 0)) {
+        if (!stringmatchlen(pattern_.c_str(), (int)pattern_.size(), key.c_str(), (int)key.size(), 0)) {
             continue;
         }
         
@@ -307,18 +349,25 @@ void keys_command(ClientConn* conn, const vector<string>& cmd_vec)
             uint64_t ttl;
             stream >> type;
             stream >> ttl;
-            if (!ttl || ttl > get_tick_count()) {
-                keys.push_back(key);
+            if (!ttl || ttl > get_wall_time_ms()) {
+                conn->SendBulkSlice(key);
+                key_count_++;
             }
         } catch (ParseException& ex) {
-            conn->SendError("db error");
+            conn->AbortStreamReply("db error");
             delete it;
-            return;
+            return true;
         }
     }
     
     delete it;
-    conn->SendArray(keys);
+    conn->EndDeferredArray(key_count_);
+    return true;
+}
+
+void keys_command(ClientConn* conn, const vector<string>& cmd_vec)
+{
+    conn->RunSlicedCommand(new KeysCommand(conn->GetDBIndex(), cmd_vec[1]));
 }
 
 // SCAN cursor [MATCH pattern] [COUNT count]
@@ -335,7 +384,7 @@ void scan_command(ClientConn* conn, const vector<string>& cmd_vec)
     EncodeKey cursor_key(KEY_TYPE_META, cmd_vec[1]);
     ScanKeyGuard scan_key_guard(db_idx);
     rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
-    rocksdb::Iterator* it = g_server.db->NewIterator(g_server.read_option, cf_handle);
+    rocksdb::Iterator* it = db_new_iterator(g_server.read_option, cf_handle);
     
     string cursor;
     vector<string> keys;
@@ -371,5 +420,5 @@ void scan_command(ClientConn* conn, const vector<string>& cmd_vec)
     string start_resp = "*2\r\n";
     conn->SendRawResponse(start_resp);
     conn->SendBulkString(cursor);
-    conn->SendArray(keys);
+    conn->SendArray(std::move(keys));
 }
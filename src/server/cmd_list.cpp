@@ -9,19 +9,25 @@
 #include "cmd_list.h"
 #include "db_util.h"
 #include "encoding.h"
+#include "sliced_command.h"
+#include "transaction.h"
+#include "blocking.h"
 
 static rocksdb::Status put_list_element(int db_idx, const string& key, uint64_t seq, uint64_t prev_seq,
-                                        uint64_t next_seq, const string& value, rocksdb::WriteBatch* batch = NULL)
+                                        uint64_t next_seq, const rocksdb::Slice& value, rocksdb::WriteBatch* batch = NULL)
 {
     rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
     EncodeKey element_key(KEY_TYPE_LIST_ELEMENT, key, seq);
-    EncodeValue element_value(KEY_TYPE_LIST_ELEMENT, prev_seq, next_seq, value);
+    EncodeValueParts element_value(KEY_TYPE_LIST_ELEMENT, prev_seq, next_seq, value);
+    rocksdb::Slice encode_key = element_key.GetEncodeKey();
     rocksdb::Status s;
     
     if (batch) {
-        s = batch->Put(cf_handle, element_key.GetEncodeKey(), element_value.GetEncodeValue());
+        s = batch->Put(cf_handle, rocksdb::SliceParts(&encode_key, 1), element_value.GetEncodeValue());
     } else {
-        s = g_server.db->Put(g_server.write_option, cf_handle, element_key.GetEncodeKey(), element_value.GetEncodeValue());
+        rocksdb::WriteBatch single_batch;
+        single_batch.Put(cf_handle, rocksdb::SliceParts(&encode_key, 1), element_value.GetEncodeValue());
+        s = g_group_commit.Write(g_server.db, &single_batch);
     }
     if (!s.ok()) {
         log_message(kLogLevelError, "put_list_element failed, error_code=%d\n", (int)s.code());
@@ -38,7 +44,9 @@ static rocksdb::Status del_list_element(int db_idx, const string& key, uint64_t
     if (batch) {
         s = batch->Delete(cf_handle, element_key.GetEncodeKey());
     } else {
-        s = g_server.db->Delete(g_server.write_option, cf_handle, element_key.GetEncodeKey());
+        rocksdb::WriteBatch single_batch;
+        single_batch.Delete(cf_handle, element_key.GetEncodeKey());
+        s = g_group_commit.Write(g_server.db, &single_batch);
     }
     if (!s.ok()) {
         log_message(kLogLevelError, "del_set_member failed, error_code=%d\n", (int)s.code());
@@ -46,13 +54,14 @@ static rocksdb::Status del_list_element(int db_idx, const string& key, uint64_t
     return s;
 }
 
-static int get_list_element(int db_idx, const string& key, uint64_t seq, uint64_t& prev_seq, uint64_t& next_seq, string& value)
+static int get_list_element(int db_idx, const string& key, uint64_t seq, uint64_t& prev_seq, uint64_t& next_seq, string& value,
+                            const rocksdb::ReadOptions& read_option = g_server.read_option)
 {
     EncodeKey element_key(KEY_TYPE_LIST_ELEMENT, key, seq);
     rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
     string encode_value;
     
-    rocksdb::Status status = g_server.db->Get(g_server.read_option, cf_handle, element_key.GetEncodeKey(), &encode_value);
+    rocksdb::Status status = db_get(read_option, cf_handle, element_key.GetEncodeKey(), &encode_value);
     if (status.ok()) {
         if (DecodeValue::Decode(encode_value, KEY_TYPE_LIST_ELEMENT, prev_seq, next_seq, value) == kDecodeOK) {
             return FIELD_EXIST;
@@ -76,8 +85,9 @@ void lindex_command(ClientConn* conn, const vector<string>& cmd_vec)
     
     int db_idx = conn->GetDBIndex();
     MetaData mdata;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    ReadSnapshotGuard snapshot_guard(db_idx);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    int ret = get_meta_data(db_idx, cmd_vec[1], mdata, read_option);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
     } else if (ret == kExpireKeyNotExist) {
@@ -107,11 +117,11 @@ void lindex_command(ClientConn* conn, const vector<string>& cmd_vec)
         string value;
         for (long i = 0; i <= index; i++) {
             value.clear();
-            get_list_element(db_idx, cmd_vec[1], seq, prev_seq, next_seq, value);
+            get_list_element(db_idx, cmd_vec[1], seq, prev_seq, next_seq, value, read_option);
             seq = forward ? next_seq : prev_seq;
         }
         
-        conn->SendBulkString(value);
+        conn->SendBulkString(std::move(value));
     }
 }
 
@@ -212,8 +222,9 @@ void llen_command(ClientConn* conn, const vector<string>& cmd_vec)
 {
     int db_idx = conn->GetDBIndex();
     MetaData mdata;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    ReadSnapshotGuard snapshot_guard(db_idx, false);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    int ret = get_meta_data(db_idx, cmd_vec[1], mdata, read_option);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
     } else if (ret == kExpireKeyNotExist) {
@@ -227,64 +238,142 @@ void llen_command(ClientConn* conn, const vector<string>& cmd_vec)
     }
 }
 
-void lpush_command(ClientConn* conn, const vector<string>& cmd_vec)
+// push the elements to the head or the tail of the list, the list is created if it does not exist,
+// list_count is the length after the push
+static int push_list_elements(int db_idx, const string& key, const rocksdb::Slice* elements, int element_count,
+                              bool push_head, uint64_t& list_count)
 {
-    int cmd_size = (int)cmd_vec.size();
-    uint64_t element_count = cmd_size - 2;
-    int db_idx = conn->GetDBIndex();
     MetaData mdata;
     rocksdb::WriteBatch batch;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    int ret = expire_key_if_needed(db_idx, key, mdata);
     if (ret == kExpireDBError) {
-        conn->SendError("db error");
-    } else if (ret == kExpireKeyNotExist) {
+        return kElementDBError;
+    }
+    
+    uint64_t edge_seq = 0;  // the old head or tail element the new elements link to, 0 for a new list
+    if (ret == kExpireKeyNotExist) {
         g_server.key_count_vec[db_idx]++;
-        uint64_t current_seq = 1;
-        for (int i = 2; i < cmd_size; i++) {
-            uint64_t prev_seq = (i == cmd_size - 1) ? 0 : current_seq + 1;
-            uint64_t next_seq = (i == 2) ? 0 : current_seq - 1;
-            put_list_element(db_idx, cmd_vec[1], current_seq, prev_seq, next_seq, cmd_vec[i], &batch);
-            current_seq++;
-        }
-        
-        uint64_t head_seq = current_seq - 1;
-        uint64_t tail_seq = 1;
-        put_meta_data(db_idx, KEY_TYPE_LIST, cmd_vec[1], 0, element_count, head_seq, tail_seq, current_seq, &batch);
-        DB_BATCH_UPDATE(batch)
-        g_server.binlog.Store(db_idx, conn->GetCurReqCommand());
-        conn->SendInteger(element_count);
+        mdata.ttl = 0;
+        mdata.count = 0;
+        mdata.head_seq = 1;
+        mdata.tail_seq = 1;
+        mdata.current_seq = 1;
     } else {
         if (mdata.type != KEY_TYPE_LIST) {
-            conn->SendRawResponse(kWrongTypeError);
-            return;
+            return kElementWrongType;
         }
         
         uint64_t prev_seq, next_seq;
         string value;
-        int result = get_list_element(db_idx, cmd_vec[1], mdata.head_seq, prev_seq, next_seq, value);
-        if (result == FIELD_EXIST) {
-            put_list_element(db_idx, cmd_vec[1], mdata.head_seq, mdata.current_seq, next_seq, value, &batch);
-        } else {
+        edge_seq = push_head ? mdata.head_seq : mdata.tail_seq;
+        int result = get_list_element(db_idx, key, edge_seq, prev_seq, next_seq, value);
+        if (result != FIELD_EXIST) {
             // element not exist or db error all means the list has broken
-            conn->SendError("db error");
-            return;
+            return kElementDBError;
         }
         
-        for (int i = 2; i < cmd_size; i++) {
-            uint64_t prev_seq = (i == cmd_size - 1) ? 0 :  mdata.current_seq + 1;
-            uint64_t next_seq = (i == 2) ? mdata.head_seq :  mdata.current_seq - 1;
-            put_list_element(db_idx, cmd_vec[1], mdata.current_seq, prev_seq, next_seq, cmd_vec[i], &batch);
-            mdata.current_seq++;
+        if (push_head) {
+            put_list_element(db_idx, key, edge_seq, mdata.current_seq, next_seq, value, &batch);
+        } else {
+            put_list_element(db_idx, key, edge_seq, prev_seq, mdata.current_seq, value, &batch);
         }
+    }
     
-        mdata.count += element_count;
-        uint64_t head_seq = mdata.current_seq - 1;
-        put_meta_data(db_idx, KEY_TYPE_LIST, cmd_vec[1], mdata.ttl, mdata.count, head_seq, mdata.tail_seq, mdata.current_seq, &batch);
-        DB_BATCH_UPDATE(batch)
-        g_server.binlog.Store(db_idx, conn->GetCurReqCommand());
-        conn->SendInteger(mdata.count);
+    for (int i = 0; i < element_count; i++) {
+        uint64_t seq = mdata.current_seq++;
+        uint64_t inner_seq = (i == 0) ? edge_seq : seq - 1;
+        uint64_t outer_seq = (i == element_count - 1) ? 0 : seq + 1;
+        if (push_head) {
+            put_list_element(db_idx, key, seq, outer_seq, inner_seq, elements[i], &batch);
+        } else {
+            put_list_element(db_idx, key, seq, inner_seq, outer_seq, elements[i], &batch);
+        }
     }
+    
+    if (push_head) {
+        mdata.head_seq = mdata.current_seq - 1;
+    } else {
+        mdata.tail_seq = mdata.current_seq - 1;
+    }
+    mdata.count += element_count;
+    put_meta_data(db_idx, KEY_TYPE_LIST, key, mdata.ttl, mdata.count, mdata.head_seq, mdata.tail_seq,
+                  mdata.current_seq, &batch);
+    DB_BATCH_UPDATE(batch)
+    list_count = mdata.count;
+    return kElementOK;
+}
+
+// pop the head or the tail element of the list, the key is deleted with the last element
+static int pop_list_element(int db_idx, const string& key, bool pop_head, string& value)
+{
+    MetaData mdata;
+    rocksdb::WriteBatch batch;
+    int ret = expire_key_if_needed(db_idx, key, mdata);
+    if (ret == kExpireDBError) {
+        return kElementDBError;
+    } else if (ret == kExpireKeyNotExist) {
+        return kElementNoKey;
+    } else if (mdata.type != KEY_TYPE_LIST) {
+        return kElementWrongType;
+    }
+    
+    uint64_t prev_seq, next_seq;
+    uint64_t seq = pop_head ? mdata.head_seq : mdata.tail_seq;
+    int result = get_list_element(db_idx, key, seq, prev_seq, next_seq, value);
+    if (result != FIELD_EXIST) {
+        // element not exist or db error all means the list has broken
+        return kElementDBError;
+    }
+    
+    if (mdata.count == 1) {
+        // last element in the list, delete key
+        delete_key(db_idx, key, mdata.ttl, KEY_TYPE_LIST);
+        return kElementOK;
+    }
+    
+    // delete list element, update the new head or tail element
+    del_list_element(db_idx, key, seq, &batch);
+    
+    uint64_t edge_seq = pop_head ? next_seq : prev_seq;
+    string edge_value;
+    result = get_list_element(db_idx, key, edge_seq, prev_seq, next_seq, edge_value);
+    if (result != FIELD_EXIST) {
+        return kElementDBError;
+    }
+    
+    if (pop_head) {
+        put_list_element(db_idx, key, edge_seq, 0, next_seq, edge_value, &batch);
+        put_meta_data(db_idx, KEY_TYPE_LIST, key, mdata.ttl, mdata.count - 1, edge_seq,
+                      mdata.tail_seq, mdata.current_seq, &batch);
+    } else {
+        put_list_element(db_idx, key, edge_seq, prev_seq, 0, edge_value, &batch);
+        put_meta_data(db_idx, KEY_TYPE_LIST, key, mdata.ttl, mdata.count - 1, mdata.head_seq,
+                      edge_seq, mdata.current_seq, &batch);
+    }
+    DB_BATCH_UPDATE(batch)
+    return kElementOK;
+}
+
+static void generic_push_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec, bool push_head)
+{
+    int db_idx = conn->GetDBIndex();
+    uint64_t list_count = 0;
+    string key = cmd_vec[1].ToString();
+    KeyLockGuard lock_guard(db_idx, key);
+    int ret = push_list_elements(db_idx, key, &cmd_vec[2], (int)cmd_vec.size() - 2, push_head, list_count);
+    if (ret != kElementOK) {
+        send_element_error(conn, ret);
+        return;
+    }
+    
+    g_server.binlog.Store(db_idx, conn->GetCurReqCommand());
+    signal_key_ready(db_idx, key);
+    conn->SendInteger(list_count);
+}
+
+void lpush_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec)
+{
+    generic_push_command(conn, cmd_vec, true);
 }
 
 void lrange_command(ClientConn* conn, const vector<string>& cmd_vec)
@@ -295,15 +384,15 @@ void lrange_command(ClientConn* conn, const vector<string>& cmd_vec)
         return;
     }
     
-    vector<string> list_vec;
     int db_idx = conn->GetDBIndex();
     MetaData mdata;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    ReadSnapshotGuard snapshot_guard(db_idx);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    int ret = get_meta_data(db_idx, cmd_vec[1], mdata, read_option);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
     } else if (ret == kExpireKeyNotExist) {
-        conn->SendArray(list_vec);
+        conn->SendMultiBuldLen(0);
     } else {
         if (mdata.type != KEY_TYPE_LIST) {
             conn->SendRawResponse(kWrongTypeError);
@@ -319,171 +408,278 @@ void lrange_command(ClientConn* conn, const vector<string>& cmd_vec)
         /* Invariant: start >= 0, so this test will be true when end < 0.
          * The range is empty when start > end or start >= length. */
         if (start > end || start >= lcount) {
-            conn->SendArray(list_vec);
+            conn->SendMultiBuldLen(0);
             return;
         }
         
         if (end >= lcount) end = lcount - 1;
         
+        // elements are sent as they are read, a long range is never held in memory as a whole
+        conn->SendMultiBuldLen(end - start + 1);
         uint64_t seq = mdata.head_seq;
-        for (long i = 0; i <= end; i++) {
+        for (long i = 0; (i <= end) && conn->IsOpen(); i++) {
             uint64_t prev_seq;
             uint64_t next_seq;
             string value;
-            if (get_list_element(db_idx, cmd_vec[1], seq, prev_seq, next_seq, value) != FIELD_EXIST) {
-                conn->SendError("db error");
+            if (get_list_element(db_idx, cmd_vec[1], seq, prev_seq, next_seq, value, read_option) != FIELD_EXIST) {
+                conn->AbortStreamReply("db error");
                 return;
             }
             
             seq = next_seq;
             if (i >= start) {
-                list_vec.push_back(value);
+                conn->SendBulkSlice(value);
             }
         }
-        
-        conn->SendArray(list_vec);
     }
 }
 
-void rpush_command(ClientConn* conn, const vector<string>& cmd_vec)
+void rpush_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec)
+{
+    generic_push_command(conn, cmd_vec, false);
+}
+
+static void generic_pop_command(ClientConn* conn, const vector<string>& cmd_vec, bool pop_head)
 {
-    int cmd_size = (int)cmd_vec.size();
-    uint64_t element_count = cmd_size - 2;
     int db_idx = conn->GetDBIndex();
-    MetaData mdata;
-    rocksdb::WriteBatch batch;
+    string value;
     KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
-    if (ret == kExpireDBError) {
-        conn->SendError("db error");
-    } else if (ret == kExpireKeyNotExist) {
-        g_server.key_count_vec[db_idx]++;
-        uint64_t current_seq = 1;
-        for (int i = 2; i < cmd_size; i++) {
-            uint64_t prev_seq = (i == 2) ? 0 : current_seq - 1;
-            uint64_t next_seq = (i == cmd_size - 1) ? 0 : current_seq + 1;
-            put_list_element(db_idx, cmd_vec[1], current_seq,  prev_seq, next_seq, cmd_vec[i], &batch);
-            current_seq++;
-        }
-        
-        uint64_t head_seq = 1;
-        uint64_t tail_seq = current_seq - 1;
-        put_meta_data(db_idx, KEY_TYPE_LIST, cmd_vec[1], 0, element_count, head_seq, tail_seq, current_seq, &batch);
-        DB_BATCH_UPDATE(batch)
-        g_server.binlog.Store(db_idx, conn->GetCurReqCommand());
-        conn->SendInteger(element_count);
+    int ret = pop_list_element(db_idx, cmd_vec[1], pop_head, value);
+    if (ret == kElementNoKey) {
+        conn->SendRawResponse(kNullBulkString);
+    } else if (ret != kElementOK) {
+        send_element_error(conn, ret);
     } else {
-        if (mdata.type != KEY_TYPE_LIST) {
-            conn->SendRawResponse(kWrongTypeError);
-            return;
-        }
-        
-        uint64_t prev_seq, next_seq;
+        g_server.binlog.Store(db_idx, conn->GetCurReqCommand());
+        conn->SendBulkString(std::move(value));
+    }
+}
+
+void lpop_command(ClientConn* conn, const vector<string>& cmd_vec)
+{
+    generic_pop_command(conn, cmd_vec, true);
+}
+
+void rpop_command(ClientConn* conn, const vector<string>& cmd_vec)
+{
+    generic_pop_command(conn, cmd_vec, false);
+}
+
+// the binlog of a blocking command is the non-blocking command without the timeout, so a slave never blocks
+static void store_unblocked_binlog(int db_idx, const vector<string>& cmd_vec)
+{
+    string request;
+    build_request(cmd_vec, request);
+    g_server.binlog.Store(db_idx, request);
+}
+
+static void generic_blocking_pop_command(ClientConn* conn, const vector<string>& cmd_vec, bool pop_head)
+{
+    uint64_t timeout_ms;
+    if (!get_block_timeout(conn, cmd_vec.back(), timeout_ms)) {
+        return;
+    }
+    
+    int db_idx = conn->GetDBIndex();
+    vector<string> keys(cmd_vec.begin() + 1, cmd_vec.end() - 1);
+    KeysLockGuard lock_guard(db_idx, set<string>(keys.begin(), keys.end()));
+    bool woken = is_client_blocked(conn);
+    for (const string& key : keys) {
         string value;
-        int result = get_list_element(db_idx, cmd_vec[1], mdata.tail_seq,  prev_seq, next_seq, value);
-        if (result == FIELD_EXIST) {
-            put_list_element(db_idx, cmd_vec[1], mdata.tail_seq, prev_seq, mdata.current_seq, value, &batch);
-        } else {
-            // element not exist or db error all means the list has broken
-            conn->SendError("db error");
-            return;
+        int ret = pop_list_element(db_idx, key, pop_head, value);
+        if ((ret == kElementNoKey) || (woken && (ret == kElementWrongType))) {
+            // a woken client keeps waiting if the key is not a list any more, like the key is deleted again
+            continue;
         }
         
-        for (int i = 2; i < cmd_size; i++) {
-            uint64_t prev_seq = (i == 2) ? mdata.tail_seq :  mdata.current_seq - 1;
-            uint64_t next_seq = (i == cmd_size - 1) ? 0 :  mdata.current_seq + 1;
-            put_list_element(db_idx, cmd_vec[1], mdata.current_seq, prev_seq, next_seq, cmd_vec[i], &batch);
-            mdata.current_seq++;
+        unblock_client(conn);
+        if (ret != kElementOK) {
+            send_element_error(conn, ret);
+            return;
         }
         
-        mdata.count += element_count;
-        mdata.tail_seq = mdata.current_seq - 1;
-        put_meta_data(db_idx, KEY_TYPE_LIST, cmd_vec[1], mdata.ttl,  mdata.count, mdata.head_seq, mdata.tail_seq,
-                      mdata.current_seq, &batch);
-        DB_BATCH_UPDATE(batch)
-        g_server.binlog.Store(db_idx, conn->GetCurReqCommand());
-        conn->SendInteger(mdata.count);
+        store_unblocked_binlog(db_idx, {pop_head ? "LPOP" : "RPOP", key});
+        conn->SendArray({key, std::move(value)});
+        return;
+    }
+    
+    if (!block_client(conn, keys, timeout_ms)) {
+        conn->SendRawResponse(kNullMultiBulk);
     }
 }
 
-static void generic_pop_command(ClientConn* conn, const vector<string>& cmd_vec, bool pop_head)
+void blpop_command(ClientConn* conn, const vector<string>& cmd_vec)
 {
-    int db_idx = conn->GetDBIndex();
-    MetaData mdata;
-    rocksdb::WriteBatch batch;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    generic_blocking_pop_command(conn, cmd_vec, true);
+}
+
+void brpop_command(ClientConn* conn, const vector<string>& cmd_vec)
+{
+    generic_blocking_pop_command(conn, cmd_vec, false);
+}
+
+// pop an element of the source list and push it to the destination list, the changes of both lists are written
+// in one batch, so an element of a reliable queue is never lost or duplicated
+// a source of another type is taken as no key if wait_for_list is true
+static int move_list_element(int db_idx, const string& src, const string& dst, bool pop_head, bool push_head,
+                             bool wait_for_list, string& value)
+{
+    MetaData src_mdata;
+    int ret = expire_key_if_needed(db_idx, src, src_mdata);
     if (ret == kExpireDBError) {
-        conn->SendError("db error");
+        return kElementDBError;
     } else if (ret == kExpireKeyNotExist) {
-        conn->SendRawResponse(kNullBulkString);
-    } else {
-        if (mdata.type != KEY_TYPE_LIST) {
-            conn->SendRawResponse(kWrongTypeError);
-            return;
-        }
-        
-        uint64_t prev_seq, next_seq;
-        string value;
-        uint64_t seq = pop_head ? mdata.head_seq : mdata.tail_seq;
-        
-        int result = get_list_element(db_idx, cmd_vec[1], seq, prev_seq, next_seq, value);
-        if (result != FIELD_EXIST) {
-            // element not exist or db error all means the list has broken
-            conn->SendError("db error");
-            return;
+        return kElementNoKey;
+    } else if (src_mdata.type != KEY_TYPE_LIST) {
+        return wait_for_list ? kElementNoKey : kElementWrongType;
+    }
+    
+    // a destination of the wrong type fails the command before the element is popped
+    MetaData mdata;
+    ret = expire_key_if_needed(db_idx, dst, mdata);
+    if (ret == kExpireDBError) {
+        return kElementDBError;
+    } else if ((ret == kExpireKeyExist) && (mdata.type != KEY_TYPE_LIST)) {
+        return kElementWrongType;
+    }
+    
+    // the writes go to the batch of a transaction, which the push reads through when the source is the destination,
+    // the command in EXEC or a script writes to the running transaction
+    Transaction* transaction = get_running_transaction() ? NULL : new Transaction();
+    if (transaction) {
+        transaction->Run(db_idx);
+    }
+    
+    uint64_t list_count;
+    bool popped = false;
+    ret = pop_list_element(db_idx, src, pop_head, value);
+    if (ret == kElementOK) {
+        popped = true;
+        rocksdb::Slice element(value);
+        ret = push_list_elements(db_idx, dst, &element, 1, push_head, list_count);
+    }
+    
+    if (transaction) {
+        if (ret == kElementOK) {
+            if (!transaction->Commit()) {
+                ret = kElementDBError;
+                // the destination created by the push is not written either
+                if (list_count == 1) {
+                    g_server.key_count_vec[db_idx]--;
+                }
+            }
+        } else {
+            transaction->Rollback();
         }
         
-        if (mdata.count == 1) {
-            // last element in the list, delete key
-            delete_key(db_idx, cmd_vec[1], mdata.ttl, KEY_TYPE_LIST);
-        } else {
-            // delete list element, update the new head or tail element
-            del_list_element(db_idx, cmd_vec[1], seq, &batch);
-            
-            uint64_t edge_seq = pop_head ? next_seq : prev_seq;
-            string edge_value;
-            int result = get_list_element(db_idx, cmd_vec[1], edge_seq, prev_seq, next_seq, edge_value);
-            if (result != FIELD_EXIST) {
-                // element not exist or db error all means the list has broken
-                conn->SendError("db error");
-                return;
-            }
-            
-            if (pop_head) {
-                put_list_element(db_idx, cmd_vec[1], edge_seq, 0, next_seq, edge_value, &batch);
-                put_meta_data(db_idx, KEY_TYPE_LIST, cmd_vec[1], mdata.ttl, mdata.count - 1, edge_seq,
-                              mdata.tail_seq, mdata.current_seq, &batch);
-            } else {
-                put_list_element(db_idx, cmd_vec[1], edge_seq, prev_seq, 0, edge_value, &batch);
-                put_meta_data(db_idx, KEY_TYPE_LIST, cmd_vec[1], mdata.ttl, mdata.count - 1, mdata.head_seq,
-                              edge_seq, mdata.current_seq, &batch);
+        if (ret != kElementOK) {
+            // the key counts are not in the batch, count the source list deleted with its last element again.
+            // a failed push does not count the destination
+            if (popped && (src_mdata.count == 1)) {
+                g_server.key_count_vec[db_idx]++;
+                if (src_mdata.ttl > 0) {
+                    g_server.ttl_key_count_vec[db_idx]++;
+                }
             }
-            DB_BATCH_UPDATE(batch)
         }
-        
+        delete transaction;
+    }
+    return ret;
+}
+
+// RPOPLPUSH/LMOVE/BRPOPLPUSH/BLMOVE
+static void generic_move_command(ClientConn* conn, const vector<string>& cmd_vec, bool pop_head, bool push_head,
+                                 bool blocking)
+{
+    uint64_t timeout_ms = 0;
+    if (blocking && !get_block_timeout(conn, cmd_vec.back(), timeout_ms)) {
+        return;
+    }
+    
+    int db_idx = conn->GetDBIndex();
+    const string& src = cmd_vec[1];
+    const string& dst = cmd_vec[2];
+    string value;
+    KeysLockGuard lock_guard(db_idx, set<string>{src, dst});
+    bool woken = blocking && is_client_blocked(conn);
+    int ret = move_list_element(db_idx, src, dst, pop_head, push_head, woken, value);
+    if (ret == kElementNoKey) {
+        if (!blocking) {
+            conn->SendRawResponse(kNullBulkString);
+        } else if (!block_client(conn, {src}, timeout_ms)) {
+            conn->SendRawResponse(kNullMultiBulk);
+        }
+        return;
+    }
+    
+    unblock_client(conn);
+    if (ret != kElementOK) {
+        send_element_error(conn, ret);
+        return;
+    }
+    
+    if (blocking) {
+        vector<string> move_cmd_vec(cmd_vec.begin(), cmd_vec.end() - 1);
+        move_cmd_vec[0].erase(0, 1);    // BRPOPLPUSH to RPOPLPUSH, BLMOVE to LMOVE
+        store_unblocked_binlog(db_idx, move_cmd_vec);
+    } else {
         g_server.binlog.Store(db_idx, conn->GetCurReqCommand());
-        conn->SendBulkString(value);
     }
+    signal_key_ready(db_idx, dst);
+    conn->SendBulkString(std::move(value));
 }
 
-void lpop_command(ClientConn* conn, const vector<string>& cmd_vec)
+// LEFT or RIGHT of LMOVE
+static bool parse_list_end(const string& arg, bool& head)
 {
-    generic_pop_command(conn, cmd_vec, true);
+    if (!strcasecmp(arg.c_str(), "left")) {
+        head = true;
+    } else if (!strcasecmp(arg.c_str(), "right")) {
+        head = false;
+    } else {
+        return false;
+    }
+    return true;
 }
 
-void rpop_command(ClientConn* conn, const vector<string>& cmd_vec)
+void rpoplpush_command(ClientConn* conn, const vector<string>& cmd_vec)
 {
-    generic_pop_command(conn, cmd_vec, false);
+    generic_move_command(conn, cmd_vec, false, true, false);
+}
+
+void brpoplpush_command(ClientConn* conn, const vector<string>& cmd_vec)
+{
+    generic_move_command(conn, cmd_vec, false, true, true);
+}
+
+static void generic_lmove_command(ClientConn* conn, const vector<string>& cmd_vec, bool blocking)
+{
+    bool pop_head, push_head;
+    if (!parse_list_end(cmd_vec[3], pop_head) || !parse_list_end(cmd_vec[4], push_head)) {
+        conn->SendError("syntax error");
+        return;
+    }
+    generic_move_command(conn, cmd_vec, pop_head, push_head, blocking);
 }
 
-void lpushx_command(ClientConn* conn, const vector<string>& cmd_vec)
+void lmove_command(ClientConn* conn, const vector<string>& cmd_vec)
+{
+    generic_lmove_command(conn, cmd_vec, false);
+}
+
+void blmove_command(ClientConn* conn, const vector<string>& cmd_vec)
+{
+    generic_lmove_command(conn, cmd_vec, true);
+}
+
+void lpushx_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec)
 {
     int db_idx = conn->GetDBIndex();
+    string key = cmd_vec[1].ToString();
     MetaData mdata;
     rocksdb::WriteBatch batch;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    KeyLockGuard lock_guard(db_idx, key);
+    int ret = expire_key_if_needed(db_idx, key, mdata);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
     } else if (ret == kExpireKeyNotExist) {
@@ -496,7 +692,7 @@ void lpushx_command(ClientConn* conn, const vector<string>& cmd_vec)
         
         uint64_t prev_seq, next_seq;
         string value;
-        int result = get_list_element(db_idx, cmd_vec[1], mdata.head_seq, prev_seq, next_seq, value);
+        int result = get_list_element(db_idx, key, mdata.head_seq, prev_seq, next_seq, value);
         if (result != FIELD_EXIST) {
             // element not exist or db error all means the list has broken
             conn->SendError("db error");
@@ -504,16 +700,16 @@ void lpushx_command(ClientConn* conn, const vector<string>& cmd_vec)
         }
         
         // update old head element
-        put_list_element(db_idx, cmd_vec[1], mdata.head_seq, mdata.current_seq, next_seq, value, &batch);
+        put_list_element(db_idx, key, mdata.head_seq, mdata.current_seq, next_seq, value, &batch);
         
         // update new head element
-        put_list_element(db_idx, cmd_vec[1], mdata.current_seq, 0, mdata.head_seq, cmd_vec[2], &batch);
+        put_list_element(db_idx, key, mdata.current_seq, 0, mdata.head_seq, cmd_vec[2], &batch);
         
         // update meta data
         mdata.head_seq = mdata.current_seq;
         mdata.current_seq++;
         mdata.count++;
-        put_meta_data(db_idx, KEY_TYPE_LIST, cmd_vec[1], mdata.ttl, mdata.count, mdata.head_seq, mdata.tail_seq,
+        put_meta_data(db_idx, KEY_TYPE_LIST, key, mdata.ttl, mdata.count, mdata.head_seq, mdata.tail_seq,
                       mdata.current_seq, &batch);
         DB_BATCH_UPDATE(batch)
         g_server.binlog.Store(db_idx, conn->GetCurReqCommand());
@@ -521,13 +717,14 @@ void lpushx_command(ClientConn* conn, const vector<string>& cmd_vec)
     }
 }
 
-void rpushx_command(ClientConn* conn, const vector<string>& cmd_vec)
+void rpushx_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec)
 {
     int db_idx = conn->GetDBIndex();
+    string key = cmd_vec[1].ToString();
     MetaData mdata;
     rocksdb::WriteBatch batch;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    KeyLockGuard lock_guard(db_idx, key);
+    int ret = expire_key_if_needed(db_idx, key, mdata);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
     } else if (ret == kExpireKeyNotExist) {
@@ -540,7 +737,7 @@ void rpushx_command(ClientConn* conn, const vector<string>& cmd_vec)
         
         uint64_t prev_seq, next_seq;
         string value;
-        int result = get_list_element(db_idx, cmd_vec[1], mdata.tail_seq, prev_seq, next_seq, value);
+        int result = get_list_element(db_idx, key, mdata.tail_seq, prev_seq, next_seq, value);
         if (result != FIELD_EXIST) {
             // element not exist or db error all means the list has broken
             conn->SendError("db error");
@@ -548,16 +745,16 @@ void rpushx_command(ClientConn* conn, const vector<string>& cmd_vec)
         }
         
         // update old tail element
-        put_list_element(db_idx, cmd_vec[1], mdata.tail_seq, prev_seq, mdata.current_seq, value, &batch);
+        put_list_element(db_idx, key, mdata.tail_seq, prev_seq, mdata.current_seq, value, &batch);
         
         // update new tail element
-        put_list_element(db_idx, cmd_vec[1], mdata.current_seq, mdata.tail_seq, 0, cmd_vec[2], &batch);
+        put_list_element(db_idx, key, mdata.current_seq, mdata.tail_seq, 0, cmd_vec[2], &batch);
         
         // update meta data
         mdata.tail_seq = mdata.current_seq;
         mdata.current_seq++;
         mdata.count++;
-        put_meta_data(db_idx, KEY_TYPE_LIST, cmd_vec[1], mdata.ttl, mdata.count, mdata.head_seq, mdata.tail_seq,
+        put_meta_data(db_idx, KEY_TYPE_LIST, key, mdata.ttl, mdata.count, mdata.head_seq, mdata.tail_seq,
                       mdata.current_seq, &batch);
         DB_BATCH_UPDATE(batch)
         g_server.binlog.Store(db_idx, conn->GetCurReqCommand());
@@ -566,113 +763,244 @@ void rpushx_command(ClientConn* conn, const vector<string>& cmd_vec)
 }
 
 // lrem key count value
-void lrem_command(ClientConn* conn, const vector<string>& cmd_vec)
+// LREM goes through the list in the snapshot in slices without the key lock, and remembers the elements to remove,
+// then removes them under the key lock at once, if the list was changed in the middle, the scan starts over
+class LRemCommand : public SlicedCommand {
+public:
+    LRemCommand(ClientConn* conn, const vector<string>& cmd_vec, long toremove);
+    virtual ~LRemCommand() {}
+    
+    virtual bool RunSlice(ClientConn* conn, uint64_t deadline_us);
+private:
+    bool _Start(ClientConn* conn);
+    int _Scan(uint64_t deadline_us);
+    int _ScanElements(uint64_t deadline_us);
+    void _Apply(ClientConn* conn);
+private:
+    string      key_;
+    string      value_;
+    string      command_;   // for binlog, the request is gone after the first slice
+    long        toremove_;
+    bool        forward_;
+    bool        started_;
+    MetaData    mdata_;
+    uint64_t    seq_;       // the element the next slice starts from
+    uint64_t    visited_;
+    vector<uint64_t> remove_seqs_;
+};
+
+LRemCommand::LRemCommand(ClientConn* conn, const vector<string>& cmd_vec, long toremove)
+    : SlicedCommand(conn->GetDBIndex()), key_(cmd_vec[1]), value_(cmd_vec[3]), command_(conn->GetCurReqCommand())
 {
-    long toremove;
-    if (get_long_from_string(cmd_vec[2], toremove) == CODE_ERROR) {
-        conn->SendError("count is not a valid number");
-        return;
+    forward_ = true;
+    if (toremove < 0) {
+        toremove = -toremove;
+        forward_ = false;
     }
-    
-    int db_idx = conn->GetDBIndex();
-    MetaData mdata;
-    rocksdb::WriteBatch batch;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    toremove_ = toremove;
+    started_ = false;
+    seq_ = 0;
+    visited_ = 0;
+}
+
+// called with the key lock held, return false if the reply is done
+bool LRemCommand::_Start(ClientConn* conn)
+{
+    string raw_meta;
+    int ret = expire_key_if_needed(db_idx_, key_, mdata_, &raw_meta);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
+        return false;
     } else if (ret == kExpireKeyNotExist) {
         conn->SendInteger(0);
-    } else {
-        if (mdata.type != KEY_TYPE_LIST) {
-            conn->SendRawResponse(kWrongTypeError);
-            return;
+        return false;
+    } else if (mdata_.type != KEY_TYPE_LIST) {
+        conn->SendRawResponse(kWrongTypeError);
+        return false;
+    }
+    
+    WatchKey(key_, raw_meta);
+    TakeSnapshot();
+    seq_ = forward_ ? mdata_.head_seq : mdata_.tail_seq;
+    visited_ = 0;
+    remove_seqs_.clear();
+    return true;
+}
+
+// called without the key lock
+int LRemCommand::_Scan(uint64_t deadline_us)
+{
+    ScanKeyGuard scan_key_guard(db_idx_);
+    if (IsFlushed()) {
+        return SCAN_DONE;   // found out before applying
+    }
+    
+    return _ScanElements(deadline_us);
+}
+
+int LRemCommand::_ScanElements(uint64_t deadline_us)
+{
+    int check_count = 0;
+    for (; visited_ < mdata_.count; visited_++) {
+        if (IsTimeout(deadline_us, check_count)) {
+            return SCAN_MORE;
         }
         
-        bool forward = true;
-        long removed = 0;
-        if (toremove < 0) {
-            toremove = -toremove;
-            forward = false;
+        uint64_t prev_seq, next_seq;
+        string value;
+        if (get_list_element(db_idx_, key_, seq_, prev_seq, next_seq, value, read_option_) != FIELD_EXIST) {
+            // element not exist or db error all means the list has broken
+            return SCAN_ERROR;
         }
         
-        uint64_t count = mdata.count;
-        uint64_t seq = forward ? mdata.head_seq : mdata.tail_seq;
-        for (uint64_t i = 0; i < count; i++) {
-            uint64_t prev_seq, next_seq;
-            string value;
-            int result = get_list_element(db_idx, cmd_vec[1], seq, prev_seq, next_seq, value);
-            if (result != FIELD_EXIST) {
-                // element not exist or db error all means the list has broken
-                conn->SendError("db error");
-                return;
-            }
-            
-            if (value == cmd_vec[3]) {
-                del_list_element(db_idx, cmd_vec[1], seq);
-                
-                value.clear();
-                uint64_t p_seq, n_seq;
-                if (prev_seq == 0) {
-                    // this is the head of the list
-                    mdata.head_seq = next_seq;
-                    get_list_element(db_idx, cmd_vec[1], mdata.head_seq, p_seq, n_seq, value);
-                    put_list_element(db_idx, cmd_vec[1], mdata.head_seq, 0, n_seq, value, &batch);
-                } else if (next_seq == 0) {
-                    // this is the tail of the list
-                    mdata.tail_seq = prev_seq;
-                    get_list_element(db_idx, cmd_vec[1], mdata.tail_seq, p_seq, n_seq, value);
-                    put_list_element(db_idx, cmd_vec[1], mdata.tail_seq, p_seq, 0, value, &batch);
-                } else {
-                    // this is the middle element of the list
-                    uint64_t seq2 = prev_seq;
-                    get_list_element(db_idx, cmd_vec[1], seq2, p_seq, n_seq, value);
-                    put_list_element(db_idx, cmd_vec[1], seq2, p_seq, next_seq, value, &batch);
-                    
-                    value.clear();
-                    seq2 = next_seq;
-                    get_list_element(db_idx, cmd_vec[1], seq2, p_seq, n_seq, value);
-                    put_list_element(db_idx, cmd_vec[1], seq2, prev_seq, n_seq, value, &batch);
-                }
-                
-                // update to db whenever delete an element, otherwise the process of delete
-                // continuous same value elements will be very complex
-                mdata.count--;
-                if (mdata.count == 0) {
-                    delete_key(db_idx, cmd_vec[1], mdata.ttl, KEY_TYPE_LIST);
-                } else {
-                    put_meta_data(db_idx, KEY_TYPE_LIST, cmd_vec[1], mdata.ttl, mdata.count, mdata.head_seq, mdata.tail_seq,
-                                  mdata.current_seq, &batch);
-                    DB_BATCH_UPDATE(batch)
-                }
-                
-                removed++;
-                if (toremove && (removed == toremove)) {
-                    break;
-                }
+        if (value == value_) {
+            remove_seqs_.push_back(seq_);
+            if (toremove_ && ((long)remove_seqs_.size() == toremove_)) {
+                break;
             }
+        }
+        
+        seq_ = forward_ ? next_seq : prev_seq;
+    }
+    
+    return SCAN_DONE;
+}
+
+// called with the key lock held
+void LRemCommand::_Apply(ClientConn* conn)
+{
+    long removed = 0;
+    for (uint64_t seq : remove_seqs_) {
+        uint64_t prev_seq, next_seq;
+        string value;
+        if (get_list_element(db_idx_, key_, seq, prev_seq, next_seq, value) != FIELD_EXIST) {
+            conn->SendError("db error");
+            return;
+        }
+        
+        // every element is removed with one batch, so a snapshot never sees the list half linked
+        rocksdb::WriteBatch batch;
+        if (mdata_.count == 1) {
+            // the last element of the list, delete the key
+            mdata_.count = 0;
+            delete_key(db_idx_, key_, mdata_.ttl, KEY_TYPE_LIST, &batch);
+            DB_BATCH_UPDATE(batch)
+            removed++;
+            break;
+        }
+        
+        del_list_element(db_idx_, key_, seq, &batch);
+        
+        value.clear();
+        uint64_t p_seq, n_seq;
+        if (prev_seq == 0) {
+            // this is the head of the list
+            mdata_.head_seq = next_seq;
+            get_list_element(db_idx_, key_, mdata_.head_seq, p_seq, n_seq, value);
+            put_list_element(db_idx_, key_, mdata_.head_seq, 0, n_seq, value, &batch);
+        } else if (next_seq == 0) {
+            // this is the tail of the list
+            mdata_.tail_seq = prev_seq;
+            get_list_element(db_idx_, key_, mdata_.tail_seq, p_seq, n_seq, value);
+            put_list_element(db_idx_, key_, mdata_.tail_seq, p_seq, 0, value, &batch);
+        } else {
+            // this is the middle element of the list
+            uint64_t seq2 = prev_seq;
+            get_list_element(db_idx_, key_, seq2, p_seq, n_seq, value);
+            put_list_element(db_idx_, key_, seq2, p_seq, next_seq, value, &batch);
             
-            seq = forward ? next_seq : prev_seq;
+            value.clear();
+            seq2 = next_seq;
+            get_list_element(db_idx_, key_, seq2, p_seq, n_seq, value);
+            put_list_element(db_idx_, key_, seq2, prev_seq, n_seq, value, &batch);
         }
         
-        g_server.binlog.Store(db_idx, conn->GetCurReqCommand());
-        conn->SendInteger(removed);
+        // update to db whenever delete an element, otherwise the process of delete
+        // continuous same value elements will be very complex
+        mdata_.count--;
+        put_meta_data(db_idx_, KEY_TYPE_LIST, key_, mdata_.ttl, mdata_.count, mdata_.head_seq, mdata_.tail_seq,
+                      mdata_.current_seq, &batch);
+        DB_BATCH_UPDATE(batch)
+        removed++;
     }
+    
+    g_server.binlog.Store(db_idx_, command_);
+    conn->SendInteger(removed);
 }
 
-void lset_command(ClientConn* conn, const vector<string>& cmd_vec)
+bool LRemCommand::RunSlice(ClientConn* conn, uint64_t deadline_us)
+{
+    if (!started_) {
+        started_ = true;
+        KeyLockGuard lock_guard(db_idx_, key_);
+        if (!_Start(conn)) {
+            return true;
+        }
+    }
+    
+    int result = _Scan(deadline_us);
+    if (result == SCAN_MORE) {
+        return false;
+    } else if (result == SCAN_ERROR) {
+        conn->SendError("db error");
+        return true;
+    }
+    
+    KeyLockGuard lock_guard(db_idx_, key_);
+    MetaData mdata;
+    string raw_meta;
+    int ret = expire_key_if_needed(db_idx_, key_, mdata, &raw_meta);
+    if (ret == kExpireDBError) {
+        conn->SendError("db error");
+        return true;
+    }
+    
+    if (IsKeyChanged(key_, (ret == kExpireKeyExist) ? raw_meta : "")) {
+        if (!_Start(conn)) {
+            return true;
+        }
+        
+        if (++retry_count_ <= kSliceMaxRetry) {
+            return false;
+        }
+        
+        // the list keeps changing, go through it with the lock held
+        ReleaseSnapshot();
+        if (_ScanElements(UINT64_MAX) != SCAN_DONE) {
+            conn->SendError("db error");
+            return true;
+        }
+    }
+    
+    _Apply(conn);
+    return true;
+}
+
+void lrem_command(ClientConn* conn, const vector<string>& cmd_vec)
+{
+    long toremove;
+    if (get_long_from_string(cmd_vec[2], toremove) == CODE_ERROR) {
+        conn->SendError("count is not a valid number");
+        return;
+    }
+    
+    conn->RunSlicedCommand(new LRemCommand(conn, cmd_vec, toremove));
+}
+
+void lset_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec)
 {
     long index;
-    if (get_long_from_string(cmd_vec[2], index) == CODE_ERROR) {
+    if (get_long_from_string(cmd_vec[2].ToString(), index) == CODE_ERROR) {
         conn->SendError("index is not valid");
         return;
     }
     
     int db_idx = conn->GetDBIndex();
+    string key = cmd_vec[1].ToString();
     MetaData mdata;
     rocksdb::WriteBatch batch;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    KeyLockGuard lock_guard(db_idx, key);
+    int ret = expire_key_if_needed(db_idx, key, mdata);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
     } else if (ret == kExpireKeyNotExist) {
@@ -702,14 +1030,14 @@ void lset_command(ClientConn* conn, const vector<string>& cmd_vec)
         string value;
         for (long i = 0; i <= index; i++) {
             value.clear();
-            get_list_element(db_idx, cmd_vec[1], seq, prev_seq, next_seq, value);
+            get_list_element(db_idx, key, seq, prev_seq, next_seq, value);
             if (i == index) {
                 break;
             }
             seq = forward ? next_seq : prev_seq;
         }
         
-        put_list_element(db_idx, cmd_vec[1], seq, prev_seq, next_seq, cmd_vec[3]);
+        put_list_element(db_idx, key, seq, prev_seq, next_seq, cmd_vec[3]);
         g_server.binlog.Store(db_idx, conn->GetCurReqCommand());
         conn->SendSimpleString("OK");
     }
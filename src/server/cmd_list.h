@@ -14,16 +14,24 @@
 void lindex_command(ClientConn* conn, const vector<string>& cmd_vec);
 void linsert_command(ClientConn* conn, const vector<string>& cmd_vec);
 void llen_command(ClientConn* conn, const vector<string>& cmd_vec);
-void lpush_command(ClientConn* conn, const vector<string>& cmd_vec);
+void lpush_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec);
 void lpop_command(ClientConn* conn, const vector<string>& cmd_vec);
 void lrange_command(ClientConn* conn, const vector<string>& cmd_vec);
-void rpush_command(ClientConn* conn, const vector<string>& cmd_vec);
+void rpush_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec);
 void rpop_command(ClientConn* conn, const vector<string>& cmd_vec);
 
-void lpushx_command(ClientConn* conn, const vector<string>& cmd_vec);
-void rpushx_command(ClientConn* conn, const vector<string>& cmd_vec);
+// blocking pops and moves between lists, see blocking.h
+void blpop_command(ClientConn* conn, const vector<string>& cmd_vec);
+void brpop_command(ClientConn* conn, const vector<string>& cmd_vec);
+void rpoplpush_command(ClientConn* conn, const vector<string>& cmd_vec);
+void brpoplpush_command(ClientConn* conn, const vector<string>& cmd_vec);
+void lmove_command(ClientConn* conn, const vector<string>& cmd_vec);
+void blmove_command(ClientConn* conn, const vector<string>& cmd_vec);
+
+void lpushx_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec);
+void rpushx_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec);
 void lrem_command(ClientConn* conn, const vector<string>& cmd_vec);
-void lset_command(ClientConn* conn, const vector<string>& cmd_vec);
+void lset_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec);
 void ltrim_command(ClientConn* conn, const vector<string>& cmd_vec);
 
 #endif /* __CMD_LIST_H__ */
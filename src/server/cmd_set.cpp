@@ -20,7 +20,9 @@ static rocksdb::Status put_set_member(int db_idx, const string& key, const strin
     if (batch) {
         s = batch->Put(cf_handle, member_key.GetEncodeKey(), member_value.GetEncodeValue());
     } else {
-        s = g_server.db->Put(g_server.write_option, cf_handle, member_key.GetEncodeKey(), member_value.GetEncodeValue());
+        rocksdb::WriteBatch single_batch;
+        single_batch.Put(cf_handle, member_key.GetEncodeKey(), member_value.GetEncodeValue());
+        s = g_group_commit.Write(g_server.db, &single_batch);
     }
     
     if (!s.ok()) {
@@ -39,7 +41,9 @@ static rocksdb::Status del_set_member(int db_idx, const string& key, const strin
     if (batch) {
         s = batch->Delete(cf_handle, member_key.GetEncodeKey());
     } else {
-        s = g_server.db->Delete(g_server.write_option, cf_handle, member_key.GetEncodeKey());
+        rocksdb::WriteBatch single_batch;
+        single_batch.Delete(cf_handle, member_key.GetEncodeKey());
+        s = g_group_commit.Write(g_server.db, &single_batch);
     }
     
     if (!s.ok()) {
@@ -48,13 +52,8 @@ static rocksdb::Status del_set_member(int db_idx, const string& key, const strin
     return s;
 }
 
-static int get_set_member(int db_idx, const string& key, const string& member)
+int decode_set_member(const rocksdb::Status& status, const string& encode_value)
 {
-    EncodeKey member_key(KEY_TYPE_SET_MEMBER, key, member);
-    rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
-    string encode_value;
-    
-    rocksdb::Status status = g_server.db->Get(g_server.read_option, cf_handle, member_key.GetEncodeKey(), &encode_value);
     if (status.ok()) {
         if (DecodeValue::Decode(encode_value, KEY_TYPE_SET_MEMBER) == kDecodeOK) {
             return FIELD_EXIST;
@@ -68,6 +67,38 @@ static int get_set_member(int db_idx, const string& key, const string& member)
     }
 }
 
+static int get_set_member(int db_idx, const string& key, const string& member,
+                          const rocksdb::ReadOptions& read_option = g_server.read_option)
+{
+    EncodeKey member_key(KEY_TYPE_SET_MEMBER, key, member);
+    rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
+    string encode_value;
+    
+    rocksdb::Status status = db_get(read_option, cf_handle, member_key.GetEncodeKey(), &encode_value);
+    return decode_set_member(status, encode_value);
+}
+
+// get_set_member() of many members with one MultiGet, results[i] is of members[i]
+static void get_set_members(int db_idx, const string& key, const vector<string>& members, vector<int>& results,
+                            const rocksdb::ReadOptions& read_option = g_server.read_option)
+{
+    vector<string> encode_keys;
+    encode_keys.reserve(members.size());
+    for (const string& member : members) {
+        EncodeKey member_key(KEY_TYPE_SET_MEMBER, key, member);
+        encode_keys.push_back(member_key.GetEncodeKey().ToString());
+    }
+    
+    vector<rocksdb::Status> statuses;
+    vector<string> encode_values;
+    multi_get(db_idx, encode_keys, statuses, encode_values, read_option);
+    
+    results.resize(members.size());
+    for (size_t i = 0; i < members.size(); i++) {
+        results[i] = decode_set_member(statuses[i], encode_values[i]);
+    }
+}
+
 void sadd_command(ClientConn* conn, const vector<string>& cmd_vec)
 {
     int cmd_size = (int)cmd_vec.size();
@@ -95,12 +126,14 @@ void sadd_command(ClientConn* conn, const vector<string>& cmd_vec)
         }
         
         int add_cnt = 0;
-        for (int i = 2; i < cmd_size; i++) {
-            int result = get_set_member(db_idx, cmd_vec[1], cmd_vec[i]);
-            if (result == FIELD_EXIST) {
+        vector<string> members(cmd_vec.begin() + 2, cmd_vec.end());
+        vector<int> results;
+        get_set_members(db_idx, cmd_vec[1], members, results);
+        for (size_t i = 0; i < members.size(); i++) {
+            if (results[i] == FIELD_EXIST) {
                 ;
-            } else if (result == FIELD_NOT_EXIST) {
-                put_set_member(db_idx, cmd_vec[1], cmd_vec[i], &batch);
+            } else if (results[i] == FIELD_NOT_EXIST) {
+                put_set_member(db_idx, cmd_vec[1], members[i], &batch);
                 add_cnt++;
             } else {
                 conn->SendError("db error");
@@ -122,8 +155,9 @@ void scard_command(ClientConn* conn, const vector<string>& cmd_vec)
 {
     int db_idx = conn->GetDBIndex();
     MetaData mdata;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    ReadSnapshotGuard snapshot_guard(db_idx, false);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    int ret = get_meta_data(db_idx, cmd_vec[1], mdata, read_option);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
     } else if (ret == kExpireKeyNotExist) {
@@ -141,8 +175,9 @@ void sismember_command(ClientConn* conn, const vector<string>& cmd_vec)
 {
     int db_idx = conn->GetDBIndex();
     MetaData mdata;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    ReadSnapshotGuard snapshot_guard(db_idx, false);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    int ret = get_meta_data(db_idx, cmd_vec[1], mdata, read_option);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
     } else if (ret == kExpireKeyNotExist) {
@@ -153,7 +188,7 @@ void sismember_command(ClientConn* conn, const vector<string>& cmd_vec)
             return;
         }
         
-        int result = get_set_member(db_idx, cmd_vec[1], cmd_vec[2]);
+        int result = get_set_member(db_idx, cmd_vec[1], cmd_vec[2], read_option);
         if (result == FIELD_EXIST) {
             conn->SendInteger(1);
         } else if (result == FIELD_NOT_EXIST) {
@@ -164,50 +199,95 @@ void sismember_command(ClientConn* conn, const vector<string>& cmd_vec)
     }
 }
 
+// SMISMEMBER key member [member ...]
+void smismember_command(ClientConn* conn, const vector<string>& cmd_vec)
+{
+    int db_idx = conn->GetDBIndex();
+    int member_cnt = (int)cmd_vec.size() - 2;
+    MetaData mdata;
+    ReadSnapshotGuard snapshot_guard(db_idx);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    int ret = get_meta_data(db_idx, cmd_vec[1], mdata, read_option);
+    if (ret == kExpireDBError) {
+        conn->SendError("db error");
+    } else if (ret == kExpireKeyNotExist) {
+        conn->SendMultiBuldLen(member_cnt);
+        for (int i = 0; i < member_cnt; i++) {
+            conn->SendInteger(0);
+        }
+    } else {
+        if (mdata.type != KEY_TYPE_SET) {
+            conn->SendRawResponse(kWrongTypeError);
+            return;
+        }
+        
+        vector<string> members(cmd_vec.begin() + 2, cmd_vec.end());
+        vector<int> results;
+        get_set_members(db_idx, cmd_vec[1], members, results, read_option);
+        for (int result : results) {
+            if (result == DB_ERROR) {
+                conn->SendError("db error");
+                return;
+            }
+        }
+        
+        conn->SendMultiBuldLen(member_cnt);
+        for (int result : results) {
+            conn->SendInteger(result == FIELD_EXIST ? 1 : 0);
+        }
+    }
+}
+
 void smembers_command(ClientConn* conn, const vector<string>& cmd_vec)
 {
-    vector<string> member_vec;
     int db_idx = conn->GetDBIndex();
     MetaData mdata;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    ReadSnapshotGuard snapshot_guard(db_idx);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    int ret = get_meta_data(db_idx, cmd_vec[1], mdata, read_option);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
     } else if (ret == kExpireKeyNotExist) {
-        conn->SendArray(member_vec);
+        conn->SendMultiBuldLen(0);
     } else {
         if (mdata.type != KEY_TYPE_SET) {
             conn->SendRawResponse(kWrongTypeError);
             return;
         }
         
+        // stream the members from the iterator, a big set is never held in memory as a whole
+        conn->SendMultiBuldLen((long)mdata.count);
+        
         EncodeKey prefix_key(KEY_TYPE_SET_MEMBER, cmd_vec[1]);
         rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
-        rocksdb::Iterator* it = g_server.db->NewIterator(g_server.read_option, cf_handle);
+        rocksdb::Iterator* it = db_new_iterator(read_option, cf_handle);
         
         uint64_t seek_cnt = 0;
-        for (it->Seek(prefix_key.GetEncodeKey()); it->Valid() && seek_cnt < mdata.count; it->Next(), seek_cnt++) {
+        for (it->Seek(prefix_key.GetEncodeKey()); it->Valid() && seek_cnt < mdata.count && conn->IsOpen();
+             it->Next(), seek_cnt++) {
             string encode_key = it->key().ToString();
             string encode_value = it->value().ToString();
             string key, member;
             
             if (DecodeKey::Decode(encode_key, KEY_TYPE_SET_MEMBER, key, member) != kDecodeOK) {
-                conn->SendError("invalid set key member");
+                conn->AbortStreamReply("invalid set key member");
                 delete it;
                 return;
             }
             
             if (DecodeValue::Decode(encode_value, KEY_TYPE_SET_MEMBER) != kDecodeOK) {
-                conn->SendError("invalid set key value");
+                conn->AbortStreamReply("invalid set key value");
                 delete it;
                 return;
             }
             
-            member_vec.push_back(member);
+            conn->SendBulkSlice(member);
         }
         
         delete it;
-        conn->SendArray(member_vec);
+        if (seek_cnt < mdata.count) {
+            conn->AbortStreamReply("set has less members than the count in meta data");
+        }
     }
 }
 
@@ -244,7 +324,7 @@ void spop_command(ClientConn* conn, const vector<string>& cmd_vec)
         
         EncodeKey prefix_key(KEY_TYPE_SET_MEMBER, cmd_vec[1]);
         rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
-        rocksdb::Iterator* it = g_server.db->NewIterator(g_server.read_option, cf_handle);
+        rocksdb::Iterator* it = db_new_iterator(g_server.read_option, cf_handle);
         
         unsigned long seek_cnt = 0;
         for (it->Seek(prefix_key.GetEncodeKey()); it->Valid() && seek_cnt < pop_cnt; it->Next(), seek_cnt++) {
@@ -270,16 +350,15 @@ void spop_command(ClientConn* conn, const vector<string>& cmd_vec)
         
         mdata.count -= pop_cnt;
         if (mdata.count == 0) {
-            delete_key(db_idx, cmd_vec[1], mdata.ttl, KEY_TYPE_SET);
-            // delete_key will delete all kv data with this key, so we do not need to execute WriteBatch
+            delete_key(db_idx, cmd_vec[1], mdata.ttl, KEY_TYPE_SET, &batch);
         } else {
             put_meta_data(db_idx, KEY_TYPE_SET, cmd_vec[1], mdata.ttl, mdata.count, &batch);
-            DB_BATCH_UPDATE(batch)
         }
+        DB_BATCH_UPDATE(batch)
         
         delete it;
         g_server.binlog.Store(db_idx, conn->GetCurReqCommand());
-        conn->SendArray(member_vec);
+        conn->SendArray(std::move(member_vec));
     }
 }
 
@@ -303,8 +382,9 @@ void srandmember_command(ClientConn* conn, const vector<string>& cmd_vec)
     vector<string> member_vec;
     int db_idx = conn->GetDBIndex();
     MetaData mdata;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    ReadSnapshotGuard snapshot_guard(db_idx);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    int ret = get_meta_data(db_idx, cmd_vec[1], mdata, read_option);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
     } else if (ret == kExpireKeyNotExist) {
@@ -321,7 +401,7 @@ void srandmember_command(ClientConn* conn, const vector<string>& cmd_vec)
         
         EncodeKey prefix_key(KEY_TYPE_SET_MEMBER, cmd_vec[1]);
         rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
-        rocksdb::Iterator* it = g_server.db->NewIterator(g_server.read_option, cf_handle);
+        rocksdb::Iterator* it = db_new_iterator(read_option, cf_handle);
         
         long start, stop;
         if (count >= (int)mdata.count) {
@@ -365,7 +445,7 @@ void srandmember_command(ClientConn* conn, const vector<string>& cmd_vec)
                     member_vec.push_back(member);
                 }
             }
-            conn->SendArray(member_vec);
+            conn->SendArray(std::move(member_vec));
         } else {
             conn->SendBulkString(member_vec[0]);
         }
@@ -390,13 +470,14 @@ void srem_command(ClientConn* conn, const vector<string>& cmd_vec)
         }
         
         int del_cnt = 0;
-        int cmd_size = (int)cmd_vec.size();
-        for (int i = 2; i < cmd_size; i++) {
-            int result = get_set_member(db_idx, cmd_vec[1], cmd_vec[i]);
-            if (result == FIELD_EXIST) {
-                del_set_member(db_idx, cmd_vec[1], cmd_vec[i], &batch);
+        vector<string> members(cmd_vec.begin() + 2, cmd_vec.end());
+        vector<int> results;
+        get_set_members(db_idx, cmd_vec[1], members, results);
+        for (size_t i = 0; i < members.size(); i++) {
+            if (results[i] == FIELD_EXIST) {
+                del_set_member(db_idx, cmd_vec[1], members[i], &batch);
                 del_cnt++;
-            } else if (result == DB_ERROR) {
+            } else if (results[i] == DB_ERROR) {
                 conn->SendError("db error");
                 return;
             }
@@ -405,11 +486,11 @@ void srem_command(ClientConn* conn, const vector<string>& cmd_vec)
         if (del_cnt > 0) {
             mdata.count -= del_cnt;
             if (mdata.count == 0) {
-                delete_key(db_idx, cmd_vec[1], mdata.ttl, mdata.type);
+                delete_key(db_idx, cmd_vec[1], mdata.ttl, mdata.type, &batch);
             } else {
                 put_meta_data(db_idx, KEY_TYPE_SET, cmd_vec[1], mdata.ttl, mdata.count, &batch);
-                DB_BATCH_UPDATE(batch)
             }
+            DB_BATCH_UPDATE(batch)
             
             g_server.binlog.Store(db_idx, conn->GetCurReqCommand());
         }
@@ -430,7 +511,7 @@ void sscan_command(ClientConn* conn, const vector<string>& cmd_vec)
     EncodeKey cursor_key(KEY_TYPE_SET_MEMBER, cmd_vec[1], cmd_vec[2]);
     ScanKeyGuard scan_key_guard(db_idx);
     rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
-    rocksdb::Iterator* it = g_server.db->NewIterator(g_server.read_option, cf_handle);
+    rocksdb::Iterator* it = db_new_iterator(g_server.read_option, cf_handle);
     
     string cursor;
     vector<string> members;
@@ -473,5 +554,5 @@ void sscan_command(ClientConn* conn, const vector<string>& cmd_vec)
     string start_resp = "*2\r\n";
     conn->SendRawResponse(start_resp);
     conn->SendBulkString(cursor);
-    conn->SendArray(members);
+    conn->SendArray(std::move(members));
 }
@@ -14,10 +14,14 @@
 void sadd_command(ClientConn* conn, const vector<string>& cmd_vec);
 void scard_command(ClientConn* conn, const vector<string>& cmd_vec);
 void sismember_command(ClientConn* conn, const vector<string>& cmd_vec);
+void smismember_command(ClientConn* conn, const vector<string>& cmd_vec);
 void smembers_command(ClientConn* conn, const vector<string>& cmd_vec);
 void spop_command(ClientConn* conn, const vector<string>& cmd_vec);
 void srandmember_command(ClientConn* conn, const vector<string>& cmd_vec);
 void srem_command(ClientConn* conn, const vector<string>& cmd_vec);
 void sscan_command(ClientConn* conn, const vector<string>& cmd_vec);
 
+// decode the result of reading a set member, return FIELD_EXIST, FIELD_NOT_EXIST or DB_ERROR
+int decode_set_member(const rocksdb::Status& status, const string& encode_value);
+
 #endif /* __CMD_SET_H__ */
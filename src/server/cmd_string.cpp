@@ -50,8 +50,9 @@ void getrange_command(ClientConn* conn, const vector<string>& cmd_vec)
     
     int db_idx = conn->GetDBIndex();
     MetaData mdata;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    ReadSnapshotGuard snapshot_guard(db_idx, false);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    int ret = get_meta_data(db_idx, cmd_vec[1], mdata, read_option);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
     } else if (ret == kExpireKeyNotExist) {
@@ -144,8 +145,9 @@ void strlen_command(ClientConn* conn, const vector<string>& cmd_vec)
 {
     int db_idx = conn->GetDBIndex();
     MetaData mdata;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    ReadSnapshotGuard snapshot_guard(db_idx, false);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    int ret = get_meta_data(db_idx, cmd_vec[1], mdata, read_option);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
     } else if (ret == kExpireKeyNotExist) {
@@ -164,8 +166,9 @@ void get_command(ClientConn* conn, const vector<string>& cmd_vec)
 {
     int db_idx = conn->GetDBIndex();
     MetaData mdata;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    ReadSnapshotGuard snapshot_guard(db_idx, false);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    int ret = get_meta_data(db_idx, cmd_vec[1], mdata, read_option);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
     } else if (ret == kExpireKeyNotExist) {
@@ -175,7 +178,7 @@ void get_command(ClientConn* conn, const vector<string>& cmd_vec)
             conn->SendRawResponse(kWrongTypeError);
         } else {
             if (mdata.value != "") {
-                conn->SendBulkString(mdata.value);
+                conn->SendBulkString(std::move(mdata.value));
             } else {
                 conn->SendRawResponse(kEmptyBulkString);
             }
@@ -183,18 +186,19 @@ void get_command(ClientConn* conn, const vector<string>& cmd_vec)
     }
 }
 
-void getset_command(ClientConn* conn, const vector<string>& cmd_vec)
+void getset_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec)
 {
     int db_idx = conn->GetDBIndex();
+    string key = cmd_vec[1].ToString();
     MetaData mdata;
     rocksdb::WriteBatch batch;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    KeyLockGuard lock_guard(db_idx, key);
+    int ret = expire_key_if_needed(db_idx, key, mdata);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
     } else if (ret == kExpireKeyNotExist) {
         g_server.key_count_vec[db_idx]++;
-        put_kv_data(db_idx, cmd_vec[1], cmd_vec[2], 0);
+        put_kv_data(db_idx, key, cmd_vec[2], 0);
         g_server.binlog.Store(db_idx, conn->GetCurReqCommand());
         conn->SendRawResponse(kNullBulkString);
     } else {
@@ -204,17 +208,17 @@ void getset_command(ClientConn* conn, const vector<string>& cmd_vec)
         }
         
         if (mdata.ttl > 0) {
-            del_ttl_data(db_idx, mdata.ttl, cmd_vec[1], &batch);
+            del_ttl_data(db_idx, mdata.ttl, key, &batch);
         }
         
-        put_kv_data(db_idx, cmd_vec[1], cmd_vec[2], 0, &batch);
+        put_kv_data(db_idx, key, cmd_vec[2], 0, &batch);
         DB_BATCH_UPDATE(batch)
         g_server.binlog.Store(db_idx, conn->GetCurReqCommand());
-        conn->SendBulkString(mdata.value);
+        conn->SendBulkString(std::move(mdata.value));
     }
 }
 
-static void generic_set_command(ClientConn* conn, const string& key, const string& value, const string& ttl_str,
+static void generic_set_command(ClientConn* conn, const string& key, const rocksdb::Slice& value, const string& ttl_str,
                                 bool unit_second, bool nx, bool xx, bool setnx_resp = false) // setnx must return an integer
 {
     long ttl;
@@ -252,13 +256,13 @@ static void generic_set_command(ClientConn* conn, const string& key, const strin
     }
     
     if (ret == kExpireKeyExist) {
-        delete_key(conn->GetDBIndex(), key, mdata.ttl, mdata.type);
+        delete_key(db_idx, key, mdata.ttl, mdata.type, &batch);
     }
     
     g_server.key_count_vec[db_idx]++;
     if (ttl > 0) {
         g_server.ttl_key_count_vec[db_idx]++;
-        ttl += get_tick_count();
+        ttl += get_wall_time_ms();
     }
     
     put_kv_data(db_idx, key, value, ttl, &batch);
@@ -275,7 +279,7 @@ static void generic_set_command(ClientConn* conn, const string& key, const strin
 }
 
 /* SET key value [NX] [XX] [EX <seconds>] [PX <milliseconds>] */
-void set_command(ClientConn* conn, const vector<string>& cmd_vec)
+void set_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec)
 {
     string ttl_str = "0";
     bool unit_second = true;
@@ -285,14 +289,14 @@ void set_command(ClientConn* conn, const vector<string>& cmd_vec)
     for (int i = 3; i < cmd_size; i++) {
         bool has_next = (i != cmd_size -1);
         
-        if (!strcasecmp(cmd_vec[i].c_str(), "NX")) {
+        if (arg_equal_nocase(cmd_vec[i], "NX")) {
             nx = true;
-        } else if (!strcasecmp(cmd_vec[i].c_str(), "XX")) {
+        } else if (arg_equal_nocase(cmd_vec[i], "XX")) {
             xx = true;
-        } else if (!strcasecmp(cmd_vec[i].c_str(), "EX") && has_next) {
-            ttl_str = cmd_vec[++i];
-        } else if (!strcasecmp(cmd_vec[i].c_str(), "PX") && has_next) {
-            ttl_str = cmd_vec[++i];
+        } else if (arg_equal_nocase(cmd_vec[i], "EX") && has_next) {
+            ttl_str = cmd_vec[++i].ToString();
+        } else if (arg_equal_nocase(cmd_vec[i], "PX") && has_next) {
+            ttl_str = cmd_vec[++i].ToString();
             unit_second = false;
         } else {
             conn->SendError("syntax error");
@@ -300,25 +304,25 @@ void set_command(ClientConn* conn, const vector<string>& cmd_vec)
         }
     }
     
-    generic_set_command(conn, cmd_vec[1], cmd_vec[2], ttl_str, unit_second, nx, xx);
+    generic_set_command(conn, cmd_vec[1].ToString(), cmd_vec[2], ttl_str, unit_second, nx, xx);
 }
 
-void setex_command(ClientConn* conn, const vector<string>& cmd_vec)
+void setex_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec)
 {
-    generic_set_command(conn, cmd_vec[1], cmd_vec[3], cmd_vec[2], true, false, false);
+    generic_set_command(conn, cmd_vec[1].ToString(), cmd_vec[3], cmd_vec[2].ToString(), true, false, false);
 }
 
-void setnx_command(ClientConn* conn, const vector<string>& cmd_vec)
+void setnx_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec)
 {
-    generic_set_command(conn, cmd_vec[1], cmd_vec[2], "0", true, true, false, true);
+    generic_set_command(conn, cmd_vec[1].ToString(), cmd_vec[2], "0", true, true, false, true);
 }
 
-void psetex_command(ClientConn* conn, const vector<string>& cmd_vec)
+void psetex_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec)
 {
-    generic_set_command(conn, cmd_vec[1], cmd_vec[3], cmd_vec[2], false, false, false);
+    generic_set_command(conn, cmd_vec[1].ToString(), cmd_vec[3], cmd_vec[2].ToString(), false, false, false);
 }
 
-void mset_command(ClientConn* conn, const vector<string>& cmd_vec)
+void mset_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec)
 {
     int cmd_size = (int)cmd_vec.size();
     if (cmd_size % 2 == 0) {
@@ -330,34 +334,33 @@ void mset_command(ClientConn* conn, const vector<string>& cmd_vec)
     int db_idx = conn->GetDBIndex();
     set<string> keys;
     for (int i = 1; i < cmd_size; i += 2) {
-        keys.insert(cmd_vec[i]);
+        keys.insert(cmd_vec[i].ToString());
     }
     
-    lock_keys(db_idx, keys);
+    KeysLockGuard keys_lock_guard(db_idx, keys);
     
     for (int i = 1; i < cmd_size; i += 2) {
         MetaData mdata;
-        int ret = expire_key_if_needed(db_idx, cmd_vec[i], mdata);
+        string key = cmd_vec[i].ToString();
+        int ret = expire_key_if_needed(db_idx, key, mdata);
         if (ret == kExpireDBError) {
             conn->SendError("db error");
-            unlock_keys(db_idx, keys);
             return;
         } else if (ret == kExpireKeyExist) {
-            delete_key(db_idx, cmd_vec[i], mdata.ttl, mdata.type);
+            delete_key(db_idx, key, mdata.ttl, mdata.type, &batch);
         }
         
-        put_kv_data(db_idx, cmd_vec[i], cmd_vec[i + 1], 0, &batch);
+        put_kv_data(db_idx, key, cmd_vec[i + 1], 0, &batch);
     }
     
     DB_BATCH_UPDATE(batch)
     g_server.binlog.Store(db_idx, conn->GetCurReqCommand());
     g_server.key_count_vec[db_idx] += (long)keys.size();
-    unlock_keys(db_idx, keys);
     
     conn->SendSimpleString("OK");
 }
 
-void msetnx_command(ClientConn* conn, const vector<string>& cmd_vec)
+void msetnx_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec)
 {
     int cmd_size = (int)cmd_vec.size();
     if (cmd_size % 2 == 0) {
@@ -369,31 +372,29 @@ void msetnx_command(ClientConn* conn, const vector<string>& cmd_vec)
     int db_idx = conn->GetDBIndex();
     set<string> keys;
     for (int i = 1; i < cmd_size; i += 2) {
-        keys.insert(cmd_vec[i]);
+        keys.insert(cmd_vec[i].ToString());
     }
     
-    lock_keys(db_idx, keys);
+    KeysLockGuard keys_lock_guard(db_idx, keys);
     
     for (int i = 1; i < cmd_size; i += 2) {
         MetaData mdata;
-        int ret = expire_key_if_needed(db_idx, cmd_vec[i], mdata);
+        string key = cmd_vec[i].ToString();
+        int ret = expire_key_if_needed(db_idx, key, mdata);
         if (ret == kExpireDBError) {
             conn->SendError("db error");
-            unlock_keys(db_idx, keys);
             return;
         } else if (ret == kExpireKeyExist) {
             conn->SendInteger(0);
-            unlock_keys(db_idx, keys);
             return;
         } else {
-            put_kv_data(db_idx, cmd_vec[i], cmd_vec[i + 1], 0, &batch);
+            put_kv_data(db_idx, key, cmd_vec[i + 1], 0, &batch);
         }
     }
     
     DB_BATCH_UPDATE(batch);
     g_server.binlog.Store(db_idx, conn->GetCurReqCommand());
     g_server.key_count_vec[db_idx] += (long)keys.size();
-    unlock_keys(db_idx, keys);
     
     conn->SendInteger(1);
 }
@@ -402,19 +403,18 @@ void mget_command(ClientConn* conn, const vector<string>& cmd_vec)
 {
     vector<string> value_vec;
     int db_idx = conn->GetDBIndex();
-    int cmd_size = (int)cmd_vec.size();
-    set<string> keys;
-    for (int i = 1; i < cmd_size; i++) {
-        keys.insert(cmd_vec[i]);
-    }
-    
-    lock_keys(db_idx, keys);
-    
-    for (int i = 1; i < cmd_size; i++) {
-        MetaData mdata;
-        int ret = expire_key_if_needed(db_idx, cmd_vec[i], mdata);
+    // the values of all keys are read from one snapshot
+    ReadSnapshotGuard snapshot_guard(db_idx);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    vector<string> keys(cmd_vec.begin() + 1, cmd_vec.end());
+    vector<MetaData> mdatas;
+    vector<int> results;
+    multi_get_meta_data(db_idx, keys, mdatas, results, read_option);
+    
+    for (size_t i = 0; i < keys.size(); i++) {
+        MetaData& mdata = mdatas[i];
+        int ret = results[i];
         if (ret == kExpireDBError) {
-            unlock_keys(db_idx, keys);
             conn->SendError("db error");
             return;
         } else if (ret == kExpireKeyNotExist) {
@@ -423,13 +423,12 @@ void mget_command(ClientConn* conn, const vector<string>& cmd_vec)
             if (mdata.type != KEY_TYPE_STRING) {
                 value_vec.push_back("");
             } else {
-                value_vec.push_back(mdata.value);
+                value_vec.push_back(std::move(mdata.value));
             }
         }
     }
     
-    unlock_keys(db_idx, keys);
-    conn->SendArray(value_vec);
+    conn->SendArray(std::move(value_vec));
 }
 
 static void incr_decr_command(ClientConn* conn, const vector<string>& cmd_vec, const string& key, long incr_value)
@@ -604,8 +603,9 @@ void getbit_command(ClientConn* conn, const vector<string>& cmd_vec)
     
     int db_idx = conn->GetDBIndex();
     MetaData mdata;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    ReadSnapshotGuard snapshot_guard(db_idx, false);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    int ret = get_meta_data(db_idx, cmd_vec[1], mdata, read_option);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
     } else if (ret == kExpireKeyNotExist) {
@@ -634,8 +634,9 @@ void bitcount_command(ClientConn* conn, const vector<string>& cmd_vec)
 {
     int db_idx = conn->GetDBIndex();
     MetaData mdata;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    ReadSnapshotGuard snapshot_guard(db_idx, false);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    int ret = get_meta_data(db_idx, cmd_vec[1], mdata, read_option);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
     } else if (ret == kExpireKeyNotExist) {
@@ -724,8 +725,9 @@ void bitpos_command(ClientConn* conn, const vector<string>& cmd_vec)
     
     int db_idx = conn->GetDBIndex();
     MetaData mdata;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    ReadSnapshotGuard snapshot_guard(db_idx, false);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    int ret = get_meta_data(db_idx, cmd_vec[1], mdata, read_option);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
     } else if (ret == kExpireKeyNotExist) {
@@ -17,14 +17,14 @@ void setrange_command(ClientConn* conn, const vector<string>& cmd_vec);
 void strlen_command(ClientConn* conn, const vector<string>& cmd_vec);
 
 void get_command(ClientConn* conn, const vector<string>& cmd_vec);
-void getset_command(ClientConn* conn, const vector<string>& cmd_vec);
-void set_command(ClientConn* conn, const vector<string>& cmd_vec);
-void setex_command(ClientConn* conn, const vector<string>& cmd_vec);
-void setnx_command(ClientConn* conn, const vector<string>& cmd_vec);
-void psetex_command(ClientConn* conn, const vector<string>& cmd_vec);
-
-void mset_command(ClientConn* conn, const vector<string>& cmd_vec);
-void msetnx_command(ClientConn* conn, const vector<string>& cmd_vec);
+void getset_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec);
+void set_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec);
+void setex_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec);
+void setnx_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec);
+void psetex_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec);
+
+void mset_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec);
+void msetnx_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec);
 void mget_command(ClientConn* conn, const vector<string>& cmd_vec);
 
 void incr_command(ClientConn* conn, const vector<string>& cmd_vec);
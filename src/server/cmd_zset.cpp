@@ -9,6 +9,8 @@
 #include "cmd_zset.h"
 #include "db_util.h"
 #include "encoding.h"
+#include "sliced_command.h"
+#include "blocking.h"
 #include "rocksdb/comparator.h"
 #include <math.h>
 
@@ -133,7 +135,9 @@ static rocksdb::Status put_zset_score(int db_idx, const string& key, const strin
     if (batch) {
         s = batch->Put(cf_handle, member_key.GetEncodeKey(), member_value.GetEncodeValue());
     } else {
-        s = g_server.db->Put(g_server.write_option, cf_handle, member_key.GetEncodeKey(), member_value.GetEncodeValue());
+        rocksdb::WriteBatch single_batch;
+        single_batch.Put(cf_handle, member_key.GetEncodeKey(), member_value.GetEncodeValue());
+        s = g_group_commit.Write(g_server.db, &single_batch);
     }
     if (!s.ok()) {
         log_message(kLogLevelError, "put_zset_score failed, error_code=%d\n", (int)s.code());
@@ -150,7 +154,9 @@ static rocksdb::Status del_zset_score(int db_idx, const string& key, const strin
     if (batch) {
         s = batch->Delete(cf_handle, member_key.GetEncodeKey());
     } else {
-        s = g_server.db->Delete(g_server.write_option, cf_handle, member_key.GetEncodeKey());
+        rocksdb::WriteBatch single_batch;
+        single_batch.Delete(cf_handle, member_key.GetEncodeKey());
+        s = g_group_commit.Write(g_server.db, &single_batch);
     }
     if (!s.ok()) {
         log_message(kLogLevelError, "del_zset_score failed, error_code=%d\n", (int)s.code());
@@ -158,14 +164,9 @@ static rocksdb::Status del_zset_score(int db_idx, const string& key, const strin
     return s;
 }
 
-static int get_zset_score(int db_idx, const string& key, const string& member, double& score)
+int decode_zset_score(const rocksdb::Status& status, const string& encode_value, double& score)
 {
-    EncodeKey member_key(KEY_TYPE_ZSET_SCORE, key, member);
-    rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
-    string encode_value;
     uint64_t encode_score;
-    
-    rocksdb::Status status = g_server.db->Get(g_server.read_option, cf_handle, member_key.GetEncodeKey(), &encode_value);
     if (status.ok()) {
         if (DecodeValue::Decode(encode_value, KEY_TYPE_ZSET_SCORE, encode_score) == kDecodeOK) {
             score = uint64_to_double(encode_score);
@@ -180,6 +181,39 @@ static int get_zset_score(int db_idx, const string& key, const string& member, d
     }
 }
 
+static int get_zset_score(int db_idx, const string& key, const string& member, double& score,
+                          const rocksdb::ReadOptions& read_option = g_server.read_option)
+{
+    EncodeKey member_key(KEY_TYPE_ZSET_SCORE, key, member);
+    rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
+    string encode_value;
+    
+    rocksdb::Status status = db_get(read_option, cf_handle, member_key.GetEncodeKey(), &encode_value);
+    return decode_zset_score(status, encode_value, score);
+}
+
+// get_zset_score() of many members with one MultiGet, results[i] and scores[i] are of members[i]
+static void get_zset_scores(int db_idx, const string& key, const vector<string>& members, vector<int>& results,
+                            vector<double>& scores, const rocksdb::ReadOptions& read_option = g_server.read_option)
+{
+    vector<string> encode_keys;
+    encode_keys.reserve(members.size());
+    for (const string& member : members) {
+        EncodeKey member_key(KEY_TYPE_ZSET_SCORE, key, member);
+        encode_keys.push_back(member_key.GetEncodeKey().ToString());
+    }
+    
+    vector<rocksdb::Status> statuses;
+    vector<string> encode_values;
+    multi_get(db_idx, encode_keys, statuses, encode_values, read_option);
+    
+    results.resize(members.size());
+    scores.assign(members.size(), 0);
+    for (size_t i = 0; i < members.size(); i++) {
+        results[i] = decode_zset_score(statuses[i], encode_values[i], scores[i]);
+    }
+}
+
 static rocksdb::Status put_zset_sort(int db_idx, const string& key, double score, const string& member,
                                      rocksdb::WriteBatch* batch = NULL)
 {
@@ -192,7 +226,9 @@ static rocksdb::Status put_zset_sort(int db_idx, const string& key, double score
     if (batch) {
         s = batch->Put(cf_handle, member_key.GetEncodeKey(), member_value.GetEncodeValue());
     } else {
-        s = g_server.db->Put(g_server.write_option, cf_handle, member_key.GetEncodeKey(), member_value.GetEncodeValue());
+        rocksdb::WriteBatch single_batch;
+        single_batch.Put(cf_handle, member_key.GetEncodeKey(), member_value.GetEncodeValue());
+        s = g_group_commit.Write(g_server.db, &single_batch);
     }
     if (!s.ok()) {
         log_message(kLogLevelError, "put_zset_sort failed, error_code=%d\n", (int)s.code());
@@ -211,7 +247,9 @@ static rocksdb::Status del_zset_sort(int db_idx, const string& key, double score
     if (batch) {
         s = batch->Delete(cf_handle, member_key.GetEncodeKey());
     } else {
-        s = g_server.db->Delete(g_server.write_option, cf_handle, member_key.GetEncodeKey());
+        rocksdb::WriteBatch single_batch;
+        single_batch.Delete(cf_handle, member_key.GetEncodeKey());
+        s = g_group_commit.Write(g_server.db, &single_batch);
     }
     if (!s.ok()) {
         log_message(kLogLevelError, "del_zset_sort failed, error_code=%d\n", (int)s.code());
@@ -291,6 +329,7 @@ static void generic_zadd_command(ClientConn* conn, const vector<string>& cmd_vec
         put_meta_data(db_idx, KEY_TYPE_ZSET, cmd_vec[1], 0, elements, &batch);
         DB_BATCH_UPDATE(batch)
         g_server.binlog.Store(db_idx, conn->GetCurReqCommand());
+        signal_key_ready(db_idx, cmd_vec[1]);
         if (incr) {
             conn->SendBulkString(cmd_vec[score_idx]);
         } else {
@@ -306,12 +345,20 @@ static void generic_zadd_command(ClientConn* conn, const vector<string>& cmd_vec
         int ch_cnt = 0;
         double incr_result_score = 0;
         bool processed = false;
+        vector<string> members;
+        for (int i = score_idx; i < cmd_size; i += 2) {
+            members.push_back(cmd_vec[i + 1]);
+        }
+        
+        vector<int> results;
+        vector<double> old_scores;
+        get_zset_scores(db_idx, cmd_vec[1], members, results, old_scores);
         for (int i = score_idx; i < cmd_size; i += 2) {
             double score = std::stod(cmd_vec[i]);
             const string& member = cmd_vec[i + 1];
             
-            double old_score;
-            int result = get_zset_score(db_idx, cmd_vec[1], member, old_score);
+            int result = results[(i - score_idx) / 2];
+            double old_score = old_scores[(i - score_idx) / 2];
             if (result == FIELD_EXIST) {
                 if (nx) {
                     continue;
@@ -360,6 +407,9 @@ static void generic_zadd_command(ClientConn* conn, const vector<string>& cmd_vec
         }
         DB_BATCH_UPDATE(batch)
         g_server.binlog.Store(db_idx, conn->GetCurReqCommand());
+        if (add_cnt > 0) {
+            signal_key_ready(db_idx, cmd_vec[1]);
+        }
         
         if (incr) {
             if (processed) {
@@ -391,8 +441,9 @@ void zcard_command(ClientConn* conn, const vector<string>& cmd_vec)
 {
     int db_idx = conn->GetDBIndex();
     MetaData mdata;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    ReadSnapshotGuard snapshot_guard(db_idx, false);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    int ret = get_meta_data(db_idx, cmd_vec[1], mdata, read_option);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
     } else if (ret == kExpireKeyNotExist) {
@@ -416,8 +467,9 @@ void zcount_command(ClientConn* conn, const vector<string>& cmd_vec)
     
     int db_idx = conn->GetDBIndex();
     MetaData mdata;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    ReadSnapshotGuard snapshot_guard(db_idx);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    int ret = get_meta_data(db_idx, cmd_vec[1], mdata, read_option);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
     } else if (ret == kExpireKeyNotExist) {
@@ -430,7 +482,7 @@ void zcount_command(ClientConn* conn, const vector<string>& cmd_vec)
         
         EncodeKey start_key(KEY_TYPE_ZSET_SORT, cmd_vec[1], range.encode_min, "");
         rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
-        rocksdb::Iterator* it = g_server.db->NewIterator(g_server.read_option, cf_handle);
+        rocksdb::Iterator* it = db_new_iterator(read_option, cf_handle);
         
         uint64_t range_cnt = 0;
         for (it->Seek(start_key.GetEncodeKey()); it->Valid(); it->Next()) {
@@ -475,16 +527,15 @@ static void generic_zrange_command(ClientConn* conn, const vector<string>& cmd_v
         return;
     }
     
-    vector<string> range_vec;
-    
     int db_idx = conn->GetDBIndex();
     MetaData mdata;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    ReadSnapshotGuard snapshot_guard(db_idx);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    int ret = get_meta_data(db_idx, cmd_vec[1], mdata, read_option);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
     } else if (ret == kExpireKeyNotExist) {
-        conn->SendArray(range_vec);
+        conn->SendMultiBuldLen(0);
     } else {
         if (mdata.type != KEY_TYPE_ZSET) {
             conn->SendRawResponse(kWrongTypeError);
@@ -500,73 +551,66 @@ static void generic_zrange_command(ClientConn* conn, const vector<string>& cmd_v
         // Invariant: start >= 0, so this test will be true when end < 0.
         // The range is empty when start > end or start >= length.
         if (start > stop || start >= zcount) {
-            conn->SendArray(range_vec);
+            conn->SendMultiBuldLen(0);
             return;
         }
         
         if (stop >= zcount) stop = zcount - 1;
         
-        if (reverse) {
-            long original_start = start;
-            start = zcount - stop - 1;
-            stop = zcount - original_start - 1;
-        }
+        // members are sent as they are read, ZREVRANGE walks the iterator backward
+        // instead of collecting the whole range and reversing it
+        conn->SendMultiBuldLen((stop - start + 1) * (withscores ? 2 : 1));
         
-        EncodeKey prefix_key(KEY_TYPE_ZSET_SORT, cmd_vec[1]);
         rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
-        rocksdb::Iterator* it = g_server.db->NewIterator(g_server.read_option, cf_handle);
+        rocksdb::Iterator* it = db_new_iterator(read_option, cf_handle);
+        if (reverse) {
+            string max_member;
+            max_member.append(128, 0xFF);
+            EncodeKey last_key(KEY_TYPE_ZSET_SORT, cmd_vec[1], UINT64_MAX, max_member);
+            it->SeekForPrev(last_key.GetEncodeKey());
+        } else {
+            EncodeKey prefix_key(KEY_TYPE_ZSET_SORT, cmd_vec[1]);
+            it->Seek(prefix_key.GetEncodeKey());
+        }
         
-        list<string> range_list;
         long rank = 0;
-        for (it->Seek(prefix_key.GetEncodeKey()); it->Valid(); it->Next()) {
+        while (it->Valid() && (rank <= stop) && conn->IsOpen()) {
             string encode_key = it->key().ToString();
             string encode_value = it->value().ToString();
             string key, member;
             uint64_t encode_score;
             
-            if (DecodeKey::Decode(encode_key, KEY_TYPE_ZSET_SORT, key, encode_score, member) != kDecodeOK) {
-                conn->SendError("invalid zset key member");
-                delete it;
-                return;
+            if ((DecodeKey::Decode(encode_key, KEY_TYPE_ZSET_SORT, key, encode_score, member) != kDecodeOK) ||
+                (key != cmd_vec[1])) {
+                break; // pass through the zset keys
             }
             
             if (DecodeValue::Decode(encode_value, KEY_TYPE_ZSET_SORT) != kDecodeOK) {
-                conn->SendError("invalid zset key value");
+                conn->AbortStreamReply("invalid zset key value");
                 delete it;
                 return;
             }
             
-            if ((rank >= start) && (rank <= stop)) {
-                double score = uint64_to_double(encode_score);
-                if (!reverse) {
-                    range_vec.push_back(member);
-                    if (withscores) {
-                        range_vec.push_back(double_to_string(score));
-                    }
-                } else {
-                    if (withscores) {
-                        range_list.push_front(double_to_string(score));
-                    }
-                    
-                    range_list.push_front(member);
+            if (rank >= start) {
+                conn->SendBulkSlice(member);
+                if (withscores) {
+                    double score = uint64_to_double(encode_score);
+                    conn->SendBulkSlice(double_to_string(score));
                 }
             }
             
             rank++;
-            if (rank > stop) {
-                break;
+            if (reverse) {
+                it->Prev();
+            } else {
+                it->Next();
             }
         }
         
         delete it;
-        
-        if (reverse) {
-            for (const string& member: range_list) {
-                range_vec.push_back(member);
-            }
+        if (rank <= stop) {
+            conn->AbortStreamReply("zset has less members than the count in meta data");
         }
-        
-        conn->SendArray(range_vec);
     }
 }
 
@@ -636,8 +680,9 @@ static void generic_zrangebyscore_command(ClientConn* conn, const vector<string>
     vector<string> zset_vec;
     int db_idx = conn->GetDBIndex();
     MetaData mdata;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    ReadSnapshotGuard snapshot_guard(db_idx);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    int ret = get_meta_data(db_idx, cmd_vec[1], mdata, read_option);
     if (ret == kExpireDBError) {
         conn->SendRawResponse(kNullBulkString);
     } else if (ret == kExpireKeyNotExist) {
@@ -649,7 +694,7 @@ static void generic_zrangebyscore_command(ClientConn* conn, const vector<string>
         }
         
         rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
-        rocksdb::Iterator* it = g_server.db->NewIterator(g_server.read_option, cf_handle);
+        rocksdb::Iterator* it = db_new_iterator(read_option, cf_handle);
         if (reverse) {
             string max_key;
             max_key.append(128, 0xFF);
@@ -709,7 +754,7 @@ static void generic_zrangebyscore_command(ClientConn* conn, const vector<string>
         }
         
         delete it;
-        conn->SendArray(zset_vec);
+        conn->SendArray(std::move(zset_vec));
     }
 }
 
@@ -754,8 +799,9 @@ void zlexcount_command(ClientConn* conn, const vector<string>& cmd_vec)
     
     int db_idx = conn->GetDBIndex();
     MetaData mdata;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    ReadSnapshotGuard snapshot_guard(db_idx);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    int ret = get_meta_data(db_idx, cmd_vec[1], mdata, read_option);
     if (ret == kExpireDBError) {
         conn->SendRawResponse(kNullBulkString);
     } else if (ret == kExpireKeyNotExist) {
@@ -767,7 +813,7 @@ void zlexcount_command(ClientConn* conn, const vector<string>& cmd_vec)
         }
         
         rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
-        rocksdb::Iterator* it = g_server.db->NewIterator(g_server.read_option, cf_handle);
+        rocksdb::Iterator* it = db_new_iterator(read_option, cf_handle);
         uint64_t encode_score;
         if (get_first_zset_score(cf_handle, it, cmd_vec[1], encode_score) == CODE_ERROR) {
             conn->SendError("db error");
@@ -854,8 +900,9 @@ void generic_zrangebylex_command(ClientConn* conn, const vector<string>& cmd_vec
     vector<string> zset_vec;
     int db_idx = conn->GetDBIndex();
     MetaData mdata;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    ReadSnapshotGuard snapshot_guard(db_idx);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    int ret = get_meta_data(db_idx, cmd_vec[1], mdata, read_option);
     if (ret == kExpireDBError) {
         conn->SendRawResponse(kNullBulkString);
     } else if (ret == kExpireKeyNotExist) {
@@ -867,7 +914,7 @@ void generic_zrangebylex_command(ClientConn* conn, const vector<string>& cmd_vec
         }
         
         rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
-        rocksdb::Iterator* it = g_server.db->NewIterator(g_server.read_option, cf_handle);
+        rocksdb::Iterator* it = db_new_iterator(read_option, cf_handle);
         uint64_t encode_score;
         if (get_first_zset_score(cf_handle, it, cmd_vec[1], encode_score) == CODE_ERROR) {
             conn->SendError("db error");
@@ -929,7 +976,7 @@ void generic_zrangebylex_command(ClientConn* conn, const vector<string>& cmd_vec
         }
         
         delete it;
-        conn->SendArray(zset_vec);
+        conn->SendArray(std::move(zset_vec));
     }
 }
 
@@ -947,8 +994,9 @@ static void generic_zrank_command(ClientConn* conn, const vector<string>& cmd_ve
 {
     int db_idx = conn->GetDBIndex();
     MetaData mdata;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    ReadSnapshotGuard snapshot_guard(db_idx);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    int ret = get_meta_data(db_idx, cmd_vec[1], mdata, read_option);
     if (ret == kExpireDBError) {
         conn->SendRawResponse(kNullBulkString);
     } else if (ret == kExpireKeyNotExist) {
@@ -960,7 +1008,7 @@ static void generic_zrank_command(ClientConn* conn, const vector<string>& cmd_ve
         }
         
         double score;
-        int result = get_zset_score(db_idx, cmd_vec[1], cmd_vec[2], score);
+        int result = get_zset_score(db_idx, cmd_vec[1], cmd_vec[2], score, read_option);
         if (result == FIELD_NOT_EXIST) {
             conn->SendRawResponse(kNullBulkString);
             return;
@@ -971,7 +1019,7 @@ static void generic_zrank_command(ClientConn* conn, const vector<string>& cmd_ve
         
         EncodeKey prefix_key(KEY_TYPE_ZSET_SORT, cmd_vec[1]);
         rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
-        rocksdb::Iterator* it = g_server.db->NewIterator(g_server.read_option, cf_handle);
+        rocksdb::Iterator* it = db_new_iterator(read_option, cf_handle);
         uint64_t seek_cnt = 0;
         for (it->Seek(prefix_key.GetEncodeKey()); it->Valid() && seek_cnt < mdata.count; it->Next(), seek_cnt++) {
             string encode_key = it->key().ToString();
@@ -1048,11 +1096,11 @@ void zrem_command(ClientConn* conn, const vector<string>& cmd_vec)
         if (del_cnt > 0) {
             mdata.count -= del_cnt;
             if (mdata.count == 0) {
-                delete_key(db_idx, cmd_vec[1], mdata.ttl, KEY_TYPE_ZSET);
+                delete_key(db_idx, cmd_vec[1], mdata.ttl, KEY_TYPE_ZSET, &batch);
             } else {
                 put_meta_data(db_idx, KEY_TYPE_ZSET, cmd_vec[1], mdata.ttl, mdata.count, &batch);
-                DB_BATCH_UPDATE(batch)
             }
+            DB_BATCH_UPDATE(batch)
             
             g_server.binlog.Store(db_idx, conn->GetCurReqCommand());
         }
@@ -1061,168 +1109,319 @@ void zrem_command(ClientConn* conn, const vector<string>& cmd_vec)
     }
 }
 
-void zremrangebylex_command(ClientConn* conn, const vector<string>& cmd_vec)
-{
-    string min_key, max_key;
-    bool min_exclusive, max_exclusive;
+enum {
+    ZREM_BY_LEX = 0,
+    ZREM_BY_RANK,
+    ZREM_BY_SCORE,
+};
+
+// ZREMRANGEBYLEX/ZREMRANGEBYRANK/ZREMRANGEBYSCORE, scan the sorted elements with a snapshot, then remove the ones
+// in the range with the key lock held
+class ZRemRangeCommand : public SlicedCommand {
+public:
+    ZRemRangeCommand(ClientConn* conn, const vector<string>& cmd_vec, int type);
+    virtual ~ZRemRangeCommand() {}
     
-    if (!parse_lex_range(cmd_vec[2], min_key, min_exclusive) || !parse_lex_range(cmd_vec[3], max_key, max_exclusive)) {
-        conn->SendError("min or max is not valid");
-        return;
-    }
+    void SetLexRange(const string& min_key, bool min_exclusive, const string& max_key, bool max_exclusive);
+    void SetRankRange(long start, long stop);
+    void SetScoreRange(const zrangespec& range);
     
-    int db_idx = conn->GetDBIndex();
-    MetaData mdata;
-    rocksdb::WriteBatch batch;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    virtual bool RunSlice(ClientConn* conn, uint64_t deadline_us);
+private:
+    bool _Start(ClientConn* conn);
+    int _Scan(uint64_t deadline_us);
+    int _ScanElements(uint64_t deadline_us);
+    void _Apply(ClientConn* conn);
+private:
+    string      key_;
+    string      command_;   // for binlog, the request is gone after the first slice
+    int         type_;
+    bool        started_;
+    MetaData    mdata_;
+    
+    string      min_key_;
+    string      max_key_;
+    bool        min_exclusive_;
+    bool        max_exclusive_;
+    long        start_;
+    long        stop_;
+    zrangespec  range_;
+    
+    string      next_key_;  // the encoded key the next slice seeks to
+    long        rank_;
+    vector<pair<uint64_t, string>> remove_members_;    // encoded score and member
+};
+
+ZRemRangeCommand::ZRemRangeCommand(ClientConn* conn, const vector<string>& cmd_vec, int type)
+    : SlicedCommand(conn->GetDBIndex()), key_(cmd_vec[1]), command_(conn->GetCurReqCommand()), type_(type)
+{
+    started_ = false;
+    min_exclusive_ = max_exclusive_ = false;
+    start_ = stop_ = 0;
+    memset(&range_, 0, sizeof(range_));
+    rank_ = 0;
+}
+
+void ZRemRangeCommand::SetLexRange(const string& min_key, bool min_exclusive, const string& max_key, bool max_exclusive)
+{
+    min_key_ = min_key;
+    min_exclusive_ = min_exclusive;
+    max_key_ = max_key;
+    max_exclusive_ = max_exclusive;
+}
+
+void ZRemRangeCommand::SetRankRange(long start, long stop)
+{
+    start_ = start;
+    stop_ = stop;
+}
+
+void ZRemRangeCommand::SetScoreRange(const zrangespec& range)
+{
+    range_ = range;
+}
+
+// called with the key lock held, return false if the reply is done
+bool ZRemRangeCommand::_Start(ClientConn* conn)
+{
+    string raw_meta;
+    int ret = expire_key_if_needed(db_idx_, key_, mdata_, &raw_meta);
     if (ret == kExpireDBError) {
-        conn->SendRawResponse(kNullBulkString);
+        if (type_ == ZREM_BY_LEX) {
+            conn->SendRawResponse(kNullBulkString);
+        } else {
+            conn->SendError("db error");
+        }
+        return false;
     } else if (ret == kExpireKeyNotExist) {
         conn->SendInteger(0);
+        return false;
+    } else if (mdata_.type != KEY_TYPE_ZSET) {
+        conn->SendRawResponse(kWrongTypeError);
+        return false;
+    }
+    
+    if (type_ == ZREM_BY_LEX) {
+        // get the score by seek to the first element of this key
+        rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx_];
+        rocksdb::Iterator* it = db_new_iterator(g_server.read_option, cf_handle);
+        uint64_t encode_score;
+        int result = get_first_zset_score(cf_handle, it, key_, encode_score);
+        delete it;
+        if (result == CODE_ERROR) {
+            conn->SendError("db error");
+            return false;
+        }
+        
+        EncodeKey prefix_key(KEY_TYPE_ZSET_SORT, key_, encode_score, min_key_);
+        next_key_ = prefix_key.GetEncodeKey().ToString();
+    } else if (type_ == ZREM_BY_RANK) {
+        long member_count = (long)mdata_.count;
+        // Sanitize indexes.
+        if (start_ < 0) start_ = member_count + start_;
+        if (stop_ < 0) stop_ = member_count + stop_;
+        if (start_ < 0) start_ = 0;
+        
+        // Invariant: start >= 0, so this test will be true when end < 0.
+        // The range is empty when start > end or start >= length.
+        if (start_ > stop_ || start_ >= member_count) {
+            conn->SendInteger(0);
+            return false;
+        }
+        
+        if (stop_ >= member_count) stop_ = member_count - 1;
+        
+        EncodeKey prefix_key(KEY_TYPE_ZSET_SORT, key_);
+        next_key_ = prefix_key.GetEncodeKey().ToString();
     } else {
-        if (mdata.type != KEY_TYPE_ZSET) {
-            conn->SendRawResponse(kWrongTypeError);
-            return;
+        EncodeKey prefix_key(KEY_TYPE_ZSET_SORT, key_, range_.encode_min, "");
+        next_key_ = prefix_key.GetEncodeKey().ToString();
+    }
+    
+    WatchKey(key_, raw_meta);
+    TakeSnapshot();
+    rank_ = 0;
+    remove_members_.clear();
+    return true;
+}
+
+// called without the key lock
+int ZRemRangeCommand::_Scan(uint64_t deadline_us)
+{
+    ScanKeyGuard scan_key_guard(db_idx_);
+    if (IsFlushed()) {
+        return SCAN_DONE;   // found out before applying
+    }
+    
+    return _ScanElements(deadline_us);
+}
+
+int ZRemRangeCommand::_ScanElements(uint64_t deadline_us)
+{
+    const rocksdb::Comparator* comparator = g_server.cf_handles_map[db_idx_]->GetComparator();
+    rocksdb::Iterator* it = NewIterator();
+    int result = SCAN_DONE;
+    int check_count = 0;
+    for (it->Seek(next_key_); it->Valid(); it->Next()) {
+        if (IsTimeout(deadline_us, check_count)) {
+            next_key_ = it->key().ToString();    // not handled yet, the next slice starts from it
+            result = SCAN_MORE;
+            break;
         }
         
-        // get the score by seek to the first element of this key
-        rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
-        rocksdb::Iterator* it = g_server.db->NewIterator(g_server.read_option, cf_handle);
+        string encode_key = it->key().ToString();
+        string key, member;
         uint64_t encode_score;
-        if (get_first_zset_score(cf_handle, it, cmd_vec[1], encode_score) == CODE_ERROR) {
-            conn->SendError("db error");
-            delete it;
-            return;
+        
+        if (DecodeKey::Decode(encode_key, KEY_TYPE_ZSET_SORT, key, encode_score, member) != kDecodeOK) {
+            if (type_ == ZREM_BY_LEX) {
+                break; // pass through the zset keys
+            }
+            result = SCAN_ERROR;
+            break;
         }
         
-        // seek the min key
-        EncodeKey prefix_key(KEY_TYPE_ZSET_SORT, cmd_vec[1], encode_score, min_key);
-        const rocksdb::Comparator* comparator = cf_handle->GetComparator();
-        int count = 0;
-        for (it->Seek(prefix_key.GetEncodeKey()); it->Valid(); it->Next()) {
-            string encode_key = it->key().ToString();
-            string key, member;
+        if (key != key_) {
+            break;
+        }
+        
+        if (type_ == ZREM_BY_LEX) {
+            if (!lex_value_lte_max(member, max_key_, max_exclusive_, comparator)) {
+                break;
+            }
             
-            if (DecodeKey::Decode(encode_key, KEY_TYPE_ZSET_SORT, key, encode_score, member) != kDecodeOK) {
-                break; // pass through the zset keys
+            if (min_exclusive_ && comparator->Equal(member, min_key_)) {
+                continue;
+            }
+        } else if (type_ == ZREM_BY_RANK) {
+            if (rank_ > stop_) {
+                break;
             }
             
-            if ((key != cmd_vec[1]) || !lex_value_lte_max(member, max_key, max_exclusive, comparator)) {
+            if (DecodeValue::Decode(it->value().ToString(), KEY_TYPE_ZSET_SORT) != kDecodeOK) {
+                result = SCAN_ERROR;
                 break;
             }
             
-            if (min_exclusive && comparator->Equal(member, min_key)) {
+            if (rank_++ < start_) {
                 continue;
             }
+        } else {
+            if (!value_lte_max(encode_score, range_)) {
+                break;
+            }
             
-            double score = uint64_to_double(encode_score);
-            del_zset_score(db_idx, key, member, &batch);
-            del_zset_sort(db_idx, key, score, member, &batch);
-            count++;
+            if (range_.minex && (encode_score == range_.encode_min)) {
+                continue;
+            }
         }
         
-        delete it;
-        conn->SendInteger(count);
+        remove_members_.push_back(make_pair(encode_score, member));
+    }
+    
+    delete it;
+    return result;
+}
+
+// called with the key lock held
+void ZRemRangeCommand::_Apply(ClientConn* conn)
+{
+    long del_cnt = (long)remove_members_.size();
+    if (del_cnt > 0) {
+        rocksdb::WriteBatch batch;
+        for (const pair<uint64_t, string>& score_member : remove_members_) {
+            double score = uint64_to_double(score_member.first);
+            del_zset_score(db_idx_, key_, score_member.second, &batch);
+            del_zset_sort(db_idx_, key_, score, score_member.second, &batch);
+        }
         
-        if (count > 0) {
-            mdata.count -= count;
-            if (mdata.count == 0) {
-                delete_key(db_idx, cmd_vec[1], mdata.ttl, KEY_TYPE_ZSET);
-            } else {
-                put_meta_data(db_idx, KEY_TYPE_ZSET, cmd_vec[1], mdata.ttl, mdata.count, &batch);
-                DB_BATCH_UPDATE(batch)
-            }
-            
-            g_server.binlog.Store(db_idx, conn->GetCurReqCommand());
+        mdata_.count -= del_cnt;
+        if (mdata_.count == 0) {
+            delete_key(db_idx_, key_, mdata_.ttl, KEY_TYPE_ZSET, &batch);
+        } else {
+            put_meta_data(db_idx_, KEY_TYPE_ZSET, key_, mdata_.ttl, mdata_.count, &batch);
         }
+        DB_BATCH_UPDATE(batch)
+        
+        g_server.binlog.Store(db_idx_, command_);
     }
+    conn->SendInteger(del_cnt);
 }
 
-void zremrangebyrank_command(ClientConn* conn, const vector<string>& cmd_vec)
+bool ZRemRangeCommand::RunSlice(ClientConn* conn, uint64_t deadline_us)
 {
-    long start, stop;
-    if (get_long_from_string(cmd_vec[2], start) == CODE_ERROR || get_long_from_string(cmd_vec[3], stop) == CODE_ERROR) {
-        conn->SendError("not invalid number");
-        return;
+    if (!started_) {
+        started_ = true;
+        KeyLockGuard lock_guard(db_idx_, key_);
+        if (!_Start(conn)) {
+            return true;
+        }
     }
-
-    int db_idx = conn->GetDBIndex();
+    
+    int result = _Scan(deadline_us);
+    if (result == SCAN_MORE) {
+        return false;
+    } else if (result == SCAN_ERROR) {
+        conn->SendError("invalid zset key member");
+        return true;
+    }
+    
+    KeyLockGuard lock_guard(db_idx_, key_);
     MetaData mdata;
-    rocksdb::WriteBatch batch;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    string raw_meta;
+    int ret = expire_key_if_needed(db_idx_, key_, mdata, &raw_meta);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
-    } else if (ret == kExpireKeyNotExist) {
-        conn->SendInteger(0);
-    } else {
-        if (mdata.type != KEY_TYPE_ZSET) {
-            conn->SendRawResponse(kWrongTypeError);
-            return;
-        }
-        
-        long member_count = (long)mdata.count;
-        // Sanitize indexes.
-        if (start < 0) start = member_count + start;
-        if (stop < 0) stop = member_count + stop;
-        if (start < 0) start = 0;
-        
-        // Invariant: start >= 0, so this test will be true when end < 0.
-        // The range is empty when start > end or start >= length.
-        if (start > stop || start >= member_count) {
-            conn->SendInteger(0);
-            return;
+        return true;
+    }
+    
+    if (IsKeyChanged(key_, (ret == kExpireKeyExist) ? raw_meta : "")) {
+        if (!_Start(conn)) {
+            return true;
         }
         
-        if (stop >= member_count) stop = member_count - 1;
-        
-        EncodeKey prefix_key(KEY_TYPE_ZSET_SORT, cmd_vec[1]);
-        rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
-        rocksdb::Iterator* it = g_server.db->NewIterator(g_server.read_option, cf_handle);
-        
-        list<string> range_list;
-        long rank = 0;
-        for (it->Seek(prefix_key.GetEncodeKey()); it->Valid() && rank <= stop; it->Next(), rank++) {
-            string encode_key = it->key().ToString();
-            string encode_value = it->value().ToString();
-            string key, member;
-            uint64_t encode_score;
-            
-            if (DecodeKey::Decode(encode_key, KEY_TYPE_ZSET_SORT, key, encode_score, member) != kDecodeOK) {
-                conn->SendError("invalid set key member");
-                delete it;
-                return;
-            }
-            
-            if (DecodeValue::Decode(encode_value, KEY_TYPE_ZSET_SORT) != kDecodeOK) {
-                conn->SendError("invalid set key value");
-                delete it;
-                return;
-            }
-            
-            if (rank >= start) {
-                double score = uint64_to_double(encode_score);
-                del_zset_score(db_idx, cmd_vec[1], member, &batch);
-                del_zset_sort(db_idx, cmd_vec[1], score, member, &batch);
-            }
+        if (++retry_count_ <= kSliceMaxRetry) {
+            return false;
         }
         
-        delete it;
-        uint64_t del_cnt = stop - start + 1;
-        if (del_cnt > 0) {
-            mdata.count -= del_cnt;
-            if (mdata.count == 0) {
-                delete_key(db_idx, cmd_vec[1], mdata.ttl, KEY_TYPE_ZSET);
-            } else {
-                put_meta_data(db_idx, KEY_TYPE_ZSET, cmd_vec[1], mdata.ttl, mdata.count, &batch);
-                DB_BATCH_UPDATE(batch)
-            }
-            
-            g_server.binlog.Store(db_idx, conn->GetCurReqCommand());
+        // the zset keeps changing, go through it with the lock held
+        ReleaseSnapshot();
+        if (_ScanElements(UINT64_MAX) != SCAN_DONE) {
+            conn->SendError("invalid zset key member");
+            return true;
         }
-        conn->SendInteger(stop - start + 1);
     }
+    
+    _Apply(conn);
+    return true;
+}
+
+void zremrangebylex_command(ClientConn* conn, const vector<string>& cmd_vec)
+{
+    string min_key, max_key;
+    bool min_exclusive, max_exclusive;
+    
+    if (!parse_lex_range(cmd_vec[2], min_key, min_exclusive) || !parse_lex_range(cmd_vec[3], max_key, max_exclusive)) {
+        conn->SendError("min or max is not valid");
+        return;
+    }
+    
+    ZRemRangeCommand* cmd = new ZRemRangeCommand(conn, cmd_vec, ZREM_BY_LEX);
+    cmd->SetLexRange(min_key, min_exclusive, max_key, max_exclusive);
+    conn->RunSlicedCommand(cmd);
+}
+
+void zremrangebyrank_command(ClientConn* conn, const vector<string>& cmd_vec)
+{
+    long start, stop;
+    if (get_long_from_string(cmd_vec[2], start) == CODE_ERROR || get_long_from_string(cmd_vec[3], stop) == CODE_ERROR) {
+        conn->SendError("not invalid number");
+        return;
+    }
+    
+    ZRemRangeCommand* cmd = new ZRemRangeCommand(conn, cmd_vec, ZREM_BY_RANK);
+    cmd->SetRankRange(start, stop);
+    conn->RunSlicedCommand(cmd);
 }
 
 void zremrangebyscore_command(ClientConn* conn, const vector<string>& cmd_vec)
@@ -1233,71 +1432,168 @@ void zremrangebyscore_command(ClientConn* conn, const vector<string>& cmd_vec)
         return;
     }
     
-    int db_idx = conn->GetDBIndex();
+    ZRemRangeCommand* cmd = new ZRemRangeCommand(conn, cmd_vec, ZREM_BY_SCORE);
+    cmd->SetScoreRange(range);
+    conn->RunSlicedCommand(cmd);
+}
+
+// pop the members with the lowest or the highest scores, the key is deleted with the last member
+static int pop_zset_members(int db_idx, const string& key, bool pop_min, long count,
+                            vector<pair<string, double>>& members)
+{
     MetaData mdata;
     rocksdb::WriteBatch batch;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    int ret = expire_key_if_needed(db_idx, key, mdata);
     if (ret == kExpireDBError) {
-        conn->SendError("db error");
+        return kElementDBError;
     } else if (ret == kExpireKeyNotExist) {
-        conn->SendInteger(0);
+        return kElementNoKey;
+    } else if (mdata.type != KEY_TYPE_ZSET) {
+        return kElementWrongType;
+    }
+    
+    rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
+    rocksdb::Iterator* it = db_new_iterator(g_server.read_option, cf_handle);
+    if (pop_min) {
+        EncodeKey prefix_key(KEY_TYPE_ZSET_SORT, key);
+        it->Seek(prefix_key.GetEncodeKey());
     } else {
-        if (mdata.type != KEY_TYPE_ZSET) {
-            conn->SendRawResponse(kWrongTypeError);
-            return;
+        string max_member;
+        max_member.append(128, 0xFF);
+        EncodeKey last_key(KEY_TYPE_ZSET_SORT, key, UINT64_MAX, max_member);
+        it->SeekForPrev(last_key.GetEncodeKey());
+    }
+    
+    while (it->Valid() && ((long)members.size() < count)) {
+        string encode_key = it->key().ToString();
+        string member_key, member;
+        uint64_t encode_score;
+        if ((DecodeKey::Decode(encode_key, KEY_TYPE_ZSET_SORT, member_key, encode_score, member) != kDecodeOK) ||
+            (member_key != key)) {
+            break;
         }
         
-        EncodeKey prefix_key(KEY_TYPE_ZSET_SORT, cmd_vec[1], range.encode_min, "");
-        rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
-        rocksdb::Iterator* it = g_server.db->NewIterator(g_server.read_option, cf_handle);
-        
-        uint64_t del_cnt = 0;
-        for (it->Seek(prefix_key.GetEncodeKey()); it->Valid(); it->Next()) {
-            string encode_key = it->key().ToString();
-            string key, member;
-            uint64_t encode_score;
-            
-            if (DecodeKey::Decode(encode_key, KEY_TYPE_ZSET_SORT, key, encode_score, member) != kDecodeOK) {
-                return;
-            }
-            
-            if ((key != cmd_vec[1]) || !value_lte_max(encode_score, range)) {
-                break;
-            }
-            
-            if (range.minex && (encode_score == range.encode_min)) {
-                continue;
-            }
-            
-            double score = uint64_to_double(encode_score);
-            del_zset_score(db_idx, cmd_vec[1], member, &batch);
-            del_zset_sort(db_idx, cmd_vec[1], score, member, &batch);
-            del_cnt++;
+        double score = uint64_to_double(encode_score);
+        del_zset_score(db_idx, key, member, &batch);
+        del_zset_sort(db_idx, key, score, member, &batch);
+        members.emplace_back(std::move(member), score);
+        if (pop_min) {
+            it->Next();
+        } else {
+            it->Prev();
+        }
+    }
+    delete it;
+    
+    if (members.empty()) {
+        return kElementOK;
+    }
+    
+    if (members.size() >= mdata.count) {
+        delete_key(db_idx, key, mdata.ttl, KEY_TYPE_ZSET, &batch);
+    } else {
+        put_meta_data(db_idx, KEY_TYPE_ZSET, key, mdata.ttl, mdata.count - members.size(), &batch);
+    }
+    DB_BATCH_UPDATE(batch)
+    return kElementOK;
+}
+
+static void generic_zpop_command(ClientConn* conn, const vector<string>& cmd_vec, bool pop_min)
+{
+    long count = 1;
+    if (cmd_vec.size() > 3) {
+        conn->SendError("syntax error");
+        return;
+    } else if ((cmd_vec.size() == 3) && (get_long_from_string(cmd_vec[2], count) == CODE_ERROR)) {
+        conn->SendError("value is not an integer or out of range");
+        return;
+    }
+    
+    int db_idx = conn->GetDBIndex();
+    vector<pair<string, double>> members;
+    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
+    int ret = pop_zset_members(db_idx, cmd_vec[1], pop_min, count, members);
+    if ((ret != kElementOK) && (ret != kElementNoKey)) {
+        send_element_error(conn, ret);
+        return;
+    }
+    
+    if (!members.empty()) {
+        g_server.binlog.Store(db_idx, conn->GetCurReqCommand());
+    }
+    conn->SendMultiBuldLen((long)members.size() * 2);
+    for (const pair<string, double>& member : members) {
+        conn->SendBulkString(member.first);
+        conn->SendBulkString(double_to_string(member.second));
+    }
+}
+
+void zpopmin_command(ClientConn* conn, const vector<string>& cmd_vec)
+{
+    generic_zpop_command(conn, cmd_vec, true);
+}
+
+void zpopmax_command(ClientConn* conn, const vector<string>& cmd_vec)
+{
+    generic_zpop_command(conn, cmd_vec, false);
+}
+
+static void generic_blocking_zpop_command(ClientConn* conn, const vector<string>& cmd_vec, bool pop_min)
+{
+    uint64_t timeout_ms;
+    if (!get_block_timeout(conn, cmd_vec.back(), timeout_ms)) {
+        return;
+    }
+    
+    int db_idx = conn->GetDBIndex();
+    vector<string> keys(cmd_vec.begin() + 1, cmd_vec.end() - 1);
+    KeysLockGuard lock_guard(db_idx, set<string>(keys.begin(), keys.end()));
+    bool woken = is_client_blocked(conn);
+    for (const string& key : keys) {
+        vector<pair<string, double>> members;
+        int ret = pop_zset_members(db_idx, key, pop_min, 1, members);
+        if ((ret == kElementNoKey) || ((ret == kElementOK) && members.empty()) ||
+            (woken && (ret == kElementWrongType))) {
+            continue;
         }
         
-        delete it;
-        if (del_cnt > 0) {
-            mdata.count -= del_cnt;
-            if (mdata.count == 0) {
-                delete_key(db_idx, cmd_vec[1], mdata.ttl, KEY_TYPE_ZSET);
-            } else {
-                put_meta_data(db_idx, KEY_TYPE_ZSET, cmd_vec[1], mdata.ttl, mdata.count, &batch);
-                DB_BATCH_UPDATE(batch)
-            }
-            
-            g_server.binlog.Store(db_idx, conn->GetCurReqCommand());
+        unblock_client(conn);
+        if (ret != kElementOK) {
+            send_element_error(conn, ret);
+            return;
         }
-        conn->SendInteger(del_cnt);
+        
+        // the slave pops the same member with ZPOPMIN or ZPOPMAX, without blocking
+        string pop_cmd;
+        vector<string> pop_cmd_vec = {pop_min ? "ZPOPMIN" : "ZPOPMAX", key};
+        build_request(pop_cmd_vec, pop_cmd);
+        g_server.binlog.Store(db_idx, pop_cmd);
+        conn->SendArray({key, members[0].first, double_to_string(members[0].second)});
+        return;
+    }
+    
+    if (!block_client(conn, keys, timeout_ms)) {
+        conn->SendRawResponse(kNullMultiBulk);
     }
 }
 
+void bzpopmin_command(ClientConn* conn, const vector<string>& cmd_vec)
+{
+    generic_blocking_zpop_command(conn, cmd_vec, true);
+}
+
+void bzpopmax_command(ClientConn* conn, const vector<string>& cmd_vec)
+{
+    generic_blocking_zpop_command(conn, cmd_vec, false);
+}
+
 void zscore_command(ClientConn* conn, const vector<string>& cmd_vec)
 {
     int db_idx = conn->GetDBIndex();
     MetaData mdata;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    ReadSnapshotGuard snapshot_guard(db_idx, false);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    int ret = get_meta_data(db_idx, cmd_vec[1], mdata, read_option);
     if (ret == kExpireDBError) {
         conn->SendError("db error");
     } else if (ret == kExpireKeyNotExist) {
@@ -1309,7 +1605,7 @@ void zscore_command(ClientConn* conn, const vector<string>& cmd_vec)
         }
         
         double score;
-        int result = get_zset_score(db_idx, cmd_vec[1], cmd_vec[2], score);
+        int result = get_zset_score(db_idx, cmd_vec[1], cmd_vec[2], score, read_option);
         if (result == FIELD_EXIST) {
             conn->SendBulkString(double_to_string(score));
         } else if (result == FIELD_NOT_EXIST) {
@@ -1320,6 +1616,50 @@ void zscore_command(ClientConn* conn, const vector<string>& cmd_vec)
     }
 }
 
+// ZMSCORE key member [member ...]
+void zmscore_command(ClientConn* conn, const vector<string>& cmd_vec)
+{
+    int db_idx = conn->GetDBIndex();
+    int member_cnt = (int)cmd_vec.size() - 2;
+    MetaData mdata;
+    ReadSnapshotGuard snapshot_guard(db_idx);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+    int ret = get_meta_data(db_idx, cmd_vec[1], mdata, read_option);
+    if (ret == kExpireDBError) {
+        conn->SendError("db error");
+    } else if (ret == kExpireKeyNotExist) {
+        conn->SendMultiBuldLen(member_cnt);
+        for (int i = 0; i < member_cnt; i++) {
+            conn->SendRawResponse(kNullBulkString);
+        }
+    } else {
+        if (mdata.type != KEY_TYPE_ZSET) {
+            conn->SendRawResponse(kWrongTypeError);
+            return;
+        }
+        
+        vector<string> members(cmd_vec.begin() + 2, cmd_vec.end());
+        vector<int> results;
+        vector<double> scores;
+        get_zset_scores(db_idx, cmd_vec[1], members, results, scores, read_option);
+        for (int result : results) {
+            if (result == DB_ERROR) {
+                conn->SendError("db error");
+                return;
+            }
+        }
+        
+        conn->SendMultiBuldLen(member_cnt);
+        for (int i = 0; i < member_cnt; i++) {
+            if (results[i] == FIELD_EXIST) {
+                conn->SendBulkString(double_to_string(scores[i]));
+            } else {
+                conn->SendRawResponse(kNullBulkString);
+            }
+        }
+    }
+}
+
 void zscan_command(ClientConn* conn, const vector<string>& cmd_vec)
 {
     long count = 10;
@@ -1333,7 +1673,7 @@ void zscan_command(ClientConn* conn, const vector<string>& cmd_vec)
     EncodeKey cursor_key(KEY_TYPE_ZSET_SCORE, cmd_vec[1], cmd_vec[2]);
     ScanKeyGuard scan_key_guard(db_idx);
     rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
-    rocksdb::Iterator* it = g_server.db->NewIterator(g_server.read_option, cf_handle);
+    rocksdb::Iterator* it = db_new_iterator(g_server.read_option, cf_handle);
     
     string cursor;
     vector<string> members;
@@ -1380,5 +1720,5 @@ void zscan_command(ClientConn* conn, const vector<string>& cmd_vec)
     string start_resp = "*2\r\n";
     conn->SendRawResponse(start_resp);
     conn->SendBulkString(cursor);
-    conn->SendArray(members);
+    conn->SendArray(std::move(members));
 }
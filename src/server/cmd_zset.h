@@ -32,6 +32,14 @@ void zremrangebylex_command(ClientConn* conn, const vector<string>& cmd_vec);
 void zremrangebyrank_command(ClientConn* conn, const vector<string>& cmd_vec);
 void zremrangebyscore_command(ClientConn* conn, const vector<string>& cmd_vec);
 void zscore_command(ClientConn* conn, const vector<string>& cmd_vec);
+void zmscore_command(ClientConn* conn, const vector<string>& cmd_vec);
 void zscan_command(ClientConn* conn, const vector<string>& cmd_vec);
+void zpopmin_command(ClientConn* conn, const vector<string>& cmd_vec);
+void zpopmax_command(ClientConn* conn, const vector<string>& cmd_vec);
+void bzpopmin_command(ClientConn* conn, const vector<string>& cmd_vec);   // see blocking.h
+void bzpopmax_command(ClientConn* conn, const vector<string>& cmd_vec);
+
+// decode the result of reading the score of a zset member, return FIELD_EXIST, FIELD_NOT_EXIST or DB_ERROR
+int decode_zset_score(const rocksdb::Status& status, const string& encode_value, double& score);
 
 #endif /* __CMD_ZSET_H__ */
@@ -0,0 +1,291 @@
+//
+//  command_table.cpp
+//  kedis
+//
+
+#include "command_table.h"
+#include "simple_log.h"
+#include "cmd_db.h"
+#include "cmd_hash.h"
+#include "cmd_keys.h"
+#include "cmd_list.h"
+#include "cmd_set.h"
+#include "cmd_string.h"
+#include "cmd_zset.h"
+#include "hyperloglog.h"
+#include "replication.h"
+#include "migrate.h"
+#include "slowlog.h"
+#include "config.h"
+#include "scripting.h"
+
+// name, proc, arity, is_write, first_key, last_key, key_step, cost, exec
+static KedisCommand g_command_table[] = {
+    // DB commands
+    {"AUTH", auth_command, 2, false, 0, 0, 0, CMD_COST_FAST, CMD_EXEC_IO},
+    {"PING", ping_command, 1, false, 0, 0, 0, CMD_COST_FAST, CMD_EXEC_IO},
+    {"ECHO", echo_command, 2, false, 0, 0, 0, CMD_COST_FAST, CMD_EXEC_IO},
+    {"SELECT", select_command, 2, false, 0, 0, 0, CMD_COST_FAST, CMD_EXEC_IO},
+    {"DBSIZE", dbsize_command, 1, false, 0, 0, 0, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"INFO", info_command, -1, false, 0, 0, 0, CMD_COST_SLOW, CMD_EXEC_IO},
+    {"FLUSHDB", flushdb_command, 1, false, 0, 0, 0, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"FLUSHALL", flushall_command, 1, false, 0, 0, 0, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"DEBUG", debug_command, -2, false, 0, 0, 0, CMD_COST_FAST, CMD_EXEC_IO},
+    {"COMMAND", command_command, 1, false, 0, 0, 0, CMD_COST_FAST, CMD_EXEC_IO},
+    {"CONFIG", config_command, -2, false, 0, 0, 0, CMD_COST_FAST, CMD_EXEC_IO},
+
+    // transaction
+    {"MULTI", multi_command, 1, false, 0, 0, 0, CMD_COST_FAST, CMD_EXEC_IO},
+    {"EXEC", exec_command, 1, false, 0, 0, 0, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"DISCARD", discard_command, 1, false, 0, 0, 0, CMD_COST_FAST, CMD_EXEC_IO},
+    {"WATCH", watch_command, -2, false, 1, -1, 1, CMD_COST_FAST, CMD_EXEC_IO},
+    {"UNWATCH", unwatch_command, 1, false, 0, 0, 0, CMD_COST_FAST, CMD_EXEC_IO},
+
+    // replication
+    {"REPLCONF", replconf_command, -3, false, 0, 0, 0, CMD_COST_FAST, CMD_EXEC_IO},
+    {"PSYNC", psync_command, 3, false, 0, 0, 0, CMD_COST_FAST, CMD_EXEC_IO},
+    {"SLAVEOF", slaveof_command, 3, false, 0, 0, 0, CMD_COST_FAST, CMD_EXEC_IO},
+    {"REPL_SNAPSHOT_COMPLETE", repl_snapshot_complete_command, 4, false, 0, 0, 0, CMD_COST_FAST, CMD_EXEC_IO},
+
+    // migrate
+    {"MIGRATE", migrate_command, -6, true, 3, 3, 1, CMD_COST_SLOW, CMD_EXEC_IO},
+    {"RESTORE", restore_command, 4, true, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"DUMP", dump_command, 2, false, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+
+    // keys commands
+    {"DEL", del_command, -2, true, 1, -1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"EXISTS", exists_command, 2, false, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"TTL", ttl_command, 2, false, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"PTTL", pttl_command, 2, false, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"TYPE", type_command, 2, false, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"EXPIRE", expire_command, 3, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"EXPIREAT", expireat_command, 3, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"PEXPIRE", pexpire_command, 3, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"PEXPIREAT", pexpireat_command, 3, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"PERSIST", persist_command, 2, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"RANDOMKEY", randomkey_command, 1, false, 0, 0, 0, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"KEYS", keys_command, 2, false, 0, 0, 0, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"SCAN", scan_command, -2, false, 0, 0, 0, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+
+    // string commands
+    {"GET", get_command, 2, false, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"GETSET", getset_command, 3, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"SET", set_command, -3, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"SETEX", setex_command, 4, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"SETNX", setnx_command, 3, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"PSETEX", psetex_command, 4, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"MSET", mset_command, -3, true, 1, -1, 2, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"MSETNX", msetnx_command, -3, true, 1, -1, 2, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"MGET", mget_command, -2, false, 1, -1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"APPEND", append_command, 3, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"GETRANGE", getrange_command, 4, false, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"SETRANGE", setrange_command, 4, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"STRLEN", strlen_command, 2, false, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"INCR", incr_command, 2, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"DECR", decr_command, 2, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"INCRBY", incrby_command, 3, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"DECRBY", decrby_command, 3, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"INCRBYFLOAT", incrbyfloat_command, 3, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"SETBIT", setbit_command, 4, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"GETBIT", getbit_command, 3, false, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"BITCOUNT", bitcount_command, -2, false, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"BITPOS", bitpos_command, -3, false, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+
+    // hash commands
+    {"HDEL", hdel_command, -3, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"HEXISTS", hexists_command, 3, false, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"HGET", hget_command, 3, false, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"HGETALL", hgetall_command, 2, false, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"HKEYS", hkeys_command, 2, false, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"HVALS", hvals_command, 2, false, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"HINCRBY", hincrby_command, 4, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"HINCRBYFLOAT", hincrbyfloat_command, 4, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"HLEN", hlen_command, 2, false, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"HMGET", hmget_command, -3, false, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"HMSET", hmset_command, -4, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"HSCAN", hscan_command, -3, false, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"HSET", hset_command, 4, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"HSETNX", hsetnx_command, 4, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"HSTRLEN", hstrlen_command, 3, false, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+
+    // list commands
+    {"LINDEX", lindex_command, 3, false, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"LINSERT", linsert_command, 5, true, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"LLEN", llen_command, 2, false, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"LPUSH", lpush_command, -3, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"LPOP", lpop_command, 2, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"LRANGE", lrange_command, 4, false, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"RPUSH", rpush_command, -3, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"RPOP", rpop_command, 2, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"LPUSHX", lpushx_command, 3, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"RPUSHX", rpushx_command, 3, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"LREM", lrem_command, 4, true, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"LSET", lset_command, 4, true, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"LTRIM", ltrim_command, 4, true, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"RPOPLPUSH", rpoplpush_command, 3, true, 1, 2, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"LMOVE", lmove_command, 5, true, 1, 2, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"BLPOP", blpop_command, -3, true, 1, -2, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"BRPOP", brpop_command, -3, true, 1, -2, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"BRPOPLPUSH", brpoplpush_command, 4, true, 1, 2, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"BLMOVE", blmove_command, 6, true, 1, 2, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+
+    // set commands
+    {"SADD", sadd_command, -3, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"SCARD", scard_command, 2, false, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"SISMEMBER", sismember_command, 3, false, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"SMISMEMBER", smismember_command, -3, false, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"SMEMBERS", smembers_command, 2, false, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"SPOP", spop_command, -2, true, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"SRANDMEMBER", srandmember_command, -2, false, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"SREM", srem_command, -3, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"SSCAN", sscan_command, -3, false, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+
+    // zset commands
+    {"ZADD", zadd_command, -4, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"ZINCRBY", zincrby_command, 4, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"ZCARD", zcard_command, 2, false, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"ZCOUNT", zcount_command, 4, false, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"ZRANGE", zrange_command, -4, false, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"ZREVRANGE", zrevrange_command, -4, false, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"ZRANGEBYSCORE", zrangebyscore_command, -4, false, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"ZREVRANGEBYSCORE", zrevrangebyscore_command, -4, false, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"ZRANGEBYLEX", zrangebylex_command, -4, false, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"ZREVRANGEBYLEX", zrevrangebylex_command, -4, false, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"ZLEXCOUNT", zlexcount_command, 4, false, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"ZRANK", zrank_command, 3, false, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"ZREVRANK", zrevrank_command, 3, false, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"ZREM", zrem_command, -3, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"ZREMRANGEBYLEX", zremrangebylex_command, 4, true, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"ZREMRANGEBYRANK", zremrangebyrank_command, 4, true, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"ZREMRANGEBYSCORE", zremrangebyscore_command, 4, true, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"ZSCORE", zscore_command, 3, false, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"ZMSCORE", zmscore_command, -3, false, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"ZSCAN", zscan_command, -3, false, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"ZPOPMIN", zpopmin_command, -2, true, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"ZPOPMAX", zpopmax_command, -2, true, 1, 1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"BZPOPMIN", bzpopmin_command, -3, true, 1, -2, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"BZPOPMAX", bzpopmax_command, -3, true, 1, -2, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+
+    // hyperloglog
+    {"PFADD", pfadd_command, -2, true, 1, 1, 1, CMD_COST_FAST, CMD_EXEC_STORAGE},
+    {"PFCOUNT", pfcount_command, -2, false, 1, -1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"PFMERGE", pfmerge_command, -3, true, 1, -1, 1, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+
+    // slowlog
+    {"SLOWLOG", slowlog_command, -2, false, 0, 0, 0, CMD_COST_FAST, CMD_EXEC_IO},
+
+    // scripting
+    {"EVAL", eval_command, -3, false, 0, 0, 0, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"EVALSHA", evalsha_command, -3, false, 0, 0, 0, CMD_COST_SLOW, CMD_EXEC_STORAGE},
+    {"SCRIPT", script_command, -2, false, 0, 0, 0, CMD_COST_FAST, CMD_EXEC_IO},
+};
+
+static const int kCommandCount = sizeof(g_command_table) / sizeof(g_command_table[0]);
+
+// the hash table is sparse enough that a collision free seed is found after a few tries,
+// slot value is the index in g_command_table plus 1, 0 means empty
+static const uint32_t kCommandSlotCount = 2048;
+static uint8_t g_command_slots[kCommandSlotCount];
+static uint32_t g_command_hash_seed = 0;
+
+// FNV-1a over the upper case name, so the command name in a request does not need to be transformed first
+static inline uint32_t command_hash(const char* name, size_t len, uint32_t seed)
+{
+    uint32_t hash = 2166136261u ^ seed;
+    for (size_t i = 0; i < len; i++) {
+        uint8_t ch = (uint8_t)name[i];
+        if ((ch >= 'a') && (ch <= 'z')) {
+            ch -= 'a' - 'A';
+        }
+        hash = (hash ^ ch) * 16777619u;
+    }
+    return hash;
+}
+
+static bool build_command_slots(uint32_t seed)
+{
+    memset(g_command_slots, 0, sizeof(g_command_slots));
+    for (int i = 0; i < kCommandCount; i++) {
+        KedisCommand& cmd = g_command_table[i];
+        uint32_t slot = command_hash(cmd.name, cmd.name_len, seed) & (kCommandSlotCount - 1);
+        if (g_command_slots[slot]) {
+            return false;
+        }
+        g_command_slots[slot] = (uint8_t)(i + 1);
+    }
+    
+    return true;
+}
+
+void init_command_table()
+{
+    static_assert(kCommandCount < 256, "slot value is uint8_t");
+    
+    // the table is fixed, so the search always ends with the same seed
+    uint32_t seed = 0;
+    while (!build_command_slots(seed)) {
+        seed++;
+    }
+    g_command_hash_seed = seed;
+}
+
+KedisCommand* lookup_command(const rocksdb::Slice& name)
+{
+    uint32_t slot = command_hash(name.data(), name.size(), g_command_hash_seed) & (kCommandSlotCount - 1);
+    uint8_t index = g_command_slots[slot];
+    if (!index) {
+        return NULL;
+    }
+    
+    KedisCommand* cmd = &g_command_table[index - 1];
+    if (((size_t)cmd->name_len != name.size()) || strncasecmp(cmd->name, name.data(), name.size())) {
+        return NULL;
+    }
+    
+    return cmd;
+}
+
+int get_command_count()
+{
+    return kCommandCount;
+}
+
+KedisCommand* get_command(int index)
+{
+    return &g_command_table[index];
+}
+
+string get_command_lower_name(KedisCommand* cmd)
+{
+    string name(cmd->name, cmd->name_len);
+    for (size_t i = 0; i < name.size(); i++) {
+        name[i] = tolower(name[i]);
+    }
+    return name;
+}
+
+void get_command_key_indexes(KedisCommand* cmd, int argc, vector<int>& indexes)
+{
+    if (!cmd->first_key) {
+        return;
+    }
+    
+    int last_key = (cmd->last_key < 0) ? argc + cmd->last_key : cmd->last_key;
+    for (int i = cmd->first_key; (i <= last_key) && (i < argc); i += cmd->key_step) {
+        indexes.push_back(i);
+    }
+}
+
+void add_command_stat(KedisCommand* cmd, uint64_t usec)
+{
+    __atomic_fetch_add(&cmd->calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&cmd->usec, usec, __ATOMIC_RELAXED);
+}
+
+void reset_command_stats()
+{
+    for (int i = 0; i < kCommandCount; i++) {
+        __atomic_store_n(&g_command_table[i].calls, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&g_command_table[i].usec, 0, __ATOMIC_RELAXED);
+    }
+}
@@ -0,0 +1,73 @@
+//
+//  command_table.h
+//  kedis
+//
+
+#ifndef __COMMAND_TABLE_H__
+#define __COMMAND_TABLE_H__
+
+#include "util.h"
+#include "rocksdb/slice.h"
+
+class ClientConn;
+
+typedef void (*KedisCommandProc)(ClientConn* conn, const vector<string>& cmd_vec);
+
+// commands with big values take the arguments as slices into the input buffer of the client, so the values are
+// written to rocksdb without copy, the slices are only valid during the call
+typedef void (*KedisSliceCommandProc)(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec);
+
+// slow commands touch a number of elements that grows with the data, like KEYS, HGETALL, LRANGE
+enum {
+    CMD_COST_FAST = 0,
+    CMD_COST_SLOW,
+};
+
+// where the command runs if the storage thread pool is enabled
+enum {
+    CMD_EXEC_IO = 0,    // in the io thread, commands that change the connection or talk to other connections
+    CMD_EXEC_STORAGE,   // in a storage thread, commands that only access the database
+};
+
+struct KedisCommand {
+    const char*         name;       // upper case
+    int                 name_len;
+    KedisCommandProc    proc;
+    KedisSliceCommandProc slice_proc;
+    int                 arity;      // -N means >= N
+    bool                is_write;
+    int                 first_key;  // 0 means no key argument
+    int                 last_key;   // -1 means the last argument
+    int                 key_step;
+    int                 cost;       // CMD_COST_XXX
+    int                 exec;       // CMD_EXEC_XXX
+
+    // statistics are updated by all io threads with relaxed atomic operations
+    uint64_t            calls;
+    uint64_t            usec;
+
+    KedisCommand(const char* n, KedisCommandProc p, int a, bool w, int first, int last, int step, int c, int e)
+        : name(n), name_len((int)strlen(n)), proc(p), slice_proc(nullptr), arity(a), is_write(w),
+          first_key(first), last_key(last), key_step(step), cost(c), exec(e), calls(0), usec(0) {}
+    KedisCommand(const char* n, KedisSliceCommandProc p, int a, bool w, int first, int last, int step, int c, int e)
+        : name(n), name_len((int)strlen(n)), proc(nullptr), slice_proc(p), arity(a), is_write(w),
+          first_key(first), last_key(last), key_step(step), cost(c), exec(e), calls(0), usec(0) {}
+};
+
+// build the perfect hash of the command table, must be called before any lookup
+void init_command_table();
+
+// case insensitive lookup with one hash and one compare, return NULL if the command does not exist
+KedisCommand* lookup_command(const rocksdb::Slice& name);
+
+int get_command_count();
+KedisCommand* get_command(int index);
+string get_command_lower_name(KedisCommand* cmd);  // for COMMAND and INFO commandstats
+
+// the indexes of the key arguments in a request of argc arguments, by first_key, last_key and key_step
+void get_command_key_indexes(KedisCommand* cmd, int argc, vector<int>& indexes);
+
+void add_command_stat(KedisCommand* cmd, uint64_t usec);
+void reset_command_stats();
+
+#endif
@@ -9,6 +9,7 @@
 #include "config.h"
 #include "server.h"
 #include "db_util.h"
+#include "event_loop.h"
 
 static const char* log_level[] = {"error", "warn", "info", "debug"};
 
@@ -22,6 +23,101 @@ static int yesnotoi(const string& s)
         return -1;
 }
 
+static const char* client_class_name[] = {"normal", "slave"};
+
+static const char* io_placement_name[] = {"round-robin", "least-conn", "least-cpu"};
+
+static int get_io_placement(const string& name)
+{
+    for (int i = 0; i < (int)(sizeof(io_placement_name) / sizeof(io_placement_name[0])); i++) {
+        if (!strcasecmp(name.c_str(), io_placement_name[i])) {
+            return i;
+        }
+    }
+    
+    return -1;
+}
+
+const char* get_io_thread_placement_name()
+{
+    return io_placement_name[g_server.io_thread_placement];
+}
+
+// convert a memory size like 64mb, 1gb or 512k to bytes, return -1 if the format is invalid
+static long long memtoll(const string& s)
+{
+    char* end = NULL;
+    long long val = strtoll(s.c_str(), &end, 10);
+    if ((end == s.c_str()) || (val < 0)) {
+        return -1;
+    }
+    
+    long long mul;
+    if (*end == 0 || !strcasecmp(end, "b")) {
+        mul = 1;
+    } else if (!strcasecmp(end, "k") || !strcasecmp(end, "kb")) {
+        mul = 1024;
+    } else if (!strcasecmp(end, "m") || !strcasecmp(end, "mb")) {
+        mul = 1024 * 1024;
+    } else if (!strcasecmp(end, "g") || !strcasecmp(end, "gb")) {
+        mul = 1024L * 1024 * 1024;
+    } else {
+        return -1;
+    }
+    
+    return val * mul;
+}
+
+// argv contains groups of <class> <hard limit> <soft limit> <soft seconds>,
+// nothing is changed if any group is invalid
+static int set_client_obuf_limits(const vector<string>& argv, int start_idx)
+{
+    int argc = (int)argv.size();
+    if ((argc == start_idx) || ((argc - start_idx) % 4 != 0)) {
+        return CODE_ERROR;
+    }
+    
+    ClientBufferLimit limits[CLIENT_CLASS_COUNT];
+    memcpy(limits, g_server.client_obuf_limits, sizeof(limits));
+    for (int i = start_idx; i < argc; i += 4) {
+        int client_class;
+        if (!strcasecmp(argv[i].c_str(), "normal")) {
+            client_class = CLIENT_CLASS_NORMAL;
+        } else if (!strcasecmp(argv[i].c_str(), "slave")) {
+            client_class = CLIENT_CLASS_SLAVE;
+        } else {
+            return CODE_ERROR;
+        }
+        
+        long long hard = memtoll(argv[i + 1]);
+        long long soft = memtoll(argv[i + 2]);
+        int soft_seconds = atoi(argv[i + 3].c_str());
+        if ((hard < 0) || (soft < 0) || (soft_seconds < 0)) {
+            return CODE_ERROR;
+        }
+        
+        limits[client_class] = {(uint64_t)hard, (uint64_t)soft, soft_seconds};
+    }
+    
+    memcpy(g_server.client_obuf_limits, limits, sizeof(limits));
+    return CODE_OK;
+}
+
+static string get_client_obuf_limits()
+{
+    string value;
+    for (int i = 0; i < CLIENT_CLASS_COUNT; i++) {
+        ClientBufferLimit& limit = g_server.client_obuf_limits[i];
+        if (!value.empty()) {
+            value += " ";
+        }
+        value += string(client_class_name[i]) + " " + to_string(limit.hard_limit_bytes) + " " +
+            to_string(limit.soft_limit_bytes) + " " + to_string(limit.soft_limit_seconds);
+    }
+    
+    return value;
+}
+
 static void load_panic(const char* error_msg)
 {
     init_simple_log(kLogLevelInfo, "error-log");
@@ -99,6 +195,53 @@ void load_config(const string& filename)
             if (g_server.io_thread_num < 0) {
                 load_panic("invalid io thread number");
             }
+        } else if (!strcasecmp("group-commit", argv[0].c_str()) && (argc == 2)) {
+            int r = yesnotoi(argv[1]);
+            if (r == -1) {
+                load_panic("must a yes or no");
+            }
+            g_server.group_commit = r;
+        } else if (!strcasecmp("read-coalesce", argv[0].c_str()) && (argc == 2)) {
+            int r = yesnotoi(argv[1]);
+            if (r == -1) {
+                load_panic("must a yes or no");
+            }
+            g_server.read_coalesce = r;
+        } else if (!strcasecmp("read-coalesce-window", argv[0].c_str()) && (argc == 2)) {
+            g_server.read_coalesce_window = atoi(argv[1].c_str());
+            if (g_server.read_coalesce_window < 0) {
+                load_panic("invalid read-coalesce-window");
+            }
+        } else if (!strcasecmp("lua-time-limit", argv[0].c_str()) && (argc == 2)) {
+            g_server.lua_time_limit = atoi(argv[1].c_str());
+            if (g_server.lua_time_limit < 0) {
+                load_panic("invalid lua-time-limit");
+            }
+        } else if (!strcasecmp("storage-thread-num", argv[0].c_str()) && (argc == 2)) {
+            g_server.storage_thread_num = atoi(argv[1].c_str());
+            if (g_server.storage_thread_num < 0) {
+                load_panic("invalid storage thread number");
+            }
+        } else if (!strcasecmp("io-thread-reuseport", argv[0].c_str()) && (argc == 2)) {
+            int r = yesnotoi(argv[1]);
+            if (r == -1) {
+                load_panic("must a yes or no");
+            }
+            g_server.io_thread_reuseport = r;
+        } else if (!strcasecmp("io-backend", argv[0].c_str()) && (argc == 2)) {
+            if (!strcasecmp("epoll", argv[1].c_str())) {
+                g_server.io_backend = IO_BACKEND_EPOLL;
+            } else if (!strcasecmp("io_uring", argv[1].c_str())) {
+                g_server.io_backend = IO_BACKEND_IO_URING;
+            } else {
+                load_panic("must be epoll or io_uring");
+            }
+        } else if (!strcasecmp("io-thread-placement", argv[0].c_str()) && (argc == 2)) {
+            int policy = get_io_placement(argv[1]);
+            if (policy == -1) {
+                load_panic("must be round-robin, least-conn or least-cpu");
+            }
+            g_server.io_thread_placement = policy;
         } else if (!strcasecmp("databases", argv[0].c_str()) && (argc == 2)) {
             g_server.db_num = atoi(argv[1].c_str());
             if (g_server.db_num < 1) {
@@ -150,6 +293,20 @@ void load_config(const string& filename)
             if (g_server.hll_sparse_max_bytes < 0) {
                 load_panic("invalid hll-sparse-max-bytes");
             }
+        } else if (!strcasecmp("command-time-slice", argv[0].c_str()) && (argc == 2)) {
+            g_server.command_time_slice = atoi(argv[1].c_str());
+            if (g_server.command_time_slice < 0) {
+                load_panic("invalid command-time-slice");
+            }
+        } else if (!strcasecmp("client-command-quota", argv[0].c_str()) && (argc == 2)) {
+            g_server.client_command_quota = atoi(argv[1].c_str());
+            if (g_server.client_command_quota < 0) {
+                load_panic("invalid client-command-quota");
+            }
+        } else if (!strcasecmp("client-output-buffer-limit", argv[0].c_str()) && (argc == 5)) {
+            if (set_client_obuf_limits(argv, 1) == CODE_ERROR) {
+                load_panic("invalid client-output-buffer-limit");
+            }
         } else {
             string msg = "bad directive or wrong number of arguments: " + line;
             load_panic(msg.c_str());
@@ -209,6 +366,48 @@ logpath %s
 # Set the number of io threads. This number can not be changed after the server is started
 io-thread-num %d
     
+# Every io thread listens on the port with SO_REUSEPORT and accepts connections by itself,
+# instead of accepting all connections in the main thread. Can not be changed after the server is started
+io-thread-reuseport %s
+    
+# Select the io backend of the event loops: epoll or io_uring (Linux 6.0+ with multishot recv),
+# the server falls back to epoll if io_uring is not supported. Can not be changed after the server is started
+io-backend %s
+    
+# How to pick the io thread for a new connection: round-robin, least-conn (the io thread with the least
+# connections) or least-cpu (the io thread that used the least cpu time in the last second).
+# Connections accepted with io-thread-reuseport stay in the io thread that accepted them
+io-thread-placement %s
+    
+# Set the number of storage threads. Commands that access the database run in the storage threads
+# and the io threads only parse requests and send replies, so a slow command does not delay
+# the other connections of the same io thread. 0 means commands run in the io threads.
+# This number can not be changed after the server is started
+storage-thread-num %d
+    
+# Write batches of the commands running at the same time are merged into one
+# database write, and so are their binlog records. A command still replies after
+# its write is done. The statistics are in the groupcommit section of INFO.
+group-commit %s
+    
+# Point reads (GET, HGET, SISMEMBER and ZSCORE) of all the clients of an io thread
+# are collected while the thread handles the requests it received, and answered
+# together with one database lookup for the keys and one for the elements, from
+# one snapshot. A client processes no more requests until its reads are answered,
+# so its replies keep the order. This helps when many clients send small reads.
+# The statistics are in the readcoalesce section of INFO.
+read-coalesce %s
+    
+# Microseconds a batch of coalesced reads waits for the reads of other clients,
+# the io thread polls for requests instead of sleeping meanwhile. 0 means the
+# batch only takes the reads received at the same time and is answered at once.
+read-coalesce-window %d
+    
+# Max execution time of a Lua script in milliseconds. A script running longer
+# is aborted with an error, which releases the keys it locked, the writes it did
+# before are kept. SCRIPT KILL aborts the running scripts at once. 0 means no limit.
+lua-time-limit %d
+    
 # Set the number of databases. The default database is DB 0, you can select
 # a different one on a per-connection basis using SELECT <dbid> where
 # dbid is a number between 0 and 'databases'-1
@@ -319,6 +518,43 @@ slowlog-max-len %d
 # composed of many HyperLogLogs with cardinality in the 0 - 15000 range.
 hll-sparse-max-bytes %d
     
+# Slow commands that go through a whole key or the whole keyspace (KEYS, HGETALL,
+# HKEYS, HVALS, LREM, ZREMRANGEBYRANK, ZREMRANGEBYSCORE, ZREMRANGEBYLEX) run in
+# time slices of this many microseconds. After every slice the thread serves the
+# other clients before the command goes on, reads see the data as it was when the
+# command started. A pipeline of slow commands also gives up the thread after a
+# slice. 0 means a command always runs to the end.
+command-time-slice %d
+    
+# A client runs at most this many commands each time it is served, the rest
+# of its pipeline waits until the other clients of the same thread are served,
+# so a client pipelining a lot of commands can not hold the thread. The times
+# a client used up the quota are counted in deferred_pipelines of INFO stats.
+# 0 means no limit.
+client-command-quota %d
+    
+# The client output buffer limits can be used to force disconnection of clients
+# that are not reading data from the server fast enough for some reason (a
+# common reason is that a client pipelines a lot of big requests like KEYS or
+# HGETALL without reading the responses).
+#
+# The limit can be set differently for the two classes of clients:
+#
+# normal -> normal clients
+# slave  -> slave clients
+#
+# The syntax of every client-output-buffer-limit directive is the following:
+#
+# client-output-buffer-limit <class> <hard limit> <soft limit> <soft seconds>
+#
+# A client is immediately disconnected once the hard limit is reached, or if
+# the soft limit is reached and remains reached for the specified number of
+# seconds. A normal client stops processing pipelined requests while its output
+# buffer is above the soft limit, and continues after the buffer drains.
+# Setting a limit to 0 disables it.
+client-output-buffer-limit normal %llu %llu %d
+client-output-buffer-limit slave %llu %llu %d
+    
 # config rewrite
     )";
     
@@ -340,7 +576,11 @@ hll-sparse-max-bytes %d
     
     fprintf(fp, config_pattern_general.c_str(),
             g_server.daemonize ? "yes" : "no", g_server.pid_file.c_str(), log_level[g_server.log_level],
-            g_server.log_path.c_str(), g_server.io_thread_num, g_server.db_num, g_server.db_name.c_str(),
+            g_server.log_path.c_str(), g_server.io_thread_num, g_server.io_thread_reuseport ? "yes" : "no",
+            g_server.io_backend == IO_BACKEND_IO_URING ? "io_uring" : "epoll", get_io_thread_placement_name(),
+            g_server.storage_thread_num, g_server.group_commit ? "yes" : "no",
+            g_server.read_coalesce ? "yes" : "no", g_server.read_coalesce_window, g_server.lua_time_limit,
+            g_server.db_num, g_server.db_name.c_str(),
             g_server.key_count_file.c_str(), g_server.binlog_dir.c_str(), g_server.binlog_capacity,
             g_server.require_pass.empty() ? "#" : "",
             g_server.require_pass.empty() ? "<password>" : g_server.require_pass.c_str(), g_server.max_clients);
@@ -355,7 +595,13 @@ hll-sparse-max-bytes %d
     
     fprintf(fp, config_pattern_other.c_str(),
             g_server.slowlog_log_slower_than, g_server.slowlog_max_len,
-            g_server.hll_sparse_max_bytes);
+            g_server.hll_sparse_max_bytes, g_server.command_time_slice, g_server.client_command_quota,
+            g_server.client_obuf_limits[CLIENT_CLASS_NORMAL].hard_limit_bytes,
+            g_server.client_obuf_limits[CLIENT_CLASS_NORMAL].soft_limit_bytes,
+            g_server.client_obuf_limits[CLIENT_CLASS_NORMAL].soft_limit_seconds,
+            g_server.client_obuf_limits[CLIENT_CLASS_SLAVE].hard_limit_bytes,
+            g_server.client_obuf_limits[CLIENT_CLASS_SLAVE].soft_limit_bytes,
+            g_server.client_obuf_limits[CLIENT_CLASS_SLAVE].soft_limit_seconds);
     fclose(fp);
     
     rename(tmp_file.c_str(), g_server.config_file.c_str());
@@ -399,6 +645,34 @@ void config_set_command(ClientConn* conn, const vector<string>& cmd_vec)
             return;
         }
         g_server.slave_read_only = r;
+    } else if (!strcasecmp(cmd_vec[2].c_str(), "group-commit")) {
+        int r = yesnotoi(cmd_vec[3]);
+        if (r == -1) {
+            conn->SendError("group-commit must be a yes or no");
+            return;
+        }
+        g_server.group_commit = r;
+    } else if (!strcasecmp(cmd_vec[2].c_str(), "read-coalesce")) {
+        int r = yesnotoi(cmd_vec[3]);
+        if (r == -1) {
+            conn->SendError("read-coalesce must be a yes or no");
+            return;
+        }
+        g_server.read_coalesce = r;
+    } else if (!strcasecmp(cmd_vec[2].c_str(), "read-coalesce-window")) {
+        int window = atoi(cmd_vec[3].c_str());
+        if (window < 0) {
+            conn->SendError("read-coalesce-window must not negative");
+            return;
+        }
+        g_server.read_coalesce_window = window;
+    } else if (!strcasecmp(cmd_vec[2].c_str(), "lua-time-limit")) {
+        int time_limit = atoi(cmd_vec[3].c_str());
+        if (time_limit < 0) {
+            conn->SendError("lua-time-limit must not negative");
+            return;
+        }
+        g_server.lua_time_limit = time_limit;
     } else if (!strcasecmp(cmd_vec[2].c_str(), "repl-timeout")) {
         int repl_timeout = atoi(cmd_vec[3].c_str());
         if (g_server.repl_timeout < 0) {
@@ -412,6 +686,33 @@ void config_set_command(ClientConn* conn, const vector<string>& cmd_vec)
         g_server.slowlog_max_len = atoi(cmd_vec[3].c_str());
     } else if (!strcasecmp(cmd_vec[2].c_str(), "hll-sparse-max-bytes")) {
         g_server.hll_sparse_max_bytes = atoi(cmd_vec[3].c_str());
+    } else if (!strcasecmp(cmd_vec[2].c_str(), "command-time-slice")) {
+        int time_slice = atoi(cmd_vec[3].c_str());
+        if (time_slice < 0) {
+            conn->SendError("command-time-slice must not negative");
+            return;
+        }
+        g_server.command_time_slice = time_slice;
+    } else if (!strcasecmp(cmd_vec[2].c_str(), "client-command-quota")) {
+        int quota = atoi(cmd_vec[3].c_str());
+        if (quota < 0) {
+            conn->SendError("client-command-quota must not negative");
+            return;
+        }
+        g_server.client_command_quota = quota;
+    } else if (!strcasecmp(cmd_vec[2].c_str(), "io-thread-placement")) {
+        int policy = get_io_placement(cmd_vec[3]);
+        if (policy == -1) {
+            conn->SendError("io-thread-placement must be round-robin, least-conn or least-cpu");
+            return;
+        }
+        g_server.io_thread_placement = policy;
+        set_io_placement_policy(policy);
+    } else if (!strcasecmp(cmd_vec[2].c_str(), "client-output-buffer-limit")) {
+        if (set_client_obuf_limits(split(cmd_vec[3], " "), 0) == CODE_ERROR) {
+            conn->SendError("invalid client-output-buffer-limit");
+            return;
+        }
     } else {
         string err_msg = "Unsupported CONFIG parameter: " + cmd_vec[2];
         conn->SendError(err_msg);
@@ -444,8 +745,30 @@ void config_get_command(ClientConn* conn, const vector<string>& cmd_vec)
         resp_vec.push_back(to_string(g_server.slowlog_log_slower_than));
     } else if (!strcasecmp(cmd_vec[2].c_str(), "slowlog-max-len")) {
         resp_vec.push_back(to_string(g_server.slowlog_max_len));
+    } else if (!strcasecmp(cmd_vec[2].c_str(), "io-thread-reuseport")) {
+        resp_vec.push_back(g_server.io_thread_reuseport ? "yes" : "no");
+    } else if (!strcasecmp(cmd_vec[2].c_str(), "io-backend")) {
+        resp_vec.push_back(g_server.io_backend == IO_BACKEND_IO_URING ? "io_uring" : "epoll");
+    } else if (!strcasecmp(cmd_vec[2].c_str(), "io-thread-placement")) {
+        resp_vec.push_back(get_io_thread_placement_name());
+    } else if (!strcasecmp(cmd_vec[2].c_str(), "storage-thread-num")) {
+        resp_vec.push_back(to_string(g_server.storage_thread_num));
+    } else if (!strcasecmp(cmd_vec[2].c_str(), "group-commit")) {
+        resp_vec.push_back(g_server.group_commit ? "yes" : "no");
+    } else if (!strcasecmp(cmd_vec[2].c_str(), "read-coalesce")) {
+        resp_vec.push_back(g_server.read_coalesce ? "yes" : "no");
+    } else if (!strcasecmp(cmd_vec[2].c_str(), "read-coalesce-window")) {
+        resp_vec.push_back(to_string(g_server.read_coalesce_window));
+    } else if (!strcasecmp(cmd_vec[2].c_str(), "lua-time-limit")) {
+        resp_vec.push_back(to_string(g_server.lua_time_limit));
     } else if (!strcasecmp(cmd_vec[2].c_str(), "hll-sparse-max-bytes")) {
         resp_vec.push_back(to_string(g_server.hll_sparse_max_bytes));
+    } else if (!strcasecmp(cmd_vec[2].c_str(), "command-time-slice")) {
+        resp_vec.push_back(to_string(g_server.command_time_slice));
+    } else if (!strcasecmp(cmd_vec[2].c_str(), "client-command-quota")) {
+        resp_vec.push_back(to_string(g_server.client_command_quota));
+    } else if (!strcasecmp(cmd_vec[2].c_str(), "client-output-buffer-limit")) {
+        resp_vec.push_back(get_client_obuf_limits());
     } else {
         resp_vec.clear();
     }
@@ -473,6 +796,7 @@ void config_command(ClientConn* conn, const vector<string>& cmd_vec)
             conn->SendError("wrong number of arguments for CONFIG RESETSTAT command");
         } else {
             g_stat.Reset();
+            reset_command_stats();
             conn->SendSimpleString("OK");
             log_message(kLogLevelWarning, "CONFIG RESETSTAT executed with success\n");
         }
@@ -18,4 +18,6 @@ int rewrite_config(const string& filename);
 
 void config_command(ClientConn* conn, const vector<string>& cmd_vec);
 
+const char* get_io_thread_placement_name();
+
 #endif /* __CONFIG_H__ */
@@ -9,11 +9,34 @@
 #include "db_util.h"
 #include "server.h"
 #include "encoding.h"
+#include "transaction.h"
+
+rocksdb::Status db_get(const rocksdb::ReadOptions& read_option, rocksdb::ColumnFamilyHandle* cf_handle,
+                       const rocksdb::Slice& key, string* value)
+{
+    Transaction* transaction = get_running_transaction();
+    if (transaction) {
+        return transaction->GetBatch()->GetFromBatchAndDB(g_server.db, read_option, cf_handle, key, value);
+    }
+    
+    return g_server.db->Get(read_option, cf_handle, key, value);
+}
+
+rocksdb::Iterator* db_new_iterator(const rocksdb::ReadOptions& read_option, rocksdb::ColumnFamilyHandle* cf_handle)
+{
+    rocksdb::Iterator* it = g_server.db->NewIterator(read_option, cf_handle);
+    Transaction* transaction = get_running_transaction();
+    if (transaction) {
+        return transaction->GetBatch()->NewIteratorWithBase(cf_handle, it);
+    }
+    
+    return it;
+}
 
 static void delete_range(int db_idx, const string& key, uint8_t key_type, rocksdb::WriteBatch& batch)
 {
     rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
-    rocksdb::Iterator* it = g_server.db->NewIterator(g_server.read_option, cf_handle);
+    rocksdb::Iterator* it = db_new_iterator(g_server.read_option, cf_handle);
     
     // consider use rocksdb's experimental feature DeleteRange()
     EncodeKey meta_key(key_type, key);
@@ -29,79 +52,70 @@ static void delete_range(int db_idx, const string& key, uint8_t key_type, rocksd
     delete it;
 }
 
-void delete_key(int db_idx, const string& key, uint64_t ttl, uint8_t key_type)
+void delete_key(int db_idx, const string& key, uint64_t ttl, uint8_t key_type, rocksdb::WriteBatch* batch)
 {
     EncodeKey meta_key(KEY_TYPE_META, key);
     rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
-    rocksdb::WriteBatch batch;
+    rocksdb::WriteBatch single_batch;
+    rocksdb::WriteBatch* delete_batch = batch ? batch : &single_batch;
     
     g_server.key_count_vec[db_idx]--;
-    batch.Delete(cf_handle, meta_key.GetEncodeKey());
+    delete_batch->Delete(cf_handle, meta_key.GetEncodeKey());
     if (ttl > 0) {
         g_server.ttl_key_count_vec[db_idx]--;
         EncodeKey ttl_key(KEY_TYPE_TTL_SORT, ttl, key);
-        batch.Delete(cf_handle, ttl_key.GetEncodeKey());
+        delete_batch->Delete(cf_handle, ttl_key.GetEncodeKey());
     }
     
     if ((key_type == KEY_TYPE_HASH) || (key_type == KEY_TYPE_LIST) || (key_type == KEY_TYPE_SET) || (key_type == KEY_TYPE_ZSET)) {
-        delete_range(db_idx, key, key_type + 1, batch);
+        delete_range(db_idx, key, key_type + 1, *delete_batch);
         if (key_type == KEY_TYPE_ZSET) {
-            delete_range(db_idx, key, KEY_TYPE_ZSET_SORT, batch);
+            delete_range(db_idx, key, KEY_TYPE_ZSET_SORT, *delete_batch);
         }
     }
     
-    rocksdb::Status status = g_server.db->Write(g_server.write_option, &batch);
-    if (!status.ok()) {
-        log_message(kLogLevelError, "delete_key WriteBatch failed: %s\n", status.ToString().c_str());
+    if (!batch) {
+        rocksdb::Status status = g_group_commit.Write(g_server.db, &single_batch);
+        if (!status.ok()) {
+            log_message(kLogLevelError, "delete_key WriteBatch failed: %s\n", status.ToString().c_str());
+        }
     }
 }
 
-int expire_key_if_needed(int db_idx, const string& key, MetaData& mdata, string* raw_value)
+// decode the meta data read from the db
+static int decode_meta_data(const string& encode_value, MetaData& mdata)
 {
-    EncodeKey meta_key(KEY_TYPE_META, key);
-    rocksdb::Slice encode_key = meta_key.GetEncodeKey();
-    rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
-    
-    string encode_value;
-    rocksdb::Status status = g_server.db->Get(g_server.read_option, cf_handle, encode_key, &encode_value);
-    
-    if (status.ok()) {
-        if (raw_value) {
-            *raw_value = encode_value;
-        }
-        
-        try {
-            ByteStream stream((uchar_t*)encode_value.data(), (uint32_t)encode_value.size());
-            stream >> mdata.type;
-            stream >> mdata.ttl;
-            if (mdata.type == KEY_TYPE_STRING) {
-                stream >> mdata.value;
-            } else if ((mdata.type == KEY_TYPE_HASH) || (mdata.type == KEY_TYPE_LIST) ||
-                       (mdata.type == KEY_TYPE_SET) || (mdata.type == KEY_TYPE_ZSET)) {
-                stream >> mdata.count;
-                if (mdata.type == KEY_TYPE_LIST) {
-                    stream >> mdata.head_seq;
-                    stream >> mdata.tail_seq;
-                    stream >> mdata.current_seq;
-                }
-            } else {
-                log_message(kLogLevelError, "wrong key type\n");
-                return kExpireDBError;
+    try {
+        ByteStream stream((uchar_t*)encode_value.data(), (uint32_t)encode_value.size());
+        stream >> mdata.type;
+        stream >> mdata.ttl;
+        if (mdata.type == KEY_TYPE_STRING) {
+            stream >> mdata.value;
+        } else if ((mdata.type == KEY_TYPE_HASH) || (mdata.type == KEY_TYPE_LIST) ||
+                   (mdata.type == KEY_TYPE_SET) || (mdata.type == KEY_TYPE_ZSET)) {
+            stream >> mdata.count;
+            if (mdata.type == KEY_TYPE_LIST) {
+                stream >> mdata.head_seq;
+                stream >> mdata.tail_seq;
+                stream >> mdata.current_seq;
             }
-            
-            if (mdata.ttl && mdata.ttl <= get_tick_count()) {
-                delete_key(db_idx, key, mdata.ttl, mdata.type);
-                g_stat.keyspace_missed++;
-                g_stat.expired_keys++;
-                return kExpireKeyNotExist;
-            } else {
-                g_stat.keyspace_hits++;
-                return kExpireKeyExist;
-            }
-        } catch (ParseException ex) {
-            log_message(kLogLevelError, "parse byte stream failed\n");
+        } else {
+            log_message(kLogLevelError, "wrong key type\n");
             return kExpireDBError;
         }
+        
+        return kExpireKeyExist;
+    } catch (ParseException ex) {
+        log_message(kLogLevelError, "parse byte stream failed\n");
+        return kExpireDBError;
+    }
+}
+
+// turn the result of the meta data lookup to kExpireXXX, the expire time is not checked
+static int parse_meta_data(const rocksdb::Status& status, const string& encode_value, MetaData& mdata)
+{
+    if (status.ok()) {
+        return decode_meta_data(encode_value, mdata);
     } else if (status.IsNotFound()) {
         g_stat.keyspace_missed++;
         return kExpireKeyNotExist;
@@ -109,8 +123,108 @@ int expire_key_if_needed(int db_idx, const string& key, MetaData& mdata, string*
         log_message(kLogLevelError, "db error: %s", status.ToString().c_str());
         return kExpireDBError;
     }
+}
+
+// read and decode the meta data of the key, the expire time is not checked
+static int read_meta_data(int db_idx, const string& key, MetaData& mdata, const rocksdb::ReadOptions& read_option,
+                          string* raw_value)
+{
+    EncodeKey meta_key(KEY_TYPE_META, key);
+    rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
     
-    return 0;
+    string encode_value;
+    rocksdb::Status status = db_get(read_option, cf_handle, meta_key.GetEncodeKey(), &encode_value);
+    if (status.ok() && raw_value) {
+        *raw_value = encode_value;
+    }
+    
+    return parse_meta_data(status, encode_value, mdata);
+}
+
+// an expired key is reported not exist, like get_meta_data()
+static int check_meta_ttl(MetaData& mdata, int ret, uint64_t current_time)
+{
+    if (ret == kExpireKeyExist) {
+        if (mdata.ttl && mdata.ttl <= current_time) {
+            g_stat.keyspace_missed++;
+            return kExpireKeyNotExist;
+        } else {
+            g_stat.keyspace_hits++;
+        }
+    }
+    
+    return ret;
+}
+
+int expire_key_if_needed(int db_idx, const string& key, MetaData& mdata, string* raw_value)
+{
+    int ret = read_meta_data(db_idx, key, mdata, g_server.read_option, raw_value);
+    if (ret == kExpireKeyExist) {
+        if (mdata.ttl && mdata.ttl <= get_wall_time_ms()) {
+            delete_key(db_idx, key, mdata.ttl, mdata.type);
+            g_stat.keyspace_missed++;
+            g_stat.expired_keys++;
+            return kExpireKeyNotExist;
+        } else {
+            g_stat.keyspace_hits++;
+        }
+    }
+    
+    return ret;
+}
+
+int get_meta_data(int db_idx, const string& key, MetaData& mdata, const rocksdb::ReadOptions& read_option)
+{
+    int ret = read_meta_data(db_idx, key, mdata, read_option, nullptr);
+    return check_meta_ttl(mdata, ret, get_wall_time_ms());
+}
+
+void multi_get(int db_idx, const vector<string>& encode_keys, vector<rocksdb::Status>& statuses, vector<string>& values,
+               const rocksdb::ReadOptions& read_option)
+{
+    // the batch of a transaction has no MultiGet
+    if (get_running_transaction()) {
+        rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
+        statuses.resize(encode_keys.size());
+        values.assign(encode_keys.size(), string());
+        for (size_t i = 0; i < encode_keys.size(); i++) {
+            statuses[i] = db_get(read_option, cf_handle, encode_keys[i], &values[i]);
+        }
+        return;
+    }
+    
+    vector<rocksdb::Slice> key_slices;
+    key_slices.reserve(encode_keys.size());
+    for (const string& encode_key : encode_keys) {
+        key_slices.push_back(encode_key);
+    }
+    
+    vector<rocksdb::ColumnFamilyHandle*> cf_handles(encode_keys.size(), g_server.cf_handles_map[db_idx]);
+    values.clear();
+    statuses = g_server.db->MultiGet(read_option, cf_handles, key_slices, &values);
+}
+
+void multi_get_meta_data(int db_idx, const vector<string>& keys, vector<MetaData>& mdatas, vector<int>& results,
+                         const rocksdb::ReadOptions& read_option)
+{
+    vector<string> encode_keys;
+    encode_keys.reserve(keys.size());
+    for (const string& key : keys) {
+        EncodeKey meta_key(KEY_TYPE_META, key);
+        encode_keys.push_back(meta_key.GetEncodeKey().ToString());
+    }
+    
+    vector<rocksdb::Status> statuses;
+    vector<string> encode_values;
+    multi_get(db_idx, encode_keys, statuses, encode_values, read_option);
+    
+    uint64_t current_time = get_wall_time_ms();
+    mdatas.assign(keys.size(), MetaData());
+    results.resize(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        int ret = parse_meta_data(statuses[i], encode_values[i], mdatas[i]);
+        results[i] = check_meta_ttl(mdatas[i], ret, current_time);
+    }
 }
 
 // used for hash, set, zset
@@ -124,7 +238,9 @@ rocksdb::Status put_meta_data(int db_idx, uint8_t key_type, const string& key, u
     if (batch) {
         s = batch->Put(cf_handle, meta_key.GetEncodeKey(), meta_value.GetEncodeValue());
     } else {
-        s = g_server.db->Put(g_server.write_option, cf_handle, meta_key.GetEncodeKey(), meta_value.GetEncodeValue());
+        rocksdb::WriteBatch single_batch;
+        single_batch.Put(cf_handle, meta_key.GetEncodeKey(), meta_value.GetEncodeValue());
+        s = g_group_commit.Write(g_server.db, &single_batch);
     }
     
     if (!s.ok()) {
@@ -146,7 +262,9 @@ rocksdb::Status put_meta_data(int db_idx, uint8_t key_type, const string& key, u
     if (batch) {
         s = batch->Put(cf_handle, meta_key.GetEncodeKey(), meta_value.GetEncodeValue());
     } else {
-        s = g_server.db->Put(g_server.write_option, cf_handle, meta_key.GetEncodeKey(), meta_value.GetEncodeValue());
+        rocksdb::WriteBatch single_batch;
+        single_batch.Put(cf_handle, meta_key.GetEncodeKey(), meta_value.GetEncodeValue());
+        s = g_group_commit.Write(g_server.db, &single_batch);
     }
     if (!s.ok()) {
         log_message(kLogLevelError, "put_meta_data failed, error_code=%d\n", (int)s.code());
@@ -168,7 +286,9 @@ rocksdb::Status put_ttl_data(int db_idx, uint64_t ttl, const string& key, uint8_
     if (batch) {
         s = batch->Put(cf_handle, ttl_key.GetEncodeKey(), ttl_value.GetEncodeValue());
     } else {
-        s = g_server.db->Put(g_server.write_option, cf_handle, ttl_key.GetEncodeKey(), ttl_value.GetEncodeValue());
+        rocksdb::WriteBatch single_batch;
+        single_batch.Put(cf_handle, ttl_key.GetEncodeKey(), ttl_value.GetEncodeValue());
+        s = g_group_commit.Write(g_server.db, &single_batch);
     }
     if (!s.ok()) {
         log_message(kLogLevelError, "put_ttl_data failed, error_code=%d\n", (int)s.code());
@@ -185,7 +305,9 @@ rocksdb::Status del_ttl_data(int db_idx, uint64_t ttl, const string& key, rocksd
     if (batch) {
         s = batch->Delete(cf_handle, ttl_key.GetEncodeKey());
     } else {
-        s = g_server.db->Delete(g_server.write_option, cf_handle, ttl_key.GetEncodeKey());
+        rocksdb::WriteBatch single_batch;
+        single_batch.Delete(cf_handle, ttl_key.GetEncodeKey());
+        s = g_group_commit.Write(g_server.db, &single_batch);
     }
     if (!s.ok()) {
         log_message(kLogLevelError, "put_ttl_data failed, error_code=%d\n", (int)s.code());
@@ -193,17 +315,20 @@ rocksdb::Status del_ttl_data(int db_idx, uint64_t ttl, const string& key, rocksd
     return s;
 }
 
-void put_kv_data(int db_idx, const string& key, const string& value, uint64_t ttl, rocksdb::WriteBatch* batch)
+void put_kv_data(int db_idx, const string& key, const rocksdb::Slice& value, uint64_t ttl, rocksdb::WriteBatch* batch)
 {
     EncodeKey meta_key(KEY_TYPE_META, key);
-    EncodeValue meta_value(KEY_TYPE_STRING, ttl, value);
+    EncodeValueParts meta_value(KEY_TYPE_STRING, ttl, value);
+    rocksdb::Slice encode_key = meta_key.GetEncodeKey();
     rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
     rocksdb::Status s;
     
     if (!batch) {
-        s = g_server.db->Put(g_server.write_option, cf_handle, meta_key.GetEncodeKey(), meta_value.GetEncodeValue());
+        rocksdb::WriteBatch single_batch;
+        single_batch.Put(cf_handle, rocksdb::SliceParts(&encode_key, 1), meta_value.GetEncodeValue());
+        s = g_group_commit.Write(g_server.db, &single_batch);
     } else {
-        s = batch->Put(cf_handle, meta_key.GetEncodeKey(), meta_value.GetEncodeValue());
+        s = batch->Put(cf_handle, rocksdb::SliceParts(&encode_key, 1), meta_value.GetEncodeValue());
     }
     if (!s.ok()) {
         log_message(kLogLevelError, "put_kv_data failed, error_code=%d\n", (int)s.code());
@@ -230,6 +355,15 @@ string double_to_string(double value)
     return string(buf, len);
 }
 
+void send_element_error(ClientConn* conn, int result)
+{
+    if (result == kElementWrongType) {
+        conn->SendRawResponse(kWrongTypeError);
+    } else {
+        conn->SendError("db error");
+    }
+}
+
 int parse_scan_param(ClientConn* conn, const vector<string>& cmd_vec, int start_index, string& pattern, long& count)
 {
     int cmd_size = (int)cmd_vec.size();
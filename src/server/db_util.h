@@ -16,6 +16,7 @@
 #include "rocksdb/db.h"
 #include "redis_parser.h"
 #include "server.h"
+#include "group_commit.h"
 
 #define FIELD_NOT_EXIST 0
 #define FIELD_EXIST     1
@@ -25,6 +26,12 @@ const int kExpireKeyNotExist    = 0;
 const int kExpireKeyExist       = 1; // also return key_type, ttl, count or value, this can save another Get method
 const int kExpireDBError        = 2;
 
+// results of the element operations shared by the commands of a type, like the pop of LPOP and BLPOP
+const int kElementOK            = 0;
+const int kElementNoKey         = 1;
+const int kElementWrongType     = 2;
+const int kElementDBError       = 3;
+
 struct MetaData {
     uint8_t type;
     uint64_t ttl;
@@ -35,10 +42,53 @@ struct MetaData {
     uint64_t current_seq;
 };
 
-void delete_key(int db_idx, const string& key, uint64_t ttl, uint8_t key_type);
+// reads of the commands go through these, so the commands running in a transaction see the writes before them
+rocksdb::Status db_get(const rocksdb::ReadOptions& read_option, rocksdb::ColumnFamilyHandle* cf_handle,
+                       const rocksdb::Slice& key, string* value);
+rocksdb::Iterator* db_new_iterator(const rocksdb::ReadOptions& read_option, rocksdb::ColumnFamilyHandle* cf_handle);
+
+// the key is deleted at once, or with the other changes of the command if batch is not NULL,
+// so a reader on a snapshot never sees the key missing while it is overwritten
+void delete_key(int db_idx, const string& key, uint64_t ttl, uint8_t key_type, rocksdb::WriteBatch* batch = NULL);
 
 int expire_key_if_needed(int db_idx, const string& key, MetaData& mdata, string* raw_value = nullptr);
 
+// the read only version of expire_key_if_needed() for the commands without the key lock, an expired key is
+// reported not exist and left to the expire thread to delete
+int get_meta_data(int db_idx, const string& key, MetaData& mdata, const rocksdb::ReadOptions& read_option);
+
+// look up many encoded keys of the db with one MultiGet instead of a Get per key, the lookups share one pass
+// over the memtables and the sst files. statuses[i] and values[i] are of encode_keys[i]
+void multi_get(int db_idx, const vector<string>& encode_keys, vector<rocksdb::Status>& statuses, vector<string>& values,
+               const rocksdb::ReadOptions& read_option = g_server.read_option);
+// get_meta_data() of many keys with one MultiGet, results[i] and mdatas[i] are of keys[i]
+void multi_get_meta_data(int db_idx, const vector<string>& keys, vector<MetaData>& mdatas, vector<int>& results,
+                         const rocksdb::ReadOptions& read_option);
+
+// read only commands read the meta data and the elements from one snapshot instead of taking the key lock,
+// so a long read does not block the writes of the key, and the reads stay consistent with each other.
+// flushdb waits until the read finished, like a scan
+class ReadSnapshotGuard {
+public:
+    // GetSnapshot() takes the db mutex, so a point read of one key, the meta data and at most one element,
+    // does not take the snapshot, only the reads of many keys or elements do
+    ReadSnapshotGuard(int db_idx, bool take_snapshot = true) : scan_key_guard_(db_idx), read_option_(g_server.read_option) {
+        if (take_snapshot) {
+            read_option_.snapshot = g_server.db->GetSnapshot();
+        }
+    }
+    ~ReadSnapshotGuard() {
+        if (read_option_.snapshot) {
+            g_server.db->ReleaseSnapshot(read_option_.snapshot);
+        }
+    }
+    
+    const rocksdb::ReadOptions& GetReadOption() { return read_option_; }
+private:
+    ScanKeyGuard            scan_key_guard_;
+    rocksdb::ReadOptions    read_option_;
+};
+
 rocksdb::Status put_meta_data(int db_idx, uint8_t key_type, const string& key, uint64_t ttl, uint64_t count,
                               rocksdb::WriteBatch* batch = NULL);
 rocksdb::Status put_meta_data(int db_idx, uint8_t key_type, const string& key, uint64_t ttl, uint64_t count,
@@ -46,16 +96,20 @@ rocksdb::Status put_meta_data(int db_idx, uint8_t key_type, const string& key, u
                               rocksdb::WriteBatch* batch = NULL);
 rocksdb::Status put_ttl_data(int db_idx, uint64_t ttl, const string& key, uint8_t key_type, rocksdb::WriteBatch* batch = NULL);
 rocksdb::Status del_ttl_data(int db_idx, uint64_t ttl, const string& key, rocksdb::WriteBatch* batch = NULL);
-void put_kv_data(int db_idx, const string& key, const string& value, uint64_t ttl, rocksdb::WriteBatch* batch = NULL);
+// the value is not copied before it is written to the batch
+void put_kv_data(int db_idx, const string& key, const rocksdb::Slice& value, uint64_t ttl, rocksdb::WriteBatch* batch = NULL);
 
 #define DB_BATCH_UPDATE(batch) \
-rocksdb::Status s = g_server.db->Write(g_server.write_option, &batch); \
+rocksdb::Status s = g_group_commit.Write(g_server.db, &batch); \
 if (!s.ok()) { \
     log_message(kLogLevelError, "write batch failed: %s\n", batch.Data().c_str()); \
 }
 
 string double_to_string(double value);
 
+// reply the error of kElementWrongType or kElementDBError
+void send_element_error(ClientConn* conn, int result);
+
 int parse_scan_param(ClientConn* conn, const vector<string>& cmd_vec, int start_index, string& pattern, long& count);
 
 // Glob-style pattern matching, 1-match, 0-unmatch
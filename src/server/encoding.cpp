@@ -121,6 +121,39 @@ EncodeValue::EncodeValue(uint8_t type, uint64_t score)
     stream_ << score;
 }
 
+//======
+// same layout as EncodeValue(type, ttl, value), EncodeValue(type, value) and EncodeValue(type, prev_seq, next_seq, value)
+EncodeValueParts::EncodeValueParts(uint8_t type, uint64_t ttl, const rocksdb::Slice& value)
+{
+    stream_.SetSimpleBuffer(&buffer_);
+    stream_ << type;
+    stream_ << ttl;
+    _SetParts(value);
+}
+
+EncodeValueParts::EncodeValueParts(uint8_t type, const rocksdb::Slice& value)
+{
+    stream_.SetSimpleBuffer(&buffer_);
+    stream_ << type;
+    _SetParts(value);
+}
+
+EncodeValueParts::EncodeValueParts(uint8_t type, uint64_t prev_seq, uint64_t next_seq, const rocksdb::Slice& value)
+{
+    stream_.SetSimpleBuffer(&buffer_);
+    stream_ << type;
+    stream_ << prev_seq;
+    stream_ << next_seq;
+    _SetParts(value);
+}
+
+void EncodeValueParts::_SetParts(const rocksdb::Slice& value)
+{
+    stream_.WriteVarUInt((uint32_t)value.size());
+    parts_[0] = rocksdb::Slice((char*)buffer_.GetBuffer(), buffer_.GetWriteOffset());
+    parts_[1] = value;
+}
+
 //========
 int DecodeKey::Decode(const string& encode_key, uint8_t expect_type, string& key)
 {
@@ -91,6 +91,25 @@ private:
 };
 
 
+// encode a string value, a hash field value or a list element without copying the payload, only the header is
+// encoded into the buffer, use WriteBatch::Put() with SliceParts to write the header and the payload as one value
+class EncodeValueParts {
+public:
+    EncodeValueParts(uint8_t type, uint64_t ttl, const rocksdb::Slice& value);
+    EncodeValueParts(uint8_t type, const rocksdb::Slice& value);
+    EncodeValueParts(uint8_t type, uint64_t prev_seq, uint64_t next_seq, const rocksdb::Slice& value);
+    ~EncodeValueParts() {}
+    
+    rocksdb::SliceParts GetEncodeValue() const { return rocksdb::SliceParts(parts_, 2); }
+private:
+    void _SetParts(const rocksdb::Slice& value);
+private:
+    SimpleBuffer    buffer_;
+    ByteStream      stream_;
+    rocksdb::Slice  parts_[2];
+};
+
+
 const int kDecodeOK = 0;
 const int kDecodeErrorType = 1;
 const int kDecodeErrorFormat = 2;
@@ -19,7 +19,7 @@ void ExpireThread::OnThreadRun()
     while (m_running) {
         usleep(100000);
         
-        uint64_t current_tick = get_tick_count();
+        uint64_t current_tick = get_wall_time_ms();
         for (int i = 0; i < g_server.db_num; i++) {
             ScanKeyGuard scan_key_guard(i);
             
@@ -42,6 +42,7 @@ void ExpireThread::OnThreadRun()
                 if (ttl <= current_tick) {
                     uint8_t key_type = it->value()[0];
                     delete_key(i, key, ttl, key_type);
+                    g_stat.expired_keys++;
                 } else {
                     break;
                 }
@@ -0,0 +1,109 @@
+//
+//  group_commit.cpp
+//  kedis
+//
+
+#include "group_commit.h"
+#include "server.h"
+#include "transaction.h"
+#include "key_lock.h"
+
+GroupCommit g_group_commit;
+
+// WriteBatch::Data() is an 8 bytes sequence and a 4 bytes little endian count followed by the records
+const size_t kWriteBatchHeader = 12;
+
+GroupCommit::GroupCommit()
+{
+    leading_ = false;
+    commit_count_ = 0;
+    batch_count_ = 0;
+    total_latency_us_ = 0;
+}
+
+rocksdb::Status GroupCommit::Write(rocksdb::DB* db, rocksdb::WriteBatch* batch)
+{
+    // the commands of a transaction write to the batch of the transaction, which is written at the end of EXEC
+    Transaction* transaction = get_running_transaction();
+    if (transaction && (db == g_server.db)) {
+        transaction->AddWrite(batch);
+        return rocksdb::Status::OK();
+    }
+    
+    // the watched keys locked by this thread are touched when they are unlocked, the binlog of a command
+    // is not another write of its keys
+    if (db == g_server.db) {
+        count_key_write();
+    }
+    
+    if (!g_server.group_commit) {
+        return db->Write(g_server.write_option, batch);
+    }
+    
+    uint64_t start_us = get_monotonic_us();
+    Writer writer;
+    writer.batch = batch;
+    writer.done = false;
+    
+    notify_.Lock();
+    writer_list_.push_back(&writer);
+    while (!writer.done) {
+        if (leading_) {
+            notify_.Wait();
+            continue;
+        }
+        
+        // become the leader of the batches queued so far
+        leading_ = true;
+        vector<Writer*> group;
+        size_t group_bytes = 0;
+        while (!writer_list_.empty() && (group.empty() || group_bytes < kGroupCommitMaxBytes)) {
+            Writer* w = writer_list_.front();
+            writer_list_.pop_front();
+            group.push_back(w);
+            group_bytes += w->batch->GetDataSize();
+        }
+        notify_.Unlock();
+        
+        rocksdb::Status s = _WriteGroup(db, group);
+        
+        notify_.Lock();
+        for (Writer* w : group) {
+            w->status = s;
+            w->done = true;
+        }
+        leading_ = false;
+        notify_.Broadcast();
+    }
+    notify_.Unlock();
+    
+    total_latency_us_ += get_monotonic_us() - start_us;
+    return writer.status;
+}
+
+rocksdb::Status GroupCommit::_WriteGroup(rocksdb::DB* db, vector<Writer*>& group)
+{
+    commit_count_++;
+    batch_count_ += group.size();
+    if (group.size() == 1) {
+        return db->Write(g_server.write_option, group[0]->batch);
+    }
+    
+    // append the records of the others to the first batch, and update the count in the header
+    string rep = group[0]->batch->Data();
+    uint32_t count = group[0]->batch->Count();
+    for (size_t i = 1; i < group.size(); i++) {
+        const string& data = group[i]->batch->Data();
+        if (data.size() > kWriteBatchHeader) {
+            rep.append(data, kWriteBatchHeader, string::npos);
+            count += group[i]->batch->Count();
+        }
+    }
+    
+    for (size_t i = 0; i < 4; i++) {
+        rep[8 + i] = (char)((count >> (8 * i)) & 0xFF);
+    }
+    
+    rocksdb::WriteBatch merged_batch(rep);
+    return db->Write(g_server.write_option, &merged_batch);
+}
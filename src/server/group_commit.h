@@ -0,0 +1,51 @@
+//
+//  group_commit.h
+//  kedis
+//
+
+#ifndef __GROUP_COMMIT_H__
+#define __GROUP_COMMIT_H__
+
+#include "util.h"
+#include "thread_pool.h"
+#include "rocksdb/db.h"
+
+const size_t kGroupCommitMaxBytes = 1024 * 1024;  // a group stops taking more batches after this size
+
+/*
+ * the write batches of concurrent commands are merged into one rocksdb write, so the threads do not
+ * line up in the rocksdb write queue and append the WAL one by one.
+ * the first waiting thread becomes the leader, it takes all the batches queued so far and writes them at once,
+ * the others wait until the leader finished, so a command still replies after its batch is written.
+ * all the writes of one GroupCommit go to the same db, g_group_commit is for g_server.db, the binlog has its own
+ */
+class GroupCommit {
+public:
+    GroupCommit();
+    ~GroupCommit() {}
+    
+    rocksdb::Status Write(rocksdb::DB* db, rocksdb::WriteBatch* batch);
+    
+    uint64_t GetCommitCount() { return commit_count_; }
+    uint64_t GetBatchCount() { return batch_count_; }
+    uint64_t GetTotalLatency() { return total_latency_us_; }
+private:
+    struct Writer {
+        rocksdb::WriteBatch*    batch;
+        rocksdb::Status         status;
+        bool                    done;
+    };
+    
+    rocksdb::Status _WriteGroup(rocksdb::DB* db, vector<Writer*>& group);
+private:
+    ThreadNotify    notify_;
+    list<Writer*>   writer_list_;
+    bool            leading_;   // a leader is writing, the new writers wait for the next group
+    atomic<uint64_t> commit_count_;
+    atomic<uint64_t> batch_count_;
+    atomic<uint64_t> total_latency_us_; // from a batch is queued to it is written
+};
+
+extern GroupCommit g_group_commit;
+
+#endif /* __GROUP_COMMIT_H__ */
@@ -8,42 +8,184 @@
 
 #include "key_lock.h"
 #include "server.h"
+#include "encoding.h"
+#include <thread>
+#include <algorithm>
 
-class KeyLock {
-public:
-    KeyLock() {
-        ref_count_ = 0;
+const int kKeyLockStripeBits = 6;
+const int kKeyLockStripes = 1 << kKeyLockStripeBits;    // stripes of every db, keys are spread by hash
+const uint32_t kKeyLockTableInitSize = 16;
+const int kHotKeySlots = 2;     // candidates of the most contended keys kept in every stripe
+const int kKeyVersionSlots = 1024;
+
+struct KeyLockNode {
+    uint64_t    hash;
+    string      key;        // the buffer is reused when the node is taken from the pool again
+    int         ref_count;  // threads holding or waiting for the lock, guarded by the stripe mutex
+    uint64_t    write_count;    // t_write_count of the thread holding the lock when it locked the key
+    mutex       key_mtx;
+};
+
+struct HotKey {
+    string      key;
+    uint64_t    count;
+};
+
+/*
+ * a stripe has its own mutex, an open addressing table of the locked keys and a pool of free nodes,
+ * so threads locking different keys rarely meet on the same mutex or cache line.
+ * the table only holds the keys being locked, a node goes back to the pool when no thread wants it.
+ * every stripe starts on its own cache line
+ */
+struct alignas(64) KeyLockStripe {
+    mutex           stripe_mtx;
+    atomic<long>    operating_count; // key locks held and scans running, decreased without the stripe mutex
+    KeyLockNode**   table;
+    uint32_t        capacity;   // power of 2
+    uint32_t        size;
+    vector<KeyLockNode*> node_pool;
+    uint64_t        acquire_count;  // guarded by the stripe mutex
+    atomic<uint64_t> contended_count;
+    atomic<uint64_t> wait_us;
+    HotKey          hot_keys[kHotKeySlots];   // guarded by the stripe mutex
+    unordered_map<string, vector<atomic<bool>*>> watched_keys; // keys watched by transactions, guarded by the stripe mutex
+    
+    KeyLockStripe() {
+        operating_count = 0;
+        capacity = kKeyLockTableInitSize;
+        size = 0;
+        table = new KeyLockNode* [capacity]();
+        acquire_count = contended_count = wait_us = 0;
+        for (int i = 0; i < kHotKeySlots; i++) {
+            hot_keys[i].count = 0;
+        }
     }
-    ~KeyLock() {}
     
-    void IncrRef() {
-        ref_count_++;
+    uint32_t GetSlot(uint64_t hash) {
+        return (uint32_t)(hash >> kKeyLockStripeBits) & (capacity - 1);
+    }
+    
+    KeyLockNode* Find(uint64_t hash, const string& key) {
+        for (uint32_t slot = GetSlot(hash); table[slot]; slot = (slot + 1) & (capacity - 1)) {
+            KeyLockNode* node = table[slot];
+            if ((node->hash == hash) && (node->key == key)) {
+                return node;
+            }
+        }
+        return NULL;
+    }
+    
+    void Insert(KeyLockNode* node) {
+        if ((size + 1) * 2 > capacity) {
+            Grow();
+        }
+        
+        uint32_t slot = GetSlot(node->hash);
+        while (table[slot]) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        table[slot] = node;
+        size++;
     }
-    void DecrRef() {
-        ref_count_--;
+    
+    // remove by shifting the following nodes back, so there is no tombstone
+    void Remove(KeyLockNode* node) {
+        uint32_t slot = GetSlot(node->hash);
+        while (table[slot] != node) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        
+        uint32_t hole = slot;
+        for (uint32_t next = (hole + 1) & (capacity - 1); table[next]; next = (next + 1) & (capacity - 1)) {
+            // a node can fill the hole if the hole is between its home slot and the slot it is in
+            uint32_t home = GetSlot(table[next]->hash);
+            if (((next - home) & (capacity - 1)) >= ((next - hole) & (capacity - 1))) {
+                table[hole] = table[next];
+                hole = next;
+            }
+        }
+        table[hole] = NULL;
+        size--;
     }
-    int GetRef() {
-        return ref_count_;
+    
+    void Grow() {
+        KeyLockNode** old_table = table;
+        uint32_t old_capacity = capacity;
+        capacity *= 2;
+        table = new KeyLockNode* [capacity]();
+        for (uint32_t i = 0; i < old_capacity; i++) {
+            if (old_table[i]) {
+                uint32_t slot = GetSlot(old_table[i]->hash);
+                while (table[slot]) {
+                    slot = (slot + 1) & (capacity - 1);
+                }
+                table[slot] = old_table[i];
+            }
+        }
+        delete [] old_table;
     }
     
-    void Lock() {
-        key_mtx_.lock();
+    void TouchWatchedKey(const string& key) {
+        auto it = watched_keys.find(key);
+        if (it != watched_keys.end()) {
+            for (atomic<bool>* touched : it->second) {
+                *touched = true;
+            }
+        }
     }
-    void Unlock() {
-        key_mtx_.unlock();
+    
+    // keep the most contended keys with the Misra-Gries algorithm
+    void AddHotKey(const string& key) {
+        HotKey* empty_slot = NULL;
+        for (int i = 0; i < kHotKeySlots; i++) {
+            if (hot_keys[i].count && (hot_keys[i].key == key)) {
+                hot_keys[i].count++;
+                return;
+            }
+            if (!hot_keys[i].count && !empty_slot) {
+                empty_slot = &hot_keys[i];
+            }
+        }
+        
+        if (empty_slot) {
+            empty_slot->key = key;
+            empty_slot->count = 1;
+        } else {
+            for (int i = 0; i < kHotKeySlots; i++) {
+                hot_keys[i].count--;
+            }
+        }
     }
-private:
-    int ref_count_;
-    mutex key_mtx_;
 };
 
 struct KeyLockMap {
-    map<string, KeyLock*> key_lock_map;
-    list<KeyLock*> key_lock_pool;
-    mutex map_mutex;
+    KeyLockStripe* stripes;
+    atomic<uint64_t> key_versions[kKeyVersionSlots];
+    
+    KeyLockMap() {
+        stripes = new KeyLockStripe[kKeyLockStripes];
+        
+        for (int i = 0; i < kKeyVersionSlots; i++) {
+            key_versions[i] = 0;
+        }
+    }
+    
+    KeyLockStripe& GetStripe(uint64_t hash) {
+        return stripes[hash & (kKeyLockStripes - 1)];
+    }
+    
+    atomic<uint64_t>& GetKeyVersion(uint64_t hash) {
+        return key_versions[hash % kKeyVersionSlots];
+    }
 };
 vector<KeyLockMap*> g_key_lock_vector;
 
+// the key locks held by the transaction running in the thread, sorted by the keys
+static thread_local int t_held_db_idx = -1;
+static thread_local vector<KeyLockNode*>* t_held_nodes = NULL;
+// writes to the db of the thread
+static thread_local uint64_t t_write_count = 0;
+
 void init_key_lock()
 {
     for (int i = 0; i < g_server.db_num; i++) {
@@ -52,126 +194,259 @@ void init_key_lock()
     }
 }
 
-void lock_key(int db_idx, const string& key)
+// find or add the node of the key and take a reference, without locking it
+static KeyLockNode* get_key_node(KeyLockStripe& stripe, uint64_t hash, const string& key)
 {
-    KeyLock* kl = NULL;
-    KeyLockMap* kl_map = g_key_lock_vector[db_idx];
-    kl_map->map_mutex.lock();
-    g_server.operating_count_vec[db_idx]++;
-
-    auto it = kl_map->key_lock_map.find(key);
-    if (it == kl_map->key_lock_map.end()) {
-        if (kl_map->key_lock_pool.empty()) {
-            kl = new KeyLock();
+    stripe.operating_count++;
+    stripe.acquire_count++;
+    KeyLockNode* node = stripe.Find(hash, key);
+    if (!node) {
+        if (stripe.node_pool.empty()) {
+            node = new KeyLockNode();
         } else {
-            kl = kl_map->key_lock_pool.front();
-            kl_map->key_lock_pool.pop_front();
+            node = stripe.node_pool.back();
+            stripe.node_pool.pop_back();
         }
-        kl_map->key_lock_map.insert(make_pair(key, kl));
-    } else {
-        kl = it->second;
+        node->hash = hash;
+        node->key = key;
+        node->ref_count = 0;
+        stripe.Insert(node);
     }
     
-    kl->IncrRef();
-    kl_map->map_mutex.unlock();
+    node->ref_count++;
+    return node;
+}
+
+static KeyLockNode* find_held_node(int db_idx, const string& key)
+{
+    if (!t_held_nodes || (db_idx != t_held_db_idx)) {
+        return NULL;
+    }
     
-    kl->Lock();
+    auto it = lower_bound(t_held_nodes->begin(), t_held_nodes->end(), key,
+                          [](KeyLockNode* node, const string& k) { return node->key < k; });
+    if ((it != t_held_nodes->end()) && ((*it)->key == key)) {
+        return *it;
+    }
+    return NULL;
 }
 
-void unlock_key(int db_idx, const string& key)
+static void lock_node(KeyLockMap* kl_map, KeyLockNode* node)
 {
-    g_server.operating_count_vec[db_idx]--;
+    if (node->key_mtx.try_lock()) {
+        node->write_count = t_write_count;
+        return;
+    }
+    
+    uint64_t start_us = get_monotonic_us();
+    node->key_mtx.lock();
+    node->write_count = t_write_count;
+    KeyLockStripe& stripe = kl_map->GetStripe(node->hash);
+    stripe.contended_count++;
+    stripe.wait_us += get_monotonic_us() - start_us;
+    
+    // spinlock_db() holds the stripe mutex until the key locks are released, so do not wait for it here
+    if (stripe.stripe_mtx.try_lock()) {
+        stripe.AddHotKey(node->key);
+        stripe.stripe_mtx.unlock();
+    }
+}
+
+KeyLockNode* lock_key(int db_idx, const string& key)
+{
+    KeyLockNode* held_node = find_held_node(db_idx, key);
+    if (held_node) {
+        return held_node;
+    }
     
     KeyLockMap* kl_map = g_key_lock_vector[db_idx];
-    kl_map->map_mutex.lock();
-    auto it = kl_map->key_lock_map.find(key);
-    if (it != kl_map->key_lock_map.end()) {
-        KeyLock* kl = it->second;
-        kl->DecrRef();
-        kl->Unlock();
-        if (kl->GetRef() == 0) {
-            kl_map->key_lock_map.erase(key);
-            kl_map->key_lock_pool.push_back(kl);
-        }
+    uint64_t key_hash = hash<string>()(key);
+    KeyLockStripe& stripe = kl_map->GetStripe(key_hash);
+    stripe.stripe_mtx.lock();
+    KeyLockNode* node = get_key_node(stripe, key_hash, key);
+    stripe.stripe_mtx.unlock();
+    
+    lock_node(kl_map, node);
+    return node;
+}
+
+void unlock_key(int db_idx, KeyLockNode* node)
+{
+    KeyLockMap* kl_map = g_key_lock_vector[db_idx];
+    kl_map->GetKeyVersion(node->hash)++;
+    if (find_held_node(db_idx, node->key) == node) {
+        return; // released by the transaction
     }
     
-    kl_map->map_mutex.unlock();
+    KeyLockStripe& stripe = kl_map->GetStripe(node->hash);
+    // a read, a failed command or a command waiting for the key does not fail the transactions watching it
+    bool written = (node->write_count != t_write_count);
+    // the key is released before waiting for the stripe mutex, spinlock_db() holds it until the operating counters
+    // are zero, which includes the threads waiting for this key. the node is kept by its reference until below
+    node->key_mtx.unlock();
+    stripe.operating_count--;
+    stripe.stripe_mtx.lock();
+    if (written && !stripe.watched_keys.empty()) {
+        stripe.TouchWatchedKey(node->key);
+    }
+    if (--node->ref_count == 0) {
+        stripe.Remove(node);
+        stripe.node_pool.push_back(node);
+    }
+    stripe.stripe_mtx.unlock();
 }
 
-void lock_keys(int db_idx, set<string>& keys)
+void lock_keys(int db_idx, const set<string>& keys, vector<KeyLockNode*>& nodes)
 {
-    list<KeyLock*> key_lock_list;
     KeyLockMap* kl_map = g_key_lock_vector[db_idx];
-    kl_map->map_mutex.lock();
-    g_server.operating_count_vec[db_idx]++;
-    
-    for (auto it_key = keys.begin(); it_key != keys.end(); it_key++) {
-        const string& key = *it_key;
-        KeyLock* kl = NULL;
-        auto it = kl_map->key_lock_map.find(key);
-        if (it == kl_map->key_lock_map.end()) {
-            if (kl_map->key_lock_pool.empty()) {
-                kl = new KeyLock();
-            } else {
-                kl = kl_map->key_lock_pool.front();
-                kl_map->key_lock_pool.pop_front();
-            }
-            kl_map->key_lock_map.insert(make_pair(key, kl));
-        } else {
-            kl = it->second;
+    nodes.clear();
+    nodes.reserve(keys.size());
+    for (const string& key : keys) {
+        KeyLockNode* held_node = find_held_node(db_idx, key);
+        if (held_node) {
+            nodes.push_back(held_node);
+            continue;
         }
         
-        key_lock_list.push_back(kl);
-        kl->IncrRef();
+        uint64_t key_hash = hash<string>()(key);
+        KeyLockStripe& stripe = kl_map->GetStripe(key_hash);
+        stripe.stripe_mtx.lock();
+        nodes.push_back(get_key_node(stripe, key_hash, key));
+        stripe.stripe_mtx.unlock();
     }
     
-    kl_map->map_mutex.unlock();
-    
-    for (auto it = key_lock_list.begin(); it != key_lock_list.end(); it++) {
-        KeyLock* kl = *it;
-        kl->Lock();
+    for (KeyLockNode* node : nodes) {
+        if (find_held_node(db_idx, node->key) != node) {
+            lock_node(kl_map, node);
+        }
     }
 }
 
-void unlock_keys(int db_idx, set<string>& keys)
+void unlock_keys(int db_idx, vector<KeyLockNode*>& nodes)
+{
+    for (KeyLockNode* node : nodes) {
+        unlock_key(db_idx, node);
+    }
+    nodes.clear();
+}
+
+void lock_transaction_keys(int db_idx, const set<string>& keys, vector<KeyLockNode*>& nodes)
+{
+    lock_keys(db_idx, keys, nodes);
+    t_held_db_idx = db_idx;
+    t_held_nodes = &nodes;
+}
+
+void unlock_transaction_keys(int db_idx, vector<KeyLockNode*>& nodes)
+{
+    t_held_db_idx = -1;
+    t_held_nodes = NULL;
+    unlock_keys(db_idx, nodes);
+}
+
+void watch_key(int db_idx, const string& key, atomic<bool>* touched)
+{
+    KeyLockStripe& stripe = g_key_lock_vector[db_idx]->GetStripe(hash<string>()(key));
+    stripe.stripe_mtx.lock();
+    stripe.watched_keys[key].push_back(touched);
+    stripe.stripe_mtx.unlock();
+}
+
+void unwatch_key(int db_idx, const string& key, atomic<bool>* touched)
+{
+    KeyLockStripe& stripe = g_key_lock_vector[db_idx]->GetStripe(hash<string>()(key));
+    stripe.stripe_mtx.lock();
+    auto it = stripe.watched_keys.find(key);
+    if (it != stripe.watched_keys.end()) {
+        vector<atomic<bool>*>& flags = it->second;
+        flags.erase(remove(flags.begin(), flags.end(), touched), flags.end());
+        if (flags.empty()) {
+            stripe.watched_keys.erase(it);
+        }
+    }
+    stripe.stripe_mtx.unlock();
+}
+
+void touch_watched_db(int db_idx)
 {
-    g_server.operating_count_vec[db_idx]--;
-    
     KeyLockMap* kl_map = g_key_lock_vector[db_idx];
-    kl_map->map_mutex.lock();
-    for (auto it_key = keys.begin(); it_key != keys.end(); it_key++) {
-        const string& key = *it_key;
-        auto it = kl_map->key_lock_map.find(key);
-        if (it != kl_map->key_lock_map.end()) {
-            KeyLock* kl = it->second;
-            kl->DecrRef();
-            kl->Unlock();
-            if (kl->GetRef() == 0) {
-                kl_map->key_lock_map.erase(key);
-                kl_map->key_lock_pool.push_back(kl);
+    rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
+    for (int i = 0; i < kKeyLockStripes; i++) {
+        for (auto& kv : kl_map->stripes[i].watched_keys) {
+            // a key that does not exist is not changed by the flush
+            EncodeKey meta_key(KEY_TYPE_META, kv.first);
+            string encode_value;
+            rocksdb::Status s = g_server.db->Get(g_server.read_option, cf_handle, meta_key.GetEncodeKey(), &encode_value);
+            if (s.IsNotFound()) {
+                continue;
+            }
+            
+            for (atomic<bool>* touched : kv.second) {
+                *touched = true;
             }
         }
     }
-    
-    kl_map->map_mutex.unlock();
+}
+
+void count_key_write()
+{
+    t_write_count++;
+}
+
+uint64_t get_key_version(int db_idx, const string& key)
+{
+    KeyLockMap* kl_map = g_key_lock_vector[db_idx];
+    return kl_map->GetKeyVersion(hash<string>()(key));
+}
+
+int enter_db(int db_idx)
+{
+    // spread the scans of different threads to different stripes too
+    int token = (int)(hash<thread::id>()(this_thread::get_id()) & (kKeyLockStripes - 1));
+    KeyLockStripe& stripe = g_key_lock_vector[db_idx]->stripes[token];
+    stripe.stripe_mtx.lock();
+    stripe.operating_count++;
+    stripe.stripe_mtx.unlock();
+    return token;
+}
+
+void leave_db(int db_idx, int token)
+{
+    g_key_lock_vector[db_idx]->stripes[token].operating_count--;
 }
 
 void spinlock_db(int db_idx)
 {
-    g_key_lock_vector[db_idx]->map_mutex.lock();
-    while (g_server.operating_count_vec[db_idx]) {
+    lock_db(db_idx);
+    KeyLockMap* kl_map = g_key_lock_vector[db_idx];
+    while (true) {
+        long operating_count = 0;
+        for (int i = 0; i < kKeyLockStripes; i++) {
+            operating_count += kl_map->stripes[i].operating_count;
+        }
+        
+        if (!operating_count) {
+            break;
+        }
         usleep(500);
     }
 }
 
+// no new key lock or scan can start after all the stripes are locked
 void lock_db(int db_idx)
 {
-    g_key_lock_vector[db_idx]->map_mutex.lock();
+    KeyLockMap* kl_map = g_key_lock_vector[db_idx];
+    for (int i = 0; i < kKeyLockStripes; i++) {
+        kl_map->stripes[i].stripe_mtx.lock();
+    }
 }
 
 void unlock_db(int db_idx)
 {
-    g_key_lock_vector[db_idx]->map_mutex.unlock();
+    KeyLockMap* kl_map = g_key_lock_vector[db_idx];
+    for (int i = kKeyLockStripes - 1; i >= 0; i--) {
+        kl_map->stripes[i].stripe_mtx.unlock();
+    }
 }
 
 void spinlock_all()
@@ -194,3 +469,32 @@ void unlock_all()
         unlock_db(i);
     }
 }
+
+void get_key_lock_stats(KeyLockStats& stats, int max_hot_keys)
+{
+    stats.acquire_count = stats.contended_count = stats.wait_us = 0;
+    stats.hot_keys.clear();
+    for (int db_idx = 0; db_idx < (int)g_key_lock_vector.size(); db_idx++) {
+        KeyLockMap* kl_map = g_key_lock_vector[db_idx];
+        for (int i = 0; i < kKeyLockStripes; i++) {
+            KeyLockStripe& stripe = kl_map->stripes[i];
+            stripe.stripe_mtx.lock();
+            stats.acquire_count += stripe.acquire_count;
+            stats.contended_count += stripe.contended_count;
+            stats.wait_us += stripe.wait_us;
+            for (int j = 0; j < kHotKeySlots; j++) {
+                if (stripe.hot_keys[j].count) {
+                    stats.hot_keys.push_back(make_pair(to_string(db_idx) + ":" + stripe.hot_keys[j].key,
+                                                       stripe.hot_keys[j].count));
+                }
+            }
+            stripe.stripe_mtx.unlock();
+        }
+    }
+    
+    sort(stats.hot_keys.begin(), stats.hot_keys.end(),
+         [](const pair<string, uint64_t>& a, const pair<string, uint64_t>& b) { return a.second > b.second; });
+    if ((int)stats.hot_keys.size() > max_hot_keys) {
+        stats.hot_keys.resize(max_hot_keys);
+    }
+}
@@ -11,15 +11,43 @@
 
 #include "util.h"
 
+struct KeyLockNode;
+
 // key lock is used when multiple thread are operating on the same key in complex structure
 void init_key_lock();
 
-void lock_key(int db_idx, const string& key);
-void unlock_key(int db_idx, const string& key);
+// the node is kept by the caller, so the unlock does not need to look up the key again
+KeyLockNode* lock_key(int db_idx, const string& key);
+void unlock_key(int db_idx, KeyLockNode* node);
+
+// keys are in set, so they are sorted and unique, and every thread locks them in the same order,
+// which prevent deadlock. nodes are filled in the order of the keys
+void lock_keys(int db_idx, const set<string>& keys, vector<KeyLockNode*>& nodes);
+void unlock_keys(int db_idx, vector<KeyLockNode*>& nodes);
+
+// a counter increased every time a key is unlocked, keys share the counters by hash, so a change of the counter
+// means the key may have been accessed. a sliced command reads it with the key lock held when it starts,
+// and finds out whether the key was touched by others before it applies the changes
+uint64_t get_key_version(int db_idx, const string& key);
 
-// keys are in set, so they are sorted and unique, which prevent deadlock
-void lock_keys(int db_idx, set<string>& keys);
-void unlock_keys(int db_idx, set<string>& keys);
+// EXEC locks the keys of all the queued commands before they run, the commands running in the same thread
+// lock these keys again without waiting, and their unlocks only increase the key versions
+void lock_transaction_keys(int db_idx, const set<string>& keys, vector<KeyLockNode*>& nodes);
+void unlock_transaction_keys(int db_idx, vector<KeyLockNode*>& nodes);
+
+// WATCH sets the flag when the key is unlocked by a command which wrote to the db while holding the lock,
+// or the db is flushed with the key in it. a command locking several keys sets the flags of all of them
+// if it writes any of them
+void watch_key(int db_idx, const string& key, atomic<bool>* touched);
+void unwatch_key(int db_idx, const string& key, atomic<bool>* touched);
+// called with the db locked by spinlock_db(), before the db is dropped
+void touch_watched_db(int db_idx);
+// called by every write to the db, the keys locked by the thread are written when they are unlocked
+void count_key_write();
+
+// used by the scan of a whole db, so flushdb waits until the scan finished, return the token for leave_db()
+int enter_db(int db_idx);
+void leave_db(int db_idx, int token);
 
 void spinlock_db(int db_idx);
 void lock_db(int db_idx);
@@ -30,18 +58,53 @@ void spinlock_all();
 void lock_all();
 void unlock_all();
 
+// contention of the key locks for INFO
+struct KeyLockStats {
+    uint64_t    acquire_count;
+    uint64_t    contended_count;
+    uint64_t    wait_us;
+    vector<pair<string, uint64_t>> hot_keys;    // "db:key" and times it was contended, the hottest first
+};
+
+void get_key_lock_stats(KeyLockStats& stats, int max_hot_keys);
+
 class KeyLockGuard {
 public:
-    KeyLockGuard(int db_idx, const string& key) : db_idx_(db_idx), key_(key) {
-        lock_key(db_idx_, key_);
+    KeyLockGuard(int db_idx, const string& key) : db_idx_(db_idx) {
+        node_ = lock_key(db_idx_, key);
     }
     ~KeyLockGuard() {
-        unlock_key(db_idx_, key_);
+        unlock_key(db_idx_, node_);
+    }
+private:
+    int db_idx_;
+    KeyLockNode* node_;
+};
+
+class KeysLockGuard {
+public:
+    KeysLockGuard(int db_idx, const set<string>& keys) : db_idx_(db_idx) {
+        lock_keys(db_idx_, keys, nodes_);
+    }
+    ~KeysLockGuard() {
+        unlock_keys(db_idx_, nodes_);
+    }
+private:
+    int db_idx_;
+    vector<KeyLockNode*> nodes_;
+};
+
+class TransactionLockGuard {
+public:
+    TransactionLockGuard(int db_idx, const set<string>& keys) : db_idx_(db_idx) {
+        lock_transaction_keys(db_idx_, keys, nodes_);
+    }
+    ~TransactionLockGuard() {
+        unlock_transaction_keys(db_idx_, nodes_);
     }
 private:
     int db_idx_;
-    string  key_;
-    //bool incr_;
+    vector<KeyLockNode*> nodes_;
 };
 
 #endif /* __KEY_LOCK_H__ */
@@ -33,17 +33,18 @@ struct MigrateServer {
 map<string, MigrateServer*> g_migrate_server_map;
 mutex g_migrate_mutex;
 
-int deserialize_map(const string& serialized_value, map<string, string>& kv_map)
+// the keys and values point into serialized_value
+int deserialize_kv(const rocksdb::Slice& serialized_value, vector<pair<rocksdb::Slice, rocksdb::Slice>>& kv_vec)
 {
     ByteStream bs((uchar_t*)serialized_value.data(), (uint32_t)serialized_value.size());
     
     try {
         uint32_t count = bs.ReadVarUInt();
         for (uint32_t i = 0; i < count; i++) {
-            string key, value;
-            bs >> key;
-            bs >> value;
-            kv_map[key] = value;
+            uint32_t key_len, value_len;
+            uchar_t* key = bs.ReadData(key_len);
+            uchar_t* value = bs.ReadData(value_len);
+            kv_vec.emplace_back(rocksdb::Slice((char*)key, key_len), rocksdb::Slice((char*)value, value_len));
         }
         
         return CODE_OK;
@@ -53,6 +54,146 @@ int deserialize_map(const string& serialized_value, map<string, string>& kv_map)
     }
 }
 
+static uint32_t varuint_size(uint32_t len)
+{
+    if (len <= 0x7F) {
+        return 1;
+    } else if (len <= 0x3FFF) {
+        return 2;
+    } else {
+        return 4;
+    }
+}
+
+// writes the key value pairs of a batch in the format of deserialize_kv()
+class SerializeHandler : public rocksdb::WriteBatch::Handler {
+public:
+    SerializeHandler(ByteStream& bs): bs_(bs) {}
+    
+    virtual rocksdb::Status PutCF(uint32_t column_family_id, const rocksdb::Slice& key, const rocksdb::Slice& value) {
+        bs_.WriteData((uchar_t*)key.data(), (uint32_t)key.size());
+        bs_.WriteData((uchar_t*)value.data(), (uint32_t)value.size());
+        return rocksdb::Status::OK();
+    }
+private:
+    ByteStream& bs_;
+};
+
+RestoreDecoder::RestoreDecoder(int db_idx)
+{
+    state_ = RESTORE_DECODE_COUNT;
+    cf_handle_ = g_server.cf_handles_map[db_idx];
+    count_ = 0;
+    decoded_count_ = 0;
+    var_len_ = 0;
+    data_len_ = 0;
+    serialized_size_ = 0;
+}
+
+// returns when all the data is consumed or more data is needed
+void RestoreDecoder::Write(const char* data, int len)
+{
+    while (true) {
+        switch (state_) {
+            case RESTORE_DECODE_COUNT:
+                if (!_ReadVarUInt(data, len, count_)) {
+                    return;
+                }
+                serialized_size_ += varuint_size(count_);
+                state_ = (count_ > 0) ? RESTORE_DECODE_KEY_LEN : RESTORE_DECODE_DONE;
+                break;
+            case RESTORE_DECODE_KEY_LEN:
+            case RESTORE_DECODE_VALUE_LEN:
+                if (!_ReadVarUInt(data, len, data_len_)) {
+                    return;
+                }
+                serialized_size_ += varuint_size(data_len_) + data_len_;
+                state_++;
+                break;
+            case RESTORE_DECODE_KEY:
+                if (!_ReadData(data, len, key_)) {
+                    return;
+                }
+                state_ = RESTORE_DECODE_VALUE_LEN;
+                break;
+            case RESTORE_DECODE_VALUE:
+                if (!_ReadData(data, len, value_)) {
+                    return;
+                }
+                batch_.Put(cf_handle_, key_, value_);
+                key_.clear();
+                if (value_.capacity() > kRedisBigBulkSize) {
+                    string().swap(value_);
+                } else {
+                    value_.clear();
+                }
+                state_ = (++decoded_count_ == count_) ? RESTORE_DECODE_DONE : RESTORE_DECODE_KEY_LEN;
+                break;
+            default:
+                // the bytes after all the pairs are ignored, the same as deserialize_kv()
+                return;
+        }
+    }
+}
+
+bool RestoreDecoder::_ReadVarUInt(const char*& data, int& len, uint32_t& value)
+{
+    // the first byte tells the length of the integer, see ByteStream::WriteVarUInt()
+    uint32_t int_len = 1;
+    while (len > 0) {
+        var_buf_[var_len_++] = (uchar_t)*data++;
+        len--;
+        
+        if (var_buf_[0] & 0x80) {
+            int_len = (var_buf_[0] & 0x40) ? 4 : 2;
+        }
+        if (var_len_ == int_len) {
+            ByteStream bs(var_buf_, var_len_);
+            value = bs.ReadVarUInt();
+            var_len_ = 0;
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+bool RestoreDecoder::_ReadData(const char*& data, int& len, string& str)
+{
+    if (str.empty()) {
+        str.reserve(data_len_);
+    }
+    
+    uint32_t copy_len = min(data_len_ - (uint32_t)str.size(), (uint32_t)len);
+    str.append(data, copy_len);
+    data += copy_len;
+    len -= copy_len;
+    return str.size() == data_len_;
+}
+
+void RestoreDecoder::BuildCommand(const vector<rocksdb::Slice>& cmd_vec, string& command)
+{
+    char tmp[32];
+    int pos = build_prefix(tmp, 32, '*', 4);
+    command.append(tmp + pos, strlen(tmp + pos));
+    for (int i = 0; i < 3; i++) {
+        pos = build_prefix(tmp, 32, '$', (int)cmd_vec[i].size());
+        command.append(tmp + pos, strlen(tmp + pos));
+        command.append(cmd_vec[i].data(), cmd_vec[i].size());
+        command.append("\r\n");
+    }
+    
+    pos = build_prefix(tmp, 32, '$', (int)serialized_size_);
+    command.reserve(command.size() + strlen(tmp + pos) + serialized_size_ + 2);
+    command.append(tmp + pos, strlen(tmp + pos));
+    
+    ByteStream bs(&command);
+    bs.WriteVarUInt(count_);
+    SerializeHandler handler(bs);
+    batch_.Iterate(&handler);
+    command.append("\r\n");
+}
+
 void dump_ttl(const string& key, uint64_t ttl, uint8_t type, ByteStream& bs)
 {
     if (ttl) {
@@ -290,8 +431,7 @@ void continue_migrate_command(const string& addr, const RedisReply& reply)
             respone = "+" + respone + "\r\n";
         }
         
-        BaseConn::Send(context->from_handle, (char*)respone.data(), (int)respone.size());
-        
+        // delete the key before replying, so the client will not see the key after MIGRATE returns
         if (reply.GetType() == REDIS_TYPE_STATUS) {
             KeyLockGuard key_lock_guard(context->src_db_id, context->key);
             
@@ -302,6 +442,8 @@ void continue_migrate_command(const string& addr, const RedisReply& reply)
             g_server.binlog.Store(context->src_db_id, command);
         }
         
+        BaseConn::Send(context->from_handle, (char*)respone.data(), (int)respone.size());
+        
         server->request_list.pop_front();
         delete context;
     }
@@ -351,6 +493,8 @@ void migrate_command(ClientConn* conn, const vector<string>& cmd_vec)
     if (it == g_migrate_server_map.end()) {
         MigrateServer* server = new MigrateServer;
         MigrateConn* mig_conn = new MigrateConn();
+        // set the address before connecting, OnConfirm() may run in an io thread before Connect() returns
+        mig_conn->SetAddr(addr);
         server->handle = mig_conn->Connect(cmd_vec[1], port);
         if (server->handle == NETLIB_INVALID_HANDLE) {
             delete server;
@@ -360,7 +504,6 @@ void migrate_command(ClientConn* conn, const vector<string>& cmd_vec)
             return;
         }
         
-        mig_conn->SetAddr(addr);
         server->is_connected = false;
         server->cur_db_index = 0;
         server->request_list.push_back(context);
@@ -384,31 +527,44 @@ void migrate_command(ClientConn* conn, const vector<string>& cmd_vec)
 }
 
 // RESTORE key ttl serialized-value
-void restore_command(ClientConn* conn, const vector<string>& cmd_vec)
+void restore_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec)
 {
     long ttl;
-    if (get_long_from_string(cmd_vec[2], ttl) == CODE_ERROR) {
+    if (get_long_from_string(cmd_vec[2].ToString(), ttl) == CODE_ERROR) {
         conn->SendError("value is not an integer or out of range");
         return;
     }
     
-    map<string, string> kv_map;
-    if (deserialize_map(cmd_vec[3], kv_map) == CODE_ERROR) {
-        conn->SendError("deserialize error");
-        return;
+    int db_idx = conn->GetDBIndex();
+    rocksdb::WriteBatch local_batch;
+    // a big serialized value has been decoded into the batch of RestoreDecoder while it was received
+    RestoreDecoder* decoder = (RestoreDecoder*)conn->GetBulkSink();
+    if (decoder) {
+        if (!decoder->IsComplete()) {
+            log_message(kLogLevelError, "deserialize failed: incomplete serialized value\n");
+            conn->SendError("deserialize error");
+            return;
+        }
+    } else {
+        vector<pair<rocksdb::Slice, rocksdb::Slice>> kv_vec;
+        if (deserialize_kv(cmd_vec[3], kv_vec) == CODE_ERROR) {
+            conn->SendError("deserialize error");
+            return;
+        }
+        
+        rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
+        for (auto& kv : kv_vec) {
+            local_batch.Put(cf_handle, kv.first, kv.second);
+        }
     }
     
-    int db_idx = conn->GetDBIndex();
-    rocksdb::WriteBatch batch;
+    rocksdb::WriteBatch& batch = decoder ? decoder->GetBatch() : local_batch;
+    string key = cmd_vec[1].ToString();
     MetaData mdata;
-    KeyLockGuard lock_guard(db_idx, cmd_vec[1]);
-    rocksdb::ColumnFamilyHandle* cf_handle = g_server.cf_handles_map[db_idx];
-    for (auto it = kv_map.begin(); it != kv_map.end(); it++) {
-        batch.Put(cf_handle, it->first, it->second);
-    }
-    int ret = expire_key_if_needed(db_idx, cmd_vec[1], mdata);
+    KeyLockGuard lock_guard(db_idx, key);
+    int ret = expire_key_if_needed(db_idx, key, mdata);
     if (ret == kExpireKeyExist) {
-        delete_key(db_idx, cmd_vec[1], mdata.ttl, mdata.type);
+        delete_key(db_idx, key, mdata.ttl, mdata.type);
     }
     
     g_server.key_count_vec[db_idx]++;
@@ -419,7 +575,14 @@ void restore_command(ClientConn* conn, const vector<string>& cmd_vec)
     if (conn->GetState() != CONN_STATE_CONNECTED) {
         return;
     }
-    g_server.binlog.Store(db_idx, conn->GetCurReqCommand());
+    
+    if (decoder) {
+        string command;
+        decoder->BuildCommand(cmd_vec, command);
+        g_server.binlog.Store(db_idx, command);
+    } else {
+        g_server.binlog.Store(db_idx, conn->GetCurReqCommand());
+    }
     conn->SendSimpleString("OK");
 }
 
@@ -435,6 +598,6 @@ void dump_command(ClientConn* conn, const vector<string>& cmd_vec)
     } else if (ret == kExpireKeyNotExist) {
         conn->SendRawResponse(kNullBulkString);
     } else {
-        conn->SendBulkString(serialized_value);
+        conn->SendBulkString(std::move(serialized_value));
     }
 }
@@ -10,6 +10,7 @@
 #define __MIGRATE_H__
 
 #include "server.h"
+#include "rocksdb/write_batch.h"
 
 int get_migrate_conn_number();
 
@@ -21,8 +22,51 @@ void migrate_conn_established(const string& addr);
 void migrate_conn_closed(const string& addr);
 void continue_migrate_command(const string& addr, const RedisReply& reply);
 
+/*
+ * decodes the serialized value of a big RESTORE into a WriteBatch while it is received,
+ * every key value pair is put into the batch once it is complete, so the serialized value is not buffered
+ */
+class RestoreDecoder : public RedisBulkSink {
+public:
+    RestoreDecoder(int db_idx);
+    virtual ~RestoreDecoder() {}
+    
+    virtual void Write(const char* data, int len);
+    
+    bool IsComplete() { return state_ == RESTORE_DECODE_DONE; }
+    rocksdb::WriteBatch& GetBatch() { return batch_; }
+    
+    // rebuild the RESTORE command with the serialized value from the batch, which is used by binlog
+    void BuildCommand(const vector<rocksdb::Slice>& cmd_vec, string& command);
+private:
+    enum {
+        RESTORE_DECODE_COUNT = 0,
+        RESTORE_DECODE_KEY_LEN,
+        RESTORE_DECODE_KEY,
+        RESTORE_DECODE_VALUE_LEN,
+        RESTORE_DECODE_VALUE,
+        RESTORE_DECODE_DONE,
+        RESTORE_DECODE_ERROR,
+    };
+    
+    bool _ReadVarUInt(const char*& data, int& len, uint32_t& value);
+    bool _ReadData(const char*& data, int& len, string& str);
+private:
+    int         state_;
+    rocksdb::ColumnFamilyHandle* cf_handle_;
+    rocksdb::WriteBatch batch_;
+    uint32_t    count_;
+    uint32_t    decoded_count_;
+    uchar_t     var_buf_[4];    // bytes of a variable unsigned integer which is split across reads
+    uint32_t    var_len_;
+    uint32_t    data_len_;      // length of the key or value being received
+    string      key_;
+    string      value_;
+    uint64_t    serialized_size_;
+};
+
 void migrate_command(ClientConn* conn, const vector<string>& cmd_vec);
-void restore_command(ClientConn* conn, const vector<string>& cmd_vec);
+void restore_command(ClientConn* conn, const vector<rocksdb::Slice>& cmd_vec);
 void dump_command(ClientConn* conn, const vector<string>& cmd_vec);
 
 #endif /* __MIGRATE_H__ */
@@ -36,9 +36,6 @@ void MigrateConn::OnRead()
 {
     _RecvData();
     
-    // when parse redis protocol, this makes sure searching string pattern will not pass the boundary
-    m_in_buf.GetWriteBuffer()[0] = 0;
-    
     while (true) {
         RedisReply reply;
         int ret = parse_redis_response((const char*)m_in_buf.GetReadBuffer(), m_in_buf.GetReadableLen(), reply);
@@ -68,11 +65,15 @@ void MigrateConn::OnTimer(uint64_t curr_tick)
         if (curr_tick >= m_last_send_tick + 1000) {
             // if connection has not establish after 1 second, close the connection
             Close();
+        } else {
+            SetTimer(m_last_send_tick + 1000 - curr_tick);
         }
     } else {
         if (curr_tick >= m_last_send_tick + 15000) {
             // if connection idled 15 seconds, close the connection
             Close();
+        } else {
+            SetTimer(m_last_send_tick + 15000 - curr_tick);
         }
     }
 }
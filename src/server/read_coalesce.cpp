@@ -0,0 +1,274 @@
+//
+//  read_coalesce.cpp
+//  kedis
+//
+
+#include "read_coalesce.h"
+#include "io_thread_resource.h"
+#include "event_loop.h"
+#include "command_table.h"
+#include "encoding.h"
+#include "db_util.h"
+#include "cmd_hash.h"
+#include "cmd_set.h"
+#include "cmd_zset.h"
+
+// the commands that can be coalesced, the index is the type of a CoalescedRead
+struct CoalesceCommand {
+    const char*     name;
+    uint8_t         key_type;
+    uint8_t         element_type;   // KEY_TYPE_META if the reply only needs the meta data
+    KedisCommand*   kedis_cmd;
+};
+
+enum {
+    COALESCE_GET = 0,
+    COALESCE_HGET,
+    COALESCE_SISMEMBER,
+    COALESCE_ZSCORE,
+    COALESCE_TYPE_COUNT,
+};
+
+static CoalesceCommand g_coalesce_cmds[COALESCE_TYPE_COUNT] = {
+    {"GET", KEY_TYPE_STRING, KEY_TYPE_META, NULL},
+    {"HGET", KEY_TYPE_HASH, KEY_TYPE_HASH_FIELD, NULL},
+    {"SISMEMBER", KEY_TYPE_SET, KEY_TYPE_SET_MEMBER, NULL},
+    {"ZSCORE", KEY_TYPE_ZSET, KEY_TYPE_ZSET_SCORE, NULL},
+};
+
+struct CoalescedRead {
+    ClientConn*     conn;
+    int             type;       // COALESCE_XXX
+    int             db_idx;
+    string          key;
+    string          element;    // the field of HGET, the member of SISMEMBER and ZSCORE
+};
+
+struct ReadBatch {
+    EventLoop*              loop;
+    vector<CoalescedRead>   reads;  // the reads of a connection are next to each other, in the order of the requests
+    uint64_t                start_us;   // when the first read joined the batch
+
+    ReadBatch() : loop(NULL), start_us(0) {}
+};
+
+static IoThreadResource<ReadBatch> g_read_batches;
+
+static int get_coalesce_type(KedisCommand* kedis_cmd)
+{
+    for (int i = 0; i < COALESCE_TYPE_COUNT; i++) {
+        if (g_coalesce_cmds[i].kedis_cmd == kedis_cmd) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// reply a read whose key exists with the expected type, the element was read with the MultiGet of the elements
+static void send_element_reply(ClientConn* conn, int type, const rocksdb::Status& status, const string& encode_value)
+{
+    int result = DB_ERROR;
+    if (type == COALESCE_HGET) {
+        string value;
+        result = decode_hash_field(status, encode_value, value);
+        if (result == FIELD_EXIST) {
+            conn->SendBulkString(std::move(value));
+        } else if (result == FIELD_NOT_EXIST) {
+            conn->SendRawResponse(kNullBulkString);
+        }
+    } else if (type == COALESCE_SISMEMBER) {
+        result = decode_set_member(status, encode_value);
+        if (result != DB_ERROR) {
+            conn->SendInteger((result == FIELD_EXIST) ? 1 : 0);
+        }
+    } else {
+        double score;
+        result = decode_zset_score(status, encode_value, score);
+        if (result == FIELD_EXIST) {
+            conn->SendBulkString(double_to_string(score));
+        } else if (result == FIELD_NOT_EXIST) {
+            conn->SendRawResponse(kNullBulkString);
+        }
+    }
+
+    if (result == DB_ERROR) {
+        conn->SendError("db error");
+    }
+}
+
+// answer the reads of one db, the same replies as the commands running by themselves, every read is of one key,
+// so they do not need a snapshot
+static void answer_db_reads(int db_idx, vector<CoalescedRead>& reads, const vector<int>& indexes)
+{
+    ReadSnapshotGuard snapshot_guard(db_idx, false);
+    const rocksdb::ReadOptions& read_option = snapshot_guard.GetReadOption();
+
+    vector<string> keys;
+    keys.reserve(indexes.size());
+    for (int idx : indexes) {
+        keys.push_back(reads[idx].key);
+    }
+
+    vector<MetaData> mdatas;
+    vector<int> results;
+    multi_get_meta_data(db_idx, keys, mdatas, results, read_option);
+
+    // the elements are only read for the keys that exist with the expected type
+    vector<string> encode_keys;
+    vector<int> element_pos(indexes.size(), -1);
+    for (size_t i = 0; i < indexes.size(); i++) {
+        CoalescedRead& read = reads[indexes[i]];
+        CoalesceCommand& cmd = g_coalesce_cmds[read.type];
+        if ((results[i] == kExpireKeyExist) && (mdatas[i].type == cmd.key_type) && (cmd.element_type != KEY_TYPE_META)) {
+            EncodeKey element_key(cmd.element_type, read.key, read.element);
+            element_pos[i] = (int)encode_keys.size();
+            encode_keys.push_back(element_key.GetEncodeKey().ToString());
+        }
+    }
+
+    vector<rocksdb::Status> statuses;
+    vector<string> encode_values;
+    if (!encode_keys.empty()) {
+        multi_get(db_idx, encode_keys, statuses, encode_values, read_option);
+    }
+
+    for (size_t i = 0; i < indexes.size(); i++) {
+        CoalescedRead& read = reads[indexes[i]];
+        ClientConn* conn = read.conn;
+        if (!conn->IsOpen()) {
+            continue;
+        }
+
+        if (results[i] == kExpireDBError) {
+            conn->SendError("db error");
+        } else if (results[i] == kExpireKeyNotExist) {
+            if (read.type == COALESCE_SISMEMBER) {
+                conn->SendInteger(0);
+            } else {
+                conn->SendRawResponse(kNullBulkString);
+            }
+        } else if (mdatas[i].type != g_coalesce_cmds[read.type].key_type) {
+            conn->SendRawResponse(kWrongTypeError);
+        } else if (read.type == COALESCE_GET) {
+            if (!mdatas[i].value.empty()) {
+                conn->SendBulkString(std::move(mdatas[i].value));
+            } else {
+                conn->SendRawResponse(kEmptyBulkString);
+            }
+        } else {
+            int pos = element_pos[i];
+            send_element_reply(conn, read.type, statuses[pos], encode_values[pos]);
+        }
+    }
+}
+
+static void answer_batch(vector<CoalescedRead>& reads)
+{
+    uint64_t start_us = get_monotonic_us();
+
+    // almost all the reads are of the same db, so the reads of each db are picked by going through the batch again
+    set<int> db_set;
+    for (const CoalescedRead& read : reads) {
+        db_set.insert(read.db_idx);
+    }
+
+    for (int db_idx : db_set) {
+        vector<int> indexes;
+        for (int i = 0; i < (int)reads.size(); i++) {
+            if (reads[i].db_idx == db_idx) {
+                indexes.push_back(i);
+            }
+        }
+        answer_db_reads(db_idx, reads, indexes);
+    }
+
+    // the time of the batch is shared by the reads in the command statistics
+    uint64_t usec = (get_monotonic_us() - start_us) / reads.size();
+    for (const CoalescedRead& read : reads) {
+        add_command_stat(g_coalesce_cmds[read.type].kedis_cmd, usec);
+    }
+    g_stat.total_commands_processed += reads.size();
+    g_stat.coalesced_reads += reads.size();
+    g_stat.coalesced_read_batches++;
+}
+
+static void read_coalesce_callback(void* callback_data, uint8_t msg, uint32_t handle, void* pParam)
+{
+    ReadBatch* batch = (ReadBatch*)callback_data;
+    if (batch->reads.empty()) {
+        return;
+    }
+
+    bool full = (int)batch->reads.size() >= kReadCoalesceMaxBatch;
+    if (full || !g_server.read_coalesce_window || (get_monotonic_us() >= batch->start_us + g_server.read_coalesce_window)) {
+        // the connections resumed below may start the next batch
+        vector<CoalescedRead> reads;
+        reads.swap(batch->reads);
+        answer_batch(reads);
+
+        for (size_t i = 0; i < reads.size(); i++) {
+            if ((i + 1 == reads.size()) || (reads[i + 1].conn != reads[i].conn)) {
+                reads[i].conn->OnResume();
+                reads[i].conn->ReleaseRef();  // reference added in add_coalesced_read()
+            }
+        }
+    }
+
+    // poll for the events of the next iteration instead of blocking in the wait
+    if (!batch->reads.empty()) {
+        batch->loop->Wakeup();
+    }
+}
+
+void init_read_coalesce(int io_thread_num)
+{
+    if (g_read_batches.IsInited()) {
+        return;
+    }
+
+    for (int i = 0; i < COALESCE_TYPE_COUNT; i++) {
+        g_coalesce_cmds[i].kedis_cmd = lookup_command(g_coalesce_cmds[i].name);
+    }
+
+    g_read_batches.Init(io_thread_num);
+    if (io_thread_num > 0) {
+        for (int i = 0; i < io_thread_num; ++i) {
+            ReadBatch* batch = g_read_batches.GetIOResource(i);
+            batch->loop = get_io_event_loop(i);
+            batch->loop->AddLoop(read_coalesce_callback, batch);
+        }
+    } else {
+        ReadBatch* batch = g_read_batches.GetMainResource();
+        batch->loop = get_main_event_loop();
+        batch->loop->AddLoop(read_coalesce_callback, batch);
+    }
+}
+
+bool can_coalesce_read(KedisCommand* kedis_cmd, const vector<rocksdb::Slice>& arg_vec)
+{
+    return g_read_batches.IsInited() && (get_coalesce_type(kedis_cmd) != -1) &&
+        ((int)arg_vec.size() == kedis_cmd->arity);
+}
+
+void add_coalesced_read(ClientConn* conn, KedisCommand* kedis_cmd, const vector<rocksdb::Slice>& arg_vec)
+{
+    ReadBatch* batch = g_read_batches.GetIOResource(conn->GetHandle());
+    if (batch->reads.empty()) {
+        batch->start_us = g_server.read_coalesce_window ? get_monotonic_us() : 0;
+    }
+
+    // the first read of the connection in the batch, released after the connection is resumed
+    if (batch->reads.empty() || (batch->reads.back().conn != conn)) {
+        conn->AddRef();
+    }
+
+    CoalescedRead read;
+    read.conn = conn;
+    read.type = get_coalesce_type(kedis_cmd);
+    read.db_idx = conn->GetDBIndex();
+    read.key = arg_vec[1].ToString();
+    if (arg_vec.size() > 2) {
+        read.element = arg_vec[2].ToString();
+    }
+    batch->reads.push_back(std::move(read));
+}
@@ -0,0 +1,37 @@
+//
+//  read_coalesce.h
+//  kedis
+//
+
+#ifndef __READ_COALESCE_H__
+#define __READ_COALESCE_H__
+
+#include "util.h"
+#include "rocksdb/slice.h"
+
+class ClientConn;
+struct KedisCommand;
+
+const int kReadCoalesceMaxBatch = 1024; // a batch is answered at the end of the loop iteration once it has this many reads
+
+/*
+ * point reads (GET, HGET, SISMEMBER, ZSCORE) of all the connections of an io thread are collected in one batch
+ * while the loop iteration handles the events, and answered together by a loop hook: the meta data of all the keys
+ * are read with one MultiGet, then the elements with another, from one snapshot of each db.
+ * the batch waits at most read-coalesce-window microseconds from the first read for the reads of later iterations,
+ * the loop does not block in the wait for events meanwhile.
+ * a connection with reads in the batch processes no more requests until they are answered, so its replies keep
+ * the order of its requests
+ */
+
+// init the batches and register the loop hooks, must be called after init_thread_base_conn()
+void init_read_coalesce(int io_thread_num);
+
+// whether the request can join the batch of the io thread instead of running at once
+bool can_coalesce_read(KedisCommand* kedis_cmd, const vector<rocksdb::Slice>& arg_vec);
+
+// called in the io thread of the connection, the arguments are copied, the reply is appended to the responses of
+// the connection when the batch is answered, then the connection is resumed by OnResume()
+void add_coalesced_read(ClientConn* conn, KedisCommand* kedis_cmd, const vector<rocksdb::Slice>& arg_vec);
+
+#endif /* __READ_COALESCE_H__ */
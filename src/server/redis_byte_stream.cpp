@@ -7,6 +7,7 @@
 //
 
 #include "redis_byte_stream.h"
+#include "simd_scan.h"
 
 RedisByteStream::RedisByteStream(char* data, int len)
 {
@@ -34,18 +35,32 @@ int RedisByteStream::ReadByte()
 void RedisByteStream::ReadLine(string& line)
 {
     char* start_pos = data_ + offset_;
-    char* pos = strstr(start_pos, "\r\n");
-    if (!pos) {
-        throw ParseRedisException(PARSE_REDIS_ERROR_NO_MORE_DATA, "no more data");
-    }
-    
+    char* pos = _FindLineEnd();
     int size = (int)(pos - start_pos);
     line.append(start_pos, size);
     offset_ += size + 2;
 }
 
+long RedisByteStream::ReadInteger()
+{
+    char* start_pos = data_ + offset_;
+    char* pos = _FindLineEnd();
+    int size = (int)(pos - start_pos);
+    long value;
+    if (scan_long(start_pos, size, value) == CODE_ERROR) {
+        throw ParseRedisException(PARSE_REDIS_ERROR_INVALID_FORMAT, "invalid integer");
+    }
+    
+    offset_ += size + 2;
+    return value;
+}
+
 void RedisByteStream::ReadBytes(int size, string& value)
 {
+    if (size < 0) {
+        throw ParseRedisException(PARSE_REDIS_ERROR_INVALID_FORMAT, "invalid bulk length");
+    }
+    
     if (offset_ + size + 2 > len_) {
         throw ParseRedisException(PARSE_REDIS_ERROR_NO_MORE_DATA, "no more data");
     }
@@ -54,3 +69,13 @@ void RedisByteStream::ReadBytes(int size, string& value)
     value.append(start_pos, size);
     offset_ += size + 2;
 }
+
+char* RedisByteStream::_FindLineEnd()
+{
+    char* pos = (char*)scan_crlf(data_ + offset_, len_ - offset_);
+    if (!pos) {
+        throw ParseRedisException(PARSE_REDIS_ERROR_NO_MORE_DATA, "no more data");
+    }
+    
+    return pos;
+}
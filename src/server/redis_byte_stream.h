@@ -36,7 +36,10 @@ public:
     int GetOffset() { return offset_; }
     int ReadByte();
     void ReadLine(string& line);
+    long ReadInteger();     // read a line which is a decimal integer
     void ReadBytes(int size, string& value);
+private:
+    char* _FindLineEnd();
 private:
     char*   data_;
     int     len_;
@@ -9,6 +9,7 @@
 #include "redis_parser.h"
 #include "simple_log.h"
 #include "redis_byte_stream.h"
+#include "simd_scan.h"
 
 const int kRedisInlineMaxSize = 1024 * 64;
 const int kRedisRequestMaxSize = 1024 * 1024 * 512;
@@ -162,7 +163,7 @@ int split_inline_args(const char *line, vector<string>& cmd_vec)
 int parse_inline_redis_request(const char* redis_cmd, int redis_len, vector<string>& cmd_vec, string& err_msg)
 {
     // redis inline command
-    char* newline = (char*)strchr(redis_cmd, '\n');
+    char* newline = (char*)memchr(redis_cmd, '\n', redis_len);
     if (!newline) {
         if (redis_len > kRedisInlineMaxSize) {
             err_msg = "Protocol error: too big inline request";
@@ -195,10 +196,10 @@ int parse_inline_redis_request(const char* redis_cmd, int redis_len, vector<stri
     return skip_len;
 }
 
-int parse_multibulk_redis_request(const char* redis_cmd, int redis_len, vector<string>& cmd_vec, string& err_msg)
+// parse "*<count>\r\n" at the beginning of redis_cmd, return the header length, 0 if incomplete, -1 if error
+static int parse_multibulk_count(const char* redis_cmd, int redis_len, long& argc_num, string& err_msg)
 {
-    // parse argument count
-    char* newline = (char*)strchr(redis_cmd, '\r');
+    const char* newline = scan_crlf(redis_cmd, redis_len);
     if (!newline) {
         if (redis_len > kRedisInlineMaxSize) {
             err_msg = "Protocol error: too big mbulk count string";
@@ -208,63 +209,79 @@ int parse_multibulk_redis_request(const char* redis_cmd, int redis_len, vector<s
         return 0;
     }
     
-    long argc_num;
-    string argc_str(redis_cmd + 1, newline - (redis_cmd + 1));
-    int ok = get_long_from_string(argc_str, argc_num);
+    int ok = scan_long(redis_cmd + 1, (int)(newline - (redis_cmd + 1)), argc_num);
     if ((ok == CODE_ERROR) || (argc_num > 1024 * 1024)) {
         err_msg = "Protocol error: invalid multibulk length";
         log_message(kLogLevelError, "Protocol error: invalid multibulk length: %d\n", argc_num);
         return -1;
     }
     
-    int pos = (int)(newline - redis_cmd) + 2;
+    return (int)(newline - redis_cmd) + 2;
+}
+
+// parse "$<len>\r\n" at the beginning of redis_cmd, return the header length, 0 if incomplete, -1 if error
+static int parse_bulk_len(const char* redis_cmd, int redis_len, long& len, string& err_msg)
+{
+    if (redis_len < 1) {
+        return 0;
+    }
+    
+    if (redis_cmd[0] != '$') {
+        err_msg = "Protocol error: expected '$', got '";
+        err_msg += redis_cmd[0];
+        err_msg += "'";
+        log_message(kLogLevelError, "%s\n", err_msg.c_str());
+        return -1;
+    }
+    
+    const char* newline = scan_crlf(redis_cmd, redis_len);
+    if (!newline) {
+        // parameter length protection
+        if (redis_len > kRedisInlineMaxSize) {
+            err_msg = "Protocol error: too big bulk count string";
+            log_message(kLogLevelError, "Protocol error: too big bulk count string\n");
+            return -1;
+        }
+        return 0;
+    }
+    
+    int ok = scan_long(redis_cmd + 1, (int)(newline - (redis_cmd + 1)), len);
+    if ((ok == CODE_ERROR) || (len < 0) || (len > kRedisRequestMaxSize)) {
+        err_msg = "Protocol error: invalid bulk length";
+        log_message(kLogLevelError, "Protocol error: invalid bulk length: %d\n", len);
+        return -1;
+    }
+    
+    return (int)(newline - redis_cmd) + 2;
+}
+
+int parse_multibulk_redis_request(const char* redis_cmd, int redis_len, vector<rocksdb::Slice>& arg_vec, string& err_msg)
+{
+    long argc_num;
+    int pos = parse_multibulk_count(redis_cmd, redis_len, argc_num, err_msg);
+    if (pos <= 0) {
+        return pos;
+    }
+    
     if (argc_num <= 0) {
         return pos;
     }
     
-    cmd_vec.reserve(argc_num);
+    arg_vec.reserve(argc_num);
     while (argc_num > 0) {
-        if (pos >= redis_len) {
-            return 0;
-        }
-        
-        // parse parameter length
-        if (redis_cmd[pos] != '$') {
-            err_msg = "Protocol error: expected '$', got '";
-            err_msg += redis_cmd[pos];
-            err_msg += "'";
-            log_message(kLogLevelError, "%s\n", err_msg.c_str());
-            return -1;
-        }
-        
-        newline = (char*)strchr(redis_cmd + pos, '\r');
-        if (!newline) {
-            // parameter length protection
-            if (redis_len - pos > kRedisInlineMaxSize) {
-                err_msg = "Protocol error: too big bulk count string";
-                log_message(kLogLevelError, "Protocol error: too big bulk count string\n");
-                return -1;
-            }
-            return 0;
-        }
-        
         long len;
-        string len_str(redis_cmd + pos + 1, newline - (redis_cmd + pos + 1));
-        ok = get_long_from_string(len_str, len);
-        if ((ok == CODE_ERROR) || (len < 0) || (len > kRedisRequestMaxSize)) {
-            err_msg = "Protocol error: invalid bulk length";
-            log_message(kLogLevelError, "Protocol error: invalid bulk length: %d\n", len);
-            return -1;
+        int header_len = parse_bulk_len(redis_cmd + pos, redis_len - pos, len, err_msg);
+        if (header_len <= 0) {
+            return header_len;
         }
         
-        pos = (int)(newline - redis_cmd) + 2;
+        pos += header_len;
         if (pos + len > redis_len - 2) {
             return 0;
         }
         
-        // add the parameter to cmd_vec
-        string argv_str(redis_cmd + pos, len);
-        cmd_vec.push_back(argv_str);
+        // add the parameter to arg_vec, the data is not copied
+        arg_vec.push_back(rocksdb::Slice(redis_cmd + pos, len));
         pos += len + 2;
         argc_num--;
     }
@@ -280,17 +297,195 @@ int parse_redis_request(const char* redis_cmd, int redis_len, vector<string>& cm
     
     if (redis_cmd[0] != '*') {
         return parse_inline_redis_request(redis_cmd, redis_len, cmd_vec, err_msg);
-    } else {
-        return parse_multibulk_redis_request(redis_cmd, redis_len, cmd_vec, err_msg);
     }
+    
+    vector<rocksdb::Slice> arg_vec;
+    int ret = parse_multibulk_redis_request(redis_cmd, redis_len, arg_vec, err_msg);
+    if (ret > 0) {
+        cmd_vec.reserve(arg_vec.size());
+        for (const rocksdb::Slice& arg : arg_vec) {
+            cmd_vec.emplace_back(arg.data(), arg.size());
+        }
+    }
+    return ret;
 }
 
-static RedisReply parse_integer(RedisByteStream& byte_stream)
+int parse_redis_request(const char* redis_cmd, int redis_len, vector<rocksdb::Slice>& arg_vec,
+                        vector<string>& inline_args, string& err_msg)
 {
-    string line;
-    byte_stream.ReadLine(line);
-    long int_value = atol(line.c_str());
+    if (redis_len < 1) {
+        return 0;
+    }
+    
+    if (redis_cmd[0] != '*') {
+        int ret = parse_inline_redis_request(redis_cmd, redis_len, inline_args, err_msg);
+        if (ret > 0) {
+            for (const string& arg : inline_args) {
+                arg_vec.push_back(arg);
+            }
+        }
+        return ret;
+    }
+    
+    return parse_multibulk_redis_request(redis_cmd, redis_len, arg_vec, err_msg);
+}
+
+// return true if the request at the beginning of redis_cmd is waiting for the data of a big bulk argument
+static bool wait_big_bulk(const char* redis_cmd, int redis_len)
+{
+    string err_msg;
+    long argc_num;
+    int pos = parse_multibulk_count(redis_cmd, redis_len, argc_num, err_msg);
+    if (pos <= 0) {
+        return false;
+    }
+    
+    while (argc_num > 0) {
+        long len;
+        int header_len = parse_bulk_len(redis_cmd + pos, redis_len - pos, len, err_msg);
+        if (header_len <= 0) {
+            return false;
+        }
+        
+        pos += header_len;
+        if (pos + len > redis_len - 2) {
+            return len >= kRedisBigBulkSize;
+        }
+        
+        pos += len + 2;
+        argc_num--;
+    }
+    
+    return false;
+}
+
+RedisBigRequest::RedisBigRequest()
+{
+    argc_ = -1;
+    bulk_left_ = 0;
+    sink_ = nullptr;
+    sink_arg_idx_ = -1;
+    sink_creator_ = nullptr;
+    sink_data_ = nullptr;
+}
+
+RedisBigRequest::~RedisBigRequest()
+{
+    delete sink_;
+}
+
+void RedisBigRequest::Reset()
+{
+    argc_ = -1;
+    bulk_left_ = 0;
+    vector<string>().swap(args_);
+    arg_vec_.clear();
+    delete sink_;
+    sink_ = nullptr;
+    sink_arg_idx_ = -1;
+}
+
+int RedisBigRequest::Feed(const char* buf, int len, string& err_msg)
+{
+    int pos = 0;
+    if (argc_ < 0) {
+        if ((len < 1) || (buf[0] != '*') || !wait_big_bulk(buf, len)) {
+            return 0;
+        }
+        
+        pos = parse_multibulk_count(buf, len, argc_, err_msg);
+    }
+    
+    while (true) {
+        if (bulk_left_ > 0) {
+            int recv_len = (int)min((long)(len - pos), bulk_left_);
+            _ReceiveBulk(buf + pos, recv_len);
+            pos += recv_len;
+            if (bulk_left_ > 0) {
+                break;
+            }
+        }
+        
+        if ((long)args_.size() == argc_) {
+            break;
+        }
+        
+        long bulk_len;
+        int header_len = parse_bulk_len(buf + pos, len - pos, bulk_len, err_msg);
+        if (header_len < 0) {
+            return -1;
+        } else if (header_len == 0) {
+            break;
+        }
+        
+        if (bulk_len >= kRedisBigBulkSize) {
+            pos += header_len;
+            _StartBulk(bulk_len);
+        } else {
+            // a small argument is copied only after all of its data is received
+            if (pos + header_len + bulk_len > len - 2) {
+                break;
+            }
+            
+            args_.emplace_back(buf + pos + header_len, bulk_len);
+            pos += header_len + (int)bulk_len + 2;
+        }
+    }
+    
+    return pos;
+}
+
+const vector<rocksdb::Slice>& RedisBigRequest::GetArgs()
+{
+    // args_ do not grow any more, the slices can point into it
+    if (arg_vec_.empty()) {
+        arg_vec_.reserve(args_.size());
+        for (const string& arg : args_) {
+            arg_vec_.push_back(arg);
+        }
+    }
+    return arg_vec_;
+}
+
+void RedisBigRequest::_StartBulk(long len)
+{
+    bulk_left_ = len + 2;
+    if (!sink_ && sink_creator_) {
+        sink_ = sink_creator_(args_, argc_, sink_data_);
+        if (sink_) {
+            sink_arg_idx_ = (int)args_.size();
+        }
+    }
     
+    args_.emplace_back();
+    if (sink_arg_idx_ != (int)args_.size() - 1) {
+        args_.back().reserve(len);
+    }
+}
+
+void RedisBigRequest::_ReceiveBulk(const char* buf, int len)
+{
+    // the trailing "\r\n" is not part of the argument
+    long data_len = min((long)len, bulk_left_ - 2);
+    if (data_len > 0) {
+        if (sink_arg_idx_ == (int)args_.size() - 1) {
+            sink_->Write(buf, (int)data_len);
+        } else {
+            args_.back().append(buf, data_len);
+        }
+    }
+    bulk_left_ -= len;
+}
+
+bool arg_equal_nocase(const rocksdb::Slice& arg, const char* str)
+{
+    size_t len = strlen(str);
+    return (arg.size() == len) && !strncasecmp(arg.data(), str, len);
+}
+
+static RedisReply parse_integer(RedisByteStream& byte_stream)
+{
+    long int_value = byte_stream.ReadInteger();
     return RedisReply(REDIS_TYPE_INTEGER, int_value);
 }
 
@@ -304,14 +499,12 @@ static RedisReply parse_simple_string(int type, RedisByteStream& byte_stream)
 
 static RedisReply parse_bulk_string(RedisByteStream& byte_stream)
 {
-    string line;
-    byte_stream.ReadLine(line);
-    int size = (int)atoi(line.c_str());
+    int size = (int)byte_stream.ReadInteger();
     if (size == -1) {
         return RedisReply(REDIS_TYPE_NIL);
     }
     
-    line.clear();
+    string line;
     byte_stream.ReadBytes(size, line);
     return RedisReply(REDIS_TYPE_STRING, line);
 }
@@ -320,9 +513,7 @@ static RedisReply parse_redis_protocol(RedisByteStream& byte_stream);
 
 static RedisReply parse_array(RedisByteStream& byte_stream)
 {
-    string line;
-    byte_stream.ReadLine(line);
-    int count = (int)atoi(line.c_str());
+    int count = (int)byte_stream.ReadInteger();
     if (count == -1) {
         return RedisReply(REDIS_TYPE_NIL);
     }
@@ -412,6 +603,22 @@ void build_request(const vector<string>& cmd_vec, string& request)
     }
 }
 
+void build_request(const vector<rocksdb::Slice>& arg_vec, string& request)
+{
+    char tmp[32];
+    int size = (int)arg_vec.size();
+    int pos = build_prefix(tmp, 32, '*', size);
+    request.append(tmp + pos, strlen(tmp + pos));
+    for (const rocksdb::Slice& arg : arg_vec) {
+        size = (int)arg.size();
+        pos = build_prefix(tmp, 32, '$', size);
+        request.append(tmp + pos, strlen(tmp + pos));
+        
+        request.append(arg.data(), size);
+        request.append("\r\n");
+    }
+}
+
 void build_response(const vector<string>& cmd_vec, string& response)
 {
     char tmp[32];
@@ -10,10 +10,13 @@
 #define __REDIS_PARSER_H__
 
 #include "util.h"
+#include "rocksdb/slice.h"
 
 const string kNullBulkString = "$-1\r\n";
 const string kEmptyBulkString = "$0\r\n\r\n";
+const string kNullMultiBulk = "*-1\r\n";
 const string kOKString = "+OK\r\n";
+const string kQueuedString = "+QUEUED\r\n";
 const string kWrongTypeError = "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
 const string kIoErrorString = "-IOERROR\r\n";
 const string kNoKeyString = "-NOKEY\r\n";
@@ -56,6 +59,69 @@ private:
  */
 int parse_redis_request(const char* redis_cmd, int redis_len, vector<string>& cmd_vec, string& err_msg);
 
+/*
+ * zero-copy version of parse_redis_request(), the arguments of a multibulk request point into redis_cmd,
+ * so redis_cmd must not be changed or consumed before the command completes.
+ * the arguments of an inline request need unescape, they are saved in inline_args and arg_vec points to them
+ */
+int parse_redis_request(const char* redis_cmd, int redis_len, vector<rocksdb::Slice>& arg_vec,
+                        vector<string>& inline_args, string& err_msg);
+
+const int kRedisBigBulkSize = 512 * 1024; // bulk arguments no less than this are received by RedisBigRequest
+
+// receives a big bulk argument piece by piece as it arrives, instead of keeping the whole argument in memory
+class RedisBulkSink {
+public:
+    virtual ~RedisBulkSink() {}
+    virtual void Write(const char* data, int len) = 0;
+};
+
+// called when a big bulk argument starts, args are the arguments before it,
+// return a sink to consume the argument, or nullptr to receive it into memory
+typedef RedisBulkSink* (*RedisBulkSinkCreator)(const vector<string>& args, long argc, void* data);
+
+/*
+ * a multibulk request with big bulk arguments, which is parsed across reads,
+ * so the input buffer does not need to grow to hold the whole request.
+ * the other arguments are copied out of the input buffer, a big bulk argument is received into its own buffer,
+ * which is allocated once with the bulk length, or is consumed by a sink
+ */
+class RedisBigRequest {
+public:
+    RedisBigRequest();
+    ~RedisBigRequest();
+    
+    void SetSinkCreator(RedisBulkSinkCreator creator, void* data) { sink_creator_ = creator; sink_data_ = data; }
+    
+    /*
+     * feed the request data at the beginning of buf, a request is started only if an incomplete big bulk argument
+     * is found, so the request which is not started should be parsed by parse_redis_request()
+     * 返回值:
+     *  -1 -- 解析失败，redis格式出错
+     *   0 -- not started, or need more data
+     *  >0 -- the length of the data consumed, the request may still be incomplete
+     */
+    int Feed(const char* buf, int len, string& err_msg);
+    
+    bool IsStarted() { return argc_ >= 0; }
+    bool IsComplete() { return (argc_ >= 0) && ((long)args_.size() == argc_) && (bulk_left_ == 0); }
+    const vector<rocksdb::Slice>& GetArgs(); // the arguments of a complete request, the sink argument is empty
+    RedisBulkSink* GetSink() { return sink_; }
+    void Reset();
+private:
+    void _StartBulk(long len);
+    void _ReceiveBulk(const char* buf, int len);
+private:
+    long            argc_;      // -1 if the request is not started
+    vector<string>  args_;
+    vector<rocksdb::Slice> arg_vec_;
+    long            bulk_left_; // the remaining length of the receiving big bulk argument, including "\r\n"
+    RedisBulkSink*  sink_;
+    int             sink_arg_idx_;
+    RedisBulkSinkCreator sink_creator_;
+    void*           sink_data_;
+};
+
 /*
  * 返回值:
  *  -1 -- 解析失败，redis格式出错
@@ -64,9 +130,13 @@ int parse_redis_request(const char* redis_cmd, int redis_len, vector<string>& cm
  */
 int parse_redis_response(const char* redis_resp, int redis_len, RedisReply& reply);
 
+// case insensitive compare for an argument from the zero-copy parser, which is not null terminated
+bool arg_equal_nocase(const rocksdb::Slice& arg, const char* str);
+
 int build_prefix(char* buf, int len, char start_char, int size);
 
 void build_request(const vector<string>& cmd_vec, string& request);
+void build_request(const vector<rocksdb::Slice>& arg_vec, string& request);
 
 void build_response(const vector<string>& cmd_vec, string& response);
 
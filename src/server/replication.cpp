@@ -53,7 +53,7 @@ void psync_command(ClientConn* conn, const vector<string>& cmd_vec)
         string resp = "+FULLRESYNC\r\n";
         conn->Send((void*)resp.data(), (int)resp.size());
         
-        uint64_t start_tick = get_tick_count();
+        uint64_t start_us = get_monotonic_us();
         spinlock_all();
         
         const rocksdb::Snapshot* snapshot = g_server.db->GetSnapshot();
@@ -62,8 +62,8 @@ void psync_command(ClientConn* conn, const vector<string>& cmd_vec)
         assert(snapshot);
         ReplicationSnapshot* repl_snapshot = new ReplicationSnapshot(snapshot);
         unlock_all();
-        uint64_t cost_tick = get_tick_count() - start_tick;
-        log_message(kLogLevelInfo, "GetSnapshot takes %lu ms\n", cost_tick);
+        uint64_t cost_us = get_monotonic_us() - start_us;
+        log_message(kLogLevelInfo, "GetSnapshot takes %lu us\n", cost_us);
         
         conn->SetReplSnapshot(repl_snapshot);
         conn->SetSyncSeq(max_seq + 1);
@@ -71,6 +71,7 @@ void psync_command(ClientConn* conn, const vector<string>& cmd_vec)
     }
     
     conn->SetFlag(CLIENT_SLAVE);
+    conn->RegisterLoopHook(); // binlog is sent to the slave in OnLoop()
     
     g_server.slave_mutex.lock();
     g_server.slaves.push_back(conn);
@@ -147,8 +148,9 @@ void replication_cron()
     if ((g_server.master_handle == NETLIB_INVALID_HANDLE) && !g_server.master_host.empty()) {
         ClientConn* conn = new ClientConn();
         conn->SetFlag(CLIENT_MASTER);
-        g_server.master_handle = conn->Connect(g_server.master_host, g_server.master_port);
+        // set the status before connecting, OnConfirm() may run in an io thread before Connect() returns
         g_server.master_link_status = "connecting";
+        g_server.master_handle = conn->Connect(g_server.master_host, g_server.master_port);
         log_message(kLogLevelInfo, "Connect to master %s:%d\n", g_server.master_host.c_str(), g_server.master_port);
     }
 }
@@ -192,7 +194,7 @@ ReplicationSnapshot::~ReplicationSnapshot()
 
 void ReplicationSnapshot::SendTo(ClientConn* conn)
 {
-    uint64_t now = get_tick_count();
+    uint64_t now = get_wall_time_ms();
     while (!conn->IsBusy()) {
         if (IsCompelte()) {
             return;
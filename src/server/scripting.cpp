@@ -0,0 +1,665 @@
+//
+//  scripting.cpp
+//  kedis
+//
+
+#include "scripting.h"
+#include "transaction.h"
+#include "key_lock.h"
+#include "command_table.h"
+
+extern "C" {
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+}
+
+// the script bodies by the SHA1 in lower case hex, shared by all the threads
+static mutex g_script_mtx;
+static unordered_map<string, string> g_script_map;
+// increased by SCRIPT FLUSH, every thread recreates its interpreter to drop the functions defined before
+static atomic<uint64_t> g_script_epoch(0);
+// increased by SCRIPT KILL, the scripts started before it are aborted
+static atomic<uint64_t> g_script_kill_epoch(0);
+static atomic<int> g_running_script_count(0);
+
+// the hook checking the time limit and SCRIPT KILL runs every this many instructions of a script
+static const int kScriptHookInstructions = 100000;
+
+// every thread running scripts has its own interpreter, the other fields are set while a script runs
+struct LuaContext {
+    lua_State*          lua;
+    uint64_t            epoch;
+    ClientConn*         conn;
+    const set<string>*  keys;   // the keys declared in KEYS, which are locked
+    Transaction         transaction;
+    uint64_t            deadline_us;    // the script is aborted after it, 0 for no limit
+    uint64_t            kill_epoch;     // g_script_kill_epoch when the script started
+    const char*         abort_error;    // set when the script is aborted
+
+    LuaContext() : lua(NULL), epoch(0), conn(NULL), keys(NULL), deadline_us(0), kill_epoch(0), abort_error(NULL) {}
+};
+
+static thread_local LuaContext* t_lua_ctx = NULL;
+
+static inline uint32_t sha1_rol(uint32_t value, int bits)
+{
+    return (value << bits) | (value >> (32 - bits));
+}
+
+static string sha1_hex(const char* data, size_t len)
+{
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+    // pad the message with 0x80, zeros and the bit length in big endian to a multiple of 64 bytes
+    string msg(data, len);
+    uint64_t bit_len = (uint64_t)len * 8;
+    msg.push_back((char)0x80);
+    while (msg.size() % 64 != 56) {
+        msg.push_back(0);
+    }
+    for (int i = 7; i >= 0; i--) {
+        msg.push_back((char)(bit_len >> (i * 8)));
+    }
+
+    for (size_t offset = 0; offset < msg.size(); offset += 64) {
+        const unsigned char* block = (const unsigned char*)msg.data() + offset;
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++) {
+            w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) |
+                ((uint32_t)block[i * 4 + 2] << 8) | (uint32_t)block[i * 4 + 3];
+        }
+        for (int i = 16; i < 80; i++) {
+            w[i] = sha1_rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t temp = sha1_rol(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = sha1_rol(b, 30);
+            b = a;
+            a = temp;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+
+    char hex[41];
+    for (int i = 0; i < 5; i++) {
+        snprintf(hex + i * 8, 9, "%08x", h[i]);
+    }
+    return string(hex, 40);
+}
+
+static string lower_sha(const string& str)
+{
+    string sha = str;
+    for (size_t i = 0; i < sha.size(); i++) {
+        sha[i] = tolower(sha[i]);
+    }
+    return sha;
+}
+
+static void cache_script(const string& sha, const string& body)
+{
+    lock_guard<mutex> guard(g_script_mtx);
+    g_script_map.emplace(sha, body);
+}
+
+static bool get_cached_script(const string& sha, string& body)
+{
+    lock_guard<mutex> guard(g_script_mtx);
+    auto it = g_script_map.find(sha);
+    if (it == g_script_map.end()) {
+        return false;
+    }
+
+    body = it->second;
+    return true;
+}
+
+static void push_error_table(lua_State* lua, const char* error_msg)
+{
+    lua_newtable(lua);
+    lua_pushstring(lua, "err");
+    lua_pushstring(lua, error_msg);
+    lua_settable(lua, -3);
+}
+
+// integer -> number, bulk -> string, nil -> false, status -> {ok=...}, error -> {err=...}, array -> table
+static void push_redis_reply(lua_State* lua, const RedisReply& reply)
+{
+    switch (reply.GetType()) {
+        case REDIS_TYPE_STRING:
+            lua_pushlstring(lua, reply.GetStrValue().data(), reply.GetStrValue().size());
+            break;
+        case REDIS_TYPE_INTEGER:
+            lua_pushnumber(lua, (lua_Number)reply.GetIntValue());
+            break;
+        case REDIS_TYPE_STATUS:
+        case REDIS_TYPE_ERROR:
+            lua_newtable(lua);
+            lua_pushstring(lua, (reply.GetType() == REDIS_TYPE_STATUS) ? "ok" : "err");
+            lua_pushlstring(lua, reply.GetStrValue().data(), reply.GetStrValue().size());
+            lua_settable(lua, -3);
+            break;
+        case REDIS_TYPE_ARRAY: {
+            const vector<RedisReply>& elements = reply.GetElements();
+            lua_newtable(lua);
+            for (size_t i = 0; i < elements.size(); i++) {
+                push_redis_reply(lua, elements[i]);
+                lua_rawseti(lua, -2, (int)i + 1);
+            }
+            break;
+        }
+        default:
+            lua_pushboolean(lua, 0);
+            break;
+    }
+}
+
+// push the reply of the command called with the arguments on the stack, return true if it is an error table
+static bool call_command(lua_State* lua)
+{
+    int argc = lua_gettop(lua);
+    if (argc == 0) {
+        push_error_table(lua, "ERR Please specify at least one argument for redis.call()");
+        return true;
+    }
+
+    vector<string> args;
+    args.reserve(argc);
+    for (int i = 1; i <= argc; i++) {
+        if (!lua_isstring(lua, i)) {
+            push_error_table(lua, "ERR Lua redis() command arguments must be strings or integers");
+            return true;
+        }
+
+        size_t len;
+        const char* arg = lua_tolstring(lua, i, &len);
+        args.emplace_back(arg, len);
+    }
+
+    vector<rocksdb::Slice> arg_vec(args.begin(), args.end());
+    KedisCommand* kedis_cmd = lookup_command(arg_vec[0]);
+    if (!kedis_cmd) {
+        push_error_table(lua, "ERR Unknown Redis command called from Lua script");
+        return true;
+    }
+
+    if (!can_queue_command(kedis_cmd)) {
+        push_error_table(lua, "ERR This Redis command is not allowed from scripts");
+        return true;
+    }
+
+    // only the keys in KEYS are locked, a command with other keys may deadlock with another script
+    vector<int> key_indexes;
+    get_command_key_indexes(kedis_cmd, argc, key_indexes);
+    for (int i : key_indexes) {
+        if (!t_lua_ctx->keys->count(args[i])) {
+            push_error_table(lua, "ERR Lua script accessed a key that is not declared in KEYS");
+            return true;
+        }
+    }
+
+    string reply_buf;
+    RedisReply reply;
+    t_lua_ctx->conn->CallCommand(arg_vec, reply_buf);
+    if (parse_redis_response(reply_buf.data(), (int)reply_buf.size(), reply) <= 0) {
+        push_error_table(lua, "ERR The command called from Lua script has no reply");
+        return true;
+    }
+
+    push_redis_reply(lua, reply);
+    return reply.GetType() == REDIS_TYPE_ERROR;
+}
+
+static int lua_redis_generic_call(lua_State* lua, bool raise_error)
+{
+    // lua_error() jumps out of the function, so it is only called after the C++ objects of the call are released
+    if (call_command(lua) && raise_error) {
+        lua_getfield(lua, -1, "err");
+        luaL_where(lua, 1);
+        lua_insert(lua, -2);
+        lua_concat(lua, 2);
+        return lua_error(lua);
+    }
+    return 1;
+}
+
+static int lua_redis_call(lua_State* lua)
+{
+    return lua_redis_generic_call(lua, true);
+}
+
+static int lua_redis_pcall(lua_State* lua)
+{
+    return lua_redis_generic_call(lua, false);
+}
+
+static int lua_redis_sha1hex(lua_State* lua)
+{
+    if (lua_gettop(lua) != 1) {
+        lua_pushstring(lua, "wrong number of arguments");
+        return lua_error(lua);
+    }
+
+    size_t len;
+    const char* data = lua_tolstring(lua, 1, &len);
+    char hex[41];
+    snprintf(hex, sizeof(hex), "%s", sha1_hex(data ? data : "", data ? len : 0).c_str());
+    lua_pushstring(lua, hex);
+    return 1;
+}
+
+static int lua_redis_return_table(lua_State* lua, const char* field)
+{
+    if ((lua_gettop(lua) != 1) || (lua_type(lua, -1) != LUA_TSTRING)) {
+        lua_pushstring(lua, "wrong number or type of arguments");
+        return lua_error(lua);
+    }
+
+    lua_newtable(lua);
+    lua_pushstring(lua, field);
+    lua_pushvalue(lua, -3);
+    lua_settable(lua, -3);
+    return 1;
+}
+
+static int lua_redis_error_reply(lua_State* lua)
+{
+    return lua_redis_return_table(lua, "err");
+}
+
+static int lua_redis_status_reply(lua_State* lua)
+{
+    return lua_redis_return_table(lua, "ok");
+}
+
+// raise an error in a script running too long or killed, so lua_pcall() returns and the keys are unlocked
+static void lua_script_hook(lua_State* lua, lua_Debug* ar)
+{
+    LuaContext* ctx = t_lua_ctx;
+    if (!ctx->conn) {
+        return;     // compiling a script
+    }
+
+    if (!ctx->abort_error) {
+        if (g_script_kill_epoch.load() != ctx->kill_epoch) {
+            ctx->abort_error = "Script killed by user with SCRIPT KILL";
+        } else if (ctx->deadline_us && (get_monotonic_us() >= ctx->deadline_us)) {
+            ctx->abort_error = "Script exceeded lua-time-limit";
+        }
+    }
+
+    if (ctx->abort_error) {
+        luaL_error(lua, "%s", ctx->abort_error);
+    }
+}
+
+// call the original function in the upvalue, then raise the error again if the script is aborted meanwhile,
+// so a script can not catch the error of the hook with pcall(), xpcall() or coroutine.resume()
+static int lua_abortable_call(lua_State* lua)
+{
+    lua_pushvalue(lua, lua_upvalueindex(1));
+    lua_insert(lua, 1);
+    lua_call(lua, lua_gettop(lua) - 1, LUA_MULTRET);
+    if (t_lua_ctx->abort_error) {
+        return luaL_error(lua, "%s", t_lua_ctx->abort_error);
+    }
+    return lua_gettop(lua);
+}
+
+// replace the function of the table on the top of the stack
+static void wrap_abortable_function(lua_State* lua, const char* name)
+{
+    lua_getfield(lua, -1, name);
+    lua_pushcclosure(lua, lua_abortable_call, 1);
+    lua_setfield(lua, -2, name);
+}
+
+static void load_lua_lib(lua_State* lua, const char* name, lua_CFunction func)
+{
+    lua_pushcfunction(lua, func);
+    lua_pushstring(lua, name);
+    lua_call(lua, 1, 0);
+}
+
+static void set_lua_function(lua_State* lua, const char* name, lua_CFunction func)
+{
+    lua_pushstring(lua, name);
+    lua_pushcfunction(lua, func);
+    lua_settable(lua, -3);
+}
+
+static lua_State* create_lua()
+{
+    lua_State* lua = luaL_newstate();
+
+    // no io, os and package, a script only reaches the database through redis.call()
+    load_lua_lib(lua, "", luaopen_base);
+    load_lua_lib(lua, LUA_TABLIBNAME, luaopen_table);
+    load_lua_lib(lua, LUA_STRLIBNAME, luaopen_string);
+    load_lua_lib(lua, LUA_MATHLIBNAME, luaopen_math);
+    lua_pushnil(lua);
+    lua_setglobal(lua, "loadfile");
+    lua_pushnil(lua);
+    lua_setglobal(lua, "dofile");
+
+    lua_pushvalue(lua, LUA_GLOBALSINDEX);
+    wrap_abortable_function(lua, "pcall");
+    wrap_abortable_function(lua, "xpcall");
+    lua_pop(lua, 1);
+    lua_getglobal(lua, "coroutine");
+    wrap_abortable_function(lua, "resume");
+    lua_pop(lua, 1);
+
+    lua_newtable(lua);
+    set_lua_function(lua, "call", lua_redis_call);
+    set_lua_function(lua, "pcall", lua_redis_pcall);
+    set_lua_function(lua, "sha1hex", lua_redis_sha1hex);
+    set_lua_function(lua, "error_reply", lua_redis_error_reply);
+    set_lua_function(lua, "status_reply", lua_redis_status_reply);
+    lua_setglobal(lua, "redis");
+
+    lua_sethook(lua, lua_script_hook, LUA_MASKCOUNT, kScriptHookInstructions);
+    return lua;
+}
+
+static LuaContext* get_lua_context()
+{
+    if (!t_lua_ctx) {
+        t_lua_ctx = new LuaContext();
+    }
+
+    uint64_t epoch = g_script_epoch.load();
+    if (!t_lua_ctx->lua || (t_lua_ctx->epoch != epoch)) {
+        if (t_lua_ctx->lua) {
+            lua_close(t_lua_ctx->lua);
+        }
+        t_lua_ctx->lua = create_lua();
+        t_lua_ctx->epoch = epoch;
+    }
+    return t_lua_ctx;
+}
+
+// define the global function f_<sha> with the body, the function is left on the stack
+static bool define_lua_function(lua_State* lua, const string& func_name, const string& body, string& error_msg)
+{
+    lua_getglobal(lua, func_name.c_str());
+    if (!lua_isnil(lua, -1)) {
+        return true;
+    }
+    lua_pop(lua, 1);
+
+    string func_def = "function " + func_name + "() " + body + "\nend";
+    if (luaL_loadbuffer(lua, func_def.data(), func_def.size(), "@user_script") || lua_pcall(lua, 0, 0, 0)) {
+        const char* msg = lua_tostring(lua, -1);
+        error_msg = "Error compiling script (new function): " + string(msg ? msg : "unknown error");
+        lua_pop(lua, 1);
+        return false;
+    }
+
+    lua_getglobal(lua, func_name.c_str());
+    return true;
+}
+
+static void set_lua_array(lua_State* lua, const char* name, const vector<string>& cmd_vec, int start, int count)
+{
+    lua_newtable(lua);
+    for (int i = 0; i < count; i++) {
+        lua_pushlstring(lua, cmd_vec[start + i].data(), cmd_vec[start + i].size());
+        lua_rawseti(lua, -2, i + 1);
+    }
+    lua_setglobal(lua, name);
+}
+
+static void append_error_line(string& resp, char prefix, const char* msg, size_t len)
+{
+    // the reply must be one line
+    resp.push_back(prefix);
+    for (size_t i = 0; i < len; i++) {
+        resp.push_back(((msg[i] == '\r') || (msg[i] == '\n')) ? ' ' : msg[i]);
+    }
+    resp.append("\r\n");
+}
+
+// string -> bulk, number -> integer, true -> 1, false and nil -> nil, {err=...} -> error, {ok=...} -> status,
+// other tables -> array of the elements until the first nil. the value on the top of the stack is popped
+static void append_lua_reply(lua_State* lua, string& resp)
+{
+    char buf[64];
+    switch (lua_type(lua, -1)) {
+        case LUA_TSTRING: {
+            size_t len;
+            const char* str = lua_tolstring(lua, -1, &len);
+            int pos = build_prefix(buf, sizeof(buf), '$', (int)len);
+            resp.append(buf + pos);
+            resp.append(str, len);
+            resp.append("\r\n");
+            break;
+        }
+        case LUA_TBOOLEAN:
+            resp.append(lua_toboolean(lua, -1) ? ":1\r\n" : kNullBulkString);
+            break;
+        case LUA_TNUMBER:
+            snprintf(buf, sizeof(buf), ":%lld\r\n", (long long)lua_tonumber(lua, -1));
+            resp.append(buf);
+            break;
+        case LUA_TTABLE: {
+            lua_getfield(lua, -1, "err");
+            if (lua_type(lua, -1) == LUA_TSTRING) {
+                size_t len;
+                const char* msg = lua_tolstring(lua, -1, &len);
+                append_error_line(resp, '-', msg, len);
+                lua_pop(lua, 1);
+                break;
+            }
+            lua_pop(lua, 1);
+
+            lua_getfield(lua, -1, "ok");
+            if (lua_type(lua, -1) == LUA_TSTRING) {
+                size_t len;
+                const char* msg = lua_tolstring(lua, -1, &len);
+                append_error_line(resp, '+', msg, len);
+                lua_pop(lua, 1);
+                break;
+            }
+            lua_pop(lua, 1);
+
+            string elements;
+            int count = 0;
+            while (true) {
+                lua_rawgeti(lua, -1, count + 1);
+                if (lua_isnil(lua, -1)) {
+                    lua_pop(lua, 1);
+                    break;
+                }
+                append_lua_reply(lua, elements);
+                count++;
+            }
+            int pos = build_prefix(buf, sizeof(buf), '*', count);
+            resp.append(buf + pos);
+            resp.append(elements);
+            break;
+        }
+        default:
+            resp.append(kNullBulkString);
+            break;
+    }
+    lua_pop(lua, 1);
+}
+
+static void eval_generic(ClientConn* conn, const vector<string>& cmd_vec, bool is_sha)
+{
+    long numkeys;
+    if (get_long_from_string(cmd_vec[2], numkeys) == CODE_ERROR) {
+        conn->SendError("value is not an integer or out of range");
+        return;
+    }
+
+    int argc = (int)cmd_vec.size();
+    if (numkeys > argc - 3) {
+        conn->SendError("Number of keys can't be greater than number of args");
+        return;
+    } else if (numkeys < 0) {
+        conn->SendError("Number of keys can't be negative");
+        return;
+    }
+
+    string sha;
+    if (is_sha) {
+        sha = lower_sha(cmd_vec[1]);
+    } else {
+        sha = sha1_hex(cmd_vec[1].data(), cmd_vec[1].size());
+    }
+
+    LuaContext* ctx = get_lua_context();
+    lua_State* lua = ctx->lua;
+    string func_name = "f_" + sha;
+    string error_msg;
+    if (is_sha) {
+        string body;
+        lua_getglobal(lua, func_name.c_str());
+        bool defined = !lua_isnil(lua, -1);
+        lua_pop(lua, 1);
+        if (!defined && !get_cached_script(sha, body)) {
+            conn->SendRawResponse("-NOSCRIPT No matching script. Please use EVAL.\r\n");
+            return;
+        }
+        if (!define_lua_function(lua, func_name, body, error_msg)) {
+            conn->SendError(error_msg);
+            return;
+        }
+    } else {
+        if (!define_lua_function(lua, func_name, cmd_vec[1], error_msg)) {
+            conn->SendError(error_msg);
+            return;
+        }
+        cache_script(sha, cmd_vec[1]);
+    }
+
+    set_lua_array(lua, "KEYS", cmd_vec, 3, (int)numkeys);
+    set_lua_array(lua, "ARGV", cmd_vec, 3 + (int)numkeys, argc - 3 - (int)numkeys);
+
+    // the writes before an error in the script are committed too
+    set<string> keys(cmd_vec.begin() + 3, cmd_vec.begin() + 3 + numkeys);
+    int db_idx = conn->GetDBIndex();
+    int ret;
+    bool committed;
+    {
+        TransactionLockGuard lock_guard(db_idx, keys);
+        ctx->conn = conn;
+        ctx->keys = &keys;
+        ctx->transaction.Run(db_idx);
+        ctx->deadline_us = g_server.lua_time_limit ? get_monotonic_us() + g_server.lua_time_limit * 1000ULL : 0;
+        ctx->kill_epoch = g_script_kill_epoch.load();
+        ctx->abort_error = NULL;
+        g_running_script_count++;
+        ret = lua_pcall(lua, 0, 1, 0);
+        g_running_script_count--;
+        committed = ctx->transaction.Commit();
+        ctx->conn = NULL;
+        ctx->keys = NULL;
+    }
+
+    if (!committed) {
+        // the writes of the script are lost, its reply is not sent
+        lua_pop(lua, 1);
+        conn->SendError("db error");
+        return;
+    }
+
+    if (ret) {
+        // an error raised with a table is the err field of the table
+        if (lua_istable(lua, -1)) {
+            lua_getfield(lua, -1, "err");
+            lua_remove(lua, -2);
+        }
+        const char* msg = lua_tostring(lua, -1);
+        error_msg = "ERR Error running script (call to " + func_name + "): " + string(msg ? msg : "unknown error");
+        lua_pop(lua, 1);
+
+        string resp;
+        append_error_line(resp, '-', error_msg.data(), error_msg.size());
+        conn->SendRawResponse(resp);
+        return;
+    }
+
+    string resp;
+    append_lua_reply(lua, resp);
+    conn->SendRawResponse(resp);
+}
+
+void eval_command(ClientConn* conn, const vector<string>& cmd_vec)
+{
+    eval_generic(conn, cmd_vec, false);
+}
+
+void evalsha_command(ClientConn* conn, const vector<string>& cmd_vec)
+{
+    eval_generic(conn, cmd_vec, true);
+}
+
+void script_command(ClientConn* conn, const vector<string>& cmd_vec)
+{
+    int cmd_size = (int)cmd_vec.size();
+    if (!strcasecmp(cmd_vec[1].c_str(), "load") && (cmd_size == 3)) {
+        // compiled in the interpreter of this thread to check the syntax
+        string sha = sha1_hex(cmd_vec[2].data(), cmd_vec[2].size());
+        string error_msg;
+        lua_State* lua = get_lua_context()->lua;
+        if (!define_lua_function(lua, "f_" + sha, cmd_vec[2], error_msg)) {
+            conn->SendError(error_msg);
+            return;
+        }
+        lua_pop(lua, 1);
+
+        cache_script(sha, cmd_vec[2]);
+        conn->SendBulkString(sha);
+    } else if (!strcasecmp(cmd_vec[1].c_str(), "exists") && (cmd_size >= 3)) {
+        conn->SendMultiBuldLen(cmd_size - 2);
+        for (int i = 2; i < cmd_size; i++) {
+            string sha = lower_sha(cmd_vec[i]);
+            lock_guard<mutex> guard(g_script_mtx);
+            conn->SendInteger(g_script_map.count(sha));
+        }
+    } else if (!strcasecmp(cmd_vec[1].c_str(), "flush") && (cmd_size == 2)) {
+        g_script_mtx.lock();
+        g_script_map.clear();
+        g_script_epoch++;
+        g_script_mtx.unlock();
+
+        conn->SendRawResponse(kOKString);
+    } else if (!strcasecmp(cmd_vec[1].c_str(), "kill") && (cmd_size == 2)) {
+        // SCRIPT runs in the io thread, so it is not queued behind a script running in a storage thread
+        if (g_running_script_count == 0) {
+            conn->SendRawResponse("-NOTBUSY No scripts in execution right now.\r\n");
+            return;
+        }
+
+        g_script_kill_epoch++;
+        conn->SendRawResponse(kOKString);
+    } else {
+        conn->SendError("Unknown SCRIPT subcommand or wrong # of args. Try LOAD, EXISTS, FLUSH, KILL");
+    }
+}
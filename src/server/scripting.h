@@ -0,0 +1,23 @@
+//
+//  scripting.h
+//  kedis
+//
+
+#ifndef __SCRIPTING_H__
+#define __SCRIPTING_H__
+
+#include "server.h"
+
+/*
+ * EVAL/EVALSHA run a Lua script in the thread of the command, with the keys in KEYS locked like EXEC.
+ * redis.call() looks up the command and calls its handler directly, the reply is converted to Lua values,
+ * the writes of all the calls go to one write batch and their binlog to one record, see Transaction.
+ * the script bodies are cached by the SHA1 of the body and shared by all the threads, every thread running scripts
+ * has its own interpreter, which defines the function of a cached script at its first call in the thread.
+ * a script running longer than lua-time-limit, or killed by SCRIPT KILL, is aborted with an error by a count hook
+ */
+void eval_command(ClientConn* conn, const vector<string>& cmd_vec);
+void evalsha_command(ClientConn* conn, const vector<string>& cmd_vec);
+void script_command(ClientConn* conn, const vector<string>& cmd_vec);
+
+#endif /* __SCRIPTING_H__ */
@@ -27,6 +27,8 @@
 #include "encoding.h"
 #include "db_util.h"
 #include "expire_thread.h"
+#include "storage_pool.h"
+#include "read_coalesce.h"
 
 KedisServer g_server;
 KedisStat g_stat;
@@ -43,6 +45,14 @@ void init_server_config()
     g_server.log_level = kLogLevelInfo;
     g_server.log_path = "log";
     g_server.io_thread_num = 16;
+    g_server.io_thread_reuseport = false;
+    g_server.io_backend = IO_BACKEND_EPOLL;
+    g_server.io_thread_placement = IO_PLACEMENT_ROUND_ROBIN;
+    g_server.storage_thread_num = 0;
+    g_server.group_commit = true;
+    g_server.read_coalesce = false;
+    g_server.read_coalesce_window = 0;
+    g_server.lua_time_limit = 5000;
     g_server.db_name = "kdb";
     g_server.db_num = 16;
     g_server.key_count_file = "key-count";
@@ -56,6 +66,10 @@ void init_server_config()
     g_server.slowlog_log_slower_than = 10; // milliseconds
     g_server.slowlog_max_len = 128;
     g_server.hll_sparse_max_bytes = 3000;
+    g_server.command_time_slice = 1000;
+    g_server.client_command_quota = 1000;
+    g_server.client_obuf_limits[CLIENT_CLASS_NORMAL] = {0, 0, 0};
+    g_server.client_obuf_limits[CLIENT_CLASS_SLAVE] = {256 * 1024 * 1024, 64 * 1024 * 1024, 60};
     
     g_server.db = NULL;
     g_server.master_handle = NETLIB_INVALID_HANDLE;
@@ -63,141 +77,7 @@ void init_server_config()
     g_server.client_num = 0;
     g_server.repl_snapshot_count = 0;
     
-    g_server.kedis_commands = {
-        // DB commands
-        {"AUTH", {auth_command, 2, false}},
-        {"PING", {ping_command, 1, false}},
-        {"ECHO", {echo_command, 2, false}},
-        {"SELECT", {select_command, 2, false}},
-        {"DBSIZE", {dbsize_command, 1, false}},
-        {"INFO", {info_command, -1, false}},
-        {"FLUSHDB", {flushdb_command, 1, false}},
-        {"FLUSHALL", {flushall_command, 1, false}},
-        {"DEBUG", {debug_command, -2, false}},
-        {"COMMAND", {command_command, 1, false}},
-        {"CONFIG", {config_command, -2, false}},
-        
-        // replication
-        {"REPLCONF", {replconf_command, -3, false}},
-        {"PSYNC", {psync_command, 3, false}},
-        {"SLAVEOF", {slaveof_command, 3, false}},
-        {"REPL_SNAPSHOT_COMPLETE", {repl_snapshot_complete_command, 4, false}},
-        
-        // migrate
-        {"MIGRATE", {migrate_command, -6, true}},
-        {"RESTORE", {restore_command, 4, true}},
-        {"DUMP", {dump_command, 2, false}},
-        
-        // keys commands
-        {"DEL", {del_command, -2, true}},
-        {"EXISTS", {exists_command, 2, false}},
-        {"TTL", {ttl_command, 2, false}},
-        {"PTTL", {pttl_command, 2, false}},
-        {"TYPE", {type_command, 2, false}},
-        {"EXPIRE", {expire_command, 3, true}},
-        {"EXPIREAT", {expireat_command, 3, true}},
-        {"PEXPIRE", {pexpire_command, 3, true}},
-        {"PEXPIREAT", {pexpireat_command, 3, true}},
-        {"PERSIST", {persist_command, 2, true}},
-        {"RANDOMKEY", {randomkey_command, 1, false}},
-        {"KEYS", {keys_command, 2, false}},
-        {"SCAN", {scan_command, -2, false}},
-        
-        // string commands
-        {"GET", {get_command, 2, false}},
-        {"GETSET", {getset_command, 3, true}},
-        {"SET", {set_command, -3, true}},
-        {"SETEX", {setex_command, 4, true}},
-        {"SETNX", {setnx_command, 3, true}},
-        {"PSETEX", {psetex_command, 4, true}},
-        {"MSET", {mset_command, -3, true}},
-        {"MSETNX", {msetnx_command, -3, true}},
-        {"MGET", {mget_command, -2, false}},
-        {"APPEND", {append_command, 3, true}},
-        {"GETRANGE", {getrange_command, 4, false}},
-        {"SETRANGE", {setrange_command, 4, true}},
-        {"STRLEN", {strlen_command, 2, false}},
-        {"INCR", {incr_command, 2, true}},
-        {"DECR", {decr_command, 2, true}},
-        {"INCRBY", {incrby_command, 3, true}},
-        {"DECRBY", {decrby_command, 3, true}},
-        {"INCRBYFLOAT", {incrbyfloat_command, 3, true}},
-        {"SETBIT", {setbit_command, 4, true}},
-        {"GETBIT", {getbit_command, 3, false}},
-        {"BITCOUNT", {bitcount_command, -2, false}},
-        {"BITPOS", {bitpos_command, -3, false}},
-        
-        // hash commands
-        {"HDEL", {hdel_command, -3, true}},
-        {"HEXISTS", {hexists_command, 3, false}},
-        {"HGET", {hget_command, 3, false}},
-        {"HGETALL", {hgetall_command, 2, false}},
-        {"HKEYS", {hkeys_command, 2, false}},
-        {"HVALS", {hvals_command, 2, false}},
-        {"HINCRBY", {hincrby_command, 4, true}},
-        {"HINCRBYFLOAT", {hincrbyfloat_command, 4, true}},
-        {"HLEN", {hlen_command, 2, false}},
-        {"HMGET", {hmget_command, -3, false}},
-        {"HMSET", {hmset_command, -4, true}},
-        {"HSCAN", {hscan_command, -3, false}},
-        {"HSET", {hset_command, 4, true}},
-        {"HSETNX", {hsetnx_command, 4, true}},
-        {"HSTRLEN", {hstrlen_command, 3, false}},
-        
-        // list commands
-        {"LINDEX", {lindex_command, 3, false}},
-        {"LINSERT", {linsert_command, 5, true}},
-        {"LLEN", {llen_command, 2, false}},
-        {"LPUSH", {lpush_command, -3, true}},
-        {"LPOP", {lpop_command, 2, true}},
-        {"LRANGE", {lrange_command, 4, false}},
-        {"RPUSH", {rpush_command, -3, true}},
-        {"RPOP", {rpop_command, 2, true}},
-        {"LPUSHX", {lpushx_command, 3, true}},
-        {"RPUSHX", {rpushx_command, 3, true}},
-        {"LREM", {lrem_command, 4, true}},
-        {"LSET", {lset_command, 4, true}},
-        {"LTRIM", {ltrim_command, 4, true}},
-        
-        // set commands
-        {"SADD", {sadd_command, -3, true}},
-        {"SCARD", {scard_command, 2, false}},
-        {"SISMEMBER", {sismember_command, 3, false}},
-        {"SMEMBERS", {smembers_command, 2, false}},
-        {"SPOP", {spop_command, -2, true}},
-        {"SRANDMEMBER", {srandmember_command, -2, false}},
-        {"SREM", {srem_command, -3, true}},
-        {"SSCAN", {sscan_command, -3, false}},
-        
-        // zset commands
-        {"ZADD", {zadd_command, -4, true}},
-        {"ZINCRBY", {zincrby_command, 4, true}},
-        {"ZCARD", {zcard_command, 2, false}},
-        {"ZCOUNT", {zcount_command, 4, false}},
-        {"ZRANGE", {zrange_command, -4, false}},
-        {"ZREVRANGE", {zrevrange_command, -4, false}},
-        {"ZRANGEBYSCORE", {zrangebyscore_command, -4, false}},
-        {"ZREVRANGEBYSCORE", {zrevrangebyscore_command, -4, false}},
-        {"ZRANGEBYLEX", {zrangebylex_command, -4, false}},
-        {"ZREVRANGEBYLEX", {zrevrangebylex_command, -4, false}},
-        {"ZLEXCOUNT", {zlexcount_command, 4, false}},
-        {"ZRANK", {zrank_command, 3, false}},
-        {"ZREVRANK", {zrevrank_command, 3, false}},
-        {"ZREM", {zrem_command, -3, true}},
-        {"ZREMRANGEBYLEX", {zremrangebylex_command, 4, true}},
-        {"ZREMRANGEBYRANK", {zremrangebyrank_command, 4, true}},
-        {"ZREMRANGEBYSCORE", {zremrangebyscore_command, 4, true}},
-        {"ZSCORE", {zscore_command, 3, false}},
-        {"ZSCAN", {zscan_command, -3, false}},
-        
-        // hyperloglog
-        {"PFADD", {pfadd_command, -2, true}},
-        {"PFCOUNT", {pfcount_command, -2, false}},
-        {"PFMERGE", {pfmerge_command, -3, true}},
-        
-        // slowlog
-        {"SLOWLOG", {slowlog_command, -2, false}},
-    };
+    init_command_table();
 }
 
 void init_rocksdb_options()
@@ -285,11 +165,11 @@ void init_key_count()
 {
     g_server.key_count_vec = new atomic<long> [g_server.db_num];
     g_server.ttl_key_count_vec = new atomic<long> [g_server.db_num];
-    g_server.operating_count_vec = new atomic<long> [g_server.db_num];
+    g_server.flush_count_vec = new atomic<long> [g_server.db_num];
     for (int i = 0; i < g_server.db_num; i++) {
         g_server.key_count_vec[i] = 0;
         g_server.ttl_key_count_vec[i] = 0;
-        g_server.operating_count_vec[i] = 0;
+        g_server.flush_count_vec[i] = 0;
     }
     
     // get key count from file
@@ -337,7 +217,7 @@ void init_key_count()
                     stream >> key_type;
                     stream >> ttl;
                     if (ttl) {
-                        if (ttl <= get_tick_count()) {
+                        if (ttl <= get_wall_time_ms()) {
                             string key(it->key().data() + 1, it->key().size() - 1);
                             delete_key(i, key, ttl, key_type);
                         } else {
@@ -422,6 +302,7 @@ void shutdown_signal_handler(int sig_no)
 {
     log_message(kLogLevelInfo, "kedis-server stopping...\n");
     
+    g_storage_pool.Stop();  // a running task posts its connection back to the io thread
     destroy_thread_event_loops(g_server.io_thread_num);
     destroy_thread_base_conn(g_server.io_thread_num);
     g_expire_thread.StopThread();
@@ -440,6 +321,15 @@ void shutdown_signal_handler(int sig_no)
     _exit(0);
 }
 
+static int start_client_listen(const string& addr, int port)
+{
+    if (g_server.io_thread_reuseport) {
+        return start_reuseport_listen<ClientConn>(addr, port, g_server.io_thread_num);
+    } else {
+        return start_listen<ClientConn>(addr, port);
+    }
+}
+
 int main(int argc, char* argv[])
 {
     signal(SIGTERM, shutdown_signal_handler);
@@ -460,19 +350,22 @@ int main(int argc, char* argv[])
     
     init_server();
     
-    init_thread_event_loops(g_server.io_thread_num);
+    init_thread_event_loops(g_server.io_thread_num, g_server.io_backend);
     init_thread_base_conn(g_server.io_thread_num);
+    init_read_coalesce(g_server.io_thread_num);
+    set_io_placement_policy(g_server.io_thread_placement);
+    g_storage_pool.Init(g_server.storage_thread_num);
     
     if (g_server.bind_addrs.empty()) {
         log_message(kLogLevelInfo, "listen on port %d\n", g_server.port);
-        if (start_listen<ClientConn>("0.0.0.0", g_server.port)) {
+        if (start_client_listen("0.0.0.0", g_server.port)) {
             log_message(kLogLevelError, "listen on 0.0.0.0:%d failed\n", g_server.port);
             shutdown_signal_handler(0);
         }
     } else {
         for (const string& addr: g_server.bind_addrs) {
             log_message(kLogLevelInfo, "listen on %s:%d\n", addr.c_str(), g_server.port);
-            if (start_listen<ClientConn>(addr, g_server.port)) {
+            if (start_client_listen(addr, g_server.port)) {
                 log_message(kLogLevelError, "listen on %s:%d failed\n", addr.c_str(), g_server.port);
                 shutdown_signal_handler(0);
             }
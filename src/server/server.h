@@ -14,6 +14,7 @@
 #include "client_conn.h"
 #include "binlog.h"
 #include "key_lock.h"
+#include "command_table.h"
 #include "rocksdb/db.h"
 #include "kedis_version.h"
 
@@ -26,12 +27,19 @@
 
 #define MAX_KEY_ITERATOR_COUNT  100000
 
-typedef void (*KedisCommandProc)(ClientConn* conn, const vector<string>& cmd_vec);
+// classes of client-output-buffer-limit
+enum {
+    CLIENT_CLASS_NORMAL = 0,
+    CLIENT_CLASS_SLAVE,
+    CLIENT_CLASS_COUNT,
+};
 
-struct KedisCommand {
-    KedisCommandProc    proc;
-    int                 arity;
-    bool                is_write;
+// the client is closed if the output buffer reaches the hard limit, or stays above the soft limit
+// for more than soft_limit_seconds, 0 means no limit
+struct ClientBufferLimit {
+    uint64_t    hard_limit_bytes;
+    uint64_t    soft_limit_bytes;
+    int         soft_limit_seconds;
 };
 
 // global state for kedis server
@@ -45,6 +53,14 @@ struct KedisServer {
     LogLevel log_level;
     string  log_path;
     int     io_thread_num;
+    bool    io_thread_reuseport;    // every io thread accept connections by itself with SO_REUSEPORT
+    int     io_backend;             // IO_BACKEND_EPOLL or IO_BACKEND_IO_URING
+    int     io_thread_placement;    // IO_PLACEMENT_XXX, how to pick the io thread for a new connection
+    int     storage_thread_num;     // threads that run the commands accessing rocksdb, 0 means in the io threads
+    bool    group_commit;           // merge the write batches of concurrent commands into one write
+    bool    read_coalesce;          // answer the point reads of all the clients of an io thread with one MultiGet
+    int     read_coalesce_window;   // microseconds a batch of coalesced reads waits for more reads, 0 for no wait
+    int     lua_time_limit;         // milliseconds a script can run before it is aborted, 0 for no limit
     string  db_name;
     int     db_num;  // total number of db
     string  binlog_dir;
@@ -59,6 +75,9 @@ struct KedisServer {
     int     slowlog_log_slower_than;
     int     slowlog_max_len;
     int     hll_sparse_max_bytes;
+    int     command_time_slice;     // microseconds a slow command runs before it gives the thread to others, 0 for no limit
+    int     client_command_quota;   // commands of a client run each time it is served, 0 for no limit
+    ClientBufferLimit client_obuf_limits[CLIENT_CLASS_COUNT];
     
     rocksdb::DB* db;
     rocksdb::Options options; // define these 5 rocksdb options here, so optimise can be done in one place
@@ -68,10 +87,9 @@ struct KedisServer {
     rocksdb::WriteOptions write_option;
     
     map<int, rocksdb::ColumnFamilyHandle*> cf_handles_map;
-    map<string, KedisCommand>   kedis_commands;
     atomic<long>* key_count_vec;
     atomic<long>* ttl_key_count_vec;
-    atomic<long>* operating_count_vec; // how many thread are operating rocksdb, used for flushdb
+    atomic<long>* flush_count_vec;  // increased by flushdb, so a sliced command knows the db was flushed between slices
     atomic<long> repl_snapshot_count;
     Binlog  binlog;
     
@@ -94,6 +112,10 @@ struct KedisStat {
     atomic<long> expired_keys;
     atomic<long> keyspace_hits;
     atomic<long> keyspace_missed;
+    atomic<long> client_obuf_limit_disconnections;
+    atomic<long> deferred_pipelines; // times a client used up client-command-quota with requests left
+    atomic<long> coalesced_reads;
+    atomic<long> coalesced_read_batches;
     
     struct {
         uint64_t last_sample_time; // Timestamp of last sample in ms
@@ -109,6 +131,9 @@ struct KedisStat {
         expired_keys = 0;
         keyspace_hits = 0;
         keyspace_missed = 0;
+        client_obuf_limit_disconnections = 0;
+        coalesced_reads = 0;
+        coalesced_read_batches = 0;
         
         for (int j = 0; j < STATS_METRIC_COUNT; j++) {
             inst_metric[j].idx = 0;
@@ -133,16 +158,15 @@ long get_instantaneous_metric(int metric);
 class ScanKeyGuard {
 public:
     ScanKeyGuard(int db_idx) : db_idx_(db_idx) {
-        lock_db(db_idx);
-        g_server.operating_count_vec[db_idx_]++;
-        unlock_db(db_idx);
+        token_ = enter_db(db_idx_);
     }
     
     ~ScanKeyGuard() {
-        g_server.operating_count_vec[db_idx_]--;
+        leave_db(db_idx_, token_);
     }
 private:
     int db_idx_;
+    int token_;
 };
 
 #endif /* __SERVER_H__ */
@@ -0,0 +1,71 @@
+//
+//  sliced_command.cpp
+//  kedis
+//
+
+#include "sliced_command.h"
+#include "server.h"
+#include "key_lock.h"
+#include "db_util.h"
+
+SlicedCommand::SlicedCommand(int db_idx)
+{
+    db_idx_ = db_idx;
+    read_option_ = g_server.read_option;
+    flush_count_ = 0;
+    key_version_ = 0;
+    retry_count_ = 0;
+}
+
+SlicedCommand::~SlicedCommand()
+{
+    ReleaseSnapshot();
+}
+
+void SlicedCommand::TakeSnapshot()
+{
+    ReleaseSnapshot();
+    read_option_.snapshot = g_server.db->GetSnapshot();
+    flush_count_ = g_server.flush_count_vec[db_idx_];
+}
+
+void SlicedCommand::ReleaseSnapshot()
+{
+    if (read_option_.snapshot) {
+        g_server.db->ReleaseSnapshot(read_option_.snapshot);
+        read_option_.snapshot = NULL;
+    }
+}
+
+bool SlicedCommand::IsFlushed()
+{
+    return flush_count_ != g_server.flush_count_vec[db_idx_];
+}
+
+rocksdb::Iterator* SlicedCommand::NewIterator()
+{
+    return db_new_iterator(read_option_, g_server.cf_handles_map[db_idx_]);
+}
+
+void SlicedCommand::WatchKey(const string& key, const string& raw_meta)
+{
+    // the key lock is held, the version increases once more when it is released by this command
+    key_version_ = get_key_version(db_idx_, key) + 1;
+    raw_meta_ = raw_meta;
+}
+
+bool SlicedCommand::IsKeyChanged(const string& key, const string& raw_meta)
+{
+    // the version covers all commands, the meta data covers expire thread and flushdb which do not lock the key
+    return (get_key_version(db_idx_, key) != key_version_) || (raw_meta != raw_meta_) || IsFlushed();
+}
+
+bool SlicedCommand::IsTimeout(uint64_t deadline_us, int& check_count)
+{
+    if (++check_count < kSliceCheckInterval) {
+        return false;
+    }
+
+    check_count = 0;
+    return get_monotonic_us() >= deadline_us;
+}
@@ -0,0 +1,62 @@
+//
+//  sliced_command.h
+//  kedis
+//
+
+#ifndef __SLICED_COMMAND_H__
+#define __SLICED_COMMAND_H__
+
+#include "util.h"
+#include "rocksdb/db.h"
+
+class ClientConn;
+
+// result of a scan step of a sliced command
+enum {
+    SCAN_DONE = 0,
+    SCAN_MORE,  // the deadline passed
+    SCAN_ERROR,
+};
+
+const int kSliceCheckInterval = 64;   // check the deadline once every this many elements
+const int kSliceMaxRetry = 3;   // a write command scans under the key lock after the key changed this many times
+
+/*
+ * a slow command that runs in time slices, the thread serves other connections between the slices.
+ * no lock is held between slices, so a slice can not block the other connections of the thread,
+ * reads go through a snapshot taken when the command starts, and the position is kept as the last key read.
+ * a write command collects the changes while scanning, then takes the key lock and applies them at once
+ * if the key was not touched since the scan started, so the command is still atomic for the binlog
+ */
+class SlicedCommand {
+public:
+    SlicedCommand(int db_idx);
+    virtual ~SlicedCommand();
+
+    // run until the command is done or the deadline passed, return true when it is done and the reply was sent
+    virtual bool RunSlice(ClientConn* conn, uint64_t deadline_us) = 0;
+protected:
+    // called with the key lock or ScanKeyGuard held, so the snapshot matches the data read under the lock
+    void TakeSnapshot();
+    void ReleaseSnapshot();
+    // the db was flushed after the snapshot was taken, the column family of the snapshot is dropped
+    bool IsFlushed();
+    rocksdb::Iterator* NewIterator();
+
+    // remember the key version and the meta data read under the key lock when the scan starts
+    void WatchKey(const string& key, const string& raw_meta);
+    // called with the key lock held, whether the key may have been changed since WatchKey()
+    bool IsKeyChanged(const string& key, const string& raw_meta);
+
+    // whether the deadline passed, the clock is read once every kSliceCheckInterval calls
+    static bool IsTimeout(uint64_t deadline_us, int& check_count);
+protected:
+    int                     db_idx_;
+    rocksdb::ReadOptions    read_option_;
+    long                    flush_count_;
+    uint64_t                key_version_;
+    string                  raw_meta_;
+    int                     retry_count_;
+};
+
+#endif /* __SLICED_COMMAND_H__ */
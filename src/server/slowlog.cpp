@@ -13,9 +13,9 @@ mutex g_slowlog_mtx;
 list<SlowlogEntry*> g_slowlog_list;
 uint64_t g_slowlog_id = 0;
 
-void add_slowlog(const vector<string>& cmd_vec, uint64_t duration)
+void add_slowlog(const string& cmd, const vector<rocksdb::Slice>& arg_vec, uint64_t duration)
 {
-    int cmd_size = (int)cmd_vec.size();
+    int cmd_size = (int)arg_vec.size();
     int sl_argc = cmd_size;
     if (sl_argc > SLOWLOG_ENTRY_MAX_ARGC) {
         sl_argc = SLOWLOG_ENTRY_MAX_ARGC;
@@ -35,17 +35,19 @@ void add_slowlog(const vector<string>& cmd_vec, uint64_t duration)
             char buf[256];
             snprintf(buf, sizeof(buf), "... (%d more arguments)", cmd_size - sl_argc + 1);
             sl_entry->cmd_vec.push_back(buf);
+        } else if (i == 0) {
+            sl_entry->cmd_vec.push_back(cmd);
         } else {
             // Trim too long strings
-            int item_size = (int)cmd_vec[i].size();
+            int item_size = (int)arg_vec[i].size();
             if (item_size > SLOWLOG_ENTRY_MAX_STRING) {
                 char buf[256];
-                string prefix = cmd_vec[i].substr(0, SLOWLOG_ENTRY_MAX_STRING);
+                string prefix(arg_vec[i].data(), SLOWLOG_ENTRY_MAX_STRING);
                 snprintf(buf, sizeof(buf), "%s... (%d more bytes)",
                          prefix.c_str(),  item_size - SLOWLOG_ENTRY_MAX_STRING);
                 sl_entry->cmd_vec.push_back(buf);
             } else {
-                sl_entry->cmd_vec.push_back(cmd_vec[i]);
+                sl_entry->cmd_vec.push_back(arg_vec[i].ToString());
             }
         }
     }
@@ -21,7 +21,8 @@ typedef struct {
     time_t time; // Unix time at which the query was executed
 } SlowlogEntry;
 
-void add_slowlog(const vector<string>& cmd_vec, uint64_t duration);
+// cmd is the upper case command name, it replaces arg_vec[0] in the log
+void add_slowlog(const string& cmd, const vector<rocksdb::Slice>& arg_vec, uint64_t duration);
 
 void slowlog_command(ClientConn* conn, const vector<string>& cmd_vec);
 
@@ -0,0 +1,101 @@
+//
+//  storage_pool.cpp
+//  kedis
+//
+
+#include "storage_pool.h"
+
+StoragePool g_storage_pool;
+
+struct StorageThreadArg {
+    StoragePool*    pool;
+    uint32_t        thread_idx;
+};
+
+StoragePool::StoragePool()
+{
+    thread_num_ = 0;
+    stop_ = false;
+    thread_ids_ = NULL;
+    queue_len_ = 0;
+    processed_tasks_ = 0;
+}
+
+void StoragePool::Init(int thread_num)
+{
+    thread_num_ = thread_num;
+    if (thread_num_ <= 0) {
+        return;
+    }
+    
+    thread_ids_ = new pthread_t [thread_num_];
+    for (int i = 0; i < thread_num_; ++i) {
+        StorageThreadArg* arg = new StorageThreadArg;
+        arg->pool = this;
+        arg->thread_idx = i;
+        (void)pthread_create(&thread_ids_[i], NULL, _StartRoutine, arg);
+    }
+}
+
+void StoragePool::Stop()
+{
+    if (thread_num_ <= 0) {
+        return;
+    }
+    
+    notify_.Lock();
+    stop_ = true;
+    notify_.Broadcast();
+    notify_.Unlock();
+    
+    for (int i = 0; i < thread_num_; ++i) {
+        pthread_join(thread_ids_[i], NULL);
+    }
+    
+    delete [] thread_ids_;
+    thread_ids_ = NULL;
+    thread_num_ = 0;
+}
+
+void StoragePool::AddTask(Task* task)
+{
+    queue_len_++;
+    notify_.Lock();
+    task_list_.push_back(task);
+    notify_.Signal();
+    notify_.Unlock();
+}
+
+void* StoragePool::_StartRoutine(void* arg)
+{
+    StorageThreadArg* thread_arg = (StorageThreadArg*)arg;
+    thread_arg->pool->_Execute(thread_arg->thread_idx);
+    delete thread_arg;
+    return NULL;
+}
+
+void StoragePool::_Execute(uint32_t thread_idx)
+{
+    while (true) {
+        notify_.Lock();
+        while (task_list_.empty() && !stop_) {
+            notify_.Wait();
+        }
+        
+        if (stop_) {
+            notify_.Unlock();
+            break;
+        }
+        
+        // take one task at a time, the others are left to the idle threads
+        Task* task = task_list_.front();
+        task_list_.pop_front();
+        notify_.Unlock();
+        
+        queue_len_--;
+        task->setThreadIdx(thread_idx);
+        task->run();
+        delete task;
+        processed_tasks_++;
+    }
+}
@@ -0,0 +1,45 @@
+//
+//  storage_pool.h
+//  kedis
+//
+
+#ifndef __STORAGE_POOL_H__
+#define __STORAGE_POOL_H__
+
+#include "thread_pool.h"
+
+/*
+ * commands that access rocksdb run in the storage threads if storage-thread-num is not 0,
+ * so a read that misses the block cache only blocks the connection waiting for it, not the whole io thread.
+ * all threads take tasks from one queue, so a slow task does not hold up the tasks behind it while
+ * other threads are idle
+ */
+class StoragePool {
+public:
+    StoragePool();
+    ~StoragePool() {}
+    
+    void Init(int thread_num);
+    void Stop();
+    bool IsEnabled() { return thread_num_ > 0; }
+    void AddTask(Task* task);
+    
+    int GetThreadNum() { return thread_num_; }
+    int GetQueueLen() { return queue_len_; }
+    uint64_t GetProcessedTasks() { return processed_tasks_; }
+private:
+    static void* _StartRoutine(void* arg);
+    void _Execute(uint32_t thread_idx);
+private:
+    int             thread_num_;
+    bool            stop_;
+    pthread_t*      thread_ids_;
+    ThreadNotify    notify_;
+    list<Task*>     task_list_;
+    atomic<int>     queue_len_;
+    atomic<uint64_t> processed_tasks_;
+};
+
+extern StoragePool g_storage_pool;
+
+#endif /* __STORAGE_POOL_H__ */
@@ -0,0 +1,200 @@
+//
+//  transaction.cpp
+//  kedis
+//
+
+#include "transaction.h"
+#include "server.h"
+#include "key_lock.h"
+#include "group_commit.h"
+#include "command_table.h"
+#include "redis_parser.h"
+#include "simple_log.h"
+
+static thread_local Transaction* t_running_transaction = NULL;
+
+// replay the batch of a command into the batch of the transaction, with the column family of every record
+class TransactionBatchHandler : public rocksdb::WriteBatch::Handler {
+public:
+    TransactionBatchHandler(rocksdb::WriteBatchWithIndex* batch) : batch_(batch) {}
+    virtual ~TransactionBatchHandler() {}
+
+    virtual rocksdb::Status PutCF(uint32_t column_family_id, const rocksdb::Slice& key, const rocksdb::Slice& value) {
+        return batch_->Put(GetHandle(column_family_id), key, value);
+    }
+
+    virtual rocksdb::Status DeleteCF(uint32_t column_family_id, const rocksdb::Slice& key) {
+        return batch_->Delete(GetHandle(column_family_id), key);
+    }
+
+    virtual rocksdb::Status SingleDeleteCF(uint32_t column_family_id, const rocksdb::Slice& key) {
+        return batch_->SingleDelete(GetHandle(column_family_id), key);
+    }
+private:
+    rocksdb::ColumnFamilyHandle* GetHandle(uint32_t column_family_id) {
+        for (int i = 0; i < g_server.db_num; i++) {
+            if (g_server.cf_handles_map[i]->GetID() == column_family_id) {
+                return g_server.cf_handles_map[i];
+            }
+        }
+        return NULL;
+    }
+private:
+    rocksdb::WriteBatchWithIndex* batch_;
+};
+
+Transaction::Transaction() : batch_(rocksdb::BytewiseComparator(), 0, true)
+{
+    started_ = false;
+    aborted_ = false;
+    running_ = false;
+    watch_touched_ = false;
+    db_idx_ = 0;
+}
+
+Transaction::~Transaction()
+{
+    Unwatch();
+}
+
+void Transaction::Watch(int db_idx, const string& key)
+{
+    for (const pair<int, string>& watched_key : watched_keys_) {
+        if ((watched_key.first == db_idx) && (watched_key.second == key)) {
+            return;
+        }
+    }
+
+    watch_key(db_idx, key, &watch_touched_);
+    watched_keys_.push_back(make_pair(db_idx, key));
+}
+
+void Transaction::Unwatch()
+{
+    for (const pair<int, string>& watched_key : watched_keys_) {
+        unwatch_key(watched_key.first, watched_key.second, &watch_touched_);
+    }
+    watched_keys_.clear();
+    watch_touched_ = false;
+}
+
+void Transaction::Queue(KedisCommand* kedis_cmd, const vector<rocksdb::Slice>& arg_vec, const string& request)
+{
+    QueuedCommand cmd;
+    cmd.kedis_cmd = kedis_cmd;
+    cmd.args.reserve(arg_vec.size());
+    for (const rocksdb::Slice& arg : arg_vec) {
+        cmd.args.emplace_back(arg.data(), arg.size());
+    }
+    cmd.request = request;
+    commands_.push_back(std::move(cmd));
+}
+
+void Transaction::GetKeys(set<string>& keys)
+{
+    vector<int> key_indexes;
+    for (const QueuedCommand& cmd : commands_) {
+        key_indexes.clear();
+        get_command_key_indexes(cmd.kedis_cmd, (int)cmd.args.size(), key_indexes);
+        for (int i : key_indexes) {
+            keys.insert(cmd.args[i]);
+        }
+    }
+}
+
+void Transaction::Run(int db_idx)
+{
+    started_ = false;
+    running_ = true;
+    db_idx_ = db_idx;
+    t_running_transaction = this;
+}
+
+bool Transaction::Commit()
+{
+    t_running_transaction = NULL;
+    running_ = false;
+
+    rocksdb::WriteBatch* batch = batch_.GetWriteBatch();
+    if (batch->Count()) {
+        rocksdb::Status s = g_group_commit.Write(g_server.db, batch);
+        if (!s.ok()) {
+            // nothing is written, so nothing goes to the binlog
+            log_message(kLogLevelError, "transaction write batch failed: %s\n", s.ToString().c_str());
+            batch_.Clear();
+            binlog_commands_.clear();
+            return false;
+        }
+    }
+
+    if (binlog_commands_.size() == 1) {
+        g_server.binlog.Store(db_idx_, binlog_commands_[0]);
+    } else if (binlog_commands_.size() > 1) {
+        // the slave queues the commands after MULTI and runs them as a transaction too
+        string record;
+        vector<string> multi_cmd_vec = {"MULTI"};
+        build_request(multi_cmd_vec, record);
+        for (const string& command : binlog_commands_) {
+            record.append(command);
+        }
+        string exec_request;
+        vector<string> exec_cmd_vec = {"EXEC"};
+        build_request(exec_cmd_vec, exec_request);
+        record.append(exec_request);
+        g_server.binlog.Store(db_idx_, record);
+    }
+
+    batch_.Clear();
+    binlog_commands_.clear();
+    return true;
+}
+
+void Transaction::Rollback()
+{
+    t_running_transaction = NULL;
+    running_ = false;
+    batch_.Clear();
+    binlog_commands_.clear();
+}
+
+void Transaction::Reset()
+{
+    started_ = false;
+    aborted_ = false;
+    commands_.clear();
+    Unwatch();
+}
+
+void Transaction::AddWrite(rocksdb::WriteBatch* batch)
+{
+    TransactionBatchHandler handler(&batch_);
+    rocksdb::Status s = batch->Iterate(&handler);
+    if (!s.ok()) {
+        log_message(kLogLevelError, "add write to transaction failed: %s\n", s.ToString().c_str());
+    }
+}
+
+void Transaction::AddBinlog(const string& command)
+{
+    binlog_commands_.push_back(command);
+}
+
+bool can_queue_command(KedisCommand* kedis_cmd)
+{
+    // DUMP and RESTORE read and write the database by themselves, PING and ECHO only reply
+    static KedisCommand* dump_cmd = lookup_command("DUMP");
+    static KedisCommand* restore_cmd = lookup_command("RESTORE");
+    static KedisCommand* ping_cmd = lookup_command("PING");
+    static KedisCommand* echo_cmd = lookup_command("ECHO");
+
+    if ((kedis_cmd == ping_cmd) || (kedis_cmd == echo_cmd)) {
+        return true;
+    }
+    return (kedis_cmd->exec == CMD_EXEC_STORAGE) && (kedis_cmd->first_key > 0) && (kedis_cmd != dump_cmd) &&
+        (kedis_cmd != restore_cmd);
+}
+
+Transaction* get_running_transaction()
+{
+    return t_running_transaction;
+}
@@ -0,0 +1,81 @@
+//
+//  transaction.h
+//  kedis
+//
+
+#ifndef __TRANSACTION_H__
+#define __TRANSACTION_H__
+
+#include "util.h"
+#include "rocksdb/db.h"
+#include "rocksdb/utilities/write_batch_with_index.h"
+
+struct KedisCommand;
+
+struct QueuedCommand {
+    KedisCommand*   kedis_cmd;
+    vector<string>  args;       // the command name is args[0]
+    string          request;    // the request in redis protocol, for the binlog
+};
+
+/*
+ * MULTI/EXEC of a connection. the commands after MULTI are queued in the io thread,
+ * EXEC locks the keys of all the queued commands in order, then runs them in the thread of EXEC:
+ * their writes go to one WriteBatchWithIndex, which their reads see too, and their binlog is collected,
+ * at last the batch is written to rocksdb at once and the binlog is stored as one record of MULTI ... EXEC,
+ * so a slave applies the transaction as a whole as well.
+ * the queued commands run in the db of EXEC, only the commands of keys which only access the database can be queued
+ */
+class Transaction {
+public:
+    Transaction();
+    ~Transaction();
+
+    void Watch(int db_idx, const string& key);
+    void Unwatch();
+    bool IsWatchTouched() { return watch_touched_; }
+    bool IsWatching() { return !watched_keys_.empty(); }
+
+    void Begin() { started_ = true; }
+    bool IsStarted() { return started_; }
+    void Queue(KedisCommand* kedis_cmd, const vector<rocksdb::Slice>& arg_vec, const string& request);
+    void Abort() { aborted_ = true; }   // a command was rejected while queuing, EXEC will fail
+    bool IsAborted() { return aborted_; }
+    bool IsRunning() { return running_; }
+    vector<QueuedCommand>& GetCommands() { return commands_; }
+
+    // the keys of all the queued commands
+    void GetKeys(set<string>& keys);
+
+    // the writes and the binlog of the commands running in this thread go to the transaction between Run() and
+    // Commit(), called with the keys locked. Commit() returns false if the batch failed to be written
+    void Run(int db_idx);
+    bool Commit();
+    void Rollback();    // nothing is written, for a command that fails after some of its writes
+
+    // after EXEC or DISCARD, the watched keys are forgotten too
+    void Reset();
+
+    // called by the command handlers, in the thread running the transaction
+    rocksdb::WriteBatchWithIndex* GetBatch() { return &batch_; }
+    void AddWrite(rocksdb::WriteBatch* batch);
+    void AddBinlog(const string& command);
+private:
+    bool                started_;
+    bool                aborted_;
+    bool                running_;
+    vector<QueuedCommand> commands_;
+    vector<pair<int, string>> watched_keys_;    // db index and key
+    atomic<bool>        watch_touched_;
+    int                 db_idx_;
+    rocksdb::WriteBatchWithIndex batch_;
+    vector<string>      binlog_commands_;
+};
+
+// whether the command can be queued after MULTI
+bool can_queue_command(KedisCommand* kedis_cmd);
+
+// the transaction running in the thread, NULL if there is none
+Transaction* get_running_transaction();
+
+#endif /* __TRANSACTION_H__ */
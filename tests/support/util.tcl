@@ -91,6 +91,20 @@ proc wait_for_sync r {
     }
 }
 
+# the clients are served by different io threads, a test expecting the clients
+# to block in the order they are sent waits for each of them
+proc wait_for_blocked_clients_count {count} {
+    wait_for_condition 50 100 {
+        [s blocked_clients] == $count
+    } else {
+        fail "Timeout waiting for $count blocked clients"
+    }
+}
+
+proc wait_for_blocked_client {} {
+    wait_for_blocked_clients_count 1
+}
+
 # Random integer between 0 and max (excluded).
 proc randomInt {max} {
     expr {int(rand()*$max)}
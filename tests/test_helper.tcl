@@ -28,6 +28,17 @@ set ::all_tests {
     unit/quit
 	unit/slowlog
 	unit/limits
+	unit/obuf-limits
+	unit/io-threads
+	unit/storage-threads
+	unit/time-slice
+	unit/group-commit
+	unit/key-locks
+	unit/snapshot-reads
+	unit/read-coalesce
+	unit/multi
+	unit/eval-scripts
+	unit/blocking
     unit/hyperloglog
 	unit/dump
 	integration/replication
@@ -0,0 +1,192 @@
+start_server {tags {"blocking"}} {
+    test {LMOVE from and to both ends} {
+        r del bsrc bdst
+        r rpush bsrc a b c d
+        set res [list [r lmove bsrc bdst left right] [r lmove bsrc bdst right left] [r lmove bsrc bsrc left right]]
+        lappend res [r lrange bsrc 0 -1] [r lrange bdst 0 -1]
+        catch {r lmove bsrc bdst up down} e
+        lappend res [string match {*syntax error*} $e] [r lmove nokey bdst left left]
+    } {a d b {c b} {d a} 1 {}}
+
+    test {BLMOVE is woken up by a push} {
+        set rd [redis_deferring_client]
+        r del bsrc bdst
+        $rd blmove bsrc bdst right left 0
+        wait_for_blocked_client
+        r lpush bsrc a b
+        list [$rd read] [r lrange bsrc 0 -1] [r lrange bdst 0 -1] [s blocked_clients]
+    } {a b a 0}
+
+    test {ZPOPMIN/ZPOPMAX} {
+        r del bzset
+        r zadd bzset 1 a 2 b 3 c 4 d
+        set res [list [r zpopmin bzset] [r zpopmax bzset 2] [r zpopmin bzset 0] [r zcard bzset]]
+        lappend res [r zpopmin bzset 10] [r exists bzset] [r zpopmax bzset]
+        r set bstr x
+        catch {r zpopmin bstr} e
+        lappend res [string match {WRONGTYPE*} $e]
+    } {{a 1} {d 4 c 3} {} 1 {b 2} 0 {} 1}
+
+    test {BZPOPMIN/BZPOPMAX of an existing zset and woken up by ZADD} {
+        set rd [redis_deferring_client]
+        r del bzset1 bzset2
+        r zadd bzset2 1 a 2 b 3 c
+        $rd bzpopmin bzset1 bzset2 0
+        set res [list [$rd read]]
+        $rd bzpopmax bzset1 bzset2 0
+        lappend res [$rd read]
+        $rd bzpopmax bzset1 0
+        wait_for_blocked_client
+        r zadd bzset1 5 x 6 y
+        lappend res [$rd read] [r zrange bzset1 0 -1] [r zrange bzset2 0 -1]
+    } {{bzset2 a 1} {bzset2 c 3} {bzset1 y 6} x b}
+
+    test {The clients blocked on a key are served in the order they blocked} {
+        r del blist
+        set rd1 [redis_deferring_client]
+        set rd2 [redis_deferring_client]
+        set rd3 [redis_deferring_client]
+        $rd1 blpop blist 0
+        wait_for_blocked_clients_count 1
+        $rd2 blpop blist 0
+        wait_for_blocked_clients_count 2
+        $rd3 blpop blist 0
+        wait_for_blocked_clients_count 3
+        r rpush blist a b
+        set res [list [$rd1 read] [$rd2 read] [s blocked_clients]]
+        r rpush blist c
+        lappend res [$rd3 read] [s blocked_clients]
+    } {{blist a} {blist b} 1 {blist c} 0}
+
+    test {A closed blocked client leaves the wait queue} {
+        r del blist
+        set rd1 [redis_deferring_client]
+        set rd2 [redis_deferring_client]
+        $rd1 blpop blist 0
+        wait_for_blocked_clients_count 1
+        $rd2 blpop blist 0
+        wait_for_blocked_clients_count 2
+        $rd1 close
+        wait_for_blocked_clients_count 1
+        r rpush blist a
+        list [$rd2 read] [s blocked_clients] [r exists blist]
+    } {{blist a} 0 0}
+
+    test {A blocked client replies the null reply after the timeout} {
+        set rd [redis_deferring_client]
+        r del blist
+        set start [clock milliseconds]
+        $rd brpop blist 1
+        wait_for_blocked_client
+        set res [list [$rd read] [s blocked_clients]]
+        lappend res [expr {[clock milliseconds] - $start >= 900}]
+        # the client serves the following requests after the timeout
+        $rd ping
+        lappend res [$rd read]
+    } {{} 0 1 PONG}
+
+    test {The pipelined requests after a blocking command wait for it} {
+        set rd [redis_deferring_client]
+        r del blist
+        $rd blpop blist 0
+        $rd rpush blist2 x
+        wait_for_blocked_client
+        set res [r exists blist2]
+        r rpush blist a
+        lappend res [$rd read] [$rd read]
+    } {0 {blist a} 1}
+
+    test {A blocking command in MULTI/EXEC does not block} {
+        r del blist bzset1
+        r multi
+        r blpop blist 0
+        r bzpopmin bzset1 0
+        r blmove blist blist2 left left 0
+        list [r exec] [s blocked_clients]
+    } {{{} {} {}} 0}
+
+    test {The binlog has the non-blocking commands} {
+        set rd [redis_deferring_client]
+        r del blist bdst
+        r rpush blist a
+        set seq [s binlog_seq]
+        $rd brpoplpush blist bdst 0
+        $rd read
+        list [expr {[s binlog_seq] - $seq}] [r lrange bdst 0 -1]
+    } {1 a}
+
+    test {The clients woken up by a push are served before it replies} {
+        r del blist1 blist2 blist3
+        set rd1 [redis_deferring_client]
+        set rd2 [redis_deferring_client]
+        $rd1 brpoplpush blist1 blist2 0
+        wait_for_blocked_clients_count 1
+        $rd2 brpoplpush blist2 blist3 0
+        wait_for_blocked_clients_count 2
+        # the reads pipelined after the push run after the moves
+        set rd [redis_deferring_client]
+        $rd write "rpush blist1 x\r\nexists blist1\r\nexists blist2\r\nlrange blist3 0 -1\r\n"
+        $rd flush
+        set res [list [$rd read] [$rd read] [$rd read] [$rd read]]
+        lappend res [$rd1 read] [$rd2 read] [s blocked_clients]
+    } {1 0 0 x x x 0}
+}
+
+start_server {tags {"blocking"} overrides {storage-thread-num 4}} {
+    test {Every element pushed is popped by one blocked client} {
+        r del blist
+        set clients {}
+        for {set c 0} {$c < 10} {incr c} {
+            set rd [redis_deferring_client]
+            $rd blpop blist 0
+            lappend clients $rd
+        }
+        wait_for_blocked_clients_count 10
+        for {set j 0} {$j < 10} {incr j} {
+            r rpush blist $j
+        }
+        set values {}
+        foreach rd $clients {
+            lappend values [lindex [$rd read] 1]
+            $rd close
+        }
+        list [lsort -integer $values] [r exists blist] [s blocked_clients]
+    } {{0 1 2 3 4 5 6 7 8 9} 0 0}
+}
+
+start_server {tags {"blocking repl"}} {
+    start_server {} {
+        set master [srv -1 client]
+        set slave [srv 0 client]
+
+        test {The pops of the woken clients are replicated} {
+            $slave slaveof [srv -1 host] [srv -1 port]
+            wait_for_condition 50 100 {
+                [string match {*master_link_status:up*} [$slave info replication]]
+            } else {
+                fail "Can't turn the instance into a slave"
+            }
+
+            set rd [redis_deferring_client -1]
+            $rd blpop rlist 0
+            wait_for_condition 50 100 {
+                [status $master blocked_clients] == 1
+            } else {
+                fail "The client is not blocked"
+            }
+            $master rpush rlist a b
+            $rd read
+            $rd brpoplpush rlist rdst 0
+            $rd read
+            $master zadd rzset 1 x 2 y
+            $rd bzpopmax rzset 0
+            $rd read
+            wait_for_condition 50 100 {
+                [$slave exists rlist] == 0 && [$slave zcard rzset] == 1
+            } else {
+                fail "The pops were not replicated"
+            }
+            list [$slave lrange rdst 0 -1] [$slave zrange rzset 0 -1] [status $slave blocked_clients]
+        } {b x 0}
+    }
+}
@@ -0,0 +1,206 @@
+start_server {tags {"eval-scripts"}} {
+    test {EVAL replies of Lua values} {
+        list [r eval {return 'hello'} 0] [r eval {return 100.5} 0] [r eval {return true} 0] \
+            [r eval {return false} 0] [r eval {return {ok='fine'}} 0] [r eval {return {1,2,3,'ciao',{1,2}}} 0]
+    } {hello 100 1 {} fine {1 2 3 ciao {1 2}}}
+
+    test {EVAL KEYS and ARGV} {
+        r eval {return {KEYS[1],KEYS[2],ARGV[1],ARGV[2]}} 2 a b c d
+    } {a b c d}
+
+    test {EVAL calls the commands} {
+        r del sk sh
+        r eval {
+            redis.call('set',KEYS[1],ARGV[1])
+            redis.call('hset',KEYS[2],'f',ARGV[1])
+            return {redis.call('incr',KEYS[1]),redis.call('hget',KEYS[2],'f'),redis.call('get',KEYS[1])}
+        } 2 sk sh 5
+    } {6 5 6}
+
+    test {EVAL reply of a command to Lua values} {
+        r del sk sl
+        r rpush sl a b c
+        r set sk v
+        r eval {
+            local status = redis.call('set',KEYS[1],'v')
+            local err = redis.pcall('incr',KEYS[1])
+            local list = redis.call('lrange',KEYS[2],0,-1)
+            local nothing = redis.call('get','nokey')
+            return {status['ok'],err['err'],#list,list[3],type(nothing)}
+        } 3 sk sl nokey
+    } {OK {ERR value is not an integer} 3 c boolean}
+
+    test {EVAL errors of redis.call} {
+        set res {}
+        r set sk v
+        catch {r eval {return redis.call('nosuchcommand')} 0} e
+        lappend res [string match {*Unknown Redis command*} $e]
+        catch {r eval {return redis.call('get','a','b')} 1 a} e
+        lappend res [string match {*wrong number of arguments*} $e]
+        catch {r eval {return redis.call('lpush',KEYS[1],'x')} 1 sk} e
+        lappend res [string match {*WRONGTYPE*} $e]
+        catch {r eval {return redis.call()} 0} e
+        lappend res [string match {*at least one argument*} $e]
+    } {1 1 1 1}
+
+    test {EVAL can only call the commands of the keys in KEYS} {
+        set res {}
+        catch {r eval {return redis.call('get','other')} 1 sk} e
+        lappend res [string match {*not declared in KEYS*} $e]
+        catch {r eval {return redis.call('flushdb')} 0} e
+        lappend res [string match {*not allowed from scripts*} $e]
+        catch {r eval {return redis.call('eval','return 1','0')} 0} e
+        lappend res [string match {*not allowed from scripts*} $e]
+        lappend res [r eval {return redis.call('ping')} 0]
+    } {1 1 1 PONG}
+
+    test {EVAL compile and runtime errors} {
+        set res {}
+        catch {r eval {return (} 0} e
+        lappend res [string match {*Error compiling script*} $e]
+        catch {r eval {return nosuchvar.field} 0} e
+        lappend res [string match {*Error running script*} $e]
+        lappend res [r eval {return redis.status_reply('fine')} 0]
+        catch {r eval {return redis.error_reply('MY error')} 0} e
+        lappend res $e
+    } {1 1 fine {MY error}}
+
+    test {EVALSHA and the script cache} {
+        r set sk v
+        set sha [r script load {return redis.call('get',KEYS[1])}]
+        set res [list $sha [r evalsha $sha 1 sk] [r evalsha [string toupper $sha] 1 sk]]
+        lappend res [r script exists $sha ffd632c7d33e571e9f24556ebed26c3479a87130]
+        catch {r evalsha ffd632c7d33e571e9f24556ebed26c3479a87130 0} e
+        lappend res [string match {NOSCRIPT*} $e]
+        r script flush
+        catch {r evalsha $sha 1 sk} e
+        lappend res [string match {NOSCRIPT*} $e]
+        r eval {return redis.call('get',KEYS[1])} 1 sk
+        lappend res [r evalsha $sha 1 sk] [r eval {return redis.sha1hex('')} 0]
+    } {fd758d1589d044dd850a6f05d52f2eefd27f033f v v {1 0} 1 1 v da39a3ee5e6b4b0d3255bfef95601890afd80709}
+
+    test {The writes before an error in a script are kept} {
+        r del sk
+        catch {r eval {redis.call('set',KEYS[1],'x'); redis.call('incr',KEYS[1])} 1 sk}
+        r get sk
+    } {x}
+
+    test {Writes of a script are one binlog record} {
+        r del sk1 sk2 sk3
+        set seq [s binlog_seq]
+        r eval {
+            redis.call('set',KEYS[1],'a')
+            redis.call('incr',KEYS[2])
+            redis.call('hset',KEYS[3],'f','v')
+            return redis.call('get',KEYS[1])
+        } 3 sk1 sk2 sk3
+        set seq1 [s binlog_seq]
+        r eval {return redis.call('get',KEYS[1])} 1 sk1
+        list [expr {$seq1 - $seq}] [expr {[s binlog_seq] - $seq1}] [r get sk2] [r hget sk3 f]
+    } {1 0 1 v}
+
+    test {Script time in slowlog and command stats} {
+        r config resetstat
+        r config set slowlog-log-slower-than 0
+        r slowlog reset
+        r eval {return redis.call('get',KEYS[1])} 1 sk1
+        r config set slowlog-log-slower-than 10000
+        set names {}
+        foreach entry [r slowlog get] {
+            lappend names [lindex $entry 3 0]
+        }
+        set info [r info commandstats]
+        list [expr {[lsearch $names EVAL] >= 0}] [regexp {cmdstat_eval:calls=1,} $info] \
+            [regexp {cmdstat_get:calls=1,} $info]
+    } {1 1 1}
+
+    test {A script running longer than lua-time-limit is aborted} {
+        r config set lua-time-limit 100
+        r del sk
+        catch {r eval {redis.call('set',KEYS[1],'x'); while true do end} 1 sk} e
+        set res [list [string match {*lua-time-limit*} $e]]
+        # a script catching the error is aborted again
+        catch {r eval {while true do pcall(function() while true do end end) end} 0} e
+        lappend res [string match {*lua-time-limit*} $e]
+        r config set lua-time-limit 5000
+        # the key is unlocked and the writes before are kept
+        lappend res [r get sk] [r set sk y]
+    } {1 1 x OK}
+}
+
+start_server {tags {"eval-scripts"} overrides {storage-thread-num 4}} {
+    test {Scripts of concurrent clients are atomic} {
+        r del sa sb
+        set clients {}
+        for {set c 0} {$c < 4} {incr c} {
+            set rd [redis_deferring_client]
+            for {set j 0} {$j < 100} {incr j} {
+                $rd eval {
+                    local a = redis.call('incr',KEYS[1])
+                    local b = redis.call('incr',KEYS[2])
+                    return a - b
+                } 2 sa sb
+            }
+            lappend clients $rd
+        }
+        set err {}
+        foreach rd $clients {
+            for {set j 0} {$j < 100} {incr j} {
+                set reply [$rd read]
+                if {$reply != 0} {
+                    set err "unexpected reply $reply"
+                }
+            }
+            $rd close
+        }
+        list $err [r get sa] [r get sb]
+    } {{} 400 400}
+
+    test {SCRIPT KILL aborts a running script} {
+        set res {}
+        catch {r script kill} e
+        lappend res [string match {NOTBUSY*} $e]
+        r config set lua-time-limit 0
+        set rd [redis_deferring_client]
+        $rd eval {while true do end} 1 sk
+        wait_for_condition 50 100 {
+            [catch {r script kill}] == 0
+        } else {
+            fail "The script is not running"
+        }
+        catch {$rd read} e
+        lappend res [string match {*SCRIPT KILL*} $e]
+        r config set lua-time-limit 5000
+        lappend res [r set sk v]
+        $rd close
+        set res
+    } {1 1 OK}
+}
+
+start_server {tags {"eval-scripts repl"}} {
+    start_server {} {
+        set master [srv -1 client]
+        set slave [srv 0 client]
+
+        test {The writes of a script are replicated} {
+            $slave slaveof [srv -1 host] [srv -1 port]
+            wait_for_condition 50 100 {
+                [string match {*master_link_status:up*} [$slave info replication]]
+            } else {
+                fail "Can't turn the instance into a slave"
+            }
+
+            $master eval {
+                redis.call('set',KEYS[1],'1')
+                redis.call('incr',KEYS[1])
+                redis.call('rpush',KEYS[2],'a','b')
+            } 2 rk rl
+            wait_for_condition 50 100 {
+                [$slave get rk] eq {2}
+            } else {
+                fail "The script was not replicated"
+            }
+            $slave lrange rl 0 -1
+        } {a b}
+    }
+}
@@ -0,0 +1,48 @@
+start_server {tags {"group-commit"}} {
+    test {CONFIG GET/SET group-commit} {
+        set res [lindex [r config get group-commit] 1]
+        r config set group-commit no
+        lappend res [lindex [r config get group-commit] 1]
+        r config set group-commit yes
+        lappend res [lindex [r config get group-commit] 1]
+    } {yes no yes}
+
+    test {Concurrent writes are committed in groups} {
+        set batches [s db_group_batches]
+        set binlog_batches [s binlog_group_batches]
+        set clients {}
+        for {set c 0} {$c < 8} {incr c} {
+            set rd [redis_deferring_client]
+            for {set j 0} {$j < 200} {incr j} {
+                $rd hset gchash:$c f$j $j
+                $rd zadd gczset $j m$c:$j
+            }
+            lappend clients $rd
+        }
+        foreach rd $clients {
+            for {set j 0} {$j < 400} {incr j} {
+                $rd read
+            }
+            $rd close
+        }
+        set res [r zcard gczset]
+        for {set c 0} {$c < 8} {incr c} {
+            lappend res [r hlen gchash:$c] [r hget gchash:$c f199]
+        }
+        lappend res [expr {[s db_group_batches] - $batches >= 3200}]
+        lappend res [expr {[s binlog_group_batches] - $binlog_batches >= 3200}]
+        lappend res [expr {[s db_group_commits] <= [s db_group_batches]}]
+    } {1600 200 199 200 199 200 199 200 199 200 199 200 199 200 199 200 199 1 1 1}
+
+    test {Writes with group-commit disabled} {
+        r config set group-commit no
+        set commits [s db_group_commits]
+        r hset gcoff f v
+        r del gcoff
+        r sadd gcoff a b
+        r srem gcoff a
+        set res [list [r smembers gcoff] [expr {[s db_group_commits] == $commits}]]
+        r config set group-commit yes
+        set res
+    } {b 1}
+}
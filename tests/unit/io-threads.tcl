@@ -0,0 +1,84 @@
+proc io_thread_conns {} {
+    set conns {}
+    for {set i 0} {$i < 4} {incr i} {
+        regexp {connections=([0-9]+)} [s io_thread_$i] - n
+        lappend conns $n
+    }
+    set conns
+}
+
+proc max_io_thread_conns {} {
+    tcl::mathfunc::max {*}[io_thread_conns]
+}
+
+start_server {tags {"io-threads"} overrides {io-thread-num 4}} {
+    test {CONFIG SET/GET io-thread-placement} {
+        r config set io-thread-placement least-cpu
+        set placement [lindex [r config get io-thread-placement] 1]
+        r config set io-thread-placement round-robin
+        list $placement [s io_thread_placement]
+    } {least-cpu round-robin}
+
+    test {CONFIG SET io-thread-placement with a bad policy fails} {
+        catch {r config set io-thread-placement random} e
+        set e
+    } {*ERR*}
+
+    test {New connections are placed on the io thread with the least connections} {
+        r config set io-thread-placement least-conn
+        set clients {}
+        for {set j 0} {$j < 8} {incr j} {
+            set rd [redis_deferring_client]
+            $rd ping
+            assert_equal PONG [$rd read]
+            lappend clients $rd
+        }
+        set conns [io_thread_conns]
+        r config set io-thread-placement round-robin
+        foreach rd $clients {
+            $rd close
+        }
+        expr {[tcl::mathfunc::max {*}$conns] - [tcl::mathfunc::min {*}$conns] <= 1}
+    } {1}
+
+    test {DEBUG REBALANCE moves idle connections to other io threads} {
+        # with round-robin every 4th connection is placed on the same io thread
+        set clients {}
+        set kept {}
+        for {set j 0} {$j < 16} {incr j} {
+            set rd [redis_deferring_client]
+            if {$j % 4 == 0} {
+                lappend kept $rd
+            } else {
+                lappend clients $rd
+            }
+        }
+        foreach rd $clients {
+            $rd close
+        }
+        wait_for_condition 50 100 {
+            [max_io_thread_conns] >= 4
+        } else {
+            fail "The connections are not placed on the same io thread"
+        }
+
+        # only connections idle for a while are moved
+        after 1200
+        r debug rebalance
+        wait_for_condition 50 100 {
+            [max_io_thread_conns] < 4
+        } else {
+            fail "The connections are not moved to other io threads"
+        }
+
+        set j 0
+        foreach rd $kept {
+            $rd set iokey$j $j
+            assert_equal OK [$rd read]
+            $rd get iokey$j
+            assert_equal $j [$rd read]
+            $rd close
+            incr j
+        }
+    }
+}
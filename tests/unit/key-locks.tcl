@@ -0,0 +1,82 @@
+start_server {tags {"key-locks"}} {
+    test {INFO keylocks counts the key locks} {
+        set acquires [s key_lock_acquires]
+        r set klkey 1
+        r incr klkey
+        list [expr {[s key_lock_acquires] > $acquires}] [string is integer [s key_lock_contended]] \
+            [string is double [s key_lock_avg_wait_us]]
+    } {1 1 1}
+
+    test {Concurrent writes to the same key} {
+        set clients {}
+        for {set c 0} {$c < 8} {incr c} {
+            set rd [redis_deferring_client]
+            for {set j 0} {$j < 500} {incr j} {
+                $rd incr hotkey
+                $rd hincrby hothash f 1
+            }
+            lappend clients $rd
+        }
+        foreach rd $clients {
+            for {set j 0} {$j < 1000} {incr j} {
+                $rd read
+            }
+            $rd close
+        }
+        list [r get hotkey] [r hget hothash f]
+    } {4000 4000}
+
+    test {Multi key commands lock overlapping keys in order} {
+        set clients {}
+        for {set c 0} {$c < 8} {incr c} {
+            set rd [redis_deferring_client]
+            for {set j 0} {$j < 200} {incr j} {
+                if {$c % 2} {
+                    $rd mset mk:a $c mk:b $c mk:c $c
+                } else {
+                    $rd mset mk:c $c mk:b $c mk:a $c
+                }
+                $rd mget mk:c mk:a
+            }
+            lappend clients $rd
+        }
+        set err {}
+        foreach rd $clients {
+            for {set j 0} {$j < 200} {incr j} {
+                $rd read
+                set res [$rd read]
+                if {[lindex $res 0] ne [lindex $res 1]} {
+                    set err "mset is not atomic: $res"
+                }
+            }
+            $rd close
+        }
+        set values [r mget mk:a mk:b mk:c]
+        list $err [llength [lsort -unique $values]]
+    } {{} 1}
+
+    test {Many different keys go through the node pool} {
+        set rd [redis_deferring_client]
+        for {set j 0} {$j < 5000} {incr j} {
+            $rd hset manykeys:$j f $j
+        }
+        for {set j 0} {$j < 5000} {incr j} {
+            $rd read
+        }
+        $rd close
+        list [r hget manykeys:4999 f] [r hget manykeys:0 f]
+    } {4999 0}
+
+    test {FLUSHDB waits for the key locks} {
+        set rd [redis_deferring_client]
+        for {set j 0} {$j < 1000} {incr j} {
+            $rd incr flkey
+        }
+        r flushdb
+        for {set j 0} {$j < 1000} {incr j} {
+            $rd read
+        }
+        $rd close
+        expr {[r get flkey] eq "" || [r get flkey] <= 1000}
+    } {1}
+}
@@ -57,22 +57,7 @@ start_server {tags {"multi"}} {
         list [r exists foo1] [r exists foo2]
     } {0 0}
 
-    test {EXEC fails if there are errors while queueing commands #2} {
-        set rd [redis_deferring_client]
-        r del foo1 foo2
-        r multi
-        r set foo1 bar1
-        $rd config set maxmemory 1
-        assert  {[$rd read] eq {OK}}
-        catch {r lpush mylist myvalue}
-        $rd config set maxmemory 0
-        assert  {[$rd read] eq {OK}}
-        r set foo2 bar2
-        catch {r exec} e
-        assert_match {EXECABORT*} $e
-        $rd close
-        list [r exists foo1] [r exists foo2]
-    } {0 0}
+    # "EXEC fails if there are errors while queueing commands #2" is not ported, it needs maxmemory
 
     test {If EXEC aborts, the client MULTI state is cleared} {
         r del foo1 foo2
@@ -111,15 +96,7 @@ start_server {tags {"multi"}} {
         r exec
     } {}
 
-    test {EXEC fail on WATCHed key modified by SORT with STORE even if the result is empty} {
-        r flushdb
-        r lpush foo bar
-        r watch foo
-        r sort emptylist store foo
-        r multi
-        r ping
-        r exec
-    } {}
+    # "EXEC fail on WATCHed key modified by SORT with STORE" is not ported, SORT is not supported
 
     test {After successful EXEC key is no longer watched} {
         r set x 30
@@ -169,23 +146,23 @@ start_server {tags {"multi"}} {
         r exec
     } {}
 
-    test {FLUSHALL does not touch non affected keys} {
-        r del x
+    test {FLUSHDB is able to touch the watched keys} {
+        r set x 30
         r watch x
-        r flushall
+        r flushdb
         r multi
         r ping
         r exec
-    } {PONG}
+    } {}
 
-    test {FLUSHDB is able to touch the watched keys} {
-        r set x 30
+    test {FLUSHALL does not touch non affected keys} {
+        r del x
         r watch x
-        r flushdb
+        r flushall
         r multi
         r ping
         r exec
-    } {}
+    } {PONG}
 
     test {FLUSHDB does not touch non affected keys} {
         r del x
@@ -253,57 +230,201 @@ start_server {tags {"multi"}} {
         r exec
     } {11}
 
-    test {MULTI / EXEC is propagated correctly (single write command)} {
-        set repl [attach_to_replication_stream]
-        r multi
-        r set foo bar
+    # the "MULTI / EXEC is propagated correctly" tests are not ported, they read the replication stream with
+    # attach_to_replication_stream, which kedis does not support. "A transaction is replicated as a whole" covers it
+}
+
+start_server {tags {"multi"}} {
+    test {Commands of a transaction read the writes before them} {
+        r del tk th tl tz ts
+        r multi
+        r set tk 1
+        r incr tk
+        r get tk
+        r hset th f1 v1
+        r hincrby th f2 5
+        r hgetall th
+        r rpush tl a b c
+        r lrem tl 1 b
+        r lrange tl 0 -1
+        r zadd tz 1 a 2 b
+        r zincrby tz 5 a
+        r zrange tz 0 -1 withscores
+        r sadd ts m1 m2
+        r srem ts m1
+        r smembers ts
+        r del th
+        r exists th
+        r get tk
         r exec
-        assert_replication_stream $repl {
-            {select *}
-            {multi}
-            {set foo bar}
-            {exec}
-        }
-        close_replication_stream $repl
-    }
+    } {OK 2 2 1 5 {f1 v1 f2 5} 3 1 {a c} 2 6 {b 2 a 6} 2 1 m2 1 0 2}
+
+    test {Commands not allowed in a transaction fail EXEC} {
+        r del tk
+        r multi
+        r set tk 1
+        catch {r select 1} e1
+        catch {r exec} e2
+        list [string match {*not allowed*} $e1] [string match {EXECABORT*} $e2] [r exists tk]
+    } {1 1 0}
 
-    test {MULTI / EXEC is propagated correctly (empty transaction)} {
-        set repl [attach_to_replication_stream]
+    test {Wrong arguments of a queued command fail EXEC} {
         r multi
-        r exec
-        r set foo bar
-        assert_replication_stream $repl {
-            {select *}
-            {set foo bar}
-        }
-        close_replication_stream $repl
-    }
+        r set tk 1
+        catch {r get} e1
+        catch {r exec} e2
+        list [string match {*wrong number*} $e1] [string match {EXECABORT*} $e2] [r exists tk]
+    } {1 1 0}
+
+    test {Errors of the commands do not stop the transaction} {
+        r del tk tl
+        r set tk a
+        r multi
+        r lpush tk x
+        r rpush tl x
+        r append tk b
+        catch {r exec} e
+        list [string match {WRONGTYPE*} $e] [r lrange tl 0 -1] [r get tk]
+    } {1 x ab}
+
+    test {EXEC and DISCARD without MULTI} {
+        catch {r exec} e1
+        catch {r discard} e2
+        list $e1 $e2
+    } {{ERR EXEC without MULTI} {ERR DISCARD without MULTI}}
+
+    test {EXEC fails on a key WATCHed and modified by another client} {
+        r set wk 1
+        r watch wk
+        set rd [redis_deferring_client]
+        $rd set wk 2
+        $rd read
+        $rd close
+        r multi
+        r incr wk
+        list [r exec] [r get wk]
+    } {{} 2}
+
+    test {EXEC works on a WATCHed key read but not modified by another client} {
+        r set wk 1
+        r watch wk
+        set rd [redis_deferring_client]
+        $rd get wk
+        $rd read
+        $rd lpush wk x
+        catch {$rd read}
+        $rd setnx wk 3
+        $rd read
+        $rd close
+        r multi
+        r incr wk
+        list [r exec] [r get wk]
+    } {2 2}
 
-    test {MULTI / EXEC is propagated correctly (read-only commands)} {
-        r set foo value1
-        set repl [attach_to_replication_stream]
+    test {A WATCHed key modified by the transaction itself} {
+        r set wk 1
+        r watch wk
         r multi
-        r get foo
+        r incr wk
+        list [r exec] [r get wk]
+    } {2 2}
+
+    test {The writes of a transaction are not seen by other clients until EXEC} {
+        r del tk
+        set rd [redis_deferring_client]
+        r multi
+        r set tk 1
+        $rd get tk
+        set before [$rd read]
         r exec
-        r set foo value2
-        assert_replication_stream $repl {
-            {select *}
-            {set foo value2}
+        $rd get tk
+        set after [$rd read]
+        $rd close
+        list $before $after
+    } {{} 1}
+
+    test {Pipelined transactions with the commands of other connections} {
+        r del tcount
+        set clients {}
+        for {set c 0} {$c < 4} {incr c} {
+            set rd [redis_deferring_client]
+            for {set j 0} {$j < 50} {incr j} {
+                $rd multi
+                $rd incr tcount
+                $rd incr tcount
+                $rd exec
+            }
+            lappend clients $rd
         }
-        close_replication_stream $repl
-    }
+        set err {}
+        foreach rd $clients {
+            for {set j 0} {$j < 50} {incr j} {
+                set res [list [$rd read] [$rd read] [$rd read] [$rd read]]
+                set incrs [lindex $res 3]
+                if {[lindex $incrs 1] != [lindex $incrs 0] + 1} {
+                    set err "not atomic: $res"
+                }
+            }
+            $rd close
+        }
+        list $err [r get tcount]
+    } {{} 400}
+}
 
-    test {MULTI / EXEC is propagated correctly (write command, no effect)} {
-        r del bar foo bar
-        set repl [attach_to_replication_stream]
+start_server {tags {"multi"} overrides {storage-thread-num 4 command-time-slice 1}} {
+    test {Transactions run in the storage threads} {
+        r del tk th
+        for {set j 0} {$j < 1000} {incr j} {
+            r hset th f$j $j
+        }
         r multi
-        r del foo
+        r set tk 1
+        r hset th fnew v
+        r hlen th
+        r incr tk
         r exec
-        assert_replication_stream $repl {
-            {select *}
-            {multi}
-            {exec}
+    } {OK 1 1001 2}
+
+    test {A sliced command runs to the end in a transaction} {
+        r del tl
+        for {set j 0} {$j < 2000} {incr j} {
+            r rpush tl x y
         }
-        close_replication_stream $repl
+        r multi
+        r rpush tl x
+        r lrem tl 0 x
+        r llen tl
+        r exec
+    } {4001 2001 2000}
+}
+
+start_server {tags {"multi repl"}} {
+    start_server {} {
+        set master [srv -1 client]
+        set slave [srv 0 client]
+
+        test {A transaction is replicated as a whole} {
+            $slave slaveof [srv -1 host] [srv -1 port]
+            wait_for_condition 50 100 {
+                [string match {*master_link_status:up*} [$slave info replication]]
+            } else {
+                fail "Can't turn the instance into a slave"
+            }
+
+            $master set rk 0
+            set seq [status $master binlog_seq]
+            $master multi
+            $master set rk 1
+            $master incr rk
+            $master rpush rl a b
+            $master get rk
+            $master exec
+            wait_for_condition 50 100 {
+                [$slave get rk] eq {2}
+            } else {
+                fail "The transaction was not replicated"
+            }
+            list [expr {[status $master binlog_seq] - $seq}] [$slave lrange rl 0 -1]
+        } {1 {a b}}
     }
 }
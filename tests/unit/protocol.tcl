@@ -68,6 +68,30 @@ start_server {tags {"protocol"}} {
         assert_error "*unbalanced*" {r read}
     }
 
+    test "Pipelined big values are stored without corruption" {
+        reconnect
+        set big [string repeat "a\r\n\x00b" 100000]
+        r write "*3\r\n\$3\r\nset\r\n\$4\r\nbig1\r\n\$[string length $big]\r\n$big\r\n"
+        r write "*4\r\n\$4\r\nhset\r\n\$4\r\nbig2\r\n\$1\r\nf\r\n\$[string length $big]\r\n$big\r\n"
+        r write "*5\r\n\$3\r\nSET\r\n\$4\r\nbig3\r\n\$3\r\nfoo\r\n\$2\r\nex\r\n\$3\r\n100\r\n"
+        r flush
+        assert_equal OK [r read]
+        assert_equal 1 [r read]
+        assert_equal OK [r read]
+        assert_equal $big [r get big1]
+        assert_equal $big [r hget big2 f]
+        assert {[r ttl big3] > 90}
+        r get big3
+    } {foo}
+
+    test "Inline SET with quoted arguments" {
+        reconnect
+        r write "set inline-key \"a b\"\r\n"
+        r flush
+        assert_equal OK [r read]
+        r get inline-key
+    } {a b}
+
     set c 0
     foreach seq [list "\x00" "*\x00" "$\x00"] {
         incr c
@@ -98,6 +122,133 @@ start_server {tags {"protocol"}} {
         } {*Protocol error*}
     }
     unset c
+
+    test "Command names are case insensitive" {
+        r del casekey
+        r SeT casekey foo
+        list [r gEt casekey] [r strlen CASEKEY] [r StrLen casekey]
+    } {foo 0 3}
+
+    test "Unknown commands and wrong arity are rejected" {
+        catch {r getx foo} e1
+        catch {r ge foo} e2
+        catch {r get} e3
+        list $e1 $e2 $e3
+    } {*not support* *not support* *wrong number of arguments for 'GET'*}
+
+    test "COMMAND returns the command table" {
+        set get_info {}
+        set mset_info {}
+        foreach cmd [r command] {
+            if {[lindex $cmd 0] eq "get"} {set get_info $cmd}
+            if {[lindex $cmd 0] eq "mset"} {set mset_info $cmd}
+        }
+        list $get_info $mset_info
+    } {{get 2 {readonly fast} 1 1 1} {mset -3 write 1 -1 2}}
+
+    test "INFO commandstats counts every command" {
+        r config resetstat
+        r set statkey 1
+        r get statkey
+        r get statkey
+        set info [r info commandstats]
+        list [regexp {cmdstat_get:calls=2,} $info] [regexp {cmdstat_set:calls=1,} $info] \
+            [regexp {cmdstat_del:} $info]
+    } {1 1 0}
+
+    test "Big collection replies are streamed intact" {
+        r flushdb
+        set members {}
+        set hash_args {}
+        set zset_args {}
+        for {set j 0} {$j < 20000} {incr j} {
+            lappend members member:$j
+            lappend hash_args field:$j value:$j
+            lappend zset_args $j member:$j
+        }
+        r sadd bigset {*}$members
+        r hmset bighash {*}$hash_args
+        r rpush biglist {*}$members
+        r zadd bigzset {*}$zset_args
+
+        assert_equal [lsort $members] [lsort [r smembers bigset]]
+        assert_equal [lsort $hash_args] [lsort [r hgetall bighash]]
+        assert_equal $members [r lrange biglist 0 -1]
+        assert_equal [lrange $members 100 15099] [r lrange biglist 100 15099]
+        assert_equal $members [r zrange bigzset 0 -1]
+        assert_equal [lreverse $members] [r zrevrange bigzset 0 -1]
+        assert_equal {member:19999 19999 member:19998 19998} [r zrevrange bigzset 0 1 withscores]
+        assert_equal {member:19001 member:19000} [r zrevrange bigzset 998 999]
+        assert_equal 40000 [llength [r zrange bigzset 0 -1 withscores]]
+        lsort [r keys big*]
+    } {bighash biglist bigset bigzset}
+
+    test "Responses of a long pipeline are flushed in batches" {
+        set rd [redis_deferring_client]
+        for {set j 0} {$j < 2000} {incr j} {
+            $rd lrange biglist 0 9
+        }
+        for {set j 0} {$j < 2000} {incr j} {
+            assert_equal [lrange $members 0 9] [$rd read]
+        }
+        $rd ping
+        set res [$rd read]
+        $rd close
+        set res
+    } {PONG}
+}
+
+start_server {tags {"protocol"}} {
+    proc send_in_pieces {fd proto size} {
+        set len [string length $proto]
+        for {set pos 0} {$pos < $len} {incr pos $size} {
+            puts -nonewline $fd [string range $proto $pos [expr {$pos + $size - 1}]]
+            flush $fd
+            after 1
+        }
+    }
+
+    test "Big bulk arguments received across many reads" {
+        set rd [redis_deferring_client]
+        set fd [$rd channel]
+        set value [string repeat "0123456789" 300000]
+        set proto "*3\r\n\$3\r\nSET\r\n\$6\r\nbigkey\r\n\$[string length $value]\r\n$value\r\n"
+        # two big values in one request, and a small request in the same pipeline
+        append proto "*6\r\n\$5\r\nHMSET\r\n\$7\r\nbighash\r\n\$2\r\nf1\r\n"
+        append proto "\$[string length $value]\r\n$value\r\n\$2\r\nf2\r\n\$[string length $value]\r\n$value\r\n"
+        append proto "*2\r\n\$4\r\nECHO\r\n\$4\r\ndone\r\n"
+        send_in_pieces $fd $proto 100000
+        set res [list [$rd read] [$rd read] [$rd read]]
+        $rd close
+        lappend res [expr {[r get bigkey] eq $value}] [expr {[r hget bighash f2] eq $value}] [r strlen bigkey]
+    } {OK OK done 1 1 3000000}
+
+    test "Big RESTORE is decoded while it is received" {
+        r del bighash
+        for {set j 0} {$j < 20000} {incr j} {
+            lappend fields field:$j [string repeat v 40]:$j
+        }
+        r hmset bighash {*}$fields
+        set encoded [r dump bighash]
+        r del bighash
+
+        set rd [redis_deferring_client]
+        set fd [$rd channel]
+        set proto "*4\r\n\$7\r\nRESTORE\r\n\$7\r\nbighash\r\n\$1\r\n0\r\n"
+        append proto "\$[string length $encoded]\r\n$encoded\r\n"
+        send_in_pieces $fd $proto 7777
+        set res [$rd read]
+        $rd close
+        assert {[string length $encoded] > 512 * 1024}
+        list $res [r hlen bighash] [r hget bighash field:19999] [expr {[r dump bighash] eq $encoded}]
+    } [list OK 20000 [string repeat v 40]:19999 1]
+
+    test "Big RESTORE with a truncated serialized value fails" {
+        set encoded [r dump bighash]
+        set truncated [string range $encoded 0 end-1000]
+        catch {r restore badhash 0 $truncated} e
+        list $e [r exists badhash] [r ping]
+    } {{ERR deserialize error} 0 PONG}
 }
 
 start_server {tags {"regression"}} {
@@ -0,0 +1,163 @@
+proc rc_pipeline {rd cmds} {
+    set fd [$rd channel]
+    set proto ""
+    foreach cmd $cmds {
+        append proto "*[llength $cmd]\r\n"
+        foreach arg $cmd {
+            append proto "\$[string length $arg]\r\n$arg\r\n"
+        }
+    }
+    puts -nonewline $fd $proto
+    flush $fd
+    set res {}
+    foreach cmd $cmds {
+        if {[catch {$rd read} reply]} {
+            set reply "ERR: $reply"
+        }
+        lappend res $reply
+    }
+    set res
+}
+
+start_server {tags {"read-coalesce"} overrides {read-coalesce yes}} {
+    test {CONFIG GET/SET read-coalesce} {
+        set res [list [lindex [r config get read-coalesce] 1] [lindex [r config get read-coalesce-window] 1]]
+        r config set read-coalesce no
+        r config set read-coalesce-window 500
+        lappend res [lindex [r config get read-coalesce] 1] [lindex [r config get read-coalesce-window] 1]
+        r config set read-coalesce yes
+        r config set read-coalesce-window 0
+        lappend res [lindex [r config get read-coalesce] 1] [lindex [r config get read-coalesce-window] 1]
+        lappend res [catch {r config set read-coalesce-window -1}]
+    } {yes 0 no 500 yes 0 1}
+
+    test {Coalesced reads reply the same as the commands running by themselves} {
+        r set rcstr hello
+        r set rcempty ""
+        r hset rchash f1 v1
+        r sadd rcset m1
+        r zadd rczset 1.5 m1
+        r set rcexpired x
+        r pexpire rcexpired 1
+        after 10
+        set cmds {
+            {GET rcstr} {GET rcempty} {GET nokey} {GET rchash} {GET rcexpired}
+            {HGET rchash f1} {HGET rchash f2} {HGET nokey f1} {HGET rcstr f1}
+            {SISMEMBER rcset m1} {SISMEMBER rcset m2} {SISMEMBER nokey m1} {SISMEMBER rczset m1}
+            {ZSCORE rczset m1} {ZSCORE rczset m2} {ZSCORE nokey m1} {ZSCORE rcset m1}
+            {GET rcstr extra}
+        }
+        set rd [redis_deferring_client]
+        set reads [s coalesced_reads]
+        set coalesced [rc_pipeline $rd $cmds]
+        set reads [expr {[s coalesced_reads] - $reads}]
+        r config set read-coalesce no
+        set single [rc_pipeline $rd $cmds]
+        r config set read-coalesce yes
+        $rd close
+        list [expr {$coalesced eq $single}] $reads [lindex $coalesced 0] [lindex $coalesced 13]
+    } {1 17 hello 1.5}
+
+    test {Replies of a pipeline mixing reads and other commands keep the order} {
+        set rd [redis_deferring_client]
+        set res [rc_pipeline $rd {
+            {SET rck 1} {GET rck} {GET rck} {INCR rck} {GET rck} {SELECT 10} {GET rck} {SET rck 10}
+            {GET rck} {SELECT 9} {HGET rchash f1} {GET rck} {PING} {GET rck}
+        }]
+        $rd close
+        set res
+    } {OK 1 1 2 2 OK {} OK 10 OK v1 2 PONG 2}
+
+    test {Reads of concurrent clients are answered in batches} {
+        for {set j 0} {$j < 100} {incr j} {
+            r set rckey:$j $j
+        }
+        set reads [s coalesced_reads]
+        set batches [s coalesced_read_batches]
+        set clients {}
+        for {set c 0} {$c < 8} {incr c} {
+            set rd [redis_deferring_client]
+            for {set j 0} {$j < 100} {incr j} {
+                $rd get rckey:$j
+            }
+            lappend clients $rd
+        }
+        set err {}
+        foreach rd $clients {
+            for {set j 0} {$j < 100} {incr j} {
+                set reply [$rd read]
+                if {$reply ne $j} {
+                    set err "unexpected reply $j: $reply"
+                }
+            }
+            $rd close
+        }
+        set reads [expr {[s coalesced_reads] - $reads}]
+        set batches [expr {[s coalesced_read_batches] - $batches}]
+        list $err $reads [expr {$batches < $reads}]
+    } {{} 800 1}
+
+    test {Reads wait for the batching window} {
+        r config set read-coalesce-window 2000
+        set clients {}
+        for {set c 0} {$c < 4} {incr c} {
+            set rd [redis_deferring_client]
+            for {set j 0} {$j < 50} {incr j} {
+                $rd get rckey:$j
+                $rd sismember rcset m1
+            }
+            lappend clients $rd
+        }
+        set err {}
+        foreach rd $clients {
+            for {set j 0} {$j < 50} {incr j} {
+                set reply [list [$rd read] [$rd read]]
+                if {$reply ne [list $j 1]} {
+                    set err "unexpected reply $j: $reply"
+                }
+            }
+            $rd close
+        }
+        r config set read-coalesce-window 0
+        set err
+    } {}
+
+    test {A client closed with reads in the batch} {
+        r config set read-coalesce-window 100000
+        set clients [s connected_clients]
+        set rd [redis_deferring_client]
+        for {set j 0} {$j < 10} {incr j} {
+            $rd get rckey:$j
+        }
+        $rd flush
+        $rd close
+        # the batch holds the connection until its reads are answered and counted,
+        # so they are not counted by the next test
+        wait_for_condition 50 100 {
+            [s connected_clients] == $clients
+        } else {
+            fail "The closed client was not released"
+        }
+        r config set read-coalesce-window 0
+        list [r ping] [r get rckey:1]
+    } {PONG 1}
+
+    test {Commands statistics of coalesced reads} {
+        r config resetstat
+        r get rcstr
+        r hget rchash f1
+        set info [r info commandstats]
+        list [s coalesced_reads] [regexp {cmdstat_get:calls=1,} $info] [regexp {cmdstat_hget:calls=1,} $info]
+    } {2 1 1}
+}
+
+start_server {tags {"read-coalesce"} overrides {read-coalesce yes storage-thread-num 4}} {
+    test {Coalesced reads with the storage threads} {
+        set rd [redis_deferring_client]
+        set res [rc_pipeline $rd {
+            {SET rck 1} {GET rck} {INCR rck} {GET rck} {HSET rch f v} {HGET rch f} {GET rck}
+        }]
+        $rd close
+        set res
+    } {OK 1 2 2 1 v 2}
+}
@@ -0,0 +1,127 @@
+start_server {tags {"snapshot-reads"}} {
+    test {Reads of an expired key report it missing and the expire thread deletes it} {
+        r hmset exphash a 1 b 2
+        r rpush explist a b c
+        r pexpire exphash 100
+        r pexpire explist 100
+        after 150
+        set res [list [r hget exphash a] [r hlen exphash] [r hgetall exphash] [r llen explist] [r lrange explist 0 -1] \
+            [r exists exphash] [r type explist]]
+        wait_for_condition 50 100 {
+            [r dbsize] == 0
+        } else {
+            fail "expired keys are not deleted"
+        }
+        lappend res [expr {[s expired_keys] >= 2}]
+    } {{} 0 {} 0 {} 0 none 1}
+
+    test {Multi field reads see each write as a whole} {
+        r del snaphash snaplist
+        set writer [redis_deferring_client]
+        for {set j 0} {$j < 1000} {incr j} {
+            $writer hmset snaphash a $j b $j c $j
+            $writer rpush snaplist $j
+        }
+        set err {}
+        for {set j 0} {$j < 200 && $err eq {}} {incr j} {
+            set fields [r hmget snaphash a b c]
+            if {[llength [lsort -unique $fields]] != 1} {
+                set err "hmget is not consistent: $fields"
+            }
+            set all [r hgetall snaphash]
+            if {[llength $all] != 0 && [llength $all] != 6} {
+                set err "hgetall is not consistent: $all"
+            }
+            set len [r llen snaplist]
+            set elements [r lrange snaplist 0 -1]
+            if {[llength $elements] < $len || ([llength $elements] > 0 && [lindex $elements end] != [llength $elements] - 1)} {
+                set err "lrange is not consistent: $len $elements"
+            }
+        }
+        for {set j 0} {$j < 2000} {incr j} {
+            $writer read
+        }
+        $writer close
+        list $err [r hmget snaphash a b c] [r llen snaplist]
+    } {{} {999 999 999} 1000}
+
+    test {An overwritten key never looks missing to the readers} {
+        r mset owkey1 0 owkey2 0
+        set writer [redis_deferring_client]
+        for {set j 0} {$j < 1000} {incr j} {
+            $writer set owkey1 $j
+            $writer mset owkey1 $j owkey2 $j
+        }
+        set err {}
+        for {set j 0} {$j < 300 && $err eq {}} {incr j} {
+            set values [r mget owkey1 owkey2]
+            if {[lindex $values 0] eq {} || [lindex $values 1] eq {}} {
+                set err "key is missing: $values"
+            }
+        }
+        for {set j 0} {$j < 2000} {incr j} {
+            $writer read
+        }
+        $writer close
+        list $err [r mget owkey1 owkey2]
+    } {{} {999 999}}
+
+    test {LRANGE and MGET see every LREM and DEL as a whole} {
+        r del lremlist delkey1 delkey2
+        set writer [redis_deferring_client]
+        for {set j 0} {$j < 500} {incr j} {
+            $writer rpush lremlist a b a
+            $writer lrem lremlist 2 a
+            $writer lrem lremlist 0 b
+            $writer mset delkey1 $j delkey2 $j
+            $writer del delkey1 delkey2
+        }
+        set err {}
+        for {set j 0} {$j < 300 && $err eq {}} {incr j} {
+            set elements [r lrange lremlist 0 -1]
+            if {[llength $elements] > 3} {
+                set err "lrange is not consistent: $elements"
+            }
+            set values [r mget delkey1 delkey2]
+            if {[lindex $values 0] ne [lindex $values 1]} {
+                set err "del is not consistent: $values"
+            }
+        }
+        for {set j 0} {$j < 2500} {incr j} {
+            $writer read
+        }
+        $writer close
+        list $err [r exists lremlist] [r mget delkey1 delkey2]
+    } {{} 0 {{} {}}}
+
+    test {Reads do not take the key lock} {
+        r set rkey 1
+        set acquires [s key_lock_acquires]
+        for {set j 0} {$j < 10} {incr j} {
+            r get rkey
+            r mget rkey nokey
+            r strlen rkey
+        }
+        expr {[s key_lock_acquires] - $acquires}
+    } {0}
+
+    test {FLUSHDB with concurrent reads} {
+        for {set j 0} {$j < 100} {incr j} {
+            r rpush flushlist $j
+        }
+        set rd [redis_deferring_client]
+        for {set j 0} {$j < 200} {incr j} {
+            $rd lrange flushlist 0 -1
+        }
+        r flushdb
+        set err {}
+        for {set j 0} {$j < 200} {incr j} {
+            set res [$rd read]
+            if {[llength $res] != 0 && [llength $res] != 100} {
+                set err "unexpected reply $res"
+            }
+        }
+        $rd close
+        list $err [r llen flushlist]
+    } {{} 0}
+}
@@ -0,0 +1,97 @@
+start_server {tags {"storage-threads"} overrides {storage-thread-num 4}} {
+    test {CONFIG GET storage-thread-num} {
+        list [lindex [r config get storage-thread-num] 1] [s storage_thread_num]
+    } {4 4}
+
+    test {Commands run in the storage threads} {
+        set processed [s storage_tasks_processed]
+        r set stkey 1
+        r incr stkey
+        list [r get stkey] [expr {[s storage_tasks_processed] > $processed}]
+    } {2 1}
+
+    test {Pipelined storage and io commands reply in order} {
+        set rd [redis_deferring_client]
+        set fd [$rd channel]
+        set proto ""
+        foreach cmd {{SET pk 0} {SELECT 9} {SET pk 9} {PING} {GET pk} {SELECT 0} {INCR pk} {ECHO done} {GET pk}} {
+            append proto "*[llength $cmd]\r\n"
+            foreach arg $cmd {
+                append proto "\$[string length $arg]\r\n$arg\r\n"
+            }
+        }
+        puts -nonewline $fd $proto
+        flush $fd
+        set res {}
+        for {set j 0} {$j < 9} {incr j} {
+            lappend res [$rd read]
+        }
+        $rd close
+        set res
+    } {OK OK OK PONG 9 OK 1 done 1}
+
+    test {Long pipeline with big replies} {
+        set rd [redis_deferring_client]
+        set value [string repeat x 1000]
+        for {set j 0} {$j < 1000} {incr j} {
+            $rd set plkey:$j $value:$j
+            $rd get plkey:$j
+        }
+        $rd ping
+        set err {}
+        for {set j 0} {$j < 1000} {incr j} {
+            set res [list [$rd read] [$rd read]]
+            if {$res ne [list OK $value:$j]} {
+                set err "unexpected reply $j: $res"
+                break
+            }
+        }
+        lappend err [$rd read]
+        $rd close
+        set err
+    } {PONG}
+
+    test {Big bulk arguments received across reads run in the storage threads} {
+        set rd [redis_deferring_client]
+        set fd [$rd channel]
+        set value [string repeat "0123456789" 100000]
+        set proto "*3\r\n\$3\r\nSET\r\n\$6\r\nbigkey\r\n\$[string length $value]\r\n$value\r\n"
+        append proto "*2\r\n\$6\r\nSTRLEN\r\n\$6\r\nbigkey\r\n"
+        for {set pos 0} {$pos < [string length $proto]} {incr pos 50000} {
+            puts -nonewline $fd [string range $proto $pos [expr {$pos + 49999}]]
+            flush $fd
+            after 1
+        }
+        set res [list [$rd read] [$rd read]]
+        $rd close
+        lappend res [expr {[r get bigkey] eq $value}]
+    } {OK 1000000 1}
+
+    test {QUIT after storage commands in a pipeline} {
+        set rd [redis_deferring_client]
+        set fd [$rd channel]
+        puts -nonewline $fd "*3\r\n\$3\r\nSET\r\n\$2\r\nqk\r\n\$1\r\n1\r\n*1\r\n\$4\r\nQUIT\r\n"
+        flush $fd
+        set res [list [$rd read] [$rd read]]
+        $rd close
+        lappend res [r get qk]
+    } {OK OK 1}
+
+    test {Concurrent clients on the storage threads} {
+        set clients {}
+        for {set c 0} {$c < 8} {incr c} {
+            set rd [redis_deferring_client]
+            for {set j 0} {$j < 200} {incr j} {
+                $rd incr cckey
+            }
+            lappend clients $rd
+        }
+        foreach rd $clients {
+            for {set j 0} {$j < 200} {incr j} {
+                $rd read
+            }
+            $rd close
+        }
+        r get cckey
+    } {1600}
+}
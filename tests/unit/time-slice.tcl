@@ -0,0 +1,164 @@
+start_server {tags {"time-slice"} overrides {command-time-slice 1}} {
+    test {CONFIG GET/SET command-time-slice} {
+        set res [lindex [r config get command-time-slice] 1]
+        catch {r config set command-time-slice -1} err
+        lappend res [string match "*ERR*" $err] [lindex [r config get command-time-slice] 1]
+    } {1 1 1}
+
+    proc populate_keys {prefix count} {
+        set args {}
+        for {set j 0} {$j < $count} {incr j} {
+            lappend args $prefix:$j $j
+        }
+        r mset {*}$args
+    }
+
+    test {KEYS in slices returns all the keys} {
+        r flushdb
+        populate_keys slkey 5000
+        r set other 1
+        set res [lsort -dictionary [r keys slkey:*]]
+        list [llength $res] [lindex $res 0] [lindex $res end]
+    } {5000 slkey:0 slkey:4999}
+
+    test {HGETALL in slices returns all the fields} {
+        set args {}
+        for {set j 0} {$j < 5000} {incr j} {
+            lappend args f$j v$j
+        }
+        r hmset slhash {*}$args
+        set res [r hgetall slhash]
+        list [llength $res] [expr {[dict get $res f4999] eq "v4999"}]
+    } {10000 1}
+
+    test {LREM in slices} {
+        set args {}
+        for {set j 0} {$j < 5000} {incr j} {
+            lappend args [expr {$j % 3 == 0 ? "a" : "b"}]
+        }
+        r rpush sllist {*}$args
+        list [r lrem sllist 10 a] [r lrem sllist -10 a] [r lrem sllist 0 a] [r llen sllist] [r lindex sllist 0]
+    } {10 10 1647 3333 b}
+
+    test {ZREMRANGEBYSCORE/ZREMRANGEBYRANK/ZREMRANGEBYLEX in slices} {
+        set args {}
+        for {set j 0} {$j < 5000} {incr j} {
+            lappend args $j m$j
+        }
+        r zadd slzset {*}$args
+        set res [r zremrangebyscore slzset (100 1000]
+        lappend res [r zremrangebyrank slzset 0 9] [r zrange slzset 0 0] [r zcard slzset]
+        set args {}
+        for {set j 0} {$j < 3000} {incr j} {
+            lappend args 0 [format "e%05d" $j]
+        }
+        r zadd sllex {*}$args
+        lappend res [r zremrangebylex sllex (e00000 \[e01999] [r zcard sllex] [r zrange sllex 0 0]
+    } {900 10 m10 4090 1999 1001 e00000}
+
+    test {Pipelined slow and fast commands reply in order} {
+        set rd [redis_deferring_client]
+        $rd keys slkey:1*
+        $rd ping
+        $rd hlen slhash
+        $rd keys other
+        $rd get other
+        set res [llength [$rd read]]
+        for {set j 0} {$j < 4} {incr j} {
+            lappend res [$rd read]
+        }
+        $rd close
+        set res
+    } {1111 PONG 5000 other 1}
+
+    test {Other clients are served between the slices} {
+        set rd [redis_deferring_client]
+        for {set j 0} {$j < 20} {incr j} {
+            $rd keys slkey:*
+        }
+        set pongs 0
+        for {set j 0} {$j < 20} {incr j} {
+            if {[r ping] eq "PONG"} {incr pongs}
+        }
+        set err {}
+        for {set j 0} {$j < 20} {incr j} {
+            if {[llength [$rd read]] != 5000} {set err "bad reply $j"}
+        }
+        $rd close
+        list $pongs $err
+    } {20 {}}
+
+    test {LREM stays atomic while the list is changed between the slices} {
+        r del cclist
+        set args {}
+        for {set j 0} {$j < 5000} {incr j} {
+            lappend args a b
+        }
+        r rpush cclist {*}$args
+        set rd [redis_deferring_client]
+        $rd lrem cclist 0 a
+        for {set j 0} {$j < 100} {incr j} {
+            r rpush cclist a
+        }
+        set removed [$rd read]
+        $rd close
+        set left [llength [lsearch -all [r lrange cclist 0 -1] a]]
+        list [expr {$removed + $left}] [expr {[r llen cclist] + $removed}]
+    } {5100 10100}
+
+    test {KEYS after FLUSHDB in the middle} {
+        populate_keys fkey 5000
+        set rd [redis_deferring_client]
+        $rd keys fkey:*
+        r flushdb
+        set n [llength [$rd read]]
+        $rd close
+        list [expr {$n >= 0 && $n <= 5000}] [r dbsize]
+    } {1 0}
+}
+
+start_server {tags {"time-slice"} overrides {client-command-quota 10}} {
+    test {CONFIG GET/SET client-command-quota} {
+        set res [lindex [r config get client-command-quota] 1]
+        catch {r config set client-command-quota -1} err
+        lappend res [string match "*ERR*" $err] [lindex [r config get client-command-quota] 1]
+    } {10 1 10}
+
+    test {A pipeline longer than the quota replies in order} {
+        set deferred [s deferred_pipelines]
+        set rd [redis_deferring_client]
+        set fd [$rd channel]
+        set proto ""
+        for {set j 0} {$j < 1000} {incr j} {
+            append proto "*2\r\n\$4\r\nINCR\r\n\$4\r\nqkey\r\n"
+        }
+        puts -nonewline $fd $proto
+        flush $fd
+        set err {}
+        for {set j 1} {$j <= 1000} {incr j} {
+            set res [$rd read]
+            if {$res != $j} {
+                set err "unexpected reply $j: $res"
+                break
+            }
+        }
+        $rd close
+        list $err [expr {[s deferred_pipelines] > $deferred}]
+    } {{} 1}
+
+    test {Other clients are served while a long pipeline runs} {
+        set rd [redis_deferring_client]
+        for {set j 0} {$j < 20000} {incr j} {
+            $rd set pkey:$j $j
+        }
+        set pongs 0
+        for {set j 0} {$j < 10} {incr j} {
+            if {[r ping] eq "PONG"} {incr pongs}
+        }
+        for {set j 0} {$j < 20000} {incr j} {
+            $rd read
+        }
+        $rd close
+        list $pongs [r get pkey:19999]
+    } {10 19999}
+}
@@ -84,9 +84,6 @@ start_server {
         assert_encoding quicklist $key
     }
 
-	# comment tests for not supported commands
-	if {0} {
-
     foreach {type large} [array get largevalue] {
         test "BLPOP, BRPOP: single existing list - $type" {
             set rd [redis_deferring_client]
@@ -155,6 +152,7 @@ start_server {
         r del list
 
         $rd blpop list 0
+        wait_for_blocked_client
         r multi
         r lpush list a
         r del list
@@ -169,6 +167,7 @@ start_server {
         r del list
 
         $rd blpop list 0
+        wait_for_blocked_client
         r multi
         r lpush list a
         r del list
@@ -239,6 +238,7 @@ start_server {
         set rd2 [redis_deferring_client]
         r del blist target
         $rd2 blpop target 0
+        wait_for_blocked_client
         $rd brpoplpush blist target 0
         after 1000
         r rpush blist foo
@@ -289,7 +289,9 @@ start_server {
         r del blist target1 target2
         r set target1 nolist
         $rd1 brpoplpush blist target1 0
+        wait_for_blocked_clients_count 1
         $rd2 brpoplpush blist target2 0
+        wait_for_blocked_clients_count 2
         r lpush blist foo
 
         assert_error "WRONGTYPE*" {$rd1 read}
@@ -305,6 +307,7 @@ start_server {
 
       $rd1 brpoplpush list1 list2 0
       $rd2 brpoplpush list2 list3 0
+      wait_for_blocked_clients_count 2
 
       r rpush list1 foo
 
@@ -321,6 +324,7 @@ start_server {
 
       $rd1 brpoplpush list1 list2 0
       $rd2 brpoplpush list2 list1 0
+      wait_for_blocked_clients_count 2
 
       r rpush list1 foo
 
@@ -334,6 +338,7 @@ start_server {
       r del blist
 
       $rd brpoplpush blist blist 0
+      wait_for_blocked_client
 
       r rpush blist foo
 
@@ -377,6 +382,7 @@ start_server {
         r del srclist dstlist somekey
         r set somekey somevalue
         $blocked_client brpoplpush srclist dstlist 0
+        wait_for_blocked_client
         $watching_client watch dstlist
         $watching_client read
         $watching_client multi
@@ -397,6 +403,9 @@ start_server {
       $rd read
     } {}
 
+	# comment tests for not supported commands
+	if {0} {
+
     test "BLPOP when new key is moved into place" {
         set rd [redis_deferring_client]
 
@@ -420,6 +429,8 @@ start_server {
         $rd read
     } {foo aguacate}
 
+	}; # end of comments
+
     foreach {pop} {BLPOP BRPOP} {
         test "$pop: with single empty list argument" {
             set rd [redis_deferring_client]
@@ -495,8 +506,6 @@ start_server {
         r blpop xlist 0
         r exec
     } {{xlist bar} {xlist foo} {}}
-
-	}; # end of comments
 	
     test {LPUSHX, RPUSHX - generic} {
         r del xlist
@@ -604,9 +613,6 @@ start_server {
         assert_error WRONGTYPE* {r rpush mylist 0}
     }
 
-	# comment tests for not supported commands
-	if {0} {
-
     foreach {type large} [array get largevalue] {
         test "RPOPLPUSH base case - $type" {
             r del mylist1 mylist2
@@ -671,8 +677,6 @@ start_server {
         assert_equal {} [r rpoplpush srclist dstlist]
     } {}
 
-	}; # end of comments
-
     foreach {type large} [array get largevalue] {
         test "Basic LPOP/RPOP - $type" {
             create_list mylist "$large 1 2"
@@ -32,6 +32,28 @@ start_server {
         assert_equal {16 17} [lsort [r smembers myset]]
     }
 
+    test {SMISMEMBER against existing and non existing members} {
+        create_set myset {a b c}
+        assert_equal {1 0 1 1 0} [r smismember myset a x b c y]
+        assert_equal {0 0} [r smismember nosuchset a b]
+        r lpush mylist foo
+        assert_error WRONGTYPE* {r smismember mylist foo}
+    }
+
+    test {SADD and SREM with many members} {
+        r del myset
+        set members {}
+        for {set i 0} {$i < 500} {incr i} {
+            lappend members m$i
+        }
+        assert_equal 250 [r sadd myset {*}[lrange $members 0 249]]
+        assert_equal 250 [r sadd myset {*}$members]
+        assert_equal 500 [r scard myset]
+        assert_equal 250 [r srem myset {*}[lrange $members 250 end] nosuchmember]
+        assert_equal {1 0} [r smismember myset m249 m250]
+        r scard myset
+    } {250}
+
     test {SADD against non set} {
         r lpush mylist foo
         assert_error WRONGTYPE* {r sadd mylist bar}
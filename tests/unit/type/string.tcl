@@ -15,6 +15,13 @@ start_server {tags {"string"}} {
         r get foo
     } [string repeat "abcd" 1000000]
 
+    test {Idle client does not pin the input buffer after a big payload} {
+        r set foo [string repeat "abcd" 1000000]
+        # only the buffer of the INFO request itself is in use
+        assert {[s buffer_pool_in_use_bytes] <= 65536}
+        assert {[s buffer_pool_pooled_bytes] <= 8388608}
+    }
+
     tags {"slow"} {
         test {Very big payload random access} {
             set err {}
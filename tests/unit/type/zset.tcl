@@ -732,6 +732,30 @@ start_server {tags {"zset"}} {
             }
         }
 
+        test "ZMSCORE - $encoding" {
+            r del zscoretest
+            set aux {}
+            for {set i 0} {$i < $elements} {incr i} {
+                set score [expr int(rand() * 100)]
+                lappend aux $score
+                r zadd zscoretest $score $i
+            }
+
+            set members {}
+            for {set i 0} {$i < $elements} {incr i} {
+                lappend members $i
+            }
+            assert_equal $aux [r zmscore zscoretest {*}$members]
+            assert_equal [list [lindex $aux 0] {} [lindex $aux 1]] [r zmscore zscoretest 0 nosuchmember 1]
+        }
+
+        test "ZMSCORE against non existing key and wrong type - $encoding" {
+            r del zscoretest
+            r set zstr foo
+            assert_equal {{} {}} [r zmscore zscoretest a b]
+            assert_error WRONGTYPE* {r zmscore zstr a}
+        }
+
         test "ZSCORE after a DEBUG RELOAD - $encoding" {
             r del zscoretest
             set aux {}
@@ -0,0 +1,39 @@
+#!/bin/bash
+# run the accept benchmark against kedis-server with different io-thread-num,
+# once accepting in the main thread and once with SO_REUSEPORT listeners in every io thread
+#
+# usage: ./accept_scaling.sh [path/to/kedis-server] [client threads] [seconds]
+
+server=${1:-../../src/server/kedis-server}
+clients=${2:-8}
+duration=${3:-10}
+port=16379
+work_dir=/tmp/kedis_accept_bench
+
+for reuseport in no yes; do
+	for io_threads in 1 2 4 8 16; do
+		rm -rf $work_dir
+		mkdir -p $work_dir
+		cat > $work_dir/kedis.conf <<CONF
+port $port
+logpath $work_dir/log
+pidfile $work_dir/kedis.pid
+db-name $work_dir/kdb
+key-count-file $work_dir/key_count
+binlog-dir $work_dir/binlog
+io-thread-num $io_threads
+io-thread-reuseport $reuseport
+maxclients 100000
+CONF
+		$server -c $work_dir/kedis.conf > /dev/null 2>&1 &
+		pid=$!
+		sleep 1
+
+		echo "io-thread-reuseport $reuseport, io-thread-num $io_threads"
+		./kedis_benchmark -p $port -t accept -c $clients -d $duration | grep -E "throughput|latency"
+
+		kill $pid
+		wait $pid
+	done
+done
+rm -rf $work_dir
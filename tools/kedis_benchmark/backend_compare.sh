@@ -0,0 +1,41 @@
+#!/bin/bash
+# run small GET/SET pipelines against kedis-server with io-backend epoll and io_uring side by side
+#
+# usage: ./backend_compare.sh [path/to/kedis-server] [client threads] [seconds] [io threads]
+
+server=${1:-../../src/server/kedis-server}
+clients=${2:-8}
+duration=${3:-10}
+io_threads=${4:-4}
+port=16379
+work_dir=/tmp/kedis_backend_bench
+
+for backend in epoll io_uring; do
+	rm -rf $work_dir
+	mkdir -p $work_dir
+	cat > $work_dir/kedis.conf <<CONF
+port $port
+logpath $work_dir/log
+pidfile $work_dir/kedis.pid
+db-name $work_dir/kdb
+key-count-file $work_dir/key_count
+binlog-dir $work_dir/binlog
+io-thread-num $io_threads
+io-backend $backend
+maxclients 100000
+CONF
+	$server -c $work_dir/kedis.conf > /dev/null 2>&1 &
+	pid=$!
+	sleep 1
+
+	# fill the keys first, so GET always hits
+	./kedis_benchmark -p $port -t set -c $clients -d $duration -P 16 -r 10000 -s 32 > /dev/null
+	for pipeline in 1 4 16 64; do
+		echo "io-backend $backend, GET pipeline $pipeline"
+		./kedis_benchmark -p $port -t get -c $clients -d $duration -P $pipeline -r 10000 | grep -E "throughput|latency"
+	done
+
+	kill $pid
+	wait $pid
+done
+rm -rf $work_dir
@@ -0,0 +1,32 @@
+//
+//  bench_accept.cpp
+//  kedis
+//
+
+#include "kedis_benchmark.h"
+
+// every operation is a short connection: connect, PING, close,
+// run it against io-thread-reuseport yes/no with different io-thread-num to see how accept scales
+void bench_accept(BenchThread* thread)
+{
+    while (!thread->IsTimeout()) {
+        uint64_t start = BenchThread::get_usec();
+        redisContext* context = bench_connect();
+        if (!context) {
+            thread->AddError();
+            continue;
+        }
+
+        redisReply* reply = (redisReply*)redisCommand(context, "PING");
+        if (reply && (reply->type == REDIS_REPLY_STATUS)) {
+            thread->AddOp(BenchThread::get_usec() - start);
+        } else {
+            thread->AddError();
+        }
+
+        if (reply) {
+            freeReplyObject(reply);
+        }
+        redisFree(context);
+    }
+}
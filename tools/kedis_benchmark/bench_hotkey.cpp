@@ -0,0 +1,65 @@
+//
+//  bench_hotkey.cpp
+//  kedis
+//
+
+#include "kedis_benchmark.h"
+
+const int kHotKeyCount = 4;
+
+// all threads share a few hot hashes, a quarter of the threads (at least one) HSET random fields,
+// the others read them with HGET and HMGET, shows how much the reads and writes of the same keys wait for each other
+static bool is_writer_thread(BenchThread* thread)
+{
+    int writer_threads = max(g_config.threads / 4, 1);
+    return thread->GetIndex() < writer_threads;
+}
+
+void bench_hotkey(BenchThread* thread)
+{
+    redisContext* context = bench_connect();
+    if (!context) {
+        thread->AddError();
+        return;
+    }
+
+    bool writer = is_writer_thread(thread);
+    string value(g_config.value_size, 'x');
+    unsigned int seed = (unsigned int)thread->GetIndex();
+    while (!thread->IsTimeout()) {
+        uint64_t start = BenchThread::get_usec();
+        for (int i = 0; i < g_config.pipeline; ++i) {
+            string key = "hotkey:" + to_string(rand_r(&seed) % kHotKeyCount);
+            string field = "field:" + to_string(rand_r(&seed) % g_config.key_range);
+            if (writer) {
+                redisAppendCommand(context, "HSET %b %b %b", key.data(), key.size(), field.data(), field.size(),
+                                   value.data(), value.size());
+            } else if (rand_r(&seed) % 2) {
+                redisAppendCommand(context, "HGET %b %b", key.data(), key.size(), field.data(), field.size());
+            } else {
+                string field2 = "field:" + to_string(rand_r(&seed) % g_config.key_range);
+                string field3 = "field:" + to_string(rand_r(&seed) % g_config.key_range);
+                redisAppendCommand(context, "HMGET %b %b %b %b", key.data(), key.size(), field.data(), field.size(),
+                                   field2.data(), field2.size(), field3.data(), field3.size());
+            }
+        }
+
+        for (int i = 0; i < g_config.pipeline; ++i) {
+            redisReply* reply = NULL;
+            if (redisGetReply(context, (void**)&reply) != REDIS_OK) {
+                thread->AddError();
+                redisFree(context);
+                return;
+            }
+
+            if (reply->type == REDIS_REPLY_ERROR) {
+                thread->AddError();
+            } else {
+                thread->AddOp(BenchThread::get_usec() - start);
+            }
+            freeReplyObject(reply);
+        }
+    }
+
+    redisFree(context);
+}
@@ -0,0 +1,58 @@
+//
+//  bench_mixed.cpp
+//  kedis
+//
+
+#include "kedis_benchmark.h"
+
+// a quarter of the threads (at least one) send slow commands that go through the whole database,
+// the others send GET and only their latency is recorded, shows how much the slow commands delay
+// the fast ones that share the io threads with them
+static bool is_cold_thread(BenchThread* thread)
+{
+    int cold_threads = max(g_config.threads / 4, 1);
+    return thread->GetIndex() < cold_threads;
+}
+
+void bench_mixed(BenchThread* thread)
+{
+    redisContext* context = bench_connect();
+    if (!context) {
+        thread->AddError();
+        return;
+    }
+
+    bool cold = is_cold_thread(thread);
+    unsigned int seed = (unsigned int)thread->GetIndex();
+    while (!thread->IsTimeout()) {
+        uint64_t start = BenchThread::get_usec();
+        for (int i = 0; i < g_config.pipeline; ++i) {
+            if (cold) {
+                redisAppendCommand(context, "KEYS *nomatch*");
+            } else {
+                string key = "key:" + to_string(rand_r(&seed) % g_config.key_range);
+                redisAppendCommand(context, "GET %b", key.data(), key.size());
+            }
+        }
+
+        for (int i = 0; i < g_config.pipeline; ++i) {
+            redisReply* reply = NULL;
+            if (redisGetReply(context, (void**)&reply) != REDIS_OK) {
+                thread->AddError();
+                redisFree(context);
+                return;
+            }
+
+            if (reply->type == REDIS_REPLY_ERROR) {
+                thread->AddError();
+            } else if (cold) {
+                thread->AddOps(1);
+            } else {
+                thread->AddOp(BenchThread::get_usec() - start);
+            }
+            freeReplyObject(reply);
+        }
+    }
+
+    redisFree(context);
+}
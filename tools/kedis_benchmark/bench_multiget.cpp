@@ -0,0 +1,76 @@
+//
+//  bench_multiget.cpp
+//  kedis
+//
+
+#include "kedis_benchmark.h"
+
+static void append_bulk_string(string& request, const string& arg)
+{
+    request += "$" + to_string(arg.size()) + "\r\n";
+    request += arg;
+    request += "\r\n";
+}
+
+// every command reads g_config.batch random keys or members, the key names match the ones the set, hset
+// and zadd tests write, so run them first to fill the data. compare the throughput with different -b
+// to see how the cost of a command grows with the number of elements it reads
+static void bench_multi_read(BenchThread* thread, const char* command, const string& key, const string& prefix)
+{
+    redisContext* context = bench_connect();
+    if (!context) {
+        thread->AddError();
+        return;
+    }
+
+    unsigned int seed = (unsigned int)thread->GetIndex();
+    int argc = 1 + (key.empty() ? 0 : 1) + g_config.batch;
+    while (!thread->IsTimeout()) {
+        uint64_t start = BenchThread::get_usec();
+        for (int i = 0; i < g_config.pipeline; ++i) {
+            // the request is formatted here, redisAppendCommandArgv() of the bundled hiredis does not support size_t
+            string request = "*" + to_string(argc) + "\r\n";
+            append_bulk_string(request, command);
+            if (!key.empty()) {
+                append_bulk_string(request, key);
+            }
+            for (int j = 0; j < g_config.batch; ++j) {
+                append_bulk_string(request, prefix + to_string(rand_r(&seed) % g_config.key_range));
+            }
+            redisAppendFormattedCommand(context, request.data(), request.size());
+        }
+
+        for (int i = 0; i < g_config.pipeline; ++i) {
+            redisReply* reply = NULL;
+            if (redisGetReply(context, (void**)&reply) != REDIS_OK) {
+                thread->AddError();
+                redisFree(context);
+                return;
+            }
+
+            if (reply->type == REDIS_REPLY_ERROR) {
+                thread->AddError();
+            } else {
+                thread->AddOp(BenchThread::get_usec() - start);
+            }
+            freeReplyObject(reply);
+        }
+    }
+
+    redisFree(context);
+}
+
+void bench_mget(BenchThread* thread)
+{
+    bench_multi_read(thread, "MGET", "", "key:");
+}
+
+void bench_hmget(BenchThread* thread)
+{
+    bench_multi_read(thread, "HMGET", "hash:" + to_string(thread->GetIndex()), "member:");
+}
+
+void bench_zmscore(BenchThread* thread)
+{
+    bench_multi_read(thread, "ZMSCORE", "zset:" + to_string(thread->GetIndex()), "member:");
+}
@@ -0,0 +1,154 @@
+//
+//  bench_scan.cpp
+//  kedis
+//
+
+#include "kedis_benchmark.h"
+#include "simd_scan.h"
+
+// the scan benchmarks do not connect to the server, every thread parses a buffer of -P pipelined
+// SET requests (-s bytes value) over and over, one operation is one request
+
+typedef const char* (*scan_crlf_func_t)(const char* buf, int len);
+
+// how the multibulk request parser worked before simd_scan: strchr() relies on a NUL after the data,
+// and every length goes through a std::string and stol()
+static int legacy_scan_request(const char* redis_cmd, int redis_len, int& argc)
+{
+    const char* newline = strchr(redis_cmd, '\r');
+    if (!newline) {
+        return 0;
+    }
+
+    long argc_num;
+    string argc_str(redis_cmd + 1, newline - (redis_cmd + 1));
+    if (get_long_from_string(argc_str, argc_num) == CODE_ERROR) {
+        return -1;
+    }
+
+    int pos = (int)(newline - redis_cmd) + 2;
+    argc = (int)argc_num;
+    while (argc_num > 0) {
+        newline = strchr(redis_cmd + pos, '\r');
+        if (!newline) {
+            return 0;
+        }
+
+        long len;
+        string len_str(redis_cmd + pos + 1, newline - (redis_cmd + pos + 1));
+        if (get_long_from_string(len_str, len) == CODE_ERROR) {
+            return -1;
+        }
+
+        pos = (int)(newline - redis_cmd) + 2 + len + 2;
+        argc_num--;
+    }
+
+    return pos;
+}
+
+static int scan_request(scan_crlf_func_t scan_func, const char* redis_cmd, int redis_len, int& argc)
+{
+    const char* newline = scan_func(redis_cmd, redis_len);
+    if (!newline) {
+        return 0;
+    }
+
+    long argc_num;
+    if (scan_long(redis_cmd + 1, (int)(newline - (redis_cmd + 1)), argc_num) == CODE_ERROR) {
+        return -1;
+    }
+
+    int pos = (int)(newline - redis_cmd) + 2;
+    argc = (int)argc_num;
+    while (argc_num > 0) {
+        newline = scan_func(redis_cmd + pos, redis_len - pos);
+        if (!newline) {
+            return 0;
+        }
+
+        long len;
+        if (scan_long(redis_cmd + pos + 1, (int)(newline - (redis_cmd + pos + 1)), len) == CODE_ERROR) {
+            return -1;
+        }
+
+        pos = (int)(newline - redis_cmd) + 2 + len + 2;
+        argc_num--;
+    }
+
+    return pos;
+}
+
+// parse the whole buffer once, return the number of arguments so the work can not be optimized out
+static long scan_buffer(scan_crlf_func_t scan_func, const string& buf)
+{
+    long total_argc = 0;
+    int pos = 0;
+    int len = (int)buf.size();
+    while (pos < len) {
+        int argc = 0;
+        int ret;
+        if (scan_func) {
+            ret = scan_request(scan_func, buf.data() + pos, len - pos, argc);
+        } else {
+            ret = legacy_scan_request(buf.c_str() + pos, len - pos, argc);
+        }
+
+        if (ret <= 0) {
+            return -1;
+        }
+        pos += ret;
+        total_argc += argc;
+    }
+
+    return total_argc;
+}
+
+static void bench_scan_command(BenchThread* thread, scan_crlf_func_t scan_func)
+{
+    string buf;
+    string value(g_config.value_size, 'x');
+    for (int i = 0; i < g_config.pipeline; ++i) {
+        string key = "key:" + to_string(i % g_config.key_range);
+        buf += "*3\r\n$3\r\nSET\r\n$" + to_string(key.size()) + "\r\n" + key + "\r\n$" + to_string(value.size()) +
+            "\r\n" + value + "\r\n";
+    }
+
+    long expect_argc = 3L * g_config.pipeline;
+    if ((scan_buffer(NULL, buf) != expect_argc) || (scan_buffer(scan_crlf_scalar, buf) != expect_argc) ||
+        (scan_buffer(scan_crlf, buf) != expect_argc)) {
+        fprintf(stderr, "scan result mismatch\n");
+        thread->AddError();
+        return;
+    }
+
+    if (thread->GetIndex() == 0) {
+        printf("scan kernel: %s\n", scan_func == scan_crlf ? get_scan_kernel_name() :
+               (scan_func ? "scalar" : "legacy"));
+    }
+
+    // reading the clock costs as much as parsing a small request, so check the deadline every 1024 rounds
+    while (!thread->IsTimeout()) {
+        for (int i = 0; i < 1024; ++i) {
+            if (scan_buffer(scan_func, buf) != expect_argc) {
+                thread->AddError();
+            }
+        }
+        thread->AddOps(1024L * g_config.pipeline);
+    }
+}
+
+void bench_scan_legacy(BenchThread* thread)
+{
+    bench_scan_command(thread, NULL);
+}
+
+void bench_scan_scalar(BenchThread* thread)
+{
+    bench_scan_command(thread, scan_crlf_scalar);
+}
+
+void bench_scan(BenchThread* thread)
+{
+    bench_scan_command(thread, scan_crlf);
+}
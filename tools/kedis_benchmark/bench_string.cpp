@@ -0,0 +1,59 @@
+//
+//  bench_string.cpp
+//  kedis
+//
+
+#include "kedis_benchmark.h"
+
+// send g_config.pipeline commands in one batch and wait for all replies,
+// latency of every command in the batch is the round trip time of the batch
+static void bench_string_command(BenchThread* thread, bool is_set)
+{
+    redisContext* context = bench_connect();
+    if (!context) {
+        thread->AddError();
+        return;
+    }
+
+    string value(g_config.value_size, 'x');
+    unsigned int seed = (unsigned int)thread->GetIndex();
+    while (!thread->IsTimeout()) {
+        uint64_t start = BenchThread::get_usec();
+        for (int i = 0; i < g_config.pipeline; ++i) {
+            string key = "key:" + to_string(rand_r(&seed) % g_config.key_range);
+            if (is_set) {
+                redisAppendCommand(context, "SET %b %b", key.data(), key.size(), value.data(), value.size());
+            } else {
+                redisAppendCommand(context, "GET %b", key.data(), key.size());
+            }
+        }
+
+        for (int i = 0; i < g_config.pipeline; ++i) {
+            redisReply* reply = NULL;
+            if (redisGetReply(context, (void**)&reply) != REDIS_OK) {
+                thread->AddError();
+                redisFree(context);
+                return;
+            }
+
+            if (reply->type == REDIS_REPLY_ERROR) {
+                thread->AddError();
+            } else {
+                thread->AddOp(BenchThread::get_usec() - start);
+            }
+            freeReplyObject(reply);
+        }
+    }
+
+    redisFree(context);
+}
+
+void bench_set(BenchThread* thread)
+{
+    bench_string_command(thread, true);
+}
+
+void bench_get(BenchThread* thread)
+{
+    bench_string_command(thread, false);
+}
@@ -0,0 +1,63 @@
+//
+//  bench_write.cpp
+//  kedis
+//
+
+#include "kedis_benchmark.h"
+
+// small writes to collections, every thread writes its own hash or zset,
+// so the commands do not wait for each other on the key lock and only share the database write
+static void bench_collection_write(BenchThread* thread, bool is_hset)
+{
+    redisContext* context = bench_connect();
+    if (!context) {
+        thread->AddError();
+        return;
+    }
+
+    string value(g_config.value_size, 'x');
+    string key = (is_hset ? "hash:" : "zset:") + to_string(thread->GetIndex());
+    unsigned int seed = (unsigned int)thread->GetIndex();
+    while (!thread->IsTimeout()) {
+        uint64_t start = BenchThread::get_usec();
+        for (int i = 0; i < g_config.pipeline; ++i) {
+            string member = "member:" + to_string(rand_r(&seed) % g_config.key_range);
+            if (is_hset) {
+                redisAppendCommand(context, "HSET %b %b %b", key.data(), key.size(), member.data(), member.size(),
+                                   value.data(), value.size());
+            } else {
+                string score = to_string(rand_r(&seed) % g_config.key_range);
+                redisAppendCommand(context, "ZADD %b %b %b", key.data(), key.size(), score.data(), score.size(),
+                                   member.data(), member.size());
+            }
+        }
+
+        for (int i = 0; i < g_config.pipeline; ++i) {
+            redisReply* reply = NULL;
+            if (redisGetReply(context, (void**)&reply) != REDIS_OK) {
+                thread->AddError();
+                redisFree(context);
+                return;
+            }
+
+            if (reply->type == REDIS_REPLY_ERROR) {
+                thread->AddError();
+            } else {
+                thread->AddOp(BenchThread::get_usec() - start);
+            }
+            freeReplyObject(reply);
+        }
+    }
+
+    redisFree(context);
+}
+
+void bench_hset(BenchThread* thread)
+{
+    bench_collection_write(thread, true);
+}
+
+void bench_zadd(BenchThread* thread)
+{
+    bench_collection_write(thread, false);
+}
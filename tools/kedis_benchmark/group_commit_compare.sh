@@ -0,0 +1,38 @@
+#!/bin/bash
+# run small HSET and ZADD writes against kedis-server with group-commit off and on side by side
+#
+# usage: ./group_commit_compare.sh [path/to/kedis-server] [client threads] [seconds] [io threads]
+
+server=${1:-../../src/server/kedis-server}
+clients=${2:-64}
+duration=${3:-10}
+io_threads=${4:-16}
+port=16379
+work_dir=/tmp/kedis_group_commit_bench
+
+for group_commit in no yes; do
+	rm -rf $work_dir
+	mkdir -p $work_dir
+	cat > $work_dir/kedis.conf <<CONF
+port $port
+logpath $work_dir/log
+pidfile $work_dir/kedis.pid
+db-name $work_dir/kdb
+key-count-file $work_dir/key_count
+binlog-dir $work_dir/binlog
+io-thread-num $io_threads
+group-commit $group_commit
+maxclients 100000
+CONF
+	$server -c $work_dir/kedis.conf > /dev/null 2>&1 &
+	pid=$!
+	sleep 1
+
+	for test in hset zadd; do
+		echo "group-commit $group_commit, $test"
+		./kedis_benchmark -p $port -t $test -c $clients -d $duration -r 100000 -s 32 | grep -E "throughput|latency"
+	done
+	kill $pid
+	wait $pid
+done
+rm -rf $work_dir
@@ -0,0 +1,42 @@
+#!/bin/bash
+# run the hotkey test (HSET mixed with HGET and HMGET of a few hot hashes) against two kedis-server builds side by side,
+# e.g. one built before the read commands took snapshots instead of the key lock
+#
+# usage: ./hotkey_compare.sh path/to/old/kedis-server [path/to/new/kedis-server] [client threads] [seconds] [io threads]
+
+old_server=$1
+new_server=${2:-../../src/server/kedis-server}
+clients=${3:-32}
+duration=${4:-10}
+io_threads=${5:-16}
+port=16379
+work_dir=/tmp/kedis_hotkey_bench
+
+if [ -z "$old_server" ]; then
+	echo "usage: $0 path/to/old/kedis-server [path/to/new/kedis-server] [client threads] [seconds] [io threads]"
+	exit 1
+fi
+
+for server in $old_server $new_server; do
+	rm -rf $work_dir
+	mkdir -p $work_dir
+	cat > $work_dir/kedis.conf <<CONF
+port $port
+logpath $work_dir/log
+pidfile $work_dir/kedis.pid
+db-name $work_dir/kdb
+key-count-file $work_dir/key_count
+binlog-dir $work_dir/binlog
+io-thread-num $io_threads
+maxclients 100000
+CONF
+	$server -c $work_dir/kedis.conf > /dev/null 2>&1 &
+	pid=$!
+	sleep 1
+
+	echo "$server, hotkey"
+	./kedis_benchmark -p $port -t hotkey -c $clients -d $duration -r 1000 -s 32 | grep -E "throughput|latency"
+	kill $pid
+	wait $pid
+done
+rm -rf $work_dir
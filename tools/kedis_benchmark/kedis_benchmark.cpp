@@ -0,0 +1,202 @@
+//
+//  kedis_benchmark.cpp
+//  kedis
+//
+
+#include "kedis_benchmark.h"
+#include "kedis_version.h"
+#include <sys/time.h>
+#include <algorithm>
+
+Config g_config;
+
+struct BenchTest {
+    const char*     name;
+    bench_func_t    func;
+    const char*     desc;
+};
+
+static BenchTest g_bench_tests[] = {
+    {"accept", bench_accept, "connect, PING and close in a loop, shows how fast the server accepts connections"},
+    {"set", bench_set, "SET random keys with -P pipelined requests"},
+    {"get", bench_get, "GET random keys with -P pipelined requests"},
+    {"hset", bench_hset, "HSET random fields of a hash per thread with -P pipelined requests"},
+    {"zadd", bench_zadd, "ZADD random members to a zset per thread with -P pipelined requests"},
+    {"hotkey", bench_hotkey, "HSET a few hot hashes in a quarter of the threads, HGET and HMGET them in the others"},
+    {"mget", bench_mget, "MGET -b random keys filled by the set test with -P pipelined requests"},
+    {"hmget", bench_hmget, "HMGET -b random fields of the hash filled by the hset test with the same -c"},
+    {"zmscore", bench_zmscore, "ZMSCORE -b random members of the zset filled by the zadd test with the same -c"},
+    {"mixed", bench_mixed, "GET random keys while a quarter of the threads send slow KEYS, latency is of GET only"},
+    {"scan", bench_scan, "parse -P pipelined SET requests in memory with the SIMD protocol scanner"},
+    {"scan-scalar", bench_scan_scalar, "same as scan, with the scalar protocol scanner"},
+    {"scan-legacy", bench_scan_legacy, "same as scan, with the old strchr() and stol() parser"},
+};
+
+uint64_t BenchThread::get_usec()
+{
+    return get_monotonic_us();
+}
+
+void BenchThread::OnThreadRun(void)
+{
+    m_running = true;
+    func_(this);
+    m_running = false;
+}
+
+redisContext* bench_connect()
+{
+    struct timeval timeout = {1, 0};
+    redisContext* context = redisConnectWithTimeout(g_config.host.c_str(), g_config.port, timeout);
+    if (!context || context->err) {
+        if (context) {
+            redisFree(context);
+        }
+        return NULL;
+    }
+
+    if (!g_config.password.empty()) {
+        redisReply* reply = (redisReply*)redisCommand(context, "AUTH %s", g_config.password.c_str());
+        bool ok = reply && (reply->type == REDIS_REPLY_STATUS);
+        if (reply) {
+            freeReplyObject(reply);
+        }
+
+        if (!ok) {
+            redisFree(context);
+            return NULL;
+        }
+    }
+
+    return context;
+}
+
+static void print_usage(const char* program)
+{
+    fprintf(stderr, "%s [OPTIONS]\n"
+            "  -h <host>            server hostname (default: 127.0.0.1)\n"
+            "  -p <port>            server port (default: 6379)\n"
+            "  -a <password>        password for AUTH\n"
+            "  -t <test>            benchmark to run (default: accept)\n"
+            "  -c <threads>         number of client threads (default: 4)\n"
+            "  -d <seconds>         duration of the benchmark (default: 10)\n"
+            "  -P <num>             pipeline <num> requests (default: 1)\n"
+            "  -r <keyrange>        use random keys in [0, keyrange) (default: 100000)\n"
+            "  -s <size>            value size in bytes (default: 64)\n"
+            "  -b <num>             keys or members read by one MGET, HMGET or ZMSCORE (default: 10)\n"
+            "  --version            show version\n"
+            "  --help\n"
+            "tests:\n", program);
+
+    for (const BenchTest& bench_test : g_bench_tests) {
+        fprintf(stderr, "  %-20s %s\n", bench_test.name, bench_test.desc);
+    }
+}
+
+static void parse_cmd_line(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        bool last_arg = (i == argc - 1);
+
+        if (!strcmp(argv[i], "--help")) {
+            print_usage(argv[0]);
+            exit(0);
+        } else if (!strcmp(argv[i], "-h") && !last_arg) {
+            g_config.host = argv[++i];
+        } else if (!strcmp(argv[i], "-p") && !last_arg) {
+            g_config.port = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-a") && !last_arg) {
+            g_config.password = argv[++i];
+        } else if (!strcmp(argv[i], "-t") && !last_arg) {
+            g_config.test = argv[++i];
+        } else if (!strcmp(argv[i], "-c") && !last_arg) {
+            g_config.threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-d") && !last_arg) {
+            g_config.duration = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-P") && !last_arg) {
+            g_config.pipeline = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-r") && !last_arg) {
+            g_config.key_range = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-s") && !last_arg) {
+            g_config.value_size = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-b") && !last_arg) {
+            g_config.batch = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--version")) {
+            printf("kedis_benchmark Version: %s\n", KEDIS_VERSION);
+            printf("kedis_benchmark Build: %s %s\n", __DATE__, __TIME__);
+            exit(0);
+        } else {
+            print_usage(argv[0]);
+            exit(1);
+        }
+    }
+
+    if ((g_config.threads < 1) || (g_config.duration < 1) || (g_config.pipeline < 1) || (g_config.key_range < 1) ||
+        (g_config.batch < 1)) {
+        print_usage(argv[0]);
+        exit(1);
+    }
+}
+
+static void report(vector<BenchThread*>& threads, uint64_t elapsed_us)
+{
+    uint64_t op_count = 0;
+    uint64_t error_count = 0;
+    vector<uint32_t> latencies;
+    for (BenchThread* thread : threads) {
+        op_count += thread->GetOpCount();
+        error_count += thread->GetErrorCount();
+        latencies.insert(latencies.end(), thread->GetLatencies().begin(), thread->GetLatencies().end());
+    }
+
+    printf("====== %s ======\n", g_config.test.c_str());
+    printf("  %d threads, %.2f seconds, pipeline %d\n", g_config.threads, elapsed_us / 1000000.0, g_config.pipeline);
+    printf("  operations: %lu, errors: %lu\n", op_count, error_count);
+    printf("  throughput: %.2f ops/sec\n", op_count * 1000000.0 / elapsed_us);
+
+    if (!latencies.empty()) {
+        sort(latencies.begin(), latencies.end());
+        size_t cnt = latencies.size();
+        printf("  latency(us): p50=%u p90=%u p99=%u p999=%u max=%u\n", latencies[cnt * 50 / 100],
+               latencies[cnt * 90 / 100], latencies[cnt * 99 / 100], latencies[cnt * 999 / 1000], latencies[cnt - 1]);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    parse_cmd_line(argc, argv);
+    signal(SIGPIPE, SIG_IGN);
+
+    bench_func_t func = NULL;
+    for (const BenchTest& bench_test : g_bench_tests) {
+        if (g_config.test == bench_test.name) {
+            func = bench_test.func;
+        }
+    }
+
+    if (!func) {
+        fprintf(stderr, "no such test: %s\n", g_config.test.c_str());
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    uint64_t start_time = BenchThread::get_usec();
+    vector<BenchThread*> threads;
+    for (int i = 0; i < g_config.threads; ++i) {
+        BenchThread* thread = new BenchThread(i, func);
+        thread->SetDeadline(start_time + g_config.duration * 1000000L);
+        thread->StartThread();
+        threads.push_back(thread);
+    }
+
+    for (BenchThread* thread : threads) {
+        thread->Join();
+    }
+
+    report(threads, BenchThread::get_usec() - start_time);
+
+    for (BenchThread* thread : threads) {
+        delete thread;
+    }
+    return 0;
+}
@@ -0,0 +1,93 @@
+//
+//  kedis_benchmark.h
+//  kedis
+//
+
+#ifndef __KEDIS_BENCHMARK_H__
+#define __KEDIS_BENCHMARK_H__
+
+#include "util.h"
+#include "thread_pool.h"
+#include "hiredis.h"
+
+struct Config {
+    string  host;
+    int     port;
+    string  password;
+    string  test;       // name of the benchmark to run
+    int     threads;    // number of client threads
+    int     duration;   // seconds of each benchmark
+    int     pipeline;   // number of requests sent in one batch
+    int     key_range;  // keys are chosen randomly in [0, key_range)
+    int     value_size;
+    int     batch;      // number of keys or members read by one multi key command
+
+    Config() {
+        host = "127.0.0.1";
+        port = 6379;
+        password = "";
+        test = "accept";
+        threads = 4;
+        duration = 10;
+        pipeline = 1;
+        key_range = 100000;
+        value_size = 64;
+        batch = 10;
+    }
+};
+
+extern Config g_config;
+
+class BenchThread;
+typedef void (*bench_func_t)(BenchThread* thread);
+
+// every client thread runs the bench function until the deadline, and records latency of each operation
+class BenchThread : public Thread
+{
+public:
+    BenchThread(int index, bench_func_t func) : index_(index), func_(func), op_count_(0), error_count_(0) {}
+    virtual ~BenchThread() {}
+
+    virtual void OnThreadRun(void);
+    void Join() { pthread_join(m_thread_id, NULL); }
+
+    int GetIndex() { return index_; }
+    bool IsTimeout() { return get_usec() >= deadline_; }
+    void SetDeadline(uint64_t deadline) { deadline_ = deadline; }
+
+    void AddOp(uint64_t latency_us) { op_count_++; latencies_.push_back((uint32_t)latency_us); }
+    void AddOps(uint64_t count) { op_count_ += count; }  // for operations too fast to record the latency
+    void AddError() { error_count_++; }
+
+    uint64_t GetOpCount() { return op_count_; }
+    uint64_t GetErrorCount() { return error_count_; }
+    vector<uint32_t>& GetLatencies() { return latencies_; }
+
+    static uint64_t get_usec();
+private:
+    int             index_;
+    bench_func_t    func_;
+    uint64_t        deadline_;
+    uint64_t        op_count_;
+    uint64_t        error_count_;
+    vector<uint32_t> latencies_;
+};
+
+// connect to the server and AUTH if password is set, return NULL if failed
+redisContext* bench_connect();
+
+void bench_accept(BenchThread* thread);
+void bench_set(BenchThread* thread);
+void bench_get(BenchThread* thread);
+void bench_hset(BenchThread* thread);
+void bench_zadd(BenchThread* thread);
+void bench_mixed(BenchThread* thread);
+void bench_hotkey(BenchThread* thread);
+void bench_mget(BenchThread* thread);
+void bench_hmget(BenchThread* thread);
+void bench_zmscore(BenchThread* thread);
+void bench_scan_legacy(BenchThread* thread);
+void bench_scan_scalar(BenchThread* thread);
+void bench_scan(BenchThread* thread);
+
+#endif /* __KEDIS_BENCHMARK_H__ */
@@ -0,0 +1,44 @@
+#!/bin/bash
+# run MGET, HMGET and ZMSCORE with growing batch sizes against a kedis-server build, run it once with a build
+# from before the multi key commands used MultiGet to compare, ZMSCORE only exists in the newer build
+#
+# usage: ./multiget_compare.sh [path/to/kedis-server] [client threads] [seconds] [io threads]
+
+server=${1:-../../src/server/kedis-server}
+clients=${2:-8}
+duration=${3:-10}
+io_threads=${4:-8}
+port=16379
+work_dir=/tmp/kedis_multiget_bench
+
+rm -rf $work_dir
+mkdir -p $work_dir
+cat > $work_dir/kedis.conf <<CONF
+port $port
+logpath $work_dir/log
+pidfile $work_dir/kedis.pid
+db-name $work_dir/kdb
+key-count-file $work_dir/key_count
+binlog-dir $work_dir/binlog
+io-thread-num $io_threads
+maxclients 100000
+CONF
+$server -c $work_dir/kedis.conf > /dev/null 2>&1 &
+pid=$!
+sleep 1
+
+# fill the keys first, so most reads hit
+for test in set hset zadd; do
+	./kedis_benchmark -p $port -t $test -c $clients -d $duration -P 16 -r 10000 -s 32 > /dev/null
+done
+
+for test in mget hmget zmscore; do
+	for batch in 1 10 100 500; do
+		echo "$test, batch $batch"
+		./kedis_benchmark -p $port -t $test -c $clients -d $duration -r 10000 -b $batch | grep -E "throughput|latency"
+	done
+done
+
+kill $pid
+wait $pid
+rm -rf $work_dir
@@ -0,0 +1,40 @@
+#!/bin/bash
+# run GET of many clients against kedis-server with read-coalesce off, on, and on with a batching window
+#
+# usage: ./read_coalesce_compare.sh [path/to/kedis-server] [client threads] [seconds] [io threads] [window us]
+
+server=${1:-../../src/server/kedis-server}
+clients=${2:-64}
+duration=${3:-10}
+io_threads=${4:-4}
+window=${5:-50}
+port=16379
+work_dir=/tmp/kedis_read_coalesce_bench
+
+for mode in "no 0" "yes 0" "yes $window"; do
+	set -- $mode
+	rm -rf $work_dir
+	mkdir -p $work_dir
+	cat > $work_dir/kedis.conf <<CONF
+port $port
+logpath $work_dir/log
+pidfile $work_dir/kedis.pid
+db-name $work_dir/kdb
+key-count-file $work_dir/key_count
+binlog-dir $work_dir/binlog
+io-thread-num $io_threads
+read-coalesce $1
+read-coalesce-window $2
+maxclients 100000
+CONF
+	$server -c $work_dir/kedis.conf > /dev/null 2>&1 &
+	pid=$!
+	sleep 1
+
+	./kedis_benchmark -p $port -t set -c 16 -d 5 -r 100000 -s 64 > /dev/null
+	echo "read-coalesce $1, read-coalesce-window $2, get"
+	./kedis_benchmark -p $port -t get -c $clients -d $duration -r 100000 | grep -E "throughput|latency"
+	kill $pid
+	wait $pid
+done
+rm -rf $work_dir
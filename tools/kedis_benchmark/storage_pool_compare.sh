@@ -0,0 +1,41 @@
+#!/bin/bash
+# run GET mixed with slow KEYS commands against kedis-server with commands in the io threads
+# and in the storage threads side by side, the latency reported is of GET only
+#
+# usage: ./storage_pool_compare.sh [path/to/kedis-server] [client threads] [seconds] [io threads] [storage threads]
+
+server=${1:-../../src/server/kedis-server}
+clients=${2:-16}
+duration=${3:-10}
+io_threads=${4:-4}
+storage_threads=${5:-8}
+port=16379
+work_dir=/tmp/kedis_storage_bench
+
+for storage_thread_num in 0 $storage_threads; do
+	rm -rf $work_dir
+	mkdir -p $work_dir
+	cat > $work_dir/kedis.conf <<CONF
+port $port
+logpath $work_dir/log
+pidfile $work_dir/kedis.pid
+db-name $work_dir/kdb
+key-count-file $work_dir/key_count
+binlog-dir $work_dir/binlog
+io-thread-num $io_threads
+storage-thread-num $storage_thread_num
+maxclients 100000
+CONF
+	$server -c $work_dir/kedis.conf > /dev/null 2>&1 &
+	pid=$!
+	sleep 1
+
+	# fill the keys first, so GET always hits and KEYS has work to do
+	./kedis_benchmark -p $port -t set -c $clients -d $duration -P 16 -r 100000 -s 32 > /dev/null
+	echo "storage-thread-num $storage_thread_num, GET mixed with KEYS"
+	./kedis_benchmark -p $port -t mixed -c $clients -d $duration -r 100000 | grep -E "throughput|latency"
+
+	kill $pid
+	wait $pid
+done
+rm -rf $work_dir
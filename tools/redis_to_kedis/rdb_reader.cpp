@@ -59,7 +59,7 @@ int RdbReader::Open(const string& rdb_file_path)
 
 int RdbReader::RestoreDB(int src_db_num, RedisConn& redis_conn)
 {
-    int64_t cur_ms_time = (int64_t)get_tick_count();
+    int64_t cur_ms_time = (int64_t)get_wall_time_ms();
     int pipeline_cmd_cnt = 0;
     while (true) {
         /* Read type. */